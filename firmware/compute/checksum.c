@@ -0,0 +1,542 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Checksum kernels of the compute daemon. Each kernel has a portable version
+ * and vectorized versions (SSE2/AVX2 on x86-64, NEON on AArch64) selected at
+ * run time, so a single binary runs at memory bandwidth on the CPU it finds.
+ * */
+
+#include "checksum.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define TARGET_CRC __attribute__((target("+crc")))
+#endif
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/*-*******
+ * Sum32 *
+ *-*******/
+
+static uint32_t sum32_scalar(const uint8_t *p, size_t bytes) {
+    uint32_t sum = 0, word = 0;
+
+    for (; bytes >= sizeof(word); bytes -= sizeof(word), p += sizeof(word)) {
+        sum += read32(p);
+    }
+    // The last word is zero padded
+    if (bytes) {
+        memcpy(&word, p, bytes);
+        sum += word;
+    }
+    return sum;
+}
+
+#if defined(__x86_64__)
+static uint32_t sum32_sse2(const uint8_t *p, size_t bytes) {
+    __m128i s0 = _mm_setzero_si128(), s1 = s0, s2 = s0, s3 = s0;
+    uint32_t lanes[4];
+
+    // Four accumulators hide the latency of the adds
+    for (; bytes >= 64; bytes -= 64, p += 64) {
+        s0 = _mm_add_epi32(s0, _mm_loadu_si128((const __m128i *)p));
+        s1 = _mm_add_epi32(s1, _mm_loadu_si128((const __m128i *)(p + 16)));
+        s2 = _mm_add_epi32(s2, _mm_loadu_si128((const __m128i *)(p + 32)));
+        s3 = _mm_add_epi32(s3, _mm_loadu_si128((const __m128i *)(p + 48)));
+    }
+    s0 = _mm_add_epi32(_mm_add_epi32(s0, s1), _mm_add_epi32(s2, s3));
+    _mm_storeu_si128((__m128i *)lanes, s0);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum32_scalar(p, bytes);
+}
+
+TARGET_AVX2 static uint32_t sum32_avx2(const uint8_t *p, size_t bytes) {
+    __m256i s0 = _mm256_setzero_si256(), s1 = s0, s2 = s0, s3 = s0;
+    uint32_t lanes[8], sum = 0;
+
+    for (; bytes >= 128; bytes -= 128, p += 128) {
+        s0 = _mm256_add_epi32(s0, _mm256_loadu_si256((const __m256i *)p));
+        s1 = _mm256_add_epi32(s1, _mm256_loadu_si256((const __m256i *)(p + 32)));
+        s2 = _mm256_add_epi32(s2, _mm256_loadu_si256((const __m256i *)(p + 64)));
+        s3 = _mm256_add_epi32(s3, _mm256_loadu_si256((const __m256i *)(p + 96)));
+    }
+    s0 = _mm256_add_epi32(_mm256_add_epi32(s0, s1), _mm256_add_epi32(s2, s3));
+    _mm256_storeu_si256((__m256i *)lanes, s0);
+    for (int i = 0; i < 8; ++i) {
+        sum += lanes[i];
+    }
+    return sum + sum32_scalar(p, bytes);
+}
+#elif defined(__aarch64__)
+static uint32_t sum32_neon(const uint8_t *p, size_t bytes) {
+    uint32x4_t s0 = vdupq_n_u32(0), s1 = s0, s2 = s0, s3 = s0;
+
+    for (; bytes >= 64; bytes -= 64, p += 64) {
+        s0 = vaddq_u32(s0, vreinterpretq_u32_u8(vld1q_u8(p)));
+        s1 = vaddq_u32(s1, vreinterpretq_u32_u8(vld1q_u8(p + 16)));
+        s2 = vaddq_u32(s2, vreinterpretq_u32_u8(vld1q_u8(p + 32)));
+        s3 = vaddq_u32(s3, vreinterpretq_u32_u8(vld1q_u8(p + 48)));
+    }
+    s0 = vaddq_u32(vaddq_u32(s0, s1), vaddq_u32(s2, s3));
+    return vaddvq_u32(s0) + sum32_scalar(p, bytes);
+}
+#endif
+
+/*-********
+ * CRC32C *
+ *-********/
+
+/* The kernels update the CRC register, without the initial and final inversion */
+
+#define CRC32C_POLY 0x82f63b78 /* reflected */
+/* The hardware kernels compute three independent streams of this many bytes
+ * at once, the latency of the CRC instruction is hidden */
+#define CRC32C_STREAM 4096
+
+static uint32_t crc32c_table[8][256];
+static uint32_t crc32c_stream_shift; /* x^(8 * CRC32C_STREAM) modulo the polynomial */
+
+/* a * b modulo the polynomial, reflected */
+static uint32_t crc32c_multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31, p = 0;
+
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if (!(a & (m - 1))) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+static void crc32c_init(void) {
+    uint32_t x = 1u << 30; /* x^1 */
+
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k) {
+            c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        crc32c_table[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; ++n) {
+        for (int k = 1; k < 8; ++k) {
+            crc32c_table[k][n] = (crc32c_table[k - 1][n] >> 8) ^
+                                 crc32c_table[0][crc32c_table[k - 1][n] & 0xff];
+        }
+    }
+
+    // x^(2^15) = x^(8 * 4096)
+    for (int k = 0; k < 15; ++k) {
+        x = crc32c_multmodp(x, x);
+    }
+    crc32c_stream_shift = x;
+}
+
+/* Slicing by 8, little endian */
+static uint32_t crc32c_scalar(uint32_t crc, const uint8_t *p, size_t bytes) {
+    for (; bytes >= 8; bytes -= 8, p += 8) {
+        uint32_t lo = read32(p) ^ crc, hi = read32(p + 4);
+        crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff] ^
+              crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][hi & 0xff] ^ crc32c_table[2][(hi >> 8) & 0xff] ^
+              crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24];
+    }
+    while (bytes--) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xff];
+    }
+    return crc;
+}
+
+/* Hardware kernel, crc8 and crc64 are the CRC instructions of the CPU */
+#define CRC32C_HW(name, target, crc8, crc64)                                            \
+target static uint32_t crc32c_##name(uint32_t crc, const uint8_t *p, size_t bytes) {  \
+    uint64_t c0 = crc;                                                                  \
+                                                                                        \
+    for (; bytes >= 3 * CRC32C_STREAM; bytes -= 3 * CRC32C_STREAM, p += 3 * CRC32C_STREAM) { \
+        uint64_t c1 = 0, c2 = 0;                                                        \
+        for (size_t i = 0; i < CRC32C_STREAM; i += 8) {                                 \
+            c0 = crc64(c0, read64(p + i));                                              \
+            c1 = crc64(c1, read64(p + CRC32C_STREAM + i));                              \
+            c2 = crc64(c2, read64(p + 2 * CRC32C_STREAM + i));                          \
+        }                                                                               \
+        /* CRC(A || B) = CRC(A) * x^(8 |B|) + CRC(B) with B from 0 */                   \
+        c0 = crc32c_multmodp(crc32c_stream_shift, (uint32_t)c0) ^ (uint32_t)c1;         \
+        c0 = crc32c_multmodp(crc32c_stream_shift, (uint32_t)c0) ^ (uint32_t)c2;         \
+    }                                                                                   \
+    for (; bytes >= 8; bytes -= 8, p += 8) {                                            \
+        c0 = crc64(c0, read64(p));                                                      \
+    }                                                                                   \
+    while (bytes--) {                                                                   \
+        c0 = crc8((uint32_t)c0, *p++);                                                  \
+    }                                                                                   \
+    return (uint32_t)c0;                                                                \
+}
+
+#if defined(__x86_64__)
+CRC32C_HW(sse42, TARGET_SSE42, _mm_crc32_u8, _mm_crc32_u64)
+#elif defined(__aarch64__)
+CRC32C_HW(armv8, TARGET_CRC, __crc32cb, __crc32cd)
+#endif
+
+/*-******
+ * XXH3 *
+ *-******/
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+#define XXH_PRIME_MX1 0x165667919E3779F9ULL
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ULL
+
+#define XXH_STRIPE_LEN 64
+#define XXH_SECRET_CONSUME_RATE 8
+#define XXH_SECRET_SIZE 192
+#define XXH_STRIPES_PER_BLOCK ((XXH_SECRET_SIZE - XXH_STRIPE_LEN) / XXH_SECRET_CONSUME_RATE)
+#define XXH_BLOCK_LEN (XXH_STRIPE_LEN * XXH_STRIPES_PER_BLOCK)
+
+static const uint8_t xxh3_secret[XXH_SECRET_SIZE] __attribute__((aligned(64))) = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static uint64_t rotl64(uint64_t v, int r) {
+    return (v << r) | (v >> (64 - r));
+}
+
+static uint64_t mul128_fold64(uint64_t a, uint64_t b) {
+    unsigned __int128 p = (unsigned __int128)a * b;
+    return (uint64_t)p ^ (uint64_t)(p >> 64);
+}
+
+static uint64_t xxh64_avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    return h ^ (h >> 32);
+}
+
+static uint64_t xxh3_avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= XXH_PRIME_MX1;
+    return h ^ (h >> 32);
+}
+
+static uint64_t xxh3_rrmxmx(uint64_t h, uint64_t len) {
+    h ^= rotl64(h, 49) ^ rotl64(h, 24);
+    h *= XXH_PRIME_MX2;
+    h ^= (h >> 35) + len;
+    h *= XXH_PRIME_MX2;
+    return h ^ (h >> 28);
+}
+
+static uint64_t xxh3_mix16(const uint8_t *p, const uint8_t *secret) {
+    return mul128_fold64(read64(p) ^ read64(secret), read64(p + 8) ^ read64(secret + 8));
+}
+
+static uint64_t xxh3_short(const uint8_t *p, size_t len) {
+    const uint8_t *s = xxh3_secret;
+    uint64_t acc, lo, hi;
+
+    if (len > 8) {
+        lo = read64(p) ^ (read64(s + 24) ^ read64(s + 32));
+        hi = read64(p + len - 8) ^ (read64(s + 40) ^ read64(s + 48));
+        return xxh3_avalanche(len + __builtin_bswap64(lo) + hi + mul128_fold64(lo, hi));
+    }
+    if (len >= 4) {
+        acc = read32(p + len - 4) + ((uint64_t)read32(p) << 32);
+        return xxh3_rrmxmx(acc ^ (read64(s + 8) ^ read64(s + 16)), len);
+    }
+    if (len) {
+        acc = ((uint32_t)p[0] << 16) | ((uint32_t)p[len >> 1] << 24) | p[len - 1] | ((uint32_t)len << 8);
+        return xxh64_avalanche(acc ^ (read32(s) ^ read32(s + 4)));
+    }
+    return xxh64_avalanche(read64(s + 56) ^ read64(s + 64));
+}
+
+static uint64_t xxh3_medium(const uint8_t *p, size_t len) {
+    const uint8_t *s = xxh3_secret;
+    uint64_t acc = len * XXH_PRIME64_1, acc_end;
+
+    if (len <= 128) {
+        // Pairs of 16 bytes from both ends, towards the middle
+        for (size_t i = (len - 1) / 32 + 1; i-- > 0;) {
+            acc += xxh3_mix16(p + 16 * i, s + 32 * i);
+            acc += xxh3_mix16(p + len - 16 * (i + 1), s + 32 * i + 16);
+        }
+        return xxh3_avalanche(acc);
+    }
+
+    for (size_t i = 0; i < 8; ++i) {
+        acc += xxh3_mix16(p + 16 * i, s + 16 * i);
+    }
+    acc_end = xxh3_mix16(p + len - 16, s + 136 - 17);
+    acc = xxh3_avalanche(acc);
+    for (size_t i = 8; i < len / 16; ++i) {
+        acc_end += xxh3_mix16(p + 16 * i, s + 16 * (i - 8) + 3);
+    }
+    return xxh3_avalanche(acc + acc_end);
+}
+
+/* Inputs longer than 240 bytes : 8 lanes of 64 bits accumulate 64 byte
+ * stripes, the vectorized kernels process several lanes at once */
+
+static void xxh3_accumulate_scalar(uint64_t *acc, const uint8_t *p, const uint8_t *secret) {
+    for (int i = 0; i < 8; ++i) {
+        uint64_t data = read64(p + 8 * i);
+        uint64_t key = data ^ read64(secret + 8 * i);
+        acc[i ^ 1] += data;
+        acc[i] += (uint32_t)key * (key >> 32);
+    }
+}
+
+static void xxh3_scramble_scalar(uint64_t *acc, const uint8_t *secret) {
+    for (int i = 0; i < 8; ++i) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= read64(secret + 8 * i);
+        acc[i] = a * XXH_PRIME32_1;
+    }
+}
+
+#if defined(__x86_64__)
+static void xxh3_accumulate_sse2(uint64_t *acc, const uint8_t *p, const uint8_t *secret) {
+    __m128i *xacc = (__m128i *)acc;
+
+    for (int i = 0; i < 4; ++i) {
+        __m128i data = _mm_loadu_si128((const __m128i *)p + i);
+        __m128i key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i *)secret + i));
+        __m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+        xacc[i] = _mm_add_epi64(product, _mm_add_epi64(xacc[i], swapped));
+    }
+}
+
+static void xxh3_scramble_sse2(uint64_t *acc, const uint8_t *secret) {
+    const __m128i prime = _mm_set1_epi32((int)XXH_PRIME32_1);
+    __m128i *xacc = (__m128i *)acc;
+
+    for (int i = 0; i < 4; ++i) {
+        __m128i a = _mm_xor_si128(xacc[i], _mm_srli_epi64(xacc[i], 47));
+        __m128i key = _mm_xor_si128(a, _mm_loadu_si128((const __m128i *)secret + i));
+        __m128i lo = _mm_mul_epu32(key, prime);
+        __m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        xacc[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+    }
+}
+
+TARGET_AVX2 static void xxh3_accumulate_avx2(uint64_t *acc, const uint8_t *p, const uint8_t *secret) {
+    __m256i *xacc = (__m256i *)acc;
+
+    for (int i = 0; i < 2; ++i) {
+        __m256i data = _mm256_loadu_si256((const __m256i *)p + i);
+        __m256i key = _mm256_xor_si256(data, _mm256_loadu_si256((const __m256i *)secret + i));
+        __m256i product = _mm256_mul_epu32(key, _mm256_srli_epi64(key, 32));
+        __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+        xacc[i] = _mm256_add_epi64(product, _mm256_add_epi64(xacc[i], swapped));
+    }
+}
+
+TARGET_AVX2 static void xxh3_scramble_avx2(uint64_t *acc, const uint8_t *secret) {
+    const __m256i prime = _mm256_set1_epi32((int)XXH_PRIME32_1);
+    __m256i *xacc = (__m256i *)acc;
+
+    for (int i = 0; i < 2; ++i) {
+        __m256i a = _mm256_xor_si256(xacc[i], _mm256_srli_epi64(xacc[i], 47));
+        __m256i key = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i *)secret + i));
+        __m256i lo = _mm256_mul_epu32(key, prime);
+        __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(key, 32), prime);
+        xacc[i] = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+    }
+}
+#elif defined(__aarch64__)
+static void xxh3_accumulate_neon(uint64_t *acc, const uint8_t *p, const uint8_t *secret) {
+    for (int i = 0; i < 4; ++i) {
+        uint64x2_t a = vld1q_u64(acc + 2 * i);
+        uint64x2_t data = vreinterpretq_u64_u8(vld1q_u8(p + 16 * i));
+        uint64x2_t key = veorq_u64(data, vreinterpretq_u64_u8(vld1q_u8(secret + 16 * i)));
+        a = vaddq_u64(a, vextq_u64(data, data, 1));
+        a = vmlal_u32(a, vmovn_u64(key), vshrn_n_u64(key, 32));
+        vst1q_u64(acc + 2 * i, a);
+    }
+}
+
+static void xxh3_scramble_neon(uint64_t *acc, const uint8_t *secret) {
+    const uint32x2_t prime = vdup_n_u32(XXH_PRIME32_1);
+
+    for (int i = 0; i < 4; ++i) {
+        uint64x2_t a = vld1q_u64(acc + 2 * i);
+        a = veorq_u64(a, vshrq_n_u64(a, 47));
+        a = veorq_u64(a, vreinterpretq_u64_u8(vld1q_u8(secret + 16 * i)));
+        // (hi * prime) << 32 + lo * prime
+        uint64x2_t hi = vshlq_n_u64(vmull_u32(vshrn_n_u64(a, 32), prime), 32);
+        vst1q_u64(acc + 2 * i, vmlal_u32(hi, vmovn_u64(a), prime));
+    }
+}
+#endif
+
+/* Long input kernel, accumulate and scramble are the lane kernels of an ISA */
+#define XXH3_LONG(name, target)                                                         \
+target static uint64_t xxh3_long_##name(const uint8_t *p, size_t len) {                \
+    uint64_t acc[8] __attribute__((aligned(32))) = {                                    \
+        XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3,                     \
+        XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1,                     \
+    };                                                                                  \
+    size_t blocks = (len - 1) / XXH_BLOCK_LEN, stripes, n;                              \
+    uint64_t result = len * XXH_PRIME64_1;                                              \
+                                                                                        \
+    for (n = 0; n < blocks; ++n) {                                                      \
+        for (size_t s = 0; s < XXH_STRIPES_PER_BLOCK; ++s) {                            \
+            xxh3_accumulate_##name(acc, p + n * XXH_BLOCK_LEN + s * XXH_STRIPE_LEN,     \
+                                   xxh3_secret + s * XXH_SECRET_CONSUME_RATE);          \
+        }                                                                               \
+        xxh3_scramble_##name(acc, xxh3_secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN);      \
+    }                                                                                   \
+    stripes = ((len - 1) - n * XXH_BLOCK_LEN) / XXH_STRIPE_LEN;                         \
+    for (size_t s = 0; s < stripes; ++s) {                                              \
+        xxh3_accumulate_##name(acc, p + n * XXH_BLOCK_LEN + s * XXH_STRIPE_LEN,         \
+                               xxh3_secret + s * XXH_SECRET_CONSUME_RATE);              \
+    }                                                                                   \
+    /* The last stripe ends with the input */                                           \
+    xxh3_accumulate_##name(acc, p + len - XXH_STRIPE_LEN,                               \
+                           xxh3_secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN - 7);         \
+                                                                                        \
+    for (int i = 0; i < 4; ++i) {                                                       \
+        result += mul128_fold64(acc[2 * i] ^ read64(xxh3_secret + 11 + 16 * i),         \
+                                acc[2 * i + 1] ^ read64(xxh3_secret + 19 + 16 * i));    \
+    }                                                                                   \
+    return xxh3_avalanche(result);                                                      \
+}
+
+XXH3_LONG(scalar, )
+#if defined(__x86_64__)
+XXH3_LONG(sse2, )
+XXH3_LONG(avx2, TARGET_AVX2)
+#elif defined(__aarch64__)
+XXH3_LONG(neon, )
+#endif
+
+/*-***********
+ * Selection *
+ *-***********/
+
+static uint32_t (*sum32_kernel)(const uint8_t *p, size_t bytes) = sum32_scalar;
+static uint32_t (*crc32c_kernel)(uint32_t crc, const uint8_t *p, size_t bytes) = crc32c_scalar;
+static uint64_t (*xxh3_long_kernel)(const uint8_t *p, size_t len) = xxh3_long_scalar;
+static char kernel_names[64] = "scalar";
+
+void checksum_init(void) {
+    const char *simd = "scalar", *crc = "scalar";
+
+    crc32c_init();
+#if defined(__x86_64__)
+    // SSE2 is part of x86-64
+    sum32_kernel = sum32_sse2;
+    xxh3_long_kernel = xxh3_long_sse2;
+    simd = "sse2";
+    if (__builtin_cpu_supports("avx2")) {
+        sum32_kernel = sum32_avx2;
+        xxh3_long_kernel = xxh3_long_avx2;
+        simd = "avx2";
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_kernel = crc32c_sse42;
+        crc = "sse4.2";
+    }
+#elif defined(__aarch64__)
+    // NEON is part of AArch64, the CRC instructions are optional in ARMv8.0
+    sum32_kernel = sum32_neon;
+    xxh3_long_kernel = xxh3_long_neon;
+    simd = "neon";
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+        crc32c_kernel = crc32c_armv8;
+        crc = "armv8";
+    }
+#endif
+    snprintf(kernel_names, sizeof(kernel_names), "sum32 %s, crc32c %s, xxh3 %s", simd, crc, simd);
+}
+
+const char *checksum_kernels(void) {
+    return kernel_names;
+}
+
+uint32_t checksum_sum32(const void *data, size_t bytes) {
+    return sum32_kernel(data, bytes);
+}
+
+uint32_t checksum_crc32c(uint32_t crc, const void *data, size_t bytes) {
+    return ~crc32c_kernel(~crc, data, bytes);
+}
+
+uint64_t checksum_xxh3(const void *data, size_t bytes) {
+    if (bytes <= 16) {
+        return xxh3_short(data, bytes);
+    }
+    if (bytes <= 240) {
+        return xxh3_medium(data, bytes);
+    }
+    return xxh3_long_kernel(data, bytes);
+}
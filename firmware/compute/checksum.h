@@ -0,0 +1,62 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Selects the fastest kernels the CPU supports, called once before the
+ * other functions
+ * */
+void checksum_init(void);
+
+/**
+ * @brief Returns the names of the selected kernels, e.g., "sum32 avx2, crc32c
+ * sse4.2, xxh3 avx2"
+ * */
+const char *checksum_kernels(void);
+
+/**
+ * @brief Sum of the little endian 32-bit words of the data, modulo 2^32, the
+ * last word is zero padded
+ * */
+uint32_t checksum_sum32(const void *data, size_t bytes);
+
+/**
+ * @brief CRC32C (Castagnoli) of the data
+ * @param crc : CRC of the previous data, 0 for the first
+ * */
+uint32_t checksum_crc32c(uint32_t crc, const void *data, size_t bytes);
+
+/**
+ * @brief XXH3 64-bit hash of the data, with seed 0 and the default secret (the
+ * value of XXH3_64bits() of the xxHash library)
+ * */
+uint64_t checksum_xxh3(const void *data, size_t bytes);
+
+#endif /* __CHECKSUM_H__ */
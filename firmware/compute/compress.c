@@ -0,0 +1,457 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Compression and decompression with the LZ4 and Zstandard libraries. The
+ * data is split in frames of COMPRESS_FRAME_BYTES that the workers of the pool
+ * (parallel.h) compress independently, a round compresses one frame per worker
+ * into its scratch buffer, the frames are then appended to the destination in
+ * order. As the frames are standard and carry the size of their content, the
+ * output is a regular .lz4 or .zst stream that the decompression splits again
+ * over the workers.
+ * */
+
+#include "compress.h"
+#include "parallel.h"
+#include "tsp.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <lz4.h>
+#include <lz4frame.h>
+#include <zstd.h>
+#include <zstd_errors.h>
+
+#define LZ4_FRAME_MAGIC 0x184D2204
+#define ZSTD_FRAME_MAGIC 0xFD2FB528
+#define SKIPPABLE_FRAME_MAGIC 0x184D2A50 /* low 4 bits are free */
+#define SKIPPABLE_FRAME_MASK 0xFFFFFFF0
+#define CONTENT_SIZE_UNKNOWN SIZE_MAX
+
+/* Frame found in the source by the decompression */
+typedef struct {
+    size_t src;     /* offset of the frame in the source */
+    size_t bytes;   /* compressed bytes of the frame */
+    size_t content; /* decompressed bytes, CONTENT_SIZE_UNKNOWN if not given */
+    size_t dst;     /* offset of the content in the destination */
+    int zstd;
+    int error;
+} frame_st;
+
+/* Per worker state */
+static struct {
+    int workers;
+    size_t scratch_bytes;
+    u8 **scratch;
+    size_t *scratch_used; /* 0 if the compression of the frame failed */
+    LZ4F_cctx **lz4c;
+    LZ4F_dctx **lz4d;
+    ZSTD_CCtx **zstdc;
+    ZSTD_DCtx **zstdd;
+    frame_st *frames;
+} ctx;
+
+static u32 read_le32(const u8 *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+static u64 read_le64(const u8 *p) {
+    return read_le32(p) | ((u64)read_le32(p + 4) << 32);
+}
+
+int compress_init(void) {
+    LZ4F_preferences_t prefs = LZ4F_INIT_PREFERENCES;
+    size_t lz4_bound, zstd_bound;
+    int n = parallel_threads();
+
+    prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+    prefs.frameInfo.contentSize = COMPRESS_FRAME_BYTES;
+    prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+    lz4_bound = LZ4F_compressFrameBound(COMPRESS_FRAME_BYTES, &prefs);
+    zstd_bound = ZSTD_compressBound(COMPRESS_FRAME_BYTES);
+
+    ctx.workers = n;
+    ctx.scratch_bytes = lz4_bound > zstd_bound ? lz4_bound : zstd_bound;
+    ctx.scratch = calloc(n, sizeof(*ctx.scratch));
+    ctx.scratch_used = calloc(n, sizeof(*ctx.scratch_used));
+    ctx.lz4c = calloc(n, sizeof(*ctx.lz4c));
+    ctx.lz4d = calloc(n, sizeof(*ctx.lz4d));
+    ctx.zstdc = calloc(n, sizeof(*ctx.zstdc));
+    ctx.zstdd = calloc(n, sizeof(*ctx.zstdd));
+    ctx.frames = calloc(n, sizeof(*ctx.frames));
+    if (!ctx.scratch || !ctx.scratch_used || !ctx.lz4c || !ctx.lz4d || !ctx.zstdc ||
+        !ctx.zstdd || !ctx.frames) {
+        return -1;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        ctx.scratch[i] = malloc(ctx.scratch_bytes);
+        ctx.zstdc[i] = ZSTD_createCCtx();
+        ctx.zstdd[i] = ZSTD_createDCtx();
+        if (!ctx.scratch[i] || !ctx.zstdc[i] || !ctx.zstdd[i] ||
+            LZ4F_isError(LZ4F_createCompressionContext(&ctx.lz4c[i], LZ4F_VERSION)) ||
+            LZ4F_isError(LZ4F_createDecompressionContext(&ctx.lz4d[i], LZ4F_VERSION))) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+const char *compress_versions(void) {
+    static char versions[64];
+
+    snprintf(versions, sizeof(versions), "lz4 %s, zstd %s", LZ4_versionString(),
+             ZSTD_versionString());
+    return versions;
+}
+
+/*-*************
+ * Compression *
+ *-*************/
+
+typedef struct {
+    int algorithm;
+    int level;
+    const u8 *src;
+    size_t src_bytes;
+    size_t first; /* offset in the source of the first frame of the round */
+} compress_round_st;
+
+/* Compresses an LZ4 frame with the context of the worker, returns its size or
+ * 0 on failure */
+static size_t compress_lz4(int worker, int level, const void *src, size_t bytes, void *dst,
+                           size_t capacity) {
+    LZ4F_preferences_t prefs = LZ4F_INIT_PREFERENCES;
+    LZ4F_cctx *cctx = ctx.lz4c[worker];
+    u8 *out = dst;
+    size_t ret, used;
+
+    prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+    prefs.frameInfo.contentSize = bytes;
+    prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+    prefs.compressionLevel = level;
+
+    ret = LZ4F_compressBegin(cctx, out, capacity, &prefs);
+    if (LZ4F_isError(ret)) {
+        return 0;
+    }
+    used = ret;
+    ret = LZ4F_compressUpdate(cctx, out + used, capacity - used, src, bytes, NULL);
+    if (LZ4F_isError(ret)) {
+        return 0;
+    }
+    used += ret;
+    ret = LZ4F_compressEnd(cctx, out + used, capacity - used, NULL);
+    return LZ4F_isError(ret) ? 0 : used + ret;
+}
+
+static size_t compress_zstd(int worker, int level, const void *src, size_t bytes, void *dst,
+                            size_t capacity) {
+    ZSTD_CCtx *cctx = ctx.zstdc[worker];
+    size_t ret;
+
+    ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+    if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level)) ||
+        ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1))) {
+        return 0;
+    }
+    ret = ZSTD_compress2(cctx, dst, capacity, src, bytes);
+    return ZSTD_isError(ret) ? 0 : ret;
+}
+
+/* Compresses frame i of the round in the scratch buffer i */
+static void compress_frame(void *arg, int i, int worker) {
+    compress_round_st *r = arg;
+    size_t offset = r->first + (size_t)i * COMPRESS_FRAME_BYTES;
+    size_t bytes = r->src_bytes - offset;
+
+    if (bytes > COMPRESS_FRAME_BYTES) {
+        bytes = COMPRESS_FRAME_BYTES;
+    }
+    if (r->algorithm == TSP_COMPRESSION_LZ4) {
+        ctx.scratch_used[i] = compress_lz4(worker, r->level, r->src + offset, bytes,
+                                           ctx.scratch[i], ctx.scratch_bytes);
+    } else {
+        ctx.scratch_used[i] = compress_zstd(worker, r->level, r->src + offset, bytes,
+                                            ctx.scratch[i], ctx.scratch_bytes);
+    }
+}
+
+int compress_frames(int algorithm, int level, const void *src, size_t src_bytes,
+                    void *dst, size_t dst_bytes, size_t *in, size_t *out) {
+    compress_round_st round = {
+        .algorithm = algorithm,
+        .level = level,
+        .src = src,
+        .src_bytes = src_bytes,
+    };
+
+    *in = 0;
+    *out = 0;
+    if (algorithm != TSP_COMPRESSION_LZ4 && algorithm != TSP_COMPRESSION_ZSTD) {
+        return -EINVAL;
+    }
+
+    while (round.first < src_bytes) {
+        size_t frames = (src_bytes - round.first + COMPRESS_FRAME_BYTES - 1) / COMPRESS_FRAME_BYTES;
+        int n = frames < (size_t)ctx.workers ? (int)frames : ctx.workers;
+
+        parallel_for(n, compress_frame, &round);
+
+        // Appended in order, up to the first frame that does not fit
+        for (int i = 0; i < n; ++i) {
+            size_t bytes = src_bytes - *in < COMPRESS_FRAME_BYTES ? src_bytes - *in
+                                                                   : COMPRESS_FRAME_BYTES;
+            if (!ctx.scratch_used[i]) {
+                return -EIO;
+            }
+            if (ctx.scratch_used[i] > dst_bytes - *out) {
+                return *in ? 0 : -ENOSPC;
+            }
+            memcpy((u8 *)dst + *out, ctx.scratch[i], ctx.scratch_used[i]);
+            *out += ctx.scratch_used[i];
+            *in += bytes;
+        }
+        round.first = *in;
+    }
+    return 0;
+}
+
+/*-***************
+ * Decompression *
+ *-***************/
+
+/* Compressed size of the LZ4 frame (walking its blocks) and size of its
+ * content, returns -ENOSPC if the frame is truncated */
+static int lz4_frame_size(const u8 *p, size_t avail, size_t *bytes, size_t *content) {
+    u8 flg;
+    size_t pos;
+
+    if (avail < 7) {
+        return -ENOSPC;
+    }
+    flg = p[4];
+    if ((flg >> 6) != 1) {
+        return -EBADMSG;
+    }
+    pos = 7 + (flg & 0x08 ? 8 : 0) + (flg & 0x01 ? 4 : 0);
+    if (avail < pos) {
+        return -ENOSPC;
+    }
+    *content = flg & 0x08 ? read_le64(p + 6) : CONTENT_SIZE_UNKNOWN;
+
+    while (1) {
+        u32 block;
+
+        if (avail - pos < 4) {
+            return -ENOSPC;
+        }
+        block = read_le32(p + pos);
+        pos += 4;
+        if (!block) {
+            break;
+        }
+        block = (block & 0x7FFFFFFF) + (flg & 0x10 ? 4 : 0);
+        if (avail - pos < block) {
+            return -ENOSPC;
+        }
+        pos += block;
+    }
+    pos += flg & 0x04 ? 4 : 0;
+    if (avail < pos) {
+        return -ENOSPC;
+    }
+    *bytes = pos;
+    return 0;
+}
+
+/* Finds the frame at the start of p, returns -ENOSPC if it is truncated, 1
+ * for a skippable frame */
+static int frame_find(const u8 *p, size_t avail, frame_st *f) {
+    u32 magic;
+    u64 content;
+
+    if (avail < 4) {
+        return -ENOSPC;
+    }
+    magic = read_le32(p);
+
+    if ((magic & SKIPPABLE_FRAME_MASK) == SKIPPABLE_FRAME_MAGIC) {
+        if (avail < 8 || avail - 8 < read_le32(p + 4)) {
+            return -ENOSPC;
+        }
+        f->bytes = 8 + (size_t)read_le32(p + 4);
+        f->content = 0;
+        return 1;
+    }
+    if (magic == LZ4_FRAME_MAGIC) {
+        f->zstd = 0;
+        return lz4_frame_size(p, avail, &f->bytes, &f->content);
+    }
+    if (magic == ZSTD_FRAME_MAGIC) {
+        f->zstd = 1;
+        f->bytes = ZSTD_findFrameCompressedSize(p, avail);
+        if (ZSTD_isError(f->bytes)) {
+            return ZSTD_getErrorCode(f->bytes) == ZSTD_error_srcSize_wrong ? -ENOSPC : -EBADMSG;
+        }
+        content = ZSTD_getFrameContentSize(p, f->bytes);
+        if (content == ZSTD_CONTENTSIZE_ERROR) {
+            return -EBADMSG;
+        }
+        f->content = content == ZSTD_CONTENTSIZE_UNKNOWN ? CONTENT_SIZE_UNKNOWN : content;
+        return 0;
+    }
+    return -EBADMSG;
+}
+
+/* Decompresses a frame in at most capacity bytes, returns the size of its
+ * content, -ENOSPC if it does not fit or -EBADMSG */
+static long frame_decompress(int worker, const frame_st *f, const u8 *src, u8 *dst,
+                             size_t capacity) {
+    if (f->zstd) {
+        size_t ret = ZSTD_decompressDCtx(ctx.zstdd[worker], dst, capacity, src + f->src, f->bytes);
+        if (ZSTD_isError(ret)) {
+            return ZSTD_getErrorCode(ret) == ZSTD_error_dstSize_tooSmall ? -ENOSPC : -EBADMSG;
+        }
+        return ret;
+    } else {
+        LZ4F_dctx *dctx = ctx.lz4d[worker];
+        LZ4F_decompressOptions_t options = {.stableDst = 1};
+        const u8 *in = src + f->src;
+        size_t in_left = f->bytes, out = 0;
+
+        LZ4F_resetDecompressionContext(dctx);
+        while (1) {
+            size_t in_bytes = in_left, out_bytes = capacity - out;
+            size_t ret = LZ4F_decompress(dctx, dst + out, &out_bytes, in, &in_bytes, &options);
+
+            if (LZ4F_isError(ret)) {
+                return -EBADMSG;
+            }
+            in += in_bytes;
+            in_left -= in_bytes;
+            out += out_bytes;
+            if (!ret) {
+                return out;
+            }
+            if (!in_bytes && !out_bytes) {
+                // The destination is full, or the frame ended early
+                return out == capacity ? -ENOSPC : -EBADMSG;
+            }
+        }
+    }
+}
+
+typedef struct {
+    const u8 *src;
+    u8 *dst;
+} decompress_round_st;
+
+static void decompress_frame(void *arg, int i, int worker) {
+    decompress_round_st *r = arg;
+    frame_st *f = &ctx.frames[i];
+    long ret = frame_decompress(worker, f, r->src, r->dst + f->dst, f->content);
+
+    f->error = ret < 0 ? (int)ret : (size_t)ret != f->content ? -EBADMSG : 0;
+}
+
+int decompress_frames(const void *src, size_t src_bytes, void *dst, size_t dst_bytes,
+                      size_t *in, size_t *out) {
+    decompress_round_st round = {.src = src, .dst = dst};
+    int error = 0;
+
+    *in = 0;
+    *out = 0;
+    while (*in < src_bytes && !error) {
+        size_t pos = *in, end = *out;
+        int n = 0, ret = 0;
+
+        // The frames of known sizes that fit are decompressed together
+        while (n < ctx.workers && pos < src_bytes) {
+            frame_st *f = &ctx.frames[n];
+
+            memset(f, 0, sizeof(*f));
+            ret = frame_find(round.src + pos, src_bytes - pos, f);
+            if (ret < 0) {
+                break;
+            }
+            f->src = pos;
+            if (ret == 1) {
+                // Skippable frames are consumed with the frames around them
+                pos += f->bytes;
+                if (!n) {
+                    *in = pos;
+                }
+                ret = 0;
+                continue;
+            }
+            if (f->content == CONTENT_SIZE_UNKNOWN) {
+                break;
+            }
+            if (f->content > dst_bytes - end) {
+                ret = -ENOSPC;
+                break;
+            }
+            f->dst = end;
+            end += f->content;
+            pos += f->bytes;
+            n++;
+        }
+
+        if (n) {
+            parallel_for(n, decompress_frame, &round);
+            for (int i = 0; i < n; ++i) {
+                if (ctx.frames[i].error) {
+                    error = ctx.frames[i].error;
+                    break;
+                }
+                *in = ctx.frames[i].src + ctx.frames[i].bytes;
+                *out = ctx.frames[i].dst + ctx.frames[i].content;
+            }
+            continue;
+        }
+        if (ret < 0) {
+            error = ret;
+            break;
+        }
+        if (*in < src_bytes) {
+            // A frame without the size of its content, decompressed alone
+            frame_st *f = &ctx.frames[0];
+            long bytes = frame_decompress(0, f, round.src, round.dst + *out, dst_bytes - *out);
+
+            if (bytes < 0) {
+                error = bytes;
+                break;
+            }
+            *in += f->bytes;
+            *out += bytes;
+        }
+    }
+
+    return *in || !error ? 0 : error;
+}
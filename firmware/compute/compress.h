@@ -0,0 +1,74 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include <stddef.h>
+
+/* Content of the frames produced by the compression, the unit of work of the
+ * workers (and the largest LZ4 block) */
+#define COMPRESS_FRAME_BYTES (4 << 20)
+
+/**
+ * @brief Allocates the contexts of the workers, called once after
+ * parallel_init()
+ * @return 0, or -1 if there is not enough memory
+ * */
+int compress_init(void);
+
+/**
+ * @brief Returns the versions of the libraries, e.g., "lz4 1.9.4, zstd 1.5.5"
+ * */
+const char *compress_versions(void);
+
+/**
+ * @brief Compresses the source into a sequence of frames (one per
+ * COMPRESS_FRAME_BYTES of the source) compressed in parallel, up to the frame
+ * that does not fit in the destination
+ * @param[in] algorithm : TSP_COMPRESSION_ALGORITHM
+ * @param[in] level : Compression level, 0 for the default of the algorithm
+ * @param[out] in : Bytes of the source compressed
+ * @param[out] out : Bytes of frames written to the destination
+ * @return 0, -EINVAL for an unknown algorithm, -ENOSPC if not even the first
+ * frame fits or -EIO if the compression failed
+ * */
+int compress_frames(int algorithm, int level, const void *src, size_t src_bytes,
+                    void *dst, size_t dst_bytes, size_t *in, size_t *out);
+
+/**
+ * @brief Decompresses the LZ4 and Zstandard frames of the source (skippable
+ * frames are skipped), the frames that give the size of their content are
+ * decompressed in parallel. Stops before the frame that is truncated, does not
+ * fit in the destination or is corrupted.
+ * @param[out] in : Bytes of frames of the source consumed
+ * @param[out] out : Bytes written to the destination
+ * @return 0, -ENOSPC if the first frame is truncated or does not fit, or
+ * -EBADMSG if the first frame is corrupted
+ * */
+int decompress_frames(const void *src, size_t src_bytes, void *dst, size_t dst_bytes,
+                      size_t *in, size_t *out);
+
+#endif /* __COMPRESS_H__ */
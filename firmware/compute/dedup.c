@@ -0,0 +1,472 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Content defined chunking and fingerprinting (Dedup). The cut points are
+ * found with FastCDC : a gear hash (shifted left and added a random value of
+ * each byte, so that it only depends on the last 64 bytes) is tested against
+ * a mask from the minimum size of a chunk on, a harder one before the average
+ * size and an easier one after it (normalized chunking), up to the maximum.
+ *
+ * The cut points only depend on the data and on the start of the chunk. The
+ * data is split in segments that the workers chunk as if a chunk started at
+ * the start of each, then the real chunks are followed from the start of the
+ * data through the segments : once a real cut point is one of the segment, the
+ * rest of its cut points are real. The chunks are then fingerprinted with
+ * SHA-256 in parallel and looked up in the index in order.
+ *
+ * The index is an open addressing hash table of fingerprints in a shared
+ * mapping of a file, the daemons lock the file while they use it.
+ * */
+
+#include "dedup.h"
+#include "parallel.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEDUP_SEGMENT_BYTES (4 << 20) /* data chunked by a worker at a time */
+#define DEDUP_HASH_BYTES (1 << 20)    /* chunks fingerprinted by a worker at a time */
+#define DEDUP_FILE_SLOTS (1 << 22)    /* of a new index file, 128 MiB */
+#define DEDUP_MEMORY_SLOTS (1 << 20)  /* of the index in memory */
+#define DEDUP_INDEX_MAGIC 0x5055444544505354ull /* "TSPDEDUP" */
+#define DEDUP_INDEX_VERSION 1
+
+typedef struct {
+    size_t min;
+    size_t avg;
+    size_t max;
+    u64 mask_s; /* before the average size */
+    u64 mask_l; /* after it */
+} dedup_params_st;
+
+typedef struct {
+    size_t start; /* [start, end) of the data */
+    size_t end;
+    u64 *cut;     /* ends of the chunks from start */
+    size_t num_cuts;
+    size_t max_cuts;
+    int partial;  /* the last cut is the end of the data */
+    int error;
+} dedup_segment_st;
+
+typedef struct {
+    const dedup_params_st *params;
+    const u8 *data;
+    size_t bytes;
+    dedup_segment_st *segments;
+    const u64 *cut;   /* real cut points, after 0 */
+    size_t *group;    /* first chunk fingerprinted by each iteration */
+    u8 (*fp)[32];
+    int error;
+} dedup_scan_st;
+
+typedef struct {
+    u64 magic;
+    u32 version;
+    u32 reserved;
+    u64 slots;
+    u64 count;
+    u8 pad[32];
+} dedup_index_hdr_st;
+
+static struct {
+    dedup_index_hdr_st *hdr;
+    u8 (*slot)[32];
+    int fd;
+} dedup_index = {.fd = -1};
+
+static u64 dedup_gear[256];
+static EVP_MD *dedup_sha256;
+static EVP_MD_CTX **dedup_ctx;
+
+int dedup_init(void) {
+    int n = parallel_threads();
+    u64 x = 0;
+
+    // splitmix64 from 0, the same table for every CSD
+    for (int i = 0; i < 256; ++i) {
+        u64 z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        dedup_gear[i] = z ^ (z >> 31);
+    }
+
+    dedup_sha256 = EVP_MD_fetch(NULL, "SHA256", NULL);
+    dedup_ctx = calloc(n, sizeof(*dedup_ctx));
+    if (!dedup_sha256 || !dedup_ctx) {
+        return -1;
+    }
+    for (int i = 0; i < n; ++i) {
+        dedup_ctx[i] = EVP_MD_CTX_new();
+        if (!dedup_ctx[i]) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*-*******
+ * Index *
+ *-*******/
+
+static int dedup_index_map(int fd, size_t bytes, int create) {
+    void *va = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                    fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED, fd, 0);
+    dedup_index_hdr_st *hdr = va;
+
+    if (va == MAP_FAILED) {
+        return -errno;
+    }
+    if (create) {
+        hdr->magic = DEDUP_INDEX_MAGIC;
+        hdr->version = DEDUP_INDEX_VERSION;
+        hdr->slots = (bytes - sizeof(*hdr)) / sizeof(*dedup_index.slot);
+        hdr->count = 0;
+    } else if (hdr->magic != DEDUP_INDEX_MAGIC || hdr->version != DEDUP_INDEX_VERSION ||
+               !hdr->slots || hdr->slots & (hdr->slots - 1) ||
+               bytes < sizeof(*hdr) + hdr->slots * sizeof(*dedup_index.slot)) {
+        munmap(va, bytes);
+        return -EINVAL;
+    }
+    dedup_index.hdr = hdr;
+    dedup_index.slot = (void *)(hdr + 1);
+    dedup_index.fd = fd;
+    return 0;
+}
+
+int dedup_index_open(const char *path) {
+    size_t bytes = sizeof(dedup_index_hdr_st) + (size_t)DEDUP_FILE_SLOTS * 32;
+    struct stat st;
+    int fd, ret = 0, create;
+
+    fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        return -errno;
+    }
+    // The first daemon creates the index
+    flock(fd, LOCK_EX);
+    if (fstat(fd, &st) < 0) {
+        ret = -errno;
+    }
+    create = !ret && !st.st_size;
+    if (create && ftruncate(fd, bytes) < 0) {
+        ret = -errno;
+    }
+    if (!ret) {
+        ret = dedup_index_map(fd, create ? bytes : (size_t)st.st_size, create);
+    }
+    flock(fd, LOCK_UN);
+    if (ret) {
+        close(fd);
+    }
+    return ret;
+}
+
+/* Looks the fingerprint up and adds it if insert, returns 1 if it was known,
+ * 0 if not, -ENOSPC if it could not be added */
+static int dedup_index_find(const u8 *fp, int insert) {
+    static const u8 empty[32];
+    u64 mask = dedup_index.hdr->slots - 1, i;
+
+    memcpy(&i, fp, sizeof(i));
+    for (i &= mask; memcmp(dedup_index.slot[i], empty, sizeof(empty)); i = (i + 1) & mask) {
+        if (!memcmp(dedup_index.slot[i], fp, sizeof(empty))) {
+            return 1;
+        }
+    }
+    if (!insert) {
+        return 0;
+    }
+    // Keeps the probes short
+    if (dedup_index.hdr->count * 4 >= dedup_index.hdr->slots * 3) {
+        return -ENOSPC;
+    }
+    memcpy(dedup_index.slot[i], fp, sizeof(empty));
+    dedup_index.hdr->count++;
+    return 0;
+}
+
+/*-**********
+ * Chunking *
+ *-**********/
+
+/* Mask of bits spread over the upper 48 bits of the hash */
+static u64 dedup_mask(int bits) {
+    u64 mask = 0;
+
+    for (int i = 0; i < bits; ++i) {
+        mask |= 1ull << (63 - i * 48 / bits);
+    }
+    return mask;
+}
+
+/* Length of the chunk at p, *partial set if the data ends before a cut */
+static size_t dedup_cut(const dedup_params_st *c, const u8 *p, size_t n, int *partial) {
+    size_t i = c->min, normal = c->avg, max = c->max;
+    u64 fp = 0;
+
+    *partial = 0;
+    if (n <= c->min) {
+        *partial = 1;
+        return n;
+    }
+    if (max > n) {
+        max = n;
+    }
+    if (normal > max) {
+        normal = max;
+    }
+    for (; i < normal; ++i) {
+        fp = (fp << 1) + dedup_gear[p[i]];
+        if (!(fp & c->mask_s)) {
+            return i + 1;
+        }
+    }
+    for (; i < max; ++i) {
+        fp = (fp << 1) + dedup_gear[p[i]];
+        if (!(fp & c->mask_l)) {
+            return i + 1;
+        }
+    }
+    *partial = max < c->max;
+    return max;
+}
+
+static int dedup_add_cut(dedup_segment_st *seg, u64 cut) {
+    if (seg->num_cuts == seg->max_cuts) {
+        size_t max = seg->max_cuts ? seg->max_cuts * 2 : 1024;
+        u64 *more = realloc(seg->cut, max * sizeof(*more));
+
+        if (!more) {
+            return -ENOMEM;
+        }
+        seg->cut = more;
+        seg->max_cuts = max;
+    }
+    seg->cut[seg->num_cuts++] = cut;
+    return 0;
+}
+
+/* Chunks from the start of the segment up to its end (the last chunk may go
+ * past it) */
+static void dedup_segment(void *arg, int i, int worker) {
+    dedup_scan_st *s = arg;
+    dedup_segment_st *seg = &s->segments[i];
+    size_t pos = seg->start;
+
+    while (pos < seg->end && !seg->partial && !seg->error) {
+        pos += dedup_cut(s->params, s->data + pos, s->bytes - pos, &seg->partial);
+        seg->error = dedup_add_cut(seg, pos);
+    }
+}
+
+/* Real cut points of the data, in chunks->cut */
+static int dedup_follow(dedup_scan_st *s, int n, dedup_segment_st *chunks) {
+    size_t pos = 0;
+    int ret = 0;
+
+    for (int i = 0; i < n && !ret && !chunks->partial; ++i) {
+        const dedup_segment_st *seg = &s->segments[i];
+        size_t j = 0;
+
+        if (seg->error) {
+            return seg->error;
+        }
+        // Chunks of the previous segments may cover this one
+        if (pos >= seg->end) {
+            continue;
+        }
+        // Real chunks up to one of the cut points of the segment
+        while (pos != seg->start && !ret && !chunks->partial && pos < seg->end) {
+            while (j < seg->num_cuts && seg->cut[j] < pos) {
+                j++;
+            }
+            if (j < seg->num_cuts && seg->cut[j] == pos) {
+                j++;
+                break;
+            }
+            pos += dedup_cut(s->params, s->data + pos, s->bytes - pos, &chunks->partial);
+            ret = dedup_add_cut(chunks, pos);
+        }
+        if (pos >= seg->end || chunks->partial) {
+            continue;
+        }
+        for (; j < seg->num_cuts && !ret; ++j) {
+            ret = dedup_add_cut(chunks, seg->cut[j]);
+        }
+        pos = seg->cut[seg->num_cuts - 1];
+        chunks->partial = seg->partial;
+    }
+    return ret;
+}
+
+static void dedup_fingerprint(void *arg, int i, int worker) {
+    dedup_scan_st *s = arg;
+    EVP_MD_CTX *ctx = dedup_ctx[worker];
+
+    for (size_t k = s->group[i]; k < s->group[i + 1]; ++k) {
+        u64 start = k ? s->cut[k - 1] : 0;
+
+        if (!EVP_DigestInit_ex(ctx, dedup_sha256, NULL) ||
+            !EVP_DigestUpdate(ctx, s->data + start, s->cut[k] - start) ||
+            !EVP_DigestFinal_ex(ctx, s->fp[k], NULL)) {
+            s->error = -EIO;
+        }
+    }
+}
+
+int dedup_chunks(const void *data, size_t data_bytes, u32 options, void *dst, size_t dst_bytes,
+                 TspDedupResult *result) {
+    u32 flags = options & 0xFF, avg_log2 = (options >> 8) & 0xFF;
+    dedup_params_st params;
+    dedup_scan_st scan = {.params = &params, .data = data, .bytes = data_bytes};
+    dedup_segment_st chunks = {0};
+    size_t num, max = dst_bytes / sizeof(TspDedupChunk), groups = 0;
+    u8 *out = dst;
+    int n, ret;
+
+    memset(result, 0, sizeof(*result));
+    if (!avg_log2) {
+        avg_log2 = TSP_DEDUP_AVG_LOG2;
+    }
+    if (avg_log2 < TSP_DEDUP_MIN_AVG_LOG2 || avg_log2 > TSP_DEDUP_MAX_AVG_LOG2 ||
+        options >> 16 || flags & ~(TSP_DEDUP_END | TSP_DEDUP_LOOKUP | TSP_DEDUP_INSERT)) {
+        return -EINVAL;
+    }
+    if (!data_bytes) {
+        return 0;
+    }
+    params = (dedup_params_st) {
+        .min = (size_t)1 << (avg_log2 - 2),
+        .avg = (size_t)1 << avg_log2,
+        .max = (size_t)1 << (avg_log2 + 3),
+        .mask_s = dedup_mask(avg_log2 + 2),
+        .mask_l = dedup_mask(avg_log2 - 2),
+    };
+
+    n = (data_bytes + DEDUP_SEGMENT_BYTES - 1) / DEDUP_SEGMENT_BYTES;
+    scan.segments = calloc(n, sizeof(*scan.segments));
+    if (!scan.segments) {
+        return -ENOMEM;
+    }
+    for (int i = 0; i < n; ++i) {
+        scan.segments[i].start = (size_t)i * DEDUP_SEGMENT_BYTES;
+        scan.segments[i].end = i == n - 1 ? data_bytes : scan.segments[i].start + DEDUP_SEGMENT_BYTES;
+    }
+    parallel_for(n, dedup_segment, &scan);
+    ret = dedup_follow(&scan, n, &chunks);
+    if (ret) {
+        goto out;
+    }
+
+    // The tail is a chunk at the end of the stream only, then as many as fit
+    num = chunks.num_cuts;
+    if (chunks.partial && !(flags & TSP_DEDUP_END)) {
+        num--;
+    }
+    if (num > max) {
+        num = max;
+    }
+    if (!num) {
+        ret = -ENOSPC;
+        goto out;
+    }
+
+    // Groups of chunks of about DEDUP_HASH_BYTES
+    scan.cut = chunks.cut;
+    scan.group = malloc((num + 1) * sizeof(*scan.group));
+    scan.fp = malloc(num * sizeof(*scan.fp));
+    if (!scan.group || !scan.fp) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    for (size_t k = 0, next = 0; k < num; ++k) {
+        if (!k || chunks.cut[k - 1] >= next) {
+            scan.group[groups++] = k;
+            next = (k ? chunks.cut[k - 1] : 0) + DEDUP_HASH_BYTES;
+        }
+    }
+    scan.group[groups] = num;
+    parallel_for(groups, dedup_fingerprint, &scan);
+    if (scan.error) {
+        ret = scan.error;
+        goto out;
+    }
+
+    if (flags & (TSP_DEDUP_LOOKUP | TSP_DEDUP_INSERT)) {
+        if (!dedup_index.hdr) {
+            ret = dedup_index_map(-1, sizeof(dedup_index_hdr_st) + (size_t)DEDUP_MEMORY_SLOTS * 32, 1);
+            if (ret) {
+                goto out;
+            }
+        }
+        if (dedup_index.fd >= 0) {
+            flock(dedup_index.fd, LOCK_EX);
+        }
+    }
+    for (size_t k = 0; k < num; ++k) {
+        u64 start = k ? chunks.cut[k - 1] : 0;
+        TspDedupChunk c = {
+            .Offset = start,
+            .Length = chunks.cut[k] - start,
+        };
+
+        memcpy(c.Fingerprint, scan.fp[k], sizeof(c.Fingerprint));
+        if (flags & (TSP_DEDUP_LOOKUP | TSP_DEDUP_INSERT)) {
+            int known = dedup_index_find(c.Fingerprint, flags & TSP_DEDUP_INSERT);
+            if (known < 0) {
+                result->Flags |= TSP_DEDUP_INDEX_FULL;
+            } else if (known) {
+                c.Flags |= TSP_DEDUP_CHUNK_KNOWN;
+                result->KnownChunks++;
+                result->KnownBytes += c.Length;
+            }
+        }
+        memcpy(out + k * sizeof(c), &c, sizeof(c));
+    }
+    if (dedup_index.fd >= 0 && flags & (TSP_DEDUP_LOOKUP | TSP_DEDUP_INSERT)) {
+        flock(dedup_index.fd, LOCK_UN);
+    }
+    result->InBytes = chunks.cut[num - 1];
+    result->Chunks = num;
+
+out:
+    for (int i = 0; i < n; ++i) {
+        free(scan.segments[i].cut);
+    }
+    free(scan.segments);
+    free(scan.group);
+    free(scan.fp);
+    free(chunks.cut);
+    return ret;
+}
@@ -0,0 +1,57 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __DEDUP_H__
+#define __DEDUP_H__
+
+#include <stddef.h>
+#include "tsp.h"
+
+/**
+ * @brief Builds the gear table and the SHA-256 contexts of the workers,
+ * called once after parallel_init()
+ * @return 0, or -1 if there is not enough memory
+ * */
+int dedup_init(void);
+
+/**
+ * @brief Maps the fingerprint index of the file, created if it does not exist
+ * or is empty. The daemons that map the same file share the index. Without
+ * it the index is in the memory of the daemon.
+ * @return 0, or a negative errno
+ * */
+int dedup_index_open(const char *path);
+
+/**
+ * @brief Splits the data in content defined chunks, fingerprints them in
+ * parallel and writes their table (TspDedupChunk) to the destination
+ * @param[in] options : TSP_DEDUP_OPTIONS() (see tsp.h), 0 for the defaults
+ * @return 0, -EINVAL if the options are invalid, -ENOSPC if the data holds no
+ * whole chunk or the first chunk does not fit, -ENOMEM
+ * */
+int dedup_chunks(const void *data, size_t data_bytes, u32 options, void *dst, size_t dst_bytes,
+                 TspDedupResult *result);
+
+#endif /* __DEDUP_H__ */
@@ -0,0 +1,451 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Reed-Solomon erasure coding and RAID parity (EC, RAID). Both are linear
+ * codes over GF(2^8) : each shard that is computed is a dot product of k
+ * shards with a row of coefficients. Encoding takes the rows of the parity
+ * matrix, reconstruction the rows of the inverse of the matrix of the first k
+ * shards that survive (multiplied by the parity rows for the lost parity).
+ *
+ * The products use split nibble tables, c * x = c * (x & 0x0F) ^ c * (x & 0xF0)
+ * are two tables of 16 products that a byte shuffle (pshufb, tbl) looks up for
+ * 16 or 32 bytes at once. The workers compute columns of the stripe a block at
+ * a time, the inputs of the block stay in the cache while the outputs are
+ * computed by groups of EC_GROUP.
+ * */
+
+#include "ec.h"
+#include "parallel.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define EC_POLY 0x11D
+#define EC_GROUP 4                 /* outputs computed in a pass over the inputs */
+#define EC_TABLE_BYTES 32          /* nibble tables of a coefficient */
+#define EC_BLOCK_BYTES 4096        /* columns of a pass */
+#define EC_COLUMN_BYTES (64 << 10) /* columns computed by a worker at a time */
+#define EC_MAX_PARITY (TSP_EC_MAX_SHARDS / 2 * TSP_EC_MAX_SHARDS / 2) /* k * m */
+
+#define INLINE inline __attribute__((always_inline))
+
+/*-*********
+ * GF(2^8) *
+ *-*********/
+
+static u8 gf_exp[512], gf_log[256];
+
+static void gf_init(void) {
+    unsigned x = 1;
+
+    for (int i = 0; i < 255; ++i) {
+        gf_exp[i] = gf_exp[i + 255] = x;
+        gf_log[x] = i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= EC_POLY;
+        }
+    }
+}
+
+static u8 gf_mul(u8 a, u8 b) {
+    return a && b ? gf_exp[gf_log[a] + gf_log[b]] : 0;
+}
+
+static u8 gf_inv(u8 a) {
+    return gf_exp[255 - gf_log[a]];
+}
+
+/* Products of the coefficient with the low nibbles then the high nibbles */
+static void gf_tables(u8 c, u8 *t) {
+    for (int x = 0; x < 16; ++x) {
+        t[x] = gf_mul(c, x);
+        t[16 + x] = gf_mul(c, x << 4);
+    }
+}
+
+/* Gauss-Jordan elimination of the n x n matrix, replaced by its inverse */
+static int gf_invert(u8 *a, int n) {
+    u8 b[TSP_EC_MAX_SHARDS * TSP_EC_MAX_SHARDS], tmp[TSP_EC_MAX_SHARDS];
+
+    memset(b, 0, n * n);
+    for (int i = 0; i < n; ++i) {
+        b[i * n + i] = 1;
+    }
+    for (int c = 0; c < n; ++c) {
+        int p = c;
+        while (p < n && !a[p * n + c]) {
+            ++p;
+        }
+        if (p == n) {
+            return -1;
+        }
+        if (p != c) {
+            memcpy(tmp, a + p * n, n), memcpy(a + p * n, a + c * n, n), memcpy(a + c * n, tmp, n);
+            memcpy(tmp, b + p * n, n), memcpy(b + p * n, b + c * n, n), memcpy(b + c * n, tmp, n);
+        }
+        u8 inv = gf_inv(a[c * n + c]);
+        for (int j = 0; j < n; ++j) {
+            a[c * n + j] = gf_mul(a[c * n + j], inv);
+            b[c * n + j] = gf_mul(b[c * n + j], inv);
+        }
+        for (int r = 0; r < n; ++r) {
+            u8 f = a[r * n + c];
+            if (r == c || !f) {
+                continue;
+            }
+            for (int j = 0; j < n; ++j) {
+                a[r * n + j] ^= gf_mul(f, a[c * n + j]);
+                b[r * n + j] ^= gf_mul(f, b[c * n + j]);
+            }
+        }
+    }
+    memcpy(a, b, n * n);
+    return 0;
+}
+
+/*-*************
+ * Dot kernels *
+ *-*************/
+
+/* out[o] = sum of tables[o][j] * in[j] for the bytes from offset, with up to
+ * EC_GROUP outputs */
+typedef void (*ec_dot_fn)(int n_in, int n_out, const u8 *tables, u8 *const *in, u8 *const *out,
+                          size_t offset, size_t bytes);
+
+static void ec_dot_scalar(int n_in, int n_out, const u8 *tables, u8 *const *in, u8 *const *out,
+                          size_t offset, size_t bytes) {
+    for (int o = 0; o < n_out; ++o) {
+        u8 *dst = out[o] + offset;
+        for (int j = 0; j < n_in; ++j) {
+            const u8 *src = in[j] + offset, *t = tables + (o * n_in + j) * EC_TABLE_BYTES;
+            for (size_t i = 0; i < bytes; ++i) {
+                u8 product = t[src[i] & 0x0F] ^ t[16 + (src[i] >> 4)];
+                dst[i] = j ? dst[i] ^ product : product;
+            }
+        }
+    }
+}
+
+#if defined(__x86_64__)
+TARGET_SSSE3 static INLINE void ec_dot_n_ssse3(int n_in, const int n_out, const u8 *tables,
+                                               u8 *const *in, u8 *const *out, size_t offset,
+                                               size_t bytes) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    size_t i;
+
+    for (i = 0; i + 16 <= bytes; i += 16) {
+        __m128i acc[EC_GROUP];
+        for (int o = 0; o < n_out; ++o) {
+            acc[o] = _mm_setzero_si128();
+        }
+        for (int j = 0; j < n_in; ++j) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(in[j] + offset + i));
+            __m128i lo = _mm_and_si128(x, nibble);
+            __m128i hi = _mm_and_si128(_mm_srli_epi64(x, 4), nibble);
+            for (int o = 0; o < n_out; ++o) {
+                const __m128i *t = (const __m128i *)(tables + (o * n_in + j) * EC_TABLE_BYTES);
+                acc[o] = _mm_xor_si128(acc[o], _mm_shuffle_epi8(_mm_loadu_si128(t), lo));
+                acc[o] = _mm_xor_si128(acc[o], _mm_shuffle_epi8(_mm_loadu_si128(t + 1), hi));
+            }
+        }
+        for (int o = 0; o < n_out; ++o) {
+            _mm_storeu_si128((__m128i *)(out[o] + offset + i), acc[o]);
+        }
+    }
+    if (i < bytes) {
+        ec_dot_scalar(n_in, n_out, tables, in, out, offset + i, bytes - i);
+    }
+}
+
+TARGET_AVX2 static INLINE void ec_dot_n_avx2(int n_in, const int n_out, const u8 *tables,
+                                             u8 *const *in, u8 *const *out, size_t offset,
+                                             size_t bytes) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    size_t i;
+
+    for (i = 0; i + 32 <= bytes; i += 32) {
+        __m256i acc[EC_GROUP];
+        for (int o = 0; o < n_out; ++o) {
+            acc[o] = _mm256_setzero_si256();
+        }
+        for (int j = 0; j < n_in; ++j) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(in[j] + offset + i));
+            __m256i lo = _mm256_and_si256(x, nibble);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi64(x, 4), nibble);
+            for (int o = 0; o < n_out; ++o) {
+                // The 16 products are looked up in both 128-bit lanes
+                const __m128i *t = (const __m128i *)(tables + (o * n_in + j) * EC_TABLE_BYTES);
+                __m256i t_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128(t));
+                __m256i t_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128(t + 1));
+                acc[o] = _mm256_xor_si256(acc[o], _mm256_shuffle_epi8(t_lo, lo));
+                acc[o] = _mm256_xor_si256(acc[o], _mm256_shuffle_epi8(t_hi, hi));
+            }
+        }
+        for (int o = 0; o < n_out; ++o) {
+            _mm256_storeu_si256((__m256i *)(out[o] + offset + i), acc[o]);
+        }
+    }
+    if (i < bytes) {
+        ec_dot_scalar(n_in, n_out, tables, in, out, offset + i, bytes - i);
+    }
+}
+#elif defined(__aarch64__)
+static INLINE void ec_dot_n_neon(int n_in, const int n_out, const u8 *tables, u8 *const *in,
+                                 u8 *const *out, size_t offset, size_t bytes) {
+    const uint8x16_t nibble = vdupq_n_u8(0x0F);
+    size_t i;
+
+    for (i = 0; i + 16 <= bytes; i += 16) {
+        uint8x16_t acc[EC_GROUP];
+        for (int o = 0; o < n_out; ++o) {
+            acc[o] = vdupq_n_u8(0);
+        }
+        for (int j = 0; j < n_in; ++j) {
+            uint8x16_t x = vld1q_u8(in[j] + offset + i);
+            uint8x16_t lo = vandq_u8(x, nibble), hi = vshrq_n_u8(x, 4);
+            for (int o = 0; o < n_out; ++o) {
+                const u8 *t = tables + (o * n_in + j) * EC_TABLE_BYTES;
+                acc[o] = veorq_u8(acc[o], vqtbl1q_u8(vld1q_u8(t), lo));
+                acc[o] = veorq_u8(acc[o], vqtbl1q_u8(vld1q_u8(t + 16), hi));
+            }
+        }
+        for (int o = 0; o < n_out; ++o) {
+            vst1q_u8(out[o] + offset + i, acc[o]);
+        }
+    }
+    if (i < bytes) {
+        ec_dot_scalar(n_in, n_out, tables, in, out, offset + i, bytes - i);
+    }
+}
+#endif
+
+/* The number of outputs is a constant in each case, so that the accumulators
+ * are registers */
+#define EC_DOT(name, target)                                                                  \
+target static void ec_dot_##name(int n_in, int n_out, const u8 *tables, u8 *const *in,       \
+                                 u8 *const *out, size_t offset, size_t bytes) {               \
+    switch (n_out) {                                                                          \
+    case 1: ec_dot_n_##name(n_in, 1, tables, in, out, offset, bytes); break;                  \
+    case 2: ec_dot_n_##name(n_in, 2, tables, in, out, offset, bytes); break;                  \
+    case 3: ec_dot_n_##name(n_in, 3, tables, in, out, offset, bytes); break;                  \
+    default: ec_dot_n_##name(n_in, 4, tables, in, out, offset, bytes); break;                 \
+    }                                                                                         \
+}
+
+#if defined(__x86_64__)
+EC_DOT(ssse3, TARGET_SSSE3)
+EC_DOT(avx2, TARGET_AVX2)
+#elif defined(__aarch64__)
+EC_DOT(neon, )
+#endif
+
+static ec_dot_fn ec_dot_kernel = ec_dot_scalar;
+static const char *kernel_name = "scalar";
+
+void ec_init(void) {
+    gf_init();
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("ssse3")) {
+        ec_dot_kernel = ec_dot_ssse3;
+        kernel_name = "ssse3";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        ec_dot_kernel = ec_dot_avx2;
+        kernel_name = "avx2";
+    }
+#elif defined(__aarch64__)
+    // NEON is part of AArch64
+    ec_dot_kernel = ec_dot_neon;
+    kernel_name = "neon";
+#endif
+}
+
+const char *ec_kernels(void) {
+    return kernel_name;
+}
+
+/*-********
+ * Stripe *
+ *-********/
+
+typedef struct {
+    u8 *in[TSP_EC_MAX_SHARDS], *out[TSP_EC_MAX_SHARDS];
+    int n_in, n_out;
+    const u8 *tables; // [n_out][n_in]
+    size_t bytes, column;
+} ec_job_st;
+
+static void ec_column(void *ctx, int i, int worker) {
+    const ec_job_st *job = ctx;
+    size_t start = (size_t)i * job->column, end = start + job->column;
+
+    if (end > job->bytes) {
+        end = job->bytes;
+    }
+    for (size_t b = start; b < end; b += EC_BLOCK_BYTES) {
+        size_t len = end - b < EC_BLOCK_BYTES ? end - b : EC_BLOCK_BYTES;
+        for (int o = 0; o < job->n_out; o += EC_GROUP) {
+            int n = job->n_out - o < EC_GROUP ? job->n_out - o : EC_GROUP;
+            ec_dot_kernel(job->n_in, n, job->tables + o * job->n_in * EC_TABLE_BYTES, job->in,
+                          job->out + o, b, len);
+        }
+    }
+}
+
+/* Row of shard s in the generator matrix, the identity above the parity */
+static void ec_generator_row(const u8 *parity, int k, int s, u8 *row) {
+    if (s < k) {
+        memset(row, 0, k);
+        row[s] = 1;
+    } else {
+        memcpy(row, parity + (s - k) * k, k);
+    }
+}
+
+/* Computes the parity shards (encode) or the erased shards (reconstruct) of
+ * the stripe of k + m shards, with the m x k parity matrix */
+static int ec_code(u8 *stripe, size_t stripe_bytes, size_t bytes, size_t stride, int k, int m,
+                   const u8 *parity, u32 op, u64 erasures) {
+    static u8 tables[EC_MAX_PARITY * EC_TABLE_BYTES];
+    u8 rows[EC_MAX_PARITY], matrix[TSP_EC_MAX_SHARDS * TSP_EC_MAX_SHARDS];
+    int n = k + m, threads = parallel_threads();
+    u64 shards = n == 64 ? ~0ull : (1ull << n) - 1;
+    ec_job_st job;
+
+    if (stride < bytes) {
+        return -EINVAL;
+    }
+    if (stride > stripe_bytes || (n - 1) * stride + bytes > stripe_bytes) {
+        return -ENOSPC;
+    }
+
+    job.n_in = k;
+    job.n_out = 0;
+    if (op == TSP_EC_ENCODE) {
+        for (int s = 0; s < k; ++s) {
+            job.in[s] = stripe + s * stride;
+        }
+        for (int e = k; e < n; ++e) {
+            job.out[job.n_out++] = stripe + e * stride;
+        }
+        memcpy(rows, parity, m * k);
+    } else if (op == TSP_EC_RECONSTRUCT) {
+        if ((erasures & ~shards) || __builtin_popcountll(erasures) > m) {
+            return -EINVAL;
+        }
+        // The data is the inverse of the rows of the first k survivors times them
+        for (int s = 0, r = 0; r < k; ++s) {
+            if (!(erasures >> s & 1)) {
+                ec_generator_row(parity, k, s, matrix + r * k);
+                job.in[r++] = stripe + s * stride;
+            }
+        }
+        if (gf_invert(matrix, k)) {
+            return -EINVAL;
+        }
+        for (int e = 0; e < n; ++e) {
+            u8 *row = rows + job.n_out * k;
+            if (!(erasures >> e & 1)) {
+                continue;
+            }
+            if (e < k) {
+                memcpy(row, matrix + e * k, k);
+            } else {
+                for (int j = 0; j < k; ++j) {
+                    row[j] = 0;
+                    for (int t = 0; t < k; ++t) {
+                        row[j] ^= gf_mul(parity[(e - k) * k + t], matrix[t * k + j]);
+                    }
+                }
+            }
+            job.out[job.n_out++] = stripe + e * stride;
+        }
+    } else {
+        return -EINVAL;
+    }
+    if (!job.n_out || !bytes) {
+        return 0;
+    }
+
+    for (int i = 0; i < job.n_out * k; ++i) {
+        gf_tables(rows[i], tables + i * EC_TABLE_BYTES);
+    }
+    job.tables = tables;
+    job.bytes = bytes;
+    // Columns of 64 KiB, narrower for all the threads to work on small shards
+    job.column = EC_COLUMN_BYTES;
+    if (bytes / threads < job.column) {
+        job.column = (bytes / threads + EC_BLOCK_BYTES - 1) / EC_BLOCK_BYTES * EC_BLOCK_BYTES;
+        if (!job.column) {
+            job.column = EC_BLOCK_BYTES;
+        }
+    }
+    parallel_for((bytes + job.column - 1) / job.column, ec_column, &job);
+    return 0;
+}
+
+int ec_stripe(void *stripe, size_t stripe_bytes, size_t bytes, size_t stride, u32 options,
+              u64 erasures) {
+    u8 parity[EC_MAX_PARITY];
+    int k = options >> 8 & 0xFF, m = options >> 16 & 0xFF;
+
+    if (!k || !m || k + m > TSP_EC_MAX_SHARDS) {
+        return -EINVAL;
+    }
+    // Cauchy matrix, the rows and columns are distinct so i ^ j is never 0
+    for (int i = k; i < k + m; ++i) {
+        for (int j = 0; j < k; ++j) {
+            parity[(i - k) * k + j] = gf_inv(i ^ j);
+        }
+    }
+    return ec_code(stripe, stripe_bytes, bytes, stride, k, m, parity, options & 0xFF, erasures);
+}
+
+int ec_raid(void *stripe, size_t stripe_bytes, size_t bytes, size_t stride, u32 options,
+            u64 erasures) {
+    u8 parity[2 * TSP_EC_MAX_SHARDS];
+    int level = options >> 8 & 0xFF, k = options >> 16 & 0xFF, m = level == 6 ? 2 : 1;
+
+    if ((level != 5 && level != 6) || !k || k + m > TSP_EC_MAX_SHARDS) {
+        return -EINVAL;
+    }
+    // P is the XOR of the data disks, Q the sum of g^j times data disk j
+    for (int j = 0; j < k; ++j) {
+        parity[j] = 1;
+        parity[k + j] = gf_exp[j];
+    }
+    return ec_code(stripe, stripe_bytes, bytes, stride, k, m, parity, options & 0xFF, erasures);
+}
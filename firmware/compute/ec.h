@@ -0,0 +1,62 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __EC_H__
+#define __EC_H__
+
+#include <stddef.h>
+#include "tsp.h"
+
+/**
+ * @brief Builds the GF(2^8) tables and selects the kernels for the CPU
+ * */
+void ec_init(void);
+
+/**
+ * @brief Returns the names of the selected kernels
+ * */
+const char *ec_kernels(void);
+
+/**
+ * @brief Encodes or reconstructs a Reed-Solomon stripe (EC)
+ * @param[in,out] stripe : k data shards followed by m parity shards, stride
+ * bytes apart, in a buffer of stripe_bytes
+ * @param[in] bytes : Bytes of a shard
+ * @param[in] options : TSP_EC_OPTIONS() (see tsp.h)
+ * @param[in] erasures : Shards to rebuild (bit i for shard i)
+ * @return 0, -EINVAL if the options, stride or erasures are invalid, -ENOSPC
+ * if the shards are not in the buffer
+ * */
+int ec_stripe(void *stripe, size_t stripe_bytes, size_t bytes, size_t stride, u32 options,
+              u64 erasures);
+
+/**
+ * @brief Encodes or reconstructs a RAID 5 or RAID 6 stripe, as ec_stripe()
+ * @param[in] options : TSP_RAID_OPTIONS() (see tsp.h)
+ * */
+int ec_raid(void *stripe, size_t stripe_bytes, size_t bytes, size_t stride, u32 options,
+            u64 erasures);
+
+#endif /* __EC_H__ */
@@ -0,0 +1,759 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Predicate pushdown (DbFilter). The records are evaluated by batches of
+ * FILTER_BATCH : the columns a comparison needs are extracted (or parsed from
+ * the text) into arrays of the batch, the comparison produces a bitmask of the
+ * batch that the logical operations combine word by word. The data is split
+ * in chunks of whole records that the workers of the pool (parallel.h) scan,
+ * each chunk collects its matches, which are then written out in order.
+ * */
+
+#include "filter.h"
+#include "parallel.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILTER_BATCH 1024
+#define FILTER_WORDS (FILTER_BATCH / 64)
+#define FILTER_CHUNK_BYTES (1 << 20) /* data scanned by a worker at a time */
+#define FILTER_MAX_FIELDS 1024       /* fields of a text line that can be compared */
+
+/* Validated program */
+typedef struct {
+    const u8 *base;
+    size_t bytes;
+    const TspFilterProgram *hdr;
+    const TspFilterColumn *col;
+    const TspFilterInstr *ins;
+    u32 text_fields; /* fields of a text line to split, last compared field + 1 */
+} filter_prog_st;
+
+typedef struct {
+    u64 offset; /* of the record in the data */
+    u32 bytes;  /* of the record, with the end of line */
+    u32 index;  /* of the record in its chunk */
+} filter_match_st;
+
+typedef struct {
+    size_t start; /* whole records [start, end) of the data */
+    size_t end;
+    u64 records;
+    filter_match_st *match;
+    size_t num_matches;
+    size_t max_matches;
+    int error;
+} filter_chunk_st;
+
+typedef union {
+    s64 i[FILTER_BATCH];
+    u64 u[FILTER_BATCH];
+    double f[FILTER_BATCH];
+} filter_values_u;
+
+/* Batch of a worker */
+typedef struct {
+    int n;
+    const u8 *rec[FILTER_BATCH];  /* start of the records */
+    u32 len[FILTER_BATCH];        /* text lines without the end of line */
+    u32 bytes[FILTER_BATCH];      /* records with the end of line */
+    s32 field[TSP_FILTER_MAX_COLUMNS][FILTER_BATCH]; /* offset in the line, -1 if missing */
+    u32 field_len[TSP_FILTER_MAX_COLUMNS][FILTER_BATCH];
+    u32 ready;                    /* bit c set if the values of column c are extracted */
+    filter_values_u values[TSP_FILTER_MAX_COLUMNS];
+    u64 valid[TSP_FILTER_MAX_COLUMNS][FILTER_WORDS]; /* text values that parsed */
+    u64 stack[TSP_FILTER_MAX_DEPTH][FILTER_WORDS];
+    u32 split_start[FILTER_MAX_FIELDS];
+    u32 split_len[FILTER_MAX_FIELDS];
+} filter_batch_st;
+
+static filter_batch_st **filter_batches;
+
+int filter_init(void) {
+    int n = parallel_threads();
+
+    filter_batches = calloc(n, sizeof(*filter_batches));
+    if (!filter_batches) {
+        return -1;
+    }
+    for (int i = 0; i < n; ++i) {
+        filter_batches[i] = malloc(sizeof(filter_batch_st));
+        if (!filter_batches[i]) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*-*********
+ * Program *
+ *-*********/
+
+static size_t filter_type_bytes(const TspFilterColumn *col) {
+    switch (col->Type) {
+    case TSP_FILTER_I32:
+    case TSP_FILTER_U32:
+    case TSP_FILTER_F32:
+        return 4;
+    case TSP_FILTER_I64:
+    case TSP_FILTER_U64:
+    case TSP_FILTER_F64:
+        return 8;
+    case TSP_FILTER_STR:
+        return col->Width;
+    default:
+        return 0;
+    }
+}
+
+static int filter_prog_check(filter_prog_st *p, const void *program, size_t bytes) {
+    const TspFilterProgram *hdr = program;
+    int depth = 0;
+
+    if (bytes < sizeof(*hdr) || hdr->NumColumns > TSP_FILTER_MAX_COLUMNS || !hdr->NumInstrs ||
+        hdr->NumInstrs > TSP_FILTER_MAX_INSTRS ||
+        bytes < sizeof(*hdr) + hdr->NumColumns * sizeof(TspFilterColumn) +
+                hdr->NumInstrs * sizeof(TspFilterInstr)) {
+        return -EINVAL;
+    }
+    if (hdr->Format == TSP_FILTER_FIXED ? !hdr->RecordBytes
+        : hdr->Format != TSP_FILTER_DELIMITED || hdr->Delimiter == '\n' || hdr->Delimiter == '"') {
+        return -EINVAL;
+    }
+
+    p->base = program;
+    p->bytes = bytes;
+    p->hdr = hdr;
+    p->col = (const TspFilterColumn *)(hdr + 1);
+    p->ins = (const TspFilterInstr *)(p->col + hdr->NumColumns);
+    p->text_fields = 0;
+
+    for (int i = 0; i < hdr->NumColumns; ++i) {
+        const TspFilterColumn *col = &p->col[i];
+        size_t size = filter_type_bytes(col);
+
+        if (!size && col->Type != TSP_FILTER_STR) {
+            return -EINVAL;
+        }
+        if (hdr->Format == TSP_FILTER_FIXED) {
+            if (!size || col->Offset > hdr->RecordBytes || size > hdr->RecordBytes - col->Offset) {
+                return -EINVAL;
+            }
+        } else if (col->Offset >= FILTER_MAX_FIELDS) {
+            return -EINVAL;
+        }
+    }
+
+    for (int i = 0; i < hdr->NumInstrs; ++i) {
+        const TspFilterInstr *ins = &p->ins[i];
+
+        switch (ins->Op) {
+        case TSP_FILTER_EQ:
+        case TSP_FILTER_NE:
+        case TSP_FILTER_LT:
+        case TSP_FILTER_LE:
+        case TSP_FILTER_GT:
+        case TSP_FILTER_GE:
+        case TSP_FILTER_PREFIX:
+            if (ins->Column >= hdr->NumColumns || depth == TSP_FILTER_MAX_DEPTH) {
+                return -EINVAL;
+            }
+            if (p->col[ins->Column].Type == TSP_FILTER_STR) {
+                if (ins->Value.Offset > bytes || ins->Length > bytes - ins->Value.Offset) {
+                    return -EINVAL;
+                }
+            } else if (ins->Op == TSP_FILTER_PREFIX) {
+                return -EINVAL;
+            }
+            if (hdr->Format == TSP_FILTER_DELIMITED &&
+                p->col[ins->Column].Offset + 1 > p->text_fields) {
+                p->text_fields = p->col[ins->Column].Offset + 1;
+            }
+            depth++;
+            break;
+        case TSP_FILTER_AND:
+        case TSP_FILTER_OR:
+            if (depth < 2) {
+                return -EINVAL;
+            }
+            depth--;
+            break;
+        case TSP_FILTER_NOT:
+            if (depth < 1) {
+                return -EINVAL;
+            }
+            break;
+        default:
+            return -EINVAL;
+        }
+    }
+    return depth == 1 ? 0 : -EINVAL;
+}
+
+/*-************
+ * Evaluation *
+ *-************/
+
+/* Bitmask of the comparison of the n values with c, masked by the valid
+ * values (if any) */
+#define FILTER_COMPARE(name, type)                                                      \
+static void name(const type *v, const u64 *valid, int n, int op, type c, u64 *mask) {   \
+    for (int k = 0; k < n; k += 64) {                                                   \
+        const type *x = v + k;                                                          \
+        int e = n - k < 64 ? n - k : 64;                                                \
+        u64 m = 0;                                                                      \
+        switch (op) {                                                                   \
+        case TSP_FILTER_EQ: for (int b = 0; b < e; ++b) m |= (u64)(x[b] == c) << b; break; \
+        case TSP_FILTER_NE: for (int b = 0; b < e; ++b) m |= (u64)(x[b] != c) << b; break; \
+        case TSP_FILTER_LT: for (int b = 0; b < e; ++b) m |= (u64)(x[b] < c) << b; break;  \
+        case TSP_FILTER_LE: for (int b = 0; b < e; ++b) m |= (u64)(x[b] <= c) << b; break; \
+        case TSP_FILTER_GT: for (int b = 0; b < e; ++b) m |= (u64)(x[b] > c) << b; break;  \
+        case TSP_FILTER_GE: for (int b = 0; b < e; ++b) m |= (u64)(x[b] >= c) << b; break; \
+        }                                                                               \
+        mask[k / 64] = valid ? m & valid[k / 64] : m;                                   \
+    }                                                                                   \
+}
+
+FILTER_COMPARE(filter_compare_s64, s64)
+FILTER_COMPARE(filter_compare_u64, u64)
+FILTER_COMPARE(filter_compare_f64, double)
+
+/* Parses a decimal integer (surrounded by spaces), returns -1 if it is not one */
+static int filter_parse_int(const u8 *p, u32 len, int is_signed, u64 *value) {
+    const u8 *end = p + len;
+    int negative = 0;
+    u64 v = 0;
+
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    while (end > p && end[-1] == ' ') {
+        end--;
+    }
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p++ == '-';
+    }
+    if (p == end || (negative && !is_signed)) {
+        return -1;
+    }
+    for (; p < end; ++p) {
+        u32 d = *p - '0';
+        if (d > 9 || v > (UINT64_MAX - d) / 10) {
+            return -1;
+        }
+        v = v * 10 + d;
+    }
+    if (is_signed) {
+        if (v > (u64)INT64_MAX + negative) {
+            return -1;
+        }
+        *value = negative ? -v : v;
+    } else {
+        *value = v;
+    }
+    return 0;
+}
+
+/* Plain decimals with up to 15 digits are exact as the quotient of two exact
+ * doubles, the others (exponents, long mantissas, inf, nan) go to strtod() */
+static int filter_parse_decimal(const u8 *p, u32 len, double *value) {
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                   1e11, 1e12, 1e13, 1e14, 1e15};
+    const u8 *end = p + len;
+    int negative = 0, digits = 0, decimals = -1;
+    u64 v = 0;
+
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    while (end > p && end[-1] == ' ') {
+        end--;
+    }
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p++ == '-';
+    }
+    for (; p < end; ++p) {
+        u32 d = *p - '0';
+        if (*p == '.' && decimals < 0) {
+            decimals = 0;
+            continue;
+        }
+        if (d > 9 || ++digits > 15) {
+            return -1;
+        }
+        v = v * 10 + d;
+        decimals += decimals >= 0;
+    }
+    if (!digits) {
+        return -1;
+    }
+    *value = decimals > 0 ? (double)v / pow10[decimals] : (double)v;
+    if (negative) {
+        *value = -*value;
+    }
+    return 0;
+}
+
+static int filter_parse_float(const u8 *p, u32 len, double *value) {
+    char buffer[64], *end;
+
+    if (!filter_parse_decimal(p, len, value)) {
+        return 0;
+    }
+    if (!len || len >= sizeof(buffer)) {
+        return -1;
+    }
+    memcpy(buffer, p, len);
+    buffer[len] = '\0';
+    *value = strtod(buffer, &end);
+    while (*end == ' ') {
+        end++;
+    }
+    return end == buffer || *end ? -1 : 0;
+}
+
+/* Extracts the values of a numeric column for the batch, as 64-bit values */
+static void filter_extract(const filter_prog_st *p, filter_batch_st *b, int c) {
+    const TspFilterColumn *col = &p->col[c];
+    filter_values_u *v = &b->values[c];
+
+    if (p->hdr->Format == TSP_FILTER_FIXED) {
+        for (int i = 0; i < b->n; ++i) {
+            const u8 *x = b->rec[i] + col->Offset;
+            union { s32 i32; u32 u32; float f32; u64 u64; double f64; } raw;
+
+            memcpy(&raw, x, filter_type_bytes(col));
+            switch (col->Type) {
+            case TSP_FILTER_I32: v->i[i] = raw.i32; break;
+            case TSP_FILTER_U32: v->u[i] = raw.u32; break;
+            case TSP_FILTER_F32: v->f[i] = raw.f32; break;
+            case TSP_FILTER_F64: v->f[i] = raw.f64; break;
+            default: v->u[i] = raw.u64; break;
+            }
+        }
+        return;
+    }
+
+    memset(b->valid[c], 0, sizeof(b->valid[c]));
+    for (int i = 0; i < b->n; ++i) {
+        const u8 *x = b->rec[i] + b->field[c][i];
+        u32 len = b->field_len[c][i];
+        int ret;
+
+        if (b->field[c][i] < 0) {
+            continue;
+        }
+        switch (col->Type) {
+        case TSP_FILTER_F32:
+        case TSP_FILTER_F64:
+            ret = filter_parse_float(x, len, &v->f[i]);
+            break;
+        default:
+            ret = filter_parse_int(x, len, col->Type == TSP_FILTER_I32 || col->Type == TSP_FILTER_I64,
+                                   &v->u[i]);
+            if (!ret && col->Type == TSP_FILTER_I32 && (v->i[i] < INT32_MIN || v->i[i] > INT32_MAX)) {
+                ret = -1;
+            }
+            if (!ret && col->Type == TSP_FILTER_U32 && v->u[i] > UINT32_MAX) {
+                ret = -1;
+            }
+            break;
+        }
+        if (!ret) {
+            b->valid[c][i / 64] |= 1ULL << (i % 64);
+        }
+    }
+}
+
+static int filter_compare_str(const u8 *x, u32 len, const u8 *c, u32 clen, int op) {
+    int r;
+
+    if (op == TSP_FILTER_PREFIX) {
+        return len >= clen && !memcmp(x, c, clen);
+    }
+    r = memcmp(x, c, len < clen ? len : clen);
+    if (!r) {
+        r = len < clen ? -1 : len > clen;
+    }
+    switch (op) {
+    case TSP_FILTER_EQ: return r == 0;
+    case TSP_FILTER_NE: return r != 0;
+    case TSP_FILTER_LT: return r < 0;
+    case TSP_FILTER_LE: return r <= 0;
+    case TSP_FILTER_GT: return r > 0;
+    default: return r >= 0;
+    }
+}
+
+static void filter_compare(const filter_prog_st *p, filter_batch_st *b, const TspFilterInstr *ins,
+                           u64 *mask) {
+    const TspFilterColumn *col = &p->col[ins->Column];
+    int fixed = p->hdr->Format == TSP_FILTER_FIXED;
+    const u64 *valid = fixed ? NULL : b->valid[ins->Column];
+
+    if (col->Type == TSP_FILTER_STR) {
+        const u8 *c = p->base + ins->Value.Offset;
+
+        memset(mask, 0, FILTER_WORDS * sizeof(u64));
+        for (int i = 0; i < b->n; ++i) {
+            const u8 *x;
+            u32 len;
+
+            if (fixed) {
+                x = b->rec[i] + col->Offset;
+                len = col->Width;
+                while (len && (x[len - 1] == '\0' || x[len - 1] == ' ')) {
+                    len--;
+                }
+            } else if (b->field[ins->Column][i] >= 0) {
+                x = b->rec[i] + b->field[ins->Column][i];
+                len = b->field_len[ins->Column][i];
+            } else {
+                continue;
+            }
+            if (filter_compare_str(x, len, c, ins->Length, ins->Op)) {
+                mask[i / 64] |= 1ULL << (i % 64);
+            }
+        }
+        return;
+    }
+
+    if (!(b->ready & (1u << ins->Column))) {
+        filter_extract(p, b, ins->Column);
+        b->ready |= 1u << ins->Column;
+    }
+    switch (col->Type) {
+    case TSP_FILTER_I32:
+    case TSP_FILTER_I64:
+        filter_compare_s64(b->values[ins->Column].i, valid, b->n, ins->Op, ins->Value.Int, mask);
+        break;
+    case TSP_FILTER_U32:
+    case TSP_FILTER_U64:
+        filter_compare_u64(b->values[ins->Column].u, valid, b->n, ins->Op, ins->Value.UInt, mask);
+        break;
+    default:
+        filter_compare_f64(b->values[ins->Column].f, valid, b->n, ins->Op, ins->Value.Float, mask);
+        break;
+    }
+}
+
+/* Runs the program on the batch, returns the selection */
+static const u64 *filter_eval(const filter_prog_st *p, filter_batch_st *b) {
+    int words = (b->n + 63) / 64, sp = 0;
+
+    b->ready = 0;
+    for (int i = 0; i < p->hdr->NumInstrs; ++i) {
+        const TspFilterInstr *ins = &p->ins[i];
+
+        switch (ins->Op) {
+        case TSP_FILTER_AND:
+            sp--;
+            for (int k = 0; k < words; ++k) {
+                b->stack[sp - 1][k] &= b->stack[sp][k];
+            }
+            break;
+        case TSP_FILTER_OR:
+            sp--;
+            for (int k = 0; k < words; ++k) {
+                b->stack[sp - 1][k] |= b->stack[sp][k];
+            }
+            break;
+        case TSP_FILTER_NOT:
+            for (int k = 0; k < words; ++k) {
+                b->stack[sp - 1][k] = ~b->stack[sp - 1][k];
+            }
+            if (b->n % 64) {
+                b->stack[sp - 1][words - 1] &= (1ULL << (b->n % 64)) - 1;
+            }
+            break;
+        default:
+            filter_compare(p, b, ins, b->stack[sp++]);
+            break;
+        }
+    }
+    return b->stack[0];
+}
+
+/*-******
+ * Text *
+ *-******/
+
+/* Splits the fields of a line up to the compared ones, a field in double
+ * quotes may hold the delimiter (the quotes are not part of its value) */
+static void filter_split(const filter_prog_st *p, filter_batch_st *b, int i) {
+    const u8 *line = b->rec[i];
+    u32 len = b->len[i], pos = 0, n = 0;
+    u8 delim = p->hdr->Delimiter;
+
+    while (n < p->text_fields && pos <= len) {
+        u32 start = pos, end;
+
+        if (pos < len && line[pos] == '"') {
+            const u8 *q;
+
+            start = ++pos;
+            while ((q = memchr(line + pos, '"', len - pos)) && q + 1 < line + len && q[1] == '"') {
+                pos = q - line + 2;
+            }
+            end = q ? (u32)(q - line) : len;
+            pos = q ? end + 1 : len;
+            while (pos < len && line[pos] != delim) {
+                pos++;
+            }
+        } else {
+            const u8 *d = memchr(line + pos, delim, len - pos);
+            end = d ? (u32)(d - line) : len;
+            pos = end;
+        }
+        b->split_start[n] = start;
+        b->split_len[n] = end - start;
+        n++;
+        pos++; // past the delimiter, beyond len if it was the last field
+    }
+
+    for (int c = 0; c < p->hdr->NumColumns; ++c) {
+        u32 f = p->col[c].Offset;
+
+        b->field[c][i] = f < n ? (s32)b->split_start[f] : -1;
+        b->field_len[c][i] = f < n ? b->split_len[f] : 0;
+    }
+}
+
+/*-******
+ * Scan *
+ *-******/
+
+typedef struct {
+    const filter_prog_st *prog;
+    const u8 *data;
+    filter_chunk_st *chunks;
+} filter_scan_st;
+
+static void filter_select(filter_chunk_st *chunk, const filter_batch_st *b, const u64 *sel,
+                          const u8 *data) {
+    for (int k = 0; k < (b->n + 63) / 64; ++k) {
+        for (u64 m = sel[k]; m; m &= m - 1) {
+            int i = k * 64 + __builtin_ctzll(m);
+            filter_match_st *match;
+
+            if (chunk->num_matches == chunk->max_matches) {
+                size_t max = chunk->max_matches ? chunk->max_matches * 2 : 256;
+                match = realloc(chunk->match, max * sizeof(*match));
+                if (!match) {
+                    chunk->error = -ENOMEM;
+                    return;
+                }
+                chunk->match = match;
+                chunk->max_matches = max;
+            }
+            match = &chunk->match[chunk->num_matches++];
+            match->offset = b->rec[i] - data;
+            match->bytes = b->bytes[i];
+            match->index = chunk->records + i;
+        }
+    }
+}
+
+static void filter_chunk(void *arg, int i, int worker) {
+    filter_scan_st *s = arg;
+    const filter_prog_st *p = s->prog;
+    filter_chunk_st *chunk = &s->chunks[i];
+    filter_batch_st *b = filter_batches[worker];
+    size_t pos = chunk->start;
+
+    while (pos < chunk->end && !chunk->error) {
+        if (p->hdr->Format == TSP_FILTER_FIXED) {
+            size_t n = (chunk->end - pos) / p->hdr->RecordBytes;
+
+            b->n = n < FILTER_BATCH ? n : FILTER_BATCH;
+            for (int j = 0; j < b->n; ++j) {
+                b->rec[j] = s->data + pos + (size_t)j * p->hdr->RecordBytes;
+                b->bytes[j] = p->hdr->RecordBytes;
+            }
+            pos += (size_t)b->n * p->hdr->RecordBytes;
+        } else {
+            for (b->n = 0; b->n < FILTER_BATCH && pos < chunk->end; b->n++) {
+                const u8 *line = s->data + pos;
+                const u8 *nl = memchr(line, '\n', chunk->end - pos);
+                u32 len = nl ? (u32)(nl - line) : (u32)(chunk->end - pos);
+
+                b->rec[b->n] = line;
+                b->bytes[b->n] = nl ? len + 1 : len;
+                b->len[b->n] = len && line[len - 1] == '\r' ? len - 1 : len;
+                pos += b->bytes[b->n];
+                filter_split(p, b, b->n);
+            }
+        }
+
+        filter_select(chunk, b, filter_eval(p, b), s->data);
+        chunk->records += b->n;
+    }
+}
+
+/* Start of the line after pos (the end if none) */
+static size_t filter_next_line(const u8 *data, size_t pos, size_t end) {
+    const u8 *nl = memchr(data + pos, '\n', end - pos);
+    return nl ? (size_t)(nl - data) + 1 : end;
+}
+
+/* Splits [start, end) in chunks of whole records, returns their number */
+static int filter_chunks(const filter_prog_st *p, const u8 *data, size_t start, size_t end,
+                         filter_chunk_st **chunks) {
+    size_t max = (end - start) / FILTER_CHUNK_BYTES + 1, chunk_bytes = FILTER_CHUNK_BYTES;
+    int n = 0;
+
+    if (p->hdr->Format == TSP_FILTER_FIXED) {
+        chunk_bytes = FILTER_CHUNK_BYTES / p->hdr->RecordBytes * p->hdr->RecordBytes;
+        if (!chunk_bytes) {
+            chunk_bytes = p->hdr->RecordBytes;
+            max = (end - start) / chunk_bytes + 1;
+        }
+    }
+    *chunks = calloc(max, sizeof(**chunks));
+    if (!*chunks) {
+        return -ENOMEM;
+    }
+
+    while (start < end) {
+        size_t next = end - start > chunk_bytes ? start + chunk_bytes : end;
+
+        if (p->hdr->Format == TSP_FILTER_DELIMITED && next < end) {
+            next = filter_next_line(data, next - 1, end);
+        }
+        (*chunks)[n].start = start;
+        (*chunks)[n].end = next;
+        n++;
+        start = next;
+    }
+    return n;
+}
+
+int filter_scan(const void *program, size_t program_bytes, const void *data, size_t data_bytes,
+                void *dst, size_t dst_bytes, TspFilterResult *result) {
+    filter_prog_st prog;
+    filter_scan_st scan = {.prog = &prog, .data = data};
+    int bitmap, n, ret = 0;
+    size_t start = 0, end = data_bytes;
+    u8 *out = dst;
+
+    memset(result, 0, sizeof(*result));
+    ret = filter_prog_check(&prog, program, program_bytes);
+    if (ret || !data_bytes) {
+        return ret;
+    }
+    bitmap = prog.hdr->Flags & TSP_FILTER_BITMAP;
+
+    // Whole records only, at most 8 per byte of a bitmap
+    if (prog.hdr->Format == TSP_FILTER_FIXED) {
+        u64 records = data_bytes / prog.hdr->RecordBytes;
+        if (bitmap && records > (u64)dst_bytes * 8) {
+            records = (u64)dst_bytes * 8;
+        }
+        end = records * prog.hdr->RecordBytes;
+    } else {
+        if (prog.hdr->Flags & TSP_FILTER_SKIP_HEADER) {
+            start = filter_next_line(scan.data, 0, data_bytes);
+            if (start == data_bytes && scan.data[data_bytes - 1] != '\n') {
+                return -ENOSPC;
+            }
+        }
+        if (!(prog.hdr->Flags & TSP_FILTER_END)) {
+            while (end > start && scan.data[end - 1] != '\n') {
+                end--;
+            }
+        }
+        if (bitmap && end - start > (u64)dst_bytes * 8) {
+            size_t pos = start;
+            for (u64 i = 0; i < (u64)dst_bytes * 8 && pos < end; ++i) {
+                pos = filter_next_line(scan.data, pos, end);
+            }
+            end = pos;
+        }
+    }
+    result->InBytes = start;
+    if (start == end) {
+        return start ? 0 : -ENOSPC;
+    }
+
+    n = filter_chunks(&prog, scan.data, start, end, &scan.chunks);
+    if (n < 0) {
+        return n;
+    }
+    parallel_for(n, filter_chunk, &scan);
+
+    if (bitmap) {
+        u64 records = 0;
+        for (int i = 0; i < n; ++i) {
+            records += scan.chunks[i].records;
+        }
+        result->OutBytes = (records + 7) / 8;
+        memset(out, 0, result->OutBytes);
+    }
+
+    // The matches in order, up to the first that does not fit
+    for (int i = 0; i < n && !ret; ++i) {
+        filter_chunk_st *chunk = &scan.chunks[i];
+
+        if (chunk->error) {
+            ret = chunk->error;
+            break;
+        }
+        for (size_t j = 0; j < chunk->num_matches; ++j) {
+            const filter_match_st *m = &chunk->match[j];
+
+            if (bitmap) {
+                u64 r = result->Records + m->index;
+                out[r / 8] |= 1 << (r % 8);
+            } else if (m->bytes > dst_bytes - result->OutBytes) {
+                result->InBytes = m->offset;
+                result->Records += m->index;
+                ret = -ENOSPC;
+                break;
+            } else {
+                memcpy(out + result->OutBytes, scan.data + m->offset, m->bytes);
+                result->OutBytes += m->bytes;
+            }
+            result->Matches++;
+        }
+        if (!ret) {
+            result->InBytes = chunk->end;
+            result->Records += chunk->records;
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        free(scan.chunks[i].match);
+    }
+    free(scan.chunks);
+
+    // Running out of destination is not an error once records were scanned
+    if (ret == -ENOSPC && result->InBytes) {
+        ret = 0;
+    }
+    return ret;
+}
@@ -0,0 +1,50 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include <stddef.h>
+#include "tsp.h"
+
+/**
+ * @brief Allocates the batches of the workers, called once after
+ * parallel_init()
+ * @return 0, or -1 if there is not enough memory
+ * */
+int filter_init(void);
+
+/**
+ * @brief Scans the records of the data with the predicate program (a
+ * TspFilterProgram, see tsp.h), the chunks of the data are scanned in parallel
+ * and the matching records (or the selection bitmap) written to the
+ * destination in order
+ * @return 0, -EINVAL if the program is invalid, -ENOSPC if the data holds no
+ * whole record or the first matching record does not fit, -ENOMEM
+ * */
+int filter_scan(const void *program, size_t program_bytes, const void *data, size_t data_bytes,
+                void *dst, size_t dst_bytes, TspFilterResult *result);
+
+#endif /* __FILTER_H__ */
@@ -0,0 +1,527 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#include "functions.h"
+#include "checksum.h"
+#include "compress.h"
+#include "dedup.h"
+#include "ec.h"
+#include "filter.h"
+#include "groupby.h"
+#include "hash.h"
+#include "parallel.h"
+#include "regex.h"
+#include "sort.h"
+#include "tsp.h"
+#include "vector.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#define COMPUTE_MAX_FUNCTIONS 64
+/* Bits of the functions in CsCapabilities */
+#define COMPUTE_BIT_COMPRESSION 0
+#define COMPUTE_BIT_DECOMPRESSION 1
+#define COMPUTE_BIT_RAID 4
+#define COMPUTE_BIT_EC 5
+#define COMPUTE_BIT_DEDUP 6
+#define COMPUTE_BIT_HASH 7
+#define COMPUTE_BIT_CHECKSUM 8
+#define COMPUTE_BIT_REGEX 9
+#define COMPUTE_BIT_DBFILTER 10
+#define COMPUTE_BIT_VECTOR_SEARCH 13 /* first CustomType bit */
+#define COMPUTE_BIT_SORT 14
+#define COMPUTE_BIT_GROUPBY 15
+
+typedef struct {
+    CS_FUNCTION_ID id;
+    const char *name;
+    compute_fn fn;
+} compute_function_st;
+
+static compute_function_st compute_functions[COMPUTE_MAX_FUNCTIONS];
+static int compute_num_functions;
+
+/*-***********
+ * Functions *
+ *-***********/
+
+/* Checksum of Args[1] bytes of Args[0] stored in Args[2], with the algorithm
+ * of Args[3] (TSP_CHECKSUM_SUM32 if not given) */
+static CS_STATUS compute_checksum(const CsComputeRequest *req, const compute_arg_st *args) {
+    u32 algorithm = TSP_CHECKSUM_SUM32, bytes, sum;
+    u64 hash;
+
+    if (req->NumArgs < 3 || !args[0].Ptr || !args[2].Ptr) {
+        return CS_INVALID_ARG;
+    }
+    bytes = req->Args[1].u.Value32;
+    if (bytes > args[0].Bytes) {
+        return CS_INVALID_LENGTH;
+    }
+    if (req->NumArgs > 3) {
+        algorithm = req->Args[3].u.Value32;
+    }
+
+    switch (algorithm) {
+    case TSP_CHECKSUM_SUM32:
+    case TSP_CHECKSUM_CRC32C:
+        if (args[2].Bytes < sizeof(sum)) {
+            return CS_INVALID_ARG;
+        }
+        sum = algorithm == TSP_CHECKSUM_SUM32 ? checksum_sum32(args[0].Ptr, bytes)
+                                              : checksum_crc32c(0, args[0].Ptr, bytes);
+        memcpy(args[2].Ptr, &sum, sizeof(sum));
+        return CS_SUCCESS;
+    case TSP_CHECKSUM_XXH3:
+        if (args[2].Bytes < sizeof(hash)) {
+            return CS_INVALID_ARG;
+        }
+        hash = checksum_xxh3(args[0].Ptr, bytes);
+        memcpy(args[2].Ptr, &hash, sizeof(hash));
+        return CS_SUCCESS;
+    default:
+        return CS_UNSUPPORTED;
+    }
+}
+
+/* Size given by a 32-bit or 64-bit value argument */
+static u64 compute_arg_size(const CsComputeArg *arg) {
+    return arg->Type == CS_64BIT_VALUE_TYPE ? arg->u.Value64 : arg->u.Value32;
+}
+
+static CS_STATUS compute_status(int ret) {
+    switch (ret) {
+    case 0:
+        return CS_SUCCESS;
+    case -EINVAL:
+        return CS_INVALID_ARG;
+    case -ENOSPC:
+        return CS_INVALID_LENGTH;
+    case -E2BIG:
+        return CS_OUT_OF_RESOURCES;
+    default:
+        return CS_ERROR_IN_EXECUTION;
+    }
+}
+
+/* Args[1] bytes of Args[0] (de)compressed in the Args[3] bytes of Args[2], the
+ * TspCompressionResult stored in Args[4]. The compression takes the algorithm
+ * and level as an optional Args[5] (TSP_COMPRESSION_LZ4 if not given). */
+static CS_STATUS compute_compression(const CsComputeRequest *req, const compute_arg_st *args,
+                                     int decompress) {
+    TspCompressionResult result;
+    u64 src_bytes, dst_bytes;
+    u32 options = TSP_COMPRESSION_LZ4;
+    size_t in, out;
+    int ret;
+
+    if (req->NumArgs < 5 || !args[0].Ptr || !args[2].Ptr || !args[4].Ptr ||
+        args[4].Bytes < sizeof(result)) {
+        return CS_INVALID_ARG;
+    }
+    src_bytes = compute_arg_size(&req->Args[1]);
+    dst_bytes = compute_arg_size(&req->Args[3]);
+    if (src_bytes > args[0].Bytes || dst_bytes > args[2].Bytes) {
+        return CS_INVALID_LENGTH;
+    }
+    if (req->NumArgs > 5) {
+        options = req->Args[5].u.Value32;
+    }
+
+    if (decompress) {
+        ret = decompress_frames(args[0].Ptr, src_bytes, args[2].Ptr, dst_bytes, &in, &out);
+    } else {
+        ret = compress_frames(options & 0xFF, (int32_t)options >> 8, args[0].Ptr, src_bytes,
+                              args[2].Ptr, dst_bytes, &in, &out);
+    }
+    if (ret) {
+        return compute_status(ret);
+    }
+
+    result.InBytes = in;
+    result.OutBytes = out;
+    memcpy(args[4].Ptr, &result, sizeof(result));
+    return CS_SUCCESS;
+}
+
+static CS_STATUS compute_compress(const CsComputeRequest *req, const compute_arg_st *args) {
+    return compute_compression(req, args, 0);
+}
+
+static CS_STATUS compute_decompress(const CsComputeRequest *req, const compute_arg_st *args) {
+    return compute_compression(req, args, 1);
+}
+
+/* Records of the Args[3] bytes of Args[2] that satisfy the predicate program
+ * of Args[1] bytes at Args[0], written in the Args[5] bytes of Args[4] (rows or
+ * bitmap), the TspFilterResult stored in Args[6] */
+static CS_STATUS compute_db_filter(const CsComputeRequest *req, const compute_arg_st *args) {
+    TspFilterResult result;
+    u64 program_bytes, data_bytes, dst_bytes;
+    int ret;
+
+    if (req->NumArgs < 7 || !args[0].Ptr || !args[2].Ptr || !args[4].Ptr || !args[6].Ptr ||
+        args[6].Bytes < sizeof(result)) {
+        return CS_INVALID_ARG;
+    }
+    program_bytes = compute_arg_size(&req->Args[1]);
+    data_bytes = compute_arg_size(&req->Args[3]);
+    dst_bytes = compute_arg_size(&req->Args[5]);
+    if (program_bytes > args[0].Bytes || data_bytes > args[2].Bytes || dst_bytes > args[4].Bytes) {
+        return CS_INVALID_LENGTH;
+    }
+
+    ret = filter_scan(args[0].Ptr, program_bytes, args[2].Ptr, data_bytes, args[4].Ptr, dst_bytes,
+                      &result);
+    if (ret) {
+        return compute_status(ret);
+    }
+    memcpy(args[6].Ptr, &result, sizeof(result));
+    return CS_SUCCESS;
+}
+
+/* Content defined chunks of the Args[1] bytes of Args[0], their table written
+ * in the Args[3] bytes of Args[2], the TspDedupResult stored in Args[4], with
+ * the options of an optional Args[5] */
+static CS_STATUS compute_dedup(const CsComputeRequest *req, const compute_arg_st *args) {
+    TspDedupResult result;
+    u64 data_bytes, dst_bytes;
+    u32 options = 0;
+    int ret;
+
+    if (req->NumArgs < 5 || !args[0].Ptr || !args[2].Ptr || !args[4].Ptr ||
+        args[4].Bytes < sizeof(result)) {
+        return CS_INVALID_ARG;
+    }
+    data_bytes = compute_arg_size(&req->Args[1]);
+    dst_bytes = compute_arg_size(&req->Args[3]);
+    if (data_bytes > args[0].Bytes || dst_bytes > args[2].Bytes) {
+        return CS_INVALID_LENGTH;
+    }
+    if (req->NumArgs > 5) {
+        options = req->Args[5].u.Value32;
+    }
+
+    ret = dedup_chunks(args[0].Ptr, data_bytes, options, args[2].Ptr, dst_bytes, &result);
+    if (ret) {
+        return compute_status(ret);
+    }
+    memcpy(args[4].Ptr, &result, sizeof(result));
+    return CS_SUCCESS;
+}
+
+/* Digests of the Args[1] bytes of Args[0], or of the extents that it lists,
+ * stored in Args[2], with the options of Args[3], one per object of an
+ * optional table of Args[5] objects at Args[4] */
+static CS_STATUS compute_hash(const CsComputeRequest *req, const compute_arg_st *args) {
+    const TspHashObject *objects = NULL;
+    u64 data_bytes, num_objects = 1;
+
+    if (req->NumArgs < 4 || !args[0].Ptr || !args[2].Ptr) {
+        return CS_INVALID_ARG;
+    }
+    data_bytes = compute_arg_size(&req->Args[1]);
+    if (req->NumArgs > 5) {
+        objects = args[4].Ptr;
+        num_objects = compute_arg_size(&req->Args[5]);
+        if (!objects) {
+            return CS_INVALID_ARG;
+        }
+        if (num_objects > args[4].Bytes / sizeof(*objects)) {
+            return CS_INVALID_LENGTH;
+        }
+    }
+    if (data_bytes > args[0].Bytes || num_objects > args[2].Bytes / TSP_HASH_DIGEST_BYTES) {
+        return CS_INVALID_LENGTH;
+    }
+
+    return compute_status(hash_digests(req->Args[3].u.Value32, args[0].Ptr, data_bytes, objects,
+                                       objects ? num_objects : 0, args[2].Ptr));
+}
+
+/* k best vectors of the index of Args[1] bytes at Args[0] (or on the extents
+ * that it lists) for each of the Args[3] queries of Args[2], stored in
+ * Args[5], with the options of Args[4]. A build writes the index of the
+ * Args[3] vectors of Args[2], of Args[5] dimensions and the IDs of an optional
+ * Args[6], in Args[0]. */
+static CS_STATUS compute_vector_search(const CsComputeRequest *req, const compute_arg_st *args) {
+    u64 index_bytes, num;
+    u32 options, dim;
+
+    if (req->NumArgs < 6 || !args[0].Ptr || !args[2].Ptr) {
+        return CS_INVALID_ARG;
+    }
+    index_bytes = compute_arg_size(&req->Args[1]);
+    num = compute_arg_size(&req->Args[3]);
+    options = req->Args[4].u.Value32;
+    if (index_bytes > args[0].Bytes) {
+        return CS_INVALID_LENGTH;
+    }
+
+    if ((options & 0xF) == TSP_VECTOR_SEARCH) {
+        if (!args[5].Ptr) {
+            return CS_INVALID_ARG;
+        }
+        return compute_status(vector_search(args[0].Ptr, index_bytes, args[2].Ptr, args[2].Bytes,
+                                            num, options, args[5].Ptr, args[5].Bytes));
+    }
+    if ((options & 0xF) != TSP_VECTOR_BUILD) {
+        return CS_INVALID_ARG;
+    }
+    dim = req->Args[5].u.Value32;
+    if (req->NumArgs > 6 && (!args[6].Ptr || num > args[6].Bytes / sizeof(u64))) {
+        return args[6].Ptr ? CS_INVALID_LENGTH : CS_INVALID_ARG;
+    }
+    if (dim && num > args[2].Bytes / sizeof(float) / dim) {
+        return CS_INVALID_LENGTH;
+    }
+    return compute_status(vector_build(args[0].Ptr, index_bytes, args[2].Ptr, num, dim, options,
+                                       req->NumArgs > 6 ? args[6].Ptr : NULL));
+}
+
+/* Records of the Args[3] bytes of Args[2] sorted in place by the spec of
+ * Args[1] bytes at Args[0], kept as a run of a session or the next records of
+ * the merge of its runs, with the options of Args[4] and the TspSortResult
+ * stored in Args[5]. A new session keeps its runs on the extents of Args[7]
+ * bytes at the optional Args[6]. */
+static CS_STATUS compute_sort(const CsComputeRequest *req, const compute_arg_st *args) {
+    TspSortResult result;
+    const void *scratch = NULL;
+    u64 spec_bytes, data_bytes, scratch_bytes = 0;
+    int ret;
+
+    if (req->NumArgs < 6 || !args[0].Ptr || !args[2].Ptr || !args[5].Ptr ||
+        args[5].Bytes < sizeof(result)) {
+        return CS_INVALID_ARG;
+    }
+    spec_bytes = compute_arg_size(&req->Args[1]);
+    data_bytes = compute_arg_size(&req->Args[3]);
+    if (spec_bytes > args[0].Bytes || data_bytes > args[2].Bytes) {
+        return CS_INVALID_LENGTH;
+    }
+    if (req->NumArgs > 7) {
+        scratch = args[6].Ptr;
+        scratch_bytes = compute_arg_size(&req->Args[7]);
+        if (!scratch) {
+            return CS_INVALID_ARG;
+        }
+        if (scratch_bytes > args[6].Bytes) {
+            return CS_INVALID_LENGTH;
+        }
+    }
+
+    ret = sort_request(args[0].Ptr, spec_bytes, args[2].Ptr, data_bytes, req->Args[4].u.Value32,
+                       scratch, scratch_bytes, &result);
+    if (ret) {
+        return compute_status(ret);
+    }
+    memcpy(args[5].Ptr, &result, sizeof(result));
+    return CS_SUCCESS;
+}
+
+/* Records of the Args[3] bytes of Args[2] aggregated in the groups of a
+ * session by the spec of Args[1] bytes at Args[0], or its next groups written
+ * in Args[2], with the options of Args[4] and the TspGroupByResult stored in
+ * Args[5] */
+static CS_STATUS compute_group_by(const CsComputeRequest *req, const compute_arg_st *args) {
+    TspGroupByResult result;
+    u64 spec_bytes, data_bytes;
+    int ret;
+
+    if (req->NumArgs < 6 || !args[0].Ptr || !args[2].Ptr || !args[5].Ptr ||
+        args[5].Bytes < sizeof(result)) {
+        return CS_INVALID_ARG;
+    }
+    spec_bytes = compute_arg_size(&req->Args[1]);
+    data_bytes = compute_arg_size(&req->Args[3]);
+    if (spec_bytes > args[0].Bytes || data_bytes > args[2].Bytes) {
+        return CS_INVALID_LENGTH;
+    }
+
+    ret = groupby_request(args[0].Ptr, spec_bytes, args[2].Ptr, data_bytes,
+                          req->Args[4].u.Value32, &result);
+    if (ret) {
+        return compute_status(ret);
+    }
+    memcpy(args[5].Ptr, &result, sizeof(result));
+    return CS_SUCCESS;
+}
+
+/* Parity of the stripe of Args[0] computed, or its shards of the Args[3]
+ * erasures rebuilt, with the code and operation of Args[2]. The shards are of
+ * Args[1] bytes and Args[4] bytes apart (Args[1] if not given). */
+static CS_STATUS compute_parity(const CsComputeRequest *req, const compute_arg_st *args, int raid) {
+    u64 bytes, stride, erasures = 0;
+    u32 options;
+    int ret;
+
+    if (req->NumArgs < 3 || !args[0].Ptr) {
+        return CS_INVALID_ARG;
+    }
+    bytes = compute_arg_size(&req->Args[1]);
+    options = req->Args[2].u.Value32;
+    if (req->NumArgs > 3) {
+        erasures = compute_arg_size(&req->Args[3]);
+    }
+    stride = req->NumArgs > 4 ? compute_arg_size(&req->Args[4]) : bytes;
+
+    if (raid) {
+        ret = ec_raid(args[0].Ptr, args[0].Bytes, bytes, stride, options, erasures);
+    } else {
+        ret = ec_stripe(args[0].Ptr, args[0].Bytes, bytes, stride, options, erasures);
+    }
+    return compute_status(ret);
+}
+
+static CS_STATUS compute_ec(const CsComputeRequest *req, const compute_arg_st *args) {
+    return compute_parity(req, args, 0);
+}
+
+static CS_STATUS compute_raid(const CsComputeRequest *req, const compute_arg_st *args) {
+    return compute_parity(req, args, 1);
+}
+
+/* Matches of the patterns of the set of Args[1] bytes at Args[0] in the
+ * Args[3] bytes of Args[2], written in the Args[5] bytes of Args[4], the
+ * TspRegexResult stored in Args[6], from the State of an optional Args[7] */
+static CS_STATUS compute_regex(const CsComputeRequest *req, const compute_arg_st *args) {
+    TspRegexResult result;
+    u64 set_bytes, data_bytes, dst_bytes;
+    u32 state = 0;
+    int ret;
+
+    if (req->NumArgs < 7 || !args[0].Ptr || !args[2].Ptr || !args[4].Ptr || !args[6].Ptr ||
+        args[6].Bytes < sizeof(result)) {
+        return CS_INVALID_ARG;
+    }
+    set_bytes = compute_arg_size(&req->Args[1]);
+    data_bytes = compute_arg_size(&req->Args[3]);
+    dst_bytes = compute_arg_size(&req->Args[5]);
+    if (set_bytes > args[0].Bytes || data_bytes > args[2].Bytes || dst_bytes > args[4].Bytes) {
+        return CS_INVALID_LENGTH;
+    }
+    if (req->NumArgs > 7) {
+        state = req->Args[7].u.Value32;
+    }
+
+    ret = regex_search(args[0].Ptr, set_bytes, args[2].Ptr, data_bytes, args[4].Ptr, dst_bytes,
+                       state, &result);
+    if (ret) {
+        return compute_status(ret);
+    }
+    memcpy(args[6].Ptr, &result, sizeof(result));
+    return CS_SUCCESS;
+}
+
+/*-**********
+ * Registry *
+ *-**********/
+
+void compute_functions_init(void) {
+    checksum_init();
+    printf("Checksum kernels : %s\n", checksum_kernels());
+    if (compress_init() == 0) {
+        printf("Compression : %s, %d threads\n", compress_versions(), parallel_threads());
+        compute_register(COMPUTE_FUNCTION_ID_BASE + COMPUTE_BIT_COMPRESSION, "Compression",
+                         compute_compress);
+        compute_register(COMPUTE_FUNCTION_ID_BASE + COMPUTE_BIT_DECOMPRESSION, "Decompression",
+                         compute_decompress);
+    } else {
+        fprintf(stderr, "Not enough memory for the compression\n");
+    }
+
+    if (filter_init() == 0) {
+        compute_register(COMPUTE_FUNCTION_ID_BASE + COMPUTE_BIT_DBFILTER, "DbFilter",
+                         compute_db_filter);
+    } else {
+        fprintf(stderr, "Not enough memory for the scans\n");
+    }
+
+    if (dedup_init() == 0) {
+        compute_register(COMPUTE_FUNCTION_ID_BASE + COMPUTE_BIT_DEDUP, "Dedup", compute_dedup);
+    } else {
+        fprintf(stderr, "Could not set up SHA-256 for the chunk fingerprints\n");
+    }
+
+    if (hash_init() == 0) {
+        printf("Hash kernels : %s\n", hash_kernels());
+        compute_register(COMPUTE_FUNCTION_ID_BASE + COMPUTE_BIT_HASH, "Hash", compute_hash);
+    } else {
+        fprintf(stderr, "Not enough memory for the digests\n");
+    }
+
+    if (vector_init() == 0) {
+        printf("Vector search kernels : %s\n", vector_kernels());
+        compute_register(COMPUTE_FUNCTION_ID_BASE + COMPUTE_BIT_VECTOR_SEARCH, "VectorSearch",
+                         compute_vector_search);
+    } else {
+        fprintf(stderr, "Not enough memory for the vector search\n");
+    }
+
+    ec_init();
+    printf("Erasure coding kernels : %s\n", ec_kernels());
+    compute_register(COMPUTE_FUNCTION_ID_BASE + COMPUTE_BIT_RAID, "RAID", compute_raid);
+    compute_register(COMPUTE_FUNCTION_ID_BASE + COMPUTE_BIT_EC, "EC", compute_ec);
+    compute_register(COMPUTE_FUNCTION_ID_BASE + COMPUTE_BIT_REGEX, "RegEx", compute_regex);
+    compute_register(COMPUTE_FUNCTION_ID_BASE + COMPUTE_BIT_CHECKSUM, "Checksum", compute_checksum);
+    compute_register(COMPUTE_FUNCTION_ID_BASE + COMPUTE_BIT_SORT, "Sort", compute_sort);
+    compute_register(COMPUTE_FUNCTION_ID_BASE + COMPUTE_BIT_GROUPBY, "GroupBy", compute_group_by);
+}
+
+int compute_register(CS_FUNCTION_ID id, const char *name, compute_fn fn) {
+    int i;
+
+    for (i = 0; i < compute_num_functions; ++i) {
+        if (compute_functions[i].id == id) {
+            break;
+        }
+    }
+    if (i == COMPUTE_MAX_FUNCTIONS) {
+        return -1;
+    }
+    compute_functions[i] = (compute_function_st) {
+        .id = id,
+        .name = name,
+        .fn = fn,
+    };
+    if (i == compute_num_functions) {
+        compute_num_functions++;
+    }
+    return 0;
+}
+
+compute_fn compute_lookup(CS_FUNCTION_ID id, const char **name) {
+    for (int i = 0; i < compute_num_functions; ++i) {
+        if (compute_functions[i].id == id) {
+            if (name) {
+                *name = compute_functions[i].name;
+            }
+            return compute_functions[i].fn;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,67 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __FUNCTIONS_H__
+#define __FUNCTIONS_H__
+
+#include "cs.h"
+
+/* A function of bit n of CsCapabilities has the ID COMPUTE_FUNCTION_ID_BASE + n,
+ * as in the emulator of the host library, the kernel of the CSD answers the
+ * function ID queries (TSP_CS_FUN) with the same IDs */
+#define COMPUTE_FUNCTION_ID_BASE 1
+
+/* Daemon view of an argument of a request */
+typedef struct {
+    void *Ptr; /* FDM arguments, NULL for values */
+    u64 Bytes; /* of FDM from Ptr to the end of the FDM */
+} compute_arg_st;
+
+/**
+ * @brief Implementation of a compute function
+ * @param[in] req : The request, as received from the host
+ * @param[in] args : Daemon view of the req->NumArgs arguments
+ * @return CS_SUCCESS, any other status fails the request
+ * */
+typedef CS_STATUS (*compute_fn)(const CsComputeRequest *req, const compute_arg_st *args);
+
+/**
+ * @brief Registers the built-in functions and selects their kernels, called
+ * after parallel_init()
+ * */
+void compute_functions_init(void);
+
+/**
+ * @brief Adds (or replaces) a function
+ * @return 0, or -1 if the table is full
+ * */
+int compute_register(CS_FUNCTION_ID id, const char *name, compute_fn fn);
+
+/**
+ * @brief Returns the implementation of a function, NULL if unknown
+ * */
+compute_fn compute_lookup(CS_FUNCTION_ID id, const char **name);
+
+#endif /* __FUNCTIONS_H__ */
@@ -0,0 +1,470 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Aggregation of fixed-width records by key (GroupBy).
+ *
+ * The groups of a session are split in partitions by the hash of their keys,
+ * each partition has its open addressing table and its rows, in the format of
+ * the output. The workers hash chunks of the records and count them in each
+ * partition, the records are then ordered by partition (as a radix sort pass)
+ * and each worker updates the groups of whole partitions, no two workers share
+ * a table.
+ * */
+
+#include "groupby.h"
+#include "parallel.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GROUPBY_PARTITIONS 64
+#define GROUPBY_PARTITION_SHIFT 58 /* hash bits of the partition, the top ones */
+#define GROUPBY_CHUNK (16 << 10)   /* records hashed by a worker at a time */
+#define GROUPBY_MIN_SLOTS 1024
+#define GROUPBY_MAX_KEY (TSP_GROUPBY_MAX_COLUMNS * 256)
+
+#define INLINE inline __attribute__((always_inline))
+
+typedef struct {
+    u32 record_bytes, num_keys, num_aggregates;
+    TspFilterColumn columns[TSP_GROUPBY_MAX_COLUMNS];
+    u32 key_bytes, key_padded, row_bytes;
+} groupby_spec_st;
+
+typedef struct {
+    u8 *rows;
+    u64 num_rows, max_rows;
+    u32 *slots;   /* row + 1, 0 if empty */
+    u64 *hashes;  /* of the rows */
+    u64 mask;     /* slots - 1 */
+} groupby_partition_st;
+
+typedef struct {
+    int active;
+    groupby_spec_st spec;
+    groupby_partition_st parts[GROUPBY_PARTITIONS];
+    u32 part, row; /* next group written */
+} groupby_session_st;
+
+static groupby_session_st groupby_sessions[TSP_GROUPBY_MAX_SESSIONS];
+
+static u32 groupby_column_width(const TspFilterColumn *column) {
+    switch (column->Type) {
+    case TSP_FILTER_I32:
+    case TSP_FILTER_U32:
+    case TSP_FILTER_F32:
+        return 4;
+    case TSP_FILTER_I64:
+    case TSP_FILTER_U64:
+    case TSP_FILTER_F64:
+        return 8;
+    case TSP_FILTER_STR:
+        return column->Width;
+    default:
+        return 0;
+    }
+}
+
+static int groupby_spec(groupby_spec_st *spec, const void *desc, size_t bytes) {
+    const TspGroupBySpec *s = desc;
+    u32 num_columns;
+
+    if (bytes < sizeof(*s)) {
+        return -EINVAL;
+    }
+    memset(spec, 0, sizeof(*spec));
+    spec->record_bytes = s->RecordBytes;
+    spec->num_keys = s->NumKeys;
+    spec->num_aggregates = s->NumAggregates;
+    num_columns = spec->num_keys + spec->num_aggregates;
+    if (!spec->record_bytes || !num_columns || num_columns > TSP_GROUPBY_MAX_COLUMNS ||
+        num_columns > (bytes - sizeof(*s)) / sizeof(TspFilterColumn)) {
+        return -EINVAL;
+    }
+    memcpy(spec->columns, s->Columns, num_columns * sizeof(TspFilterColumn));
+    for (u32 i = 0; i < num_columns; ++i) {
+        u32 width = groupby_column_width(&spec->columns[i]);
+        if (!width || width > spec->record_bytes ||
+            spec->columns[i].Offset > spec->record_bytes - width ||
+            (i >= spec->num_keys && spec->columns[i].Type == TSP_FILTER_STR)) {
+            return -EINVAL;
+        }
+        spec->columns[i].Reserved = 0;
+        if (i < spec->num_keys) {
+            spec->key_bytes += width;
+        }
+    }
+    spec->key_padded = (spec->key_bytes + 7) & ~7u;
+    spec->row_bytes = TSP_GROUPBY_ROW_BYTES(spec->key_bytes, spec->num_aggregates);
+    return 0;
+}
+
+/* Key columns of the record, zero padded */
+static INLINE void groupby_key(const groupby_spec_st *spec, const u8 *record, u8 *key) {
+    u32 pos = 0;
+
+    for (u32 i = 0; i < spec->num_keys; ++i) {
+        u32 width = groupby_column_width(&spec->columns[i]);
+        memcpy(key + pos, record + spec->columns[i].Offset, width);
+        pos += width;
+    }
+    memset(key + pos, 0, spec->key_padded - pos);
+}
+
+static INLINE u64 groupby_hash(const groupby_spec_st *spec, const u8 *key) {
+    u64 h = 0x9E3779B97F4A7C15ULL, w;
+
+    for (u32 pos = 0; pos < spec->key_padded; pos += 8) {
+        memcpy(&w, key + pos, 8);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    return h ^ (h >> 33);
+}
+
+/*-*************
+ * Aggregation *
+ *-*************/
+
+/* Adds the record to the counts and aggregates of the row */
+static INLINE void groupby_update(const groupby_spec_st *spec, u8 *row, const u8 *record) {
+    u64 count;
+    u8 *agg = row + spec->key_padded + 8;
+
+    memcpy(&count, row + spec->key_padded, 8);
+    for (u32 i = 0; i < spec->num_aggregates; ++i, agg += 24) {
+        const TspFilterColumn *column = &spec->columns[spec->num_keys + i];
+        const u8 *p = record + column->Offset;
+
+        switch (column->Type) {
+        case TSP_FILTER_I32:
+        case TSP_FILTER_I64: {
+            s64 v, a[3];
+            if (column->Type == TSP_FILTER_I32) {
+                s32 v32;
+                memcpy(&v32, p, 4);
+                v = v32;
+            } else {
+                memcpy(&v, p, 8);
+            }
+            memcpy(a, agg, 24);
+            a[0] = count ? (s64)((u64)a[0] + (u64)v) : v;
+            a[1] = count && a[1] < v ? a[1] : v;
+            a[2] = count && a[2] > v ? a[2] : v;
+            memcpy(agg, a, 24);
+            break;
+        }
+        case TSP_FILTER_U32:
+        case TSP_FILTER_U64: {
+            u64 v, a[3];
+            if (column->Type == TSP_FILTER_U32) {
+                u32 v32;
+                memcpy(&v32, p, 4);
+                v = v32;
+            } else {
+                memcpy(&v, p, 8);
+            }
+            memcpy(a, agg, 24);
+            a[0] = count ? a[0] + v : v;
+            a[1] = count && a[1] < v ? a[1] : v;
+            a[2] = count && a[2] > v ? a[2] : v;
+            memcpy(agg, a, 24);
+            break;
+        }
+        default: {
+            double v, a[3];
+            if (column->Type == TSP_FILTER_F32) {
+                float f;
+                memcpy(&f, p, 4);
+                v = f;
+            } else {
+                memcpy(&v, p, 8);
+            }
+            memcpy(a, agg, 24);
+            a[0] = count ? a[0] + v : v;
+            a[1] = count && a[1] < v ? a[1] : v;
+            a[2] = count && a[2] > v ? a[2] : v;
+            memcpy(agg, a, 24);
+            break;
+        }
+        }
+    }
+    count++;
+    memcpy(row + spec->key_padded, &count, 8);
+}
+
+static void groupby_partition_free(groupby_partition_st *part) {
+    free(part->rows);
+    free(part->slots);
+    free(part->hashes);
+    memset(part, 0, sizeof(*part));
+}
+
+/* Doubles the slots of the table (or allocates them) */
+static int groupby_grow(groupby_partition_st *part) {
+    u64 num_slots = part->slots ? (part->mask + 1) * 2 : GROUPBY_MIN_SLOTS;
+    u32 *slots = calloc(num_slots, sizeof(*slots));
+
+    if (!slots || num_slots / 2 > UINT32_MAX) {
+        free(slots);
+        return -E2BIG;
+    }
+    for (u64 r = 0; r < part->num_rows; ++r) {
+        u64 s = part->hashes[r] & (num_slots - 1);
+        while (slots[s]) {
+            s = (s + 1) & (num_slots - 1);
+        }
+        slots[s] = r + 1;
+    }
+    free(part->slots);
+    part->slots = slots;
+    part->mask = num_slots - 1;
+    return 0;
+}
+
+/* Row of the group of the key, a new one if there is none */
+static u8 *groupby_find(const groupby_spec_st *spec, groupby_partition_st *part, const u8 *key,
+                        u64 h) {
+    u64 s;
+    u8 *row;
+
+    if (part->num_rows * 2 >= (part->slots ? part->mask + 1 : 0) && groupby_grow(part)) {
+        return NULL;
+    }
+    for (s = h & part->mask; part->slots[s]; s = (s + 1) & part->mask) {
+        u64 r = part->slots[s] - 1;
+        if (part->hashes[r] == h &&
+            !memcmp(part->rows + r * spec->row_bytes, key, spec->key_padded)) {
+            return part->rows + r * spec->row_bytes;
+        }
+    }
+
+    if (part->num_rows == part->max_rows) {
+        u64 max_rows = part->max_rows ? part->max_rows * 2 : GROUPBY_MIN_SLOTS / 2;
+        u8 *rows = realloc(part->rows, max_rows * spec->row_bytes);
+        u64 *hashes = rows ? realloc(part->hashes, max_rows * sizeof(*hashes)) : NULL;
+        if (rows) {
+            part->rows = rows;
+        }
+        if (!hashes) {
+            return NULL;
+        }
+        part->hashes = hashes;
+        part->max_rows = max_rows;
+    }
+    row = part->rows + part->num_rows * spec->row_bytes;
+    memcpy(row, key, spec->key_padded);
+    memset(row + spec->key_padded, 0, spec->row_bytes - spec->key_padded);
+    part->hashes[part->num_rows] = h;
+    part->slots[s] = ++part->num_rows;
+    return row;
+}
+
+typedef struct {
+    groupby_session_st *s;
+    const u8 *data;
+    u64 n;
+    u64 *hashes;
+    u64 (*counts)[GROUPBY_PARTITIONS]; /* records of each chunk in each partition */
+    u64 *order;                         /* indices of the records by partition */
+    u64 starts[GROUPBY_PARTITIONS + 1];
+    int error;
+} groupby_add_st;
+
+static void groupby_hash_chunk(void *ctx, int c, int worker) {
+    groupby_add_st *job = ctx;
+    const groupby_spec_st *spec = &job->s->spec;
+    u64 lo = (u64)c * GROUPBY_CHUNK, hi = lo + GROUPBY_CHUNK < job->n ? lo + GROUPBY_CHUNK : job->n;
+    u8 key[GROUPBY_MAX_KEY];
+
+    memset(job->counts[c], 0, sizeof(job->counts[c]));
+    for (u64 i = lo; i < hi; ++i) {
+        groupby_key(spec, job->data + i * spec->record_bytes, key);
+        job->hashes[i] = groupby_hash(spec, key);
+        job->counts[c][job->hashes[i] >> GROUPBY_PARTITION_SHIFT]++;
+    }
+}
+
+static void groupby_scatter_chunk(void *ctx, int c, int worker) {
+    groupby_add_st *job = ctx;
+    u64 lo = (u64)c * GROUPBY_CHUNK, hi = lo + GROUPBY_CHUNK < job->n ? lo + GROUPBY_CHUNK : job->n;
+    u64 *pos = job->counts[c]; /* first index of the chunk in each partition */
+
+    for (u64 i = lo; i < hi; ++i) {
+        job->order[pos[job->hashes[i] >> GROUPBY_PARTITION_SHIFT]++] = i;
+    }
+}
+
+static void groupby_add_partition(void *ctx, int p, int worker) {
+    groupby_add_st *job = ctx;
+    const groupby_spec_st *spec = &job->s->spec;
+    groupby_partition_st *part = &job->s->parts[p];
+    u8 key[GROUPBY_MAX_KEY];
+
+    for (u64 j = job->starts[p]; j < job->starts[p + 1]; ++j) {
+        const u8 *record = job->data + job->order[j] * spec->record_bytes;
+        u8 *row;
+
+        groupby_key(spec, record, key);
+        row = groupby_find(spec, part, key, job->hashes[job->order[j]]);
+        if (!row) {
+            __atomic_store_n(&job->error, -E2BIG, __ATOMIC_RELAXED);
+            return;
+        }
+        groupby_update(spec, row, record);
+    }
+}
+
+/* Aggregates the n records in the groups of the session */
+static int groupby_add(groupby_session_st *s, const u8 *data, u64 n) {
+    groupby_add_st job = {.s = s, .data = data, .n = n};
+    int chunks = (n + GROUPBY_CHUNK - 1) / GROUPBY_CHUNK;
+    u64 pos = 0;
+
+    if (!n) {
+        return 0;
+    }
+    job.hashes = malloc(n * sizeof(*job.hashes));
+    job.order = malloc(n * sizeof(*job.order));
+    job.counts = malloc(chunks * sizeof(*job.counts));
+    if (!job.hashes || !job.order || !job.counts) {
+        job.error = -ENOMEM;
+        goto out;
+    }
+    parallel_for(chunks, groupby_hash_chunk, &job);
+
+    // Records of each chunk in each partition to their first index in order
+    for (int p = 0; p < GROUPBY_PARTITIONS; ++p) {
+        job.starts[p] = pos;
+        for (int c = 0; c < chunks; ++c) {
+            u64 count = job.counts[c][p];
+            job.counts[c][p] = pos;
+            pos += count;
+        }
+    }
+    job.starts[GROUPBY_PARTITIONS] = pos;
+    parallel_for(chunks, groupby_scatter_chunk, &job);
+    parallel_for(GROUPBY_PARTITIONS, groupby_add_partition, &job);
+
+out:
+    free(job.hashes);
+    free(job.order);
+    free(job.counts);
+    return job.error;
+}
+
+/*-********
+ * Output *
+ *-********/
+
+static u64 groupby_groups(const groupby_session_st *s) {
+    u64 groups = 0;
+
+    for (int p = 0; p < GROUPBY_PARTITIONS; ++p) {
+        groups += s->parts[p].num_rows;
+    }
+    return groups;
+}
+
+static void groupby_session_end(groupby_session_st *s) {
+    for (int p = 0; p < GROUPBY_PARTITIONS; ++p) {
+        groupby_partition_free(&s->parts[p]);
+    }
+    memset(s, 0, sizeof(*s));
+}
+
+/* Writes the next groups of the session in out, as many as fit */
+static int groupby_output(groupby_session_st *s, u8 *out, u64 capacity, TspGroupByResult *result) {
+    const u32 row_bytes = s->spec.row_bytes;
+    u64 done = 0;
+
+    while (s->part < GROUPBY_PARTITIONS) {
+        const groupby_partition_st *part = &s->parts[s->part];
+        u64 n = part->num_rows - s->row;
+
+        n = n < capacity - done ? n : capacity - done;
+        if (n) {
+            memcpy(out + done * row_bytes, part->rows + (u64)s->row * row_bytes, n * row_bytes);
+        }
+        done += n;
+        s->row += n;
+        if (s->row < part->num_rows) {
+            break;
+        }
+        s->part++;
+        s->row = 0;
+    }
+    if (!done && s->part < GROUPBY_PARTITIONS) {
+        return -ENOSPC;
+    }
+    result->OutBytes = done * row_bytes;
+    result->Records = done;
+    result->Flags = s->part == GROUPBY_PARTITIONS ? TSP_GROUPBY_DONE : 0;
+    return 0;
+}
+
+int groupby_request(const void *spec_desc, size_t spec_bytes, void *data, size_t data_bytes,
+                    u32 options, TspGroupByResult *result) {
+    u32 op = options & 0xF, session = (options >> 8) & 0xFF;
+    groupby_session_st *s;
+    groupby_spec_st spec;
+    int ret;
+
+    memset(result, 0, sizeof(*result));
+    if (session >= TSP_GROUPBY_MAX_SESSIONS || op > TSP_GROUPBY_OUTPUT) {
+        return -EINVAL;
+    }
+    s = &groupby_sessions[session];
+    ret = groupby_spec(&spec, spec_desc, spec_bytes);
+    if (ret) {
+        return ret;
+    }
+    if (op == TSP_GROUPBY_ADD && ((options & TSP_GROUPBY_BEGIN) || !s->active)) {
+        groupby_session_end(s);
+        s->active = 1;
+        s->spec = spec;
+    } else if (!s->active || memcmp(&s->spec, &spec, sizeof(spec))) {
+        return -EINVAL;
+    }
+
+    if (op == TSP_GROUPBY_ADD) {
+        u64 n = data_bytes / spec.record_bytes;
+        ret = groupby_add(s, data, n);
+        result->InBytes = n * spec.record_bytes;
+        result->Records = n;
+    } else {
+        ret = groupby_output(s, data, data_bytes / spec.row_bytes, result);
+    }
+    result->Groups = groupby_groups(s);
+    // A destination too small for a group can be followed by a larger one
+    if ((ret && ret != -ENOSPC) || (result->Flags & TSP_GROUPBY_DONE)) {
+        groupby_session_end(s);
+    }
+    return ret;
+}
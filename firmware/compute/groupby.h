@@ -0,0 +1,45 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __GROUPBY_H__
+#define __GROUPBY_H__
+
+#include <stddef.h>
+#include "tsp.h"
+
+/**
+ * @brief Aggregates records in the groups of a session, or writes its groups
+ * (see TSP_GROUPBY_* in tsp.h)
+ * @param[in] spec : TspGroupBySpec of spec_bytes
+ * @param[in,out] data : The records, or the destination of the groups
+ * @param[in] options : TSP_GROUPBY_OPTIONS()
+ * @return 0, -EINVAL if the options or the spec are invalid (or not the one of
+ * the session), -ENOSPC if a group does not fit in the destination, -E2BIG if
+ * the groups do not fit in memory, -ENOMEM
+ * */
+int groupby_request(const void *spec, size_t spec_bytes, void *data, size_t data_bytes,
+                    u32 options, TspGroupByResult *result);
+
+#endif /* __GROUPBY_H__ */
@@ -0,0 +1,853 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Cryptographic digests (Hash), BLAKE3 and SHA-256.
+ *
+ * BLAKE3 is a tree : the chunks of 1 KiB are hashed independently and pairs of
+ * chaining values are merged up to the root. An aligned power of two of chunks
+ * is a subtree, so the data is split in pieces that the workers hash in
+ * parallel, and within a piece 8 chunks (or parents) at a time in the SIMD
+ * lanes, a lane per chunk. SHA-256 is sequential, the throughput comes from
+ * hashing 8 objects at a time in the lanes (multi-buffer), or from the SHA
+ * instructions of the CPU through OpenSSL when it has them.
+ *
+ * The lane kernels are written with the vector extensions of GCC, 8 lanes of
+ * 32 bits for AVX2 and 4 lanes for the base SIMD of the CPU (SSE2, NEON),
+ * selected at run time. SHA-256 on SSE2 stays with OpenSSL, which is faster
+ * than 4 lanes there.
+ *
+ * The data is in the FDM, or on a namespace that the workers read a window at
+ * a time with direct I/O, the data then never goes through the FDM.
+ * */
+
+#include "hash.h"
+#include "namespace.h"
+#include "parallel.h"
+
+#include <errno.h>
+#include <openssl/evp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#define HASH_WINDOW (1 << 20)           /* data hashed by a worker at a time */
+#define HASH_MIN_PIECE (16 << 10)       /* of the data split between the workers */
+#define HASH_LANES 8
+
+#define BLAKE3_CHUNK 1024
+#define BLAKE3_BLOCK 64
+#define BLAKE3_MAX_DEPTH 54
+#define BLAKE3_CHUNK_START (1 << 0)
+#define BLAKE3_CHUNK_END (1 << 1)
+#define BLAKE3_PARENT (1 << 2)
+#define BLAKE3_ROOT (1 << 3)
+
+#define INLINE inline __attribute__((always_inline))
+#define ROTR(x, n) ((x) >> (n) | (x) << (32 - (n)))
+
+static const u32 blake3_iv[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+static const u8 blake3_schedule[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+static const u32 sha256_k[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+/* SHA-256 starts from the same words as BLAKE3 */
+#define sha256_iv blake3_iv
+
+/* Works on scalars and on lanes */
+#define BLAKE3_G(v, a, b, c, d, x, y)      \
+    do {                                   \
+        v[a] += v[b] + (x);                \
+        v[d] = ROTR(v[d] ^ v[a], 16);      \
+        v[c] += v[d];                      \
+        v[b] = ROTR(v[b] ^ v[c], 12);      \
+        v[a] += v[b] + (y);                \
+        v[d] = ROTR(v[d] ^ v[a], 8);       \
+        v[c] += v[d];                      \
+        v[b] = ROTR(v[b] ^ v[c], 7);       \
+    } while (0)
+
+#define BLAKE3_ROUND(v, m, s)                                  \
+    do {                                                       \
+        BLAKE3_G(v, 0, 4, 8, 12, m[(s)[0]], m[(s)[1]]);        \
+        BLAKE3_G(v, 1, 5, 9, 13, m[(s)[2]], m[(s)[3]]);        \
+        BLAKE3_G(v, 2, 6, 10, 14, m[(s)[4]], m[(s)[5]]);       \
+        BLAKE3_G(v, 3, 7, 11, 15, m[(s)[6]], m[(s)[7]]);       \
+        BLAKE3_G(v, 0, 5, 10, 15, m[(s)[8]], m[(s)[9]]);       \
+        BLAKE3_G(v, 1, 6, 11, 12, m[(s)[10]], m[(s)[11]]);     \
+        BLAKE3_G(v, 2, 7, 8, 13, m[(s)[12]], m[(s)[13]]);      \
+        BLAKE3_G(v, 3, 4, 9, 14, m[(s)[14]], m[(s)[15]]);      \
+    } while (0)
+
+#define SHA256_S0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define SHA256_S1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SHA256_s0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SHA256_s1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+/*-*******
+ * Lanes *
+ *-*******/
+
+/* 4 lanes fill the 128-bit registers of SSE2 and NEON, 8 those of AVX2. The
+ * kernels take 8 inputs, the 4 lane kernels run twice. */
+typedef u32 lanes4_t __attribute__((vector_size(16)));
+typedef u32 lanes8_t __attribute__((vector_size(32)));
+typedef u8 lane_bytes4_t __attribute__((vector_size(16)));
+typedef u8 lane_bytes8_t __attribute__((vector_size(32)));
+
+#define SPLAT4(x) ((lanes4_t){(x), (x), (x), (x)})
+#define SPLAT8(x) ((lanes8_t){(x), (x), (x), (x), (x), (x), (x), (x)})
+
+/* Big endian words */
+#define BSWAP4(x) \
+    ((lanes4_t)__builtin_shuffle((lane_bytes4_t)(x), \
+        (lane_bytes4_t){3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12}))
+#define BSWAP8(x) \
+    ((lanes8_t)__builtin_shuffle((lane_bytes8_t)(x), \
+        (lane_bytes8_t){3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, \
+                        19, 18, 17, 16, 23, 22, 21, 20, 27, 26, 25, 24, 31, 30, 29, 28}))
+
+/* Rows of the words of each lane to the words across the lanes, and back */
+static INLINE void lanes4_transpose(lanes4_t *r) {
+    lanes4_t a0 = __builtin_shuffle(r[0], r[1], (lanes4_t){0, 4, 1, 5});
+    lanes4_t a1 = __builtin_shuffle(r[0], r[1], (lanes4_t){2, 6, 3, 7});
+    lanes4_t a2 = __builtin_shuffle(r[2], r[3], (lanes4_t){0, 4, 1, 5});
+    lanes4_t a3 = __builtin_shuffle(r[2], r[3], (lanes4_t){2, 6, 3, 7});
+
+    r[0] = __builtin_shuffle(a0, a2, (lanes4_t){0, 1, 4, 5});
+    r[1] = __builtin_shuffle(a0, a2, (lanes4_t){2, 3, 6, 7});
+    r[2] = __builtin_shuffle(a1, a3, (lanes4_t){0, 1, 4, 5});
+    r[3] = __builtin_shuffle(a1, a3, (lanes4_t){2, 3, 6, 7});
+}
+
+static INLINE void lanes8_transpose(lanes8_t *r) {
+    lanes8_t a[8], b[8];
+
+    for (int i = 0; i < 8; i += 2) {
+        a[i] = __builtin_shuffle(r[i], r[i + 1], (lanes8_t){0, 8, 1, 9, 4, 12, 5, 13});
+        a[i + 1] = __builtin_shuffle(r[i], r[i + 1], (lanes8_t){2, 10, 3, 11, 6, 14, 7, 15});
+    }
+    for (int i = 0; i < 8; i += 4) {
+        b[i] = __builtin_shuffle(a[i], a[i + 2], (lanes8_t){0, 1, 8, 9, 4, 5, 12, 13});
+        b[i + 1] = __builtin_shuffle(a[i], a[i + 2], (lanes8_t){2, 3, 10, 11, 6, 7, 14, 15});
+        b[i + 2] = __builtin_shuffle(a[i + 1], a[i + 3], (lanes8_t){0, 1, 8, 9, 4, 5, 12, 13});
+        b[i + 3] = __builtin_shuffle(a[i + 1], a[i + 3], (lanes8_t){2, 3, 10, 11, 6, 7, 14, 15});
+    }
+    for (int i = 0; i < 4; ++i) {
+        r[i] = __builtin_shuffle(b[i], b[i + 4], (lanes8_t){0, 1, 2, 3, 8, 9, 10, 11});
+        r[i + 4] = __builtin_shuffle(b[i], b[i + 4], (lanes8_t){4, 5, 6, 7, 12, 13, 14, 15});
+    }
+}
+
+/* The 16 words of the 64-byte blocks of the lanes, N words of a lane at a time */
+#define LANES_LOAD_BLOCKS(N)                                                        \
+static INLINE void lanes##N##_load_blocks(lanes##N##_t *m, const u8 *const *in,     \
+                                          size_t offset) {                          \
+    for (int g = 0; g < 16; g += N) {                                               \
+        for (int l = 0; l < N; ++l) {                                               \
+            memcpy(&m[g + l], in[l] + offset + 4 * g, sizeof(lanes##N##_t));       \
+        }                                                                           \
+        lanes##N##_transpose(m + g);                                                \
+    }                                                                               \
+}
+
+/* BLAKE3 compression of the blocks of N inputs, their chaining values in out,
+ * the counter of lane l is counter + l if increment. v is initialized for GCC,
+ * that does not see that the rounds write it first. */
+#define BLAKE3_LANES(N)                                                                     \
+static INLINE void blake3_lanes##N(const u8 *const *in, size_t blocks, u64 counter,          \
+                                   int increment, u32 flags, u32 flags_start,               \
+                                   u32 flags_end, u8 *out) {                                \
+    lanes##N##_t h[8], m[16], v[16] = {{0}}, counter_lo, counter_hi;                         \
+    u32 flags_block = flags | flags_start, lo[N], hi[N];                                     \
+                                                                                             \
+    for (int l = 0; l < N; ++l) {                                                            \
+        u64 c = counter + (increment ? l : 0);                                               \
+        lo[l] = (u32)c;                                                                      \
+        hi[l] = c >> 32;                                                                     \
+    }                                                                                        \
+    memcpy(&counter_lo, lo, sizeof(lo));                                                     \
+    memcpy(&counter_hi, hi, sizeof(hi));                                                     \
+    for (int i = 0; i < 8; ++i) {                                                            \
+        h[i] = SPLAT##N(blake3_iv[i]);                                                       \
+    }                                                                                        \
+    for (size_t b = 0; b < blocks; ++b) {                                                    \
+        if (b + 1 == blocks) {                                                               \
+            flags_block |= flags_end;                                                        \
+        }                                                                                    \
+        lanes##N##_load_blocks(m, in, b * BLAKE3_BLOCK);                                     \
+        for (int i = 0; i < 8; ++i) {                                                        \
+            v[i] = h[i];                                                                     \
+        }                                                                                    \
+        for (int i = 0; i < 4; ++i) {                                                        \
+            v[8 + i] = SPLAT##N(blake3_iv[i]);                                               \
+        }                                                                                    \
+        v[12] = counter_lo;                                                                  \
+        v[13] = counter_hi;                                                                  \
+        v[14] = SPLAT##N(BLAKE3_BLOCK);                                                      \
+        v[15] = SPLAT##N(flags_block);                                                       \
+        for (int r = 0; r < 7; ++r) {                                                        \
+            BLAKE3_ROUND(v, m, blake3_schedule[r]);                                          \
+        }                                                                                    \
+        for (int i = 0; i < 8; ++i) {                                                        \
+            h[i] = v[i] ^ v[i + 8];                                                          \
+        }                                                                                    \
+        flags_block = flags;                                                                 \
+    }                                                                                        \
+    for (int g = 0; g < 8; g += N) {                                                         \
+        lanes##N##_transpose(h + g);                                                         \
+        for (int l = 0; l < N; ++l) {                                                        \
+            memcpy(out + l * 32 + 4 * g, &h[g + l], sizeof(lanes##N##_t));                   \
+        }                                                                                    \
+    }                                                                                        \
+}
+
+/* SHA-256 compression of a block per lane, state[HASH_LANES * i + l] is word i
+ * of lane l */
+#define SHA256_LANES(N)                                                                     \
+static INLINE void sha256_lanes##N(u32 *state, const u8 *const *blocks) {                   \
+    lanes##N##_t w[16], s[8], t1, t2;                                                        \
+                                                                                             \
+    lanes##N##_load_blocks(w, blocks, 0);                                                    \
+    for (int i = 0; i < 16; ++i) {                                                           \
+        w[i] = BSWAP##N(w[i]);                                                               \
+    }                                                                                        \
+    for (int i = 0; i < 8; ++i) {                                                            \
+        memcpy(&s[i], state + HASH_LANES * i, sizeof(lanes##N##_t));                         \
+    }                                                                                        \
+    lanes##N##_t a = s[0], b = s[1], c = s[2], d = s[3];                                     \
+    lanes##N##_t e = s[4], f = s[5], g = s[6], h = s[7];                                     \
+    for (int t = 0; t < 64; ++t) {                                                           \
+        if (t >= 16) {                                                                       \
+            w[t & 15] += SHA256_s1(w[(t - 2) & 15]) + w[(t - 7) & 15] +                      \
+                         SHA256_s0(w[(t - 15) & 15]);                                        \
+        }                                                                                    \
+        t1 = h + SHA256_S1(e) + ((e & f) ^ (~e & g)) + sha256_k[t] + w[t & 15];              \
+        t2 = SHA256_S0(a) + ((a & b) ^ (a & c) ^ (b & c));                                   \
+        h = g, g = f, f = e, e = d + t1, d = c, c = b, b = a, a = t1 + t2;                   \
+    }                                                                                        \
+    s[0] += a, s[1] += b, s[2] += c, s[3] += d, s[4] += e, s[5] += f, s[6] += g, s[7] += h;  \
+    for (int i = 0; i < 8; ++i) {                                                            \
+        memcpy(state + HASH_LANES * i, &s[i], sizeof(lanes##N##_t));                         \
+    }                                                                                        \
+}
+
+LANES_LOAD_BLOCKS(4)
+LANES_LOAD_BLOCKS(8)
+BLAKE3_LANES(4)
+BLAKE3_LANES(8)
+SHA256_LANES(4)
+SHA256_LANES(8)
+
+typedef void (*blake3_x8_fn)(const u8 *const *in, size_t blocks, u64 counter, int increment,
+                             u32 flags, u32 flags_start, u32 flags_end, u8 *out);
+typedef void (*sha256_x8_fn)(u32 *state, const u8 *const *blocks);
+
+/* Kernels of HASH_LANES inputs with the lanes of N */
+#define HASH_LANES_KERNELS(name, target, N)                                                 \
+target static void blake3_x8_##name(const u8 *const *in, size_t blocks, u64 counter,      \
+                                    int increment, u32 flags, u32 flags_start,             \
+                                    u32 flags_end, u8 *out) {                              \
+    for (int i = 0; i < HASH_LANES; i += N) {                                               \
+        blake3_lanes##N(in + i, blocks, counter + (increment ? i : 0), increment, flags,    \
+                        flags_start, flags_end, out + 32 * i);                              \
+    }                                                                                       \
+}                                                                                           \
+target static void sha256_x8_##name(u32 *state, const u8 *const *blocks) {                 \
+    for (int i = 0; i < HASH_LANES; i += N) {                                               \
+        sha256_lanes##N(state + i, blocks + i);                                             \
+    }                                                                                       \
+}
+
+HASH_LANES_KERNELS(base, , 4)
+#if defined(__x86_64__)
+HASH_LANES_KERNELS(avx2, TARGET_AVX2, 8)
+#endif
+
+/*-***********
+ * Selection *
+ *-***********/
+
+static blake3_x8_fn blake3_x8_kernel = blake3_x8_base;
+static sha256_x8_fn sha256_x8_kernel = sha256_x8_base;
+static int sha256_lanes; /* multi-buffer, without SHA instructions */
+static char kernel_names[64];
+
+static EVP_MD *hash_sha256;
+static struct {
+    EVP_MD_CTX *ctx;
+    u8 *cvs;    /* chaining values of the chunks of a window */
+    u8 *buffer; /* window read from a namespace */
+} *hash_workers;
+
+int hash_init(void) {
+    const char *lanes = "generic", *sha = "sha-ext";
+    int n = parallel_threads(), width = 4;
+
+#if defined(__x86_64__)
+    unsigned eax, ebx = 0, ecx, edx;
+    lanes = "sse2";
+    if (__builtin_cpu_supports("avx2")) {
+        blake3_x8_kernel = blake3_x8_avx2;
+        sha256_x8_kernel = sha256_x8_avx2;
+        lanes = "avx2";
+        width = 8;
+    }
+    // The SHA extensions (SHA-NI) are bit 29 of EBX of leaf 7, 4 lanes of SSE2
+    // do not beat the SSSE3 code of OpenSSL
+    __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+    sha = ebx & (1u << 29) ? "sha-ni" : "openssl";
+    sha256_lanes = !(ebx & (1u << 29)) && width == 8;
+#elif defined(__aarch64__)
+    lanes = "neon";
+    sha256_lanes = !(getauxval(AT_HWCAP) & HWCAP_SHA2);
+    sha = "armv8";
+#else
+    sha256_lanes = 1;
+#endif
+    snprintf(kernel_names, sizeof(kernel_names), "blake3 %s x%d, sha256 %s", lanes, width,
+             sha256_lanes ? lanes : sha);
+
+    hash_sha256 = EVP_MD_fetch(NULL, "SHA256", NULL);
+    hash_workers = calloc(n, sizeof(*hash_workers));
+    if (!hash_sha256 || !hash_workers) {
+        return -1;
+    }
+    for (int i = 0; i < n; ++i) {
+        hash_workers[i].ctx = EVP_MD_CTX_new();
+        hash_workers[i].cvs = malloc(HASH_WINDOW / BLAKE3_CHUNK * 32);
+        if (!hash_workers[i].ctx || !hash_workers[i].cvs) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+const char *hash_kernels(void) {
+    return kernel_names;
+}
+
+/*-********
+ * BLAKE3 *
+ *-********/
+
+static void blake3_compress(u32 *cv, const u8 *block, u32 block_len, u64 counter, u32 flags) {
+    u32 m[16], v[16];
+
+    memcpy(m, block, sizeof(m));
+    memcpy(v, cv, 8 * sizeof(u32));
+    memcpy(v + 8, blake3_iv, 4 * sizeof(u32));
+    v[12] = (u32)counter;
+    v[13] = counter >> 32;
+    v[14] = block_len;
+    v[15] = flags;
+    for (int r = 0; r < 7; ++r) {
+        BLAKE3_ROUND(v, m, blake3_schedule[r]);
+    }
+    for (int i = 0; i < 8; ++i) {
+        cv[i] = v[i] ^ v[i + 8];
+    }
+}
+
+/* Chaining value of a chunk (whole or the last of the input) */
+static void blake3_chunk(const u8 *p, size_t len, u64 counter, u32 flags, u8 *out) {
+    size_t blocks = len ? (len + BLAKE3_BLOCK - 1) / BLAKE3_BLOCK : 1;
+    u8 block[BLAKE3_BLOCK];
+    u32 cv[8];
+
+    memcpy(cv, blake3_iv, sizeof(cv));
+    for (size_t b = 0; b < blocks; ++b) {
+        size_t n = len - b * BLAKE3_BLOCK < BLAKE3_BLOCK ? len - b * BLAKE3_BLOCK : BLAKE3_BLOCK;
+        u32 f = (b == 0 ? BLAKE3_CHUNK_START : 0) | (b + 1 == blocks ? BLAKE3_CHUNK_END | flags : 0);
+        memset(block, 0, sizeof(block));
+        memcpy(block, p + b * BLAKE3_BLOCK, n);
+        blake3_compress(cv, block, n, counter, f);
+    }
+    memcpy(out, cv, sizeof(cv));
+}
+
+/* Chaining value of the parent of two adjacent chaining values */
+static void blake3_parent(const u8 *pair, u32 flags, u8 *out) {
+    u32 cv[8];
+
+    memcpy(cv, blake3_iv, sizeof(cv));
+    blake3_compress(cv, pair, BLAKE3_BLOCK, 0, BLAKE3_PARENT | flags);
+    memcpy(out, cv, sizeof(cv));
+}
+
+/* Up to 8 inputs of the same number of blocks in the lanes */
+static void blake3_many(const u8 **in, int n, size_t blocks, u64 counter, int increment,
+                        u32 flags, u32 flags_start, u32 flags_end, u8 *out) {
+    u8 cvs[HASH_LANES * 32];
+
+    if (n == HASH_LANES) {
+        blake3_x8_kernel(in, blocks, counter, increment, flags, flags_start, flags_end, out);
+        return;
+    }
+    if (n == 1) {
+        u32 cv[8];
+        memcpy(cv, blake3_iv, sizeof(cv));
+        for (size_t b = 0; b < blocks; ++b) {
+            u32 f = flags | (b == 0 ? flags_start : 0) | (b + 1 == blocks ? flags_end : 0);
+            blake3_compress(cv, in[0] + b * BLAKE3_BLOCK, BLAKE3_BLOCK, counter, f);
+        }
+        memcpy(out, cv, sizeof(cv));
+        return;
+    }
+    for (int l = n; l < HASH_LANES; ++l) {
+        in[l] = in[0];
+    }
+    blake3_x8_kernel(in, blocks, counter, increment, flags, flags_start, flags_end, cvs);
+    memcpy(out, cvs, n * 32);
+}
+
+/* Merges the n >= 2 chaining values of adjacent subtrees level by level, in
+ * place, the last merge gives the digest if root */
+static void blake3_reduce(u8 *cvs, size_t n, int root, u8 *out) {
+    const u8 *in[HASH_LANES];
+
+    while (n > 2) {
+        size_t parents = n / 2;
+        for (size_t i = 0; i < parents; i += HASH_LANES) {
+            int k = parents - i < HASH_LANES ? parents - i : HASH_LANES;
+            for (int l = 0; l < k; ++l) {
+                in[l] = cvs + (i + l) * 64;
+            }
+            // The lanes read their pairs before the chaining values are written
+            blake3_many(in, k, 1, 0, 0, BLAKE3_PARENT, 0, 0, cvs + i * 32);
+        }
+        if (n & 1) {
+            memcpy(cvs + parents * 32, cvs + (n - 1) * 32, 32);
+        }
+        n = parents + (n & 1);
+    }
+    blake3_parent(cvs, root ? BLAKE3_ROOT : 0, out);
+}
+
+/* Chaining value of the subtree of the chunks at p, a power of two of them or
+ * the last ones of the input, counter is the index of the first one. The
+ * digest of the input if root. */
+static void blake3_subtree(const u8 *p, size_t len, u64 counter, int root, u8 *cvs, u8 *out) {
+    size_t chunks = len > BLAKE3_CHUNK ? (len + BLAKE3_CHUNK - 1) / BLAKE3_CHUNK : 1;
+    size_t full = len / BLAKE3_CHUNK;
+    const u8 *in[HASH_LANES];
+
+    if (chunks == 1) {
+        blake3_chunk(p, len, counter, root ? BLAKE3_ROOT : 0, out);
+        return;
+    }
+    for (size_t i = 0; i < full; i += HASH_LANES) {
+        int n = full - i < HASH_LANES ? full - i : HASH_LANES;
+        for (int l = 0; l < n; ++l) {
+            in[l] = p + (i + l) * BLAKE3_CHUNK;
+        }
+        blake3_many(in, n, BLAKE3_CHUNK / BLAKE3_BLOCK, counter + i, 1, 0, BLAKE3_CHUNK_START,
+                    BLAKE3_CHUNK_END, cvs + i * 32);
+    }
+    if (full < chunks) {
+        blake3_chunk(p + full * BLAKE3_CHUNK, len - full * BLAKE3_CHUNK, counter + full, 0,
+                     cvs + full * 32);
+    }
+    blake3_reduce(cvs, chunks, root, out);
+}
+
+/* Chaining values of the subtrees of an input hashed a window at a time, the
+ * stack only holds the subtrees that are not merged yet */
+typedef struct {
+    u8 cv[BLAKE3_MAX_DEPTH][32];
+    int depth;
+    u64 windows;
+} blake3_stack_st;
+
+static void blake3_push(blake3_stack_st *s, const u8 *cv) {
+    // The subtrees that are complete are merged, the last one is kept as it
+    // could be the root
+    int merged = __builtin_popcountll(s->windows);
+
+    while (s->depth > merged) {
+        blake3_parent(s->cv[s->depth - 2], 0, s->cv[s->depth - 2]);
+        --s->depth;
+    }
+    memcpy(s->cv[s->depth++], cv, 32);
+    ++s->windows;
+}
+
+static void blake3_finish(blake3_stack_st *s, u8 *out) {
+    // From the last subtree to the first, the root is the last merge
+    while (s->depth > 1) {
+        blake3_parent(s->cv[s->depth - 2], s->depth == 2 ? BLAKE3_ROOT : 0, s->cv[s->depth - 2]);
+        --s->depth;
+    }
+    memcpy(out, s->cv[0], 32);
+}
+
+/*-*********
+ * SHA-256 *
+ *-*********/
+
+typedef struct {
+    const u8 *p;       /* next whole block of the object */
+    size_t blocks;     /* whole blocks left */
+    u8 tail[128];      /* last bytes and padding */
+    int tail_blocks;
+    int tail_next;
+    size_t object;
+    int busy;
+} sha256_lane_st;
+
+/* Digests of the objects at data (object i at objects[i].Offset - base), 8
+ * objects hashed at a time, a lane takes the next object when it is done */
+static void sha256_objects_lanes(const u8 *data, u64 base, const TspHashObject *objects, size_t n,
+                                 u8 *digests) {
+    static const u8 zero[64];
+    sha256_lane_st lanes[HASH_LANES];
+    const u8 *blocks[HASH_LANES];
+    u32 state[8 * HASH_LANES];
+    size_t next = 0;
+    int busy = 0;
+
+    memset(lanes, 0, sizeof(lanes));
+    for (;;) {
+        for (int l = 0; l < HASH_LANES && next < n; ++l) {
+            sha256_lane_st *lane = &lanes[l];
+            if (lane->busy) {
+                continue;
+            }
+            const TspHashObject *o = &objects[next];
+            size_t rest = o->Length % 64;
+            u64 bits = o->Length * 8;
+
+            lane->p = data + (o->Offset - base);
+            lane->blocks = o->Length / 64;
+            memset(lane->tail, 0, sizeof(lane->tail));
+            memcpy(lane->tail, lane->p + lane->blocks * 64, rest);
+            lane->tail[rest] = 0x80;
+            lane->tail_blocks = rest + 9 <= 64 ? 1 : 2;
+            for (int i = 0; i < 8; ++i) {
+                lane->tail[lane->tail_blocks * 64 - 1 - i] = bits >> (8 * i);
+                state[8 * i + l] = sha256_iv[i];
+            }
+            lane->tail_next = 0;
+            lane->object = next++;
+            lane->busy = 1;
+            ++busy;
+        }
+        if (!busy) {
+            break;
+        }
+
+        for (int l = 0; l < HASH_LANES; ++l) {
+            sha256_lane_st *lane = &lanes[l];
+            blocks[l] = !lane->busy ? zero : lane->blocks ? lane->p : lane->tail + lane->tail_next * 64;
+        }
+        sha256_x8_kernel(state, blocks);
+        for (int l = 0; l < HASH_LANES; ++l) {
+            sha256_lane_st *lane = &lanes[l];
+            if (!lane->busy) {
+                continue;
+            }
+            if (lane->blocks) {
+                lane->p += 64;
+                --lane->blocks;
+            } else if (++lane->tail_next == lane->tail_blocks) {
+                u8 *digest = digests + lane->object * TSP_HASH_DIGEST_BYTES;
+                for (int i = 0; i < 8; ++i) {
+                    u32 w = state[8 * i + l];
+                    digest[4 * i] = w >> 24, digest[4 * i + 1] = w >> 16;
+                    digest[4 * i + 2] = w >> 8, digest[4 * i + 3] = w;
+                }
+                lane->busy = 0;
+                --busy;
+            }
+        }
+    }
+}
+
+/*-*********
+ * Sources *
+ *-*********/
+
+typedef struct {
+    const u8 *data;           /* in the FDM, NULL on a namespace */
+    u64 bytes;
+    namespace_extents_st ns;
+} hash_source_st;
+
+/* Bytes [offset, offset + len) of the data, len at most HASH_WINDOW */
+static const u8 *hash_source_read(const hash_source_st *src, u64 offset, size_t len, u8 *buffer,
+                                  int *error) {
+    if (src->data) {
+        return src->data + offset;
+    }
+    return namespace_read(&src->ns, offset, len, buffer, error);
+}
+
+/* Locates the extents of the namespace and allocates the windows */
+static int hash_source_namespace(hash_source_st *src, const void *desc, size_t desc_bytes) {
+    int ret = namespace_extents(&src->ns, desc, desc_bytes);
+
+    if (ret) {
+        return ret;
+    }
+    src->data = NULL;
+    src->bytes = src->ns.bytes;
+    // Window buffers of the workers, allocated on the first use
+    for (int i = 0; i < parallel_threads(); ++i) {
+        if (!hash_workers[i].buffer &&
+            posix_memalign((void **)&hash_workers[i].buffer, NAMESPACE_MAX_BLOCK,
+                           HASH_WINDOW + 2 * NAMESPACE_MAX_BLOCK)) {
+            hash_workers[i].buffer = NULL;
+            return -ENOMEM;
+        }
+    }
+    return 0;
+}
+
+/*-**********
+ * Requests *
+ *-**********/
+
+typedef struct {
+    const hash_source_st *src;
+    int algorithm;
+    const TspHashObject *objects;
+    const size_t *batch;  /* first object of each batch */
+    u64 piece;            /* bytes of the pieces of a single input */
+    u8 *out;              /* digests, or chaining values of the pieces */
+    int error;
+} hash_job_st;
+
+/* Digest of an object larger than a window, a window at a time */
+static void hash_large(hash_job_st *job, u64 offset, u64 len, int worker, u8 *digest) {
+    EVP_MD_CTX *ctx = hash_workers[worker].ctx;
+    blake3_stack_st stack = {.depth = 0, .windows = 0};
+    u8 cv[32];
+
+    if (job->algorithm == TSP_HASH_SHA256 && !EVP_DigestInit_ex(ctx, hash_sha256, NULL)) {
+        __atomic_store_n(&job->error, -ENOMEM, __ATOMIC_RELAXED);
+        return;
+    }
+    for (u64 w = 0; w < len; w += HASH_WINDOW) {
+        size_t n = len - w < HASH_WINDOW ? len - w : HASH_WINDOW;
+        const u8 *p = hash_source_read(job->src, offset + w, n, hash_workers[worker].buffer,
+                                       &job->error);
+        if (!p) {
+            return;
+        }
+        if (job->algorithm == TSP_HASH_SHA256) {
+            EVP_DigestUpdate(ctx, p, n);
+        } else {
+            blake3_subtree(p, n, w / BLAKE3_CHUNK, 0, hash_workers[worker].cvs, cv);
+            blake3_push(&stack, cv);
+        }
+    }
+    if (job->algorithm == TSP_HASH_SHA256) {
+        EVP_DigestFinal_ex(ctx, digest, NULL);
+    } else {
+        blake3_finish(&stack, digest);
+    }
+}
+
+static void hash_batch(void *ctx, int i, int worker) {
+    hash_job_st *job = ctx;
+    const TspHashObject *objects = job->objects + job->batch[i];
+    size_t n = job->batch[i + 1] - job->batch[i];
+    u8 *digests = job->out + job->batch[i] * TSP_HASH_DIGEST_BYTES;
+    u64 lo = objects[0].Offset, hi = objects[0].Offset + objects[0].Length;
+    const u8 *data;
+
+    if (objects[0].Length > HASH_WINDOW) {
+        hash_large(job, objects[0].Offset, objects[0].Length, worker, digests);
+        return;
+    }
+    // The objects of a batch are in a window, read at once
+    for (size_t k = 1; k < n; ++k) {
+        lo = objects[k].Offset < lo ? objects[k].Offset : lo;
+        hi = objects[k].Offset + objects[k].Length > hi ? objects[k].Offset + objects[k].Length : hi;
+    }
+    data = hash_source_read(job->src, lo, hi - lo, hash_workers[worker].buffer, &job->error);
+    if (!data) {
+        return;
+    }
+
+    if (job->algorithm == TSP_HASH_SHA256 && sha256_lanes) {
+        sha256_objects_lanes(data, lo, objects, n, digests);
+        return;
+    }
+    for (size_t k = 0; k < n; ++k) {
+        const u8 *p = data + (objects[k].Offset - lo);
+        u8 *digest = digests + k * TSP_HASH_DIGEST_BYTES;
+        if (job->algorithm == TSP_HASH_SHA256) {
+            EVP_Digest(p, objects[k].Length, digest, NULL, hash_sha256, NULL);
+        } else {
+            blake3_subtree(p, objects[k].Length, 0, 1, hash_workers[worker].cvs, digest);
+        }
+    }
+}
+
+/* Chaining value of a piece of a single input */
+static void hash_piece(void *ctx, int i, int worker) {
+    hash_job_st *job = ctx;
+    u64 offset = (u64)i * job->piece;
+    size_t n = job->src->bytes - offset < job->piece ? job->src->bytes - offset : job->piece;
+    const u8 *p = hash_source_read(job->src, offset, n, hash_workers[worker].buffer,
+                                   &job->error);
+
+    if (p) {
+        blake3_subtree(p, n, offset / BLAKE3_CHUNK, 0, hash_workers[worker].cvs, job->out + i * 32);
+    }
+}
+
+static int hash_input(hash_job_st *job, u8 *digest) {
+    u64 bytes = job->src->bytes, pieces;
+    int threads = parallel_threads();
+
+    if (job->algorithm == TSP_HASH_SHA256) {
+        if (job->src->data) {
+            return EVP_Digest(job->src->data, bytes, digest, NULL, hash_sha256, NULL) ? 0 : -ENOMEM;
+        }
+        hash_large(job, 0, bytes, 0, digest);
+        return job->error;
+    }
+
+    // Pieces of 1 MiB, smaller (a power of two of chunks) for the threads to
+    // have several each
+    job->piece = HASH_WINDOW;
+    while (job->piece > HASH_MIN_PIECE && bytes / job->piece < 4 * (u64)threads) {
+        job->piece /= 2;
+    }
+    pieces = (bytes + job->piece - 1) / job->piece;
+    if (pieces <= 1) {
+        const u8 *p = hash_source_read(job->src, 0, bytes, hash_workers[0].buffer, &job->error);
+        if (p) {
+            blake3_subtree(p, bytes, 0, 1, hash_workers[0].cvs, digest);
+        }
+        return job->error;
+    }
+    job->out = malloc(pieces * 32);
+    if (!job->out) {
+        return -ENOMEM;
+    }
+    parallel_for(pieces, hash_piece, job);
+    if (!job->error) {
+        blake3_reduce(job->out, pieces, 1, digest);
+    }
+    free(job->out);
+    return job->error;
+}
+
+static int hash_objects(hash_job_st *job, const TspHashObject *table, size_t num, u8 *digests) {
+    TspHashObject *objects = malloc(num * sizeof(*objects));
+    size_t *batch = malloc((num + 1) * sizeof(*batch)), batches = 0;
+    int ret = -ENOMEM;
+
+    if (!objects || !batch) {
+        goto out;
+    }
+    // The table may not be aligned in the FDM
+    memcpy(objects, table, num * sizeof(*objects));
+
+    // Batches of the objects in a window, larger objects are alone
+    for (size_t i = 0; i < num;) {
+        u64 lo = objects[i].Offset, hi = lo + objects[i].Length;
+        batch[batches++] = i;
+        for (++i; i < num && hi - lo <= HASH_WINDOW; ++i) {
+            u64 l = objects[i].Offset < lo ? objects[i].Offset : lo;
+            u64 h = objects[i].Offset + objects[i].Length > hi ? objects[i].Offset + objects[i].Length : hi;
+            if (h - l > HASH_WINDOW) {
+                break;
+            }
+            lo = l, hi = h;
+        }
+    }
+    batch[batches] = num;
+    for (size_t i = 0; i < num; ++i) {
+        if (objects[i].Offset > job->src->bytes ||
+            objects[i].Length > job->src->bytes - objects[i].Offset) {
+            ret = -EINVAL;
+            goto out;
+        }
+    }
+
+    job->objects = objects;
+    job->batch = batch;
+    job->out = digests;
+    parallel_for(batches, hash_batch, job);
+    ret = job->error;
+out:
+    free(objects);
+    free(batch);
+    return ret;
+}
+
+int hash_digests(u32 options, const void *data, size_t data_bytes, const TspHashObject *objects,
+                 size_t num_objects, void *digests) {
+    hash_source_st src = {.data = data, .bytes = data_bytes};
+    hash_job_st job = {.src = &src, .algorithm = options & 0xFF};
+    int ret;
+
+    if (job.algorithm != TSP_HASH_BLAKE3 && job.algorithm != TSP_HASH_SHA256) {
+        return -EINVAL;
+    }
+    if (options & TSP_HASH_NAMESPACE) {
+        ret = hash_source_namespace(&src, data, data_bytes);
+        if (ret) {
+            namespace_extents_free(&src.ns);
+            return ret;
+        }
+    }
+
+    ret = objects ? hash_objects(&job, objects, num_objects, digests) : hash_input(&job, digests);
+    namespace_extents_free(&src.ns);
+    return ret;
+}
@@ -0,0 +1,58 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <stddef.h>
+#include "tsp.h"
+
+/**
+ * @brief Selects the kernels and sets up the state of the workers, called once
+ * after parallel_init()
+ * @return 0, or -1 if there is not enough memory or SHA-256 is not available
+ * */
+int hash_init(void);
+
+/**
+ * @brief Returns the names of the selected kernels, e.g., "blake3 avx2 x8, sha256
+ * sha-ni"
+ * */
+const char *hash_kernels(void);
+
+/**
+ * @brief Computes the digests of the data, or of each object
+ * @param[in] options : TSP_HASH_ALGORITHM and TSP_HASH_NAMESPACE (see tsp.h)
+ * @param[in] data : The data, or its TspExtentList with TSP_HASH_NAMESPACE
+ * (the namespace opened with namespace_open())
+ * @param[in] objects : Ranges of the data, NULL for a digest of all of it
+ * @param[out] digests : TSP_HASH_DIGEST_BYTES per object, or for the data
+ * @return 0, -EINVAL if the options, extents or objects are invalid, -ENODEV if
+ * the namespace was not opened, -EIO if it could not be read, -ENOMEM
+ * */
+int hash_digests(u32 options, const void *data, size_t data_bytes, const TspHashObject *objects,
+                 size_t num_objects, void *digests);
+
+#endif /* __HASH_H__ */
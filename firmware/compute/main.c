@@ -0,0 +1,386 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Compute daemon of the CSD. Compute commands sent with TSP_CS_COMPUTE_USER
+ * set are forwarded by the kernel to user space through /dev/tsp-<N>, as the
+ * I/O commands of the self-encrypting disk (firmware/crypt). The daemon reads
+ * the command and its data (the compute requests, legacy or wire format),
+ * executes the requests with the registered functions on the FDM, which it
+ * maps, and writes the completion back.
+ * */
+
+#include "cs.h"
+#include "tsp.h"
+#include "tsp_wire.h"
+#include "dedup.h"
+#include "functions.h"
+#include "namespace.h"
+#include "parallel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+struct __attribute__((__packed__)) nvme_common_command {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t command_id;
+    uint32_t nsid;
+    uint32_t cdw2[2];
+    uint64_t metadata;
+    uint64_t dptr[2];
+    uint32_t cdw10;
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+};
+
+struct __attribute__((__packed__)) nvme_completion {
+    uint32_t result;
+    uint32_t rsvd;
+    uint16_t sq_head;
+    uint16_t sq_id;
+    uint16_t command_id;
+    uint16_t status;
+};
+
+enum {
+    NVME_SC_SUCCESS = 0x0,
+    NVME_SC_INVALID_OPCODE = 0x1,
+    NVME_SC_INVALID_FIELD = 0x2,
+    NVME_SC_INTERNAL = 0x6,
+};
+
+/* A command and its data, up to the maximum data transfer size */
+#define BUFFER_SIZE (sizeof(struct nvme_common_command) + TSP_MDTS)
+/* Most arguments a request of a command can have */
+#define COMPUTE_MAX_ARGS (TSP_MDTS / sizeof(TspWireArg))
+
+/* Mapping of the FDM, device addresses [base, base + size) */
+static struct {
+    u8 *va;
+    u64 base;
+    u64 size;
+} fdm;
+
+static compute_arg_st args[COMPUTE_MAX_ARGS];
+/* Wire requests converted to the layout of the CS API for the functions */
+static u8 request_buffer[offsetof(CsComputeRequest, Args) + COMPUTE_MAX_ARGS * sizeof(CsComputeArg)]
+    __attribute__((aligned(8)));
+
+static int verbose;
+
+/* Returns the address of the FDM at device address addr, NULL if outside */
+static void *compute_fdm(u64 addr, u64 *bytes) {
+    if (!fdm.va || addr < fdm.base || addr - fdm.base >= fdm.size) {
+        return NULL;
+    }
+    *bytes = fdm.size - (addr - fdm.base);
+    return fdm.va + (addr - fdm.base);
+}
+
+/* Executes a request, returns the NVMe status */
+static int compute_run(const CsComputeRequest *req) {
+    const char *name = NULL;
+    compute_fn fn = compute_lookup(req->FunctionId, &name);
+    CS_STATUS status;
+
+    if (!fn) {
+        fprintf(stderr, "Unknown function %u\n", req->FunctionId);
+        return NVME_SC_INVALID_FIELD;
+    }
+
+    for (int i = 0; i < req->NumArgs; ++i) {
+        const CsComputeArg *arg = &req->Args[i];
+        args[i].Ptr = NULL;
+        args[i].Bytes = 0;
+        if (arg->Type == CS_AFDM_TYPE) {
+            args[i].Ptr = compute_fdm(arg->u.DevMem.MemHandle + arg->u.DevMem.ByteOffset,
+                                      &args[i].Bytes);
+            if (!args[i].Ptr) {
+                fprintf(stderr, "Argument %d of %s is not in the FDM\n", i, name);
+                return NVME_SC_INVALID_FIELD;
+            }
+        }
+    }
+
+    status = fn(req, args);
+    if (verbose) {
+        printf("%s : %d\n", name, status);
+    }
+    return status == CS_SUCCESS ? NVME_SC_SUCCESS : NVME_SC_INTERNAL;
+}
+
+/* Legacy format, a single packed CsComputeRequest of cdw12 bytes */
+static int compute_legacy(const struct nvme_common_command *sqe, const void *data, size_t len) {
+    const CsComputeRequest *req = data;
+
+    if (sqe->cdw12 < sizeof(CsComputeRequest) || sqe->cdw12 > len || req->NumArgs < 0 ||
+        (u64)req->NumArgs > (sqe->cdw12 - offsetof(CsComputeRequest, Args)) / sizeof(CsComputeArg) ||
+        (u64)req->NumArgs > COMPUTE_MAX_ARGS) {
+        return NVME_SC_INVALID_FIELD;
+    }
+    return compute_run(req);
+}
+
+/* Wire format, the requests are executed in order up to the first failure,
+ * result is the index of the failed request (NumRequests if none failed) */
+static int compute_wire(const struct nvme_common_command *sqe, const void *data, size_t len,
+                        u32 *result) {
+    const TspWireHeader *h = data;
+    const TspWireRequest *w;
+    int ret = NVME_SC_SUCCESS;
+    u32 i;
+
+    w = sqe->cdw12 <= len ? tsp_wire_first(data, sqe->cdw12) : NULL;
+    if (!w || h->Length != sqe->cdw12) {
+        return NVME_SC_INVALID_FIELD;
+    }
+
+    for (i = 0; i < h->NumRequests; ++i, w = tsp_wire_next(w)) {
+        CsComputeRequest *req = (CsComputeRequest *)request_buffer;
+
+        if (!tsp_wire_check(h, w) || w->NumArgs > COMPUTE_MAX_ARGS) {
+            ret = NVME_SC_INVALID_FIELD;
+            break;
+        }
+        req->CSEHandle = 0;
+        req->FunctionId = w->FunctionId;
+        req->NumArgs = w->NumArgs;
+        for (u32 j = 0; j < w->NumArgs; ++j) {
+            CsComputeArg *arg = &req->Args[j];
+
+            arg->Type = w->Args[j].Type;
+            arg->u.DevMem.MemHandle = w->Args[j].u.DevMem.MemHandle;
+            arg->u.DevMem.ByteOffset = w->Args[j].u.DevMem.ByteOffset;
+        }
+
+        ret = compute_run(req);
+        if (ret != NVME_SC_SUCCESS) {
+            break;
+        }
+    }
+
+    *result = ret == NVME_SC_SUCCESS ? h->NumRequests : i;
+    return ret;
+}
+
+/* Executes a command, fills its completion */
+static void compute_command(const struct nvme_common_command *sqe, const void *data, size_t len,
+                            struct nvme_completion *cqe) {
+    u32 result = 0;
+
+    memset(cqe, 0, sizeof(*cqe));
+    cqe->command_id = sqe->command_id;
+
+    if ((sqe->cdw10 & ~TSP_CS_COMPUTE_USER) != TSP_CS_COMPUTE) {
+        cqe->status = NVME_SC_INVALID_OPCODE;
+        return;
+    }
+
+    switch (sqe->cdw13) {
+    case 0:
+        cqe->status = compute_legacy(sqe, data, len);
+        break;
+    case TSP_WIRE_VERSION:
+        cqe->status = compute_wire(sqe, data, len, &result);
+        cqe->result = result;
+        break;
+    default:
+        cqe->status = NVME_SC_INVALID_FIELD;
+        break;
+    }
+}
+
+/* Maps size bytes of the FDM from offset of path, at device address base */
+static int compute_map_fdm(const char *path, u64 base, u64 size, u64 offset) {
+    int fd = open(path, O_RDWR | O_SYNC);
+    void *va;
+
+    if (fd < 0) {
+        perror("Could not open the FDM");
+        return -1;
+    }
+    va = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    close(fd);
+    if (va == MAP_FAILED) {
+        perror("Could not map the FDM");
+        return -1;
+    }
+
+    fdm.va = va;
+    fdm.base = base;
+    fdm.size = size;
+    return 0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage : %s -d <device> [-m <FDM file> -s <size> [-b <base>] [-o <offset>]] [-j <threads>] [-i <index>] [-n <namespace>]... [-v]\n"
+            "  -d : user space queue of the commands, e.g., /dev/tsp-0\n"
+            "  -m : file that holds the FDM, e.g., /dev/mem\n"
+            "  -s : bytes of the FDM\n"
+            "  -b : device address of the FDM (0)\n"
+            "  -o : offset of the FDM in the file (0)\n"
+            "  -j : threads of the functions that use several cores (one per core)\n"
+            "  -i : file of the fingerprint index of Dedup, shared by the daemons (in memory)\n"
+            "  -n : block device of namespace 1, 2, ... in order, read by Hash and VectorSearch,\n"
+            "       written by Sort\n"
+            "  -v : prints every request\n", name);
+}
+
+int main(int argc, char **argv) {
+    const char *device = NULL, *fdm_path = NULL, *index_path = NULL;
+    const char *namespaces[NAMESPACE_MAX];
+    u64 base = 0, size = 0, offset = 0;
+    struct nvme_completion cqe;
+    void *buffer;
+    ssize_t ret;
+    int fd, c, threads = 0, num_namespaces = 0;
+
+    while ((c = getopt(argc, argv, "d:m:s:b:o:j:i:n:v")) != -1) {
+        switch (c) {
+        case 'd':
+            device = optarg;
+            break;
+        case 'm':
+            fdm_path = optarg;
+            break;
+        case 's':
+            size = strtoull(optarg, NULL, 0);
+            break;
+        case 'b':
+            base = strtoull(optarg, NULL, 0);
+            break;
+        case 'o':
+            offset = strtoull(optarg, NULL, 0);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'i':
+            index_path = optarg;
+            break;
+        case 'n':
+            if (num_namespaces == NAMESPACE_MAX) {
+                fprintf(stderr, "At most %d namespaces\n", NAMESPACE_MAX);
+                return 1;
+            }
+            namespaces[num_namespaces++] = optarg;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case '?':
+            if (optopt == 'd' || optopt == 'm' || optopt == 's' || optopt == 'b' || optopt == 'o' ||
+                optopt == 'j' || optopt == 'i' || optopt == 'n')
+                fprintf(stderr, "Option -%c requires an argument\n", optopt);
+            else if (isprint(optopt))
+                fprintf(stderr, "Unknown option '-%c'\n", optopt);
+            else
+                fprintf(stderr, "Unknown option character '\\x%x\n", optopt);
+            return 1;
+        default:
+            abort();
+        }
+    }
+    if (!device || (fdm_path && !size)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("Compute daemon\n");
+    if (parallel_init(threads) < 0) {
+        fprintf(stderr, "Could not start the worker threads\n");
+    }
+    compute_functions_init();
+    if (index_path && (ret = dedup_index_open(index_path)) < 0) {
+        fprintf(stderr, "Could not open the index %s : %s\n", index_path, strerror(-ret));
+        return 1;
+    }
+    for (int i = 0; i < num_namespaces; ++i) {
+        if ((ret = namespace_open(i + 1, namespaces[i])) < 0) {
+            fprintf(stderr, "Could not open the namespace %s : %s\n", namespaces[i], strerror(-ret));
+            return 1;
+        }
+    }
+
+    if (fdm_path) {
+        if (compute_map_fdm(fdm_path, base, size, offset) < 0) {
+            return 1;
+        }
+    } else {
+        printf("No FDM, the requests with FDM arguments fail\n");
+    }
+
+    printf("Opening device: %s\n", device);
+    fd = open(device, O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open TSP device");
+        return 1;
+    }
+
+    // The data of the command follows it, aligned for the wire format
+    buffer = aligned_alloc(TSP_WIRE_ALIGN, BUFFER_SIZE);
+    if (!buffer) {
+        perror("Not enough memory");
+        return 1;
+    }
+
+    while (1) {
+        ret = read(fd, buffer, BUFFER_SIZE);
+
+        if (!ret) {
+            fprintf(stderr, "End of file was returned\n");
+            break;
+        }
+        if (ret < 0) {
+            perror("Read error");
+            break;
+        }
+        if ((size_t)ret < sizeof(struct nvme_common_command)) {
+            fprintf(stderr, "Partial read\n");
+            break;
+        }
+
+        compute_command(buffer, (u8 *)buffer + sizeof(struct nvme_common_command),
+                        ret - sizeof(struct nvme_common_command), &cqe);
+
+        // Compute commands return no data
+        if (write(fd, &cqe, sizeof(cqe)) != sizeof(cqe)) {
+            perror("Write error");
+            break;
+        }
+    }
+
+    return 0;
+}
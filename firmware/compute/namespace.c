@@ -0,0 +1,193 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Namespaces of the CSD read by the functions.
+ *
+ * The functions that work on a namespace get the extents of the data instead
+ * of the data in the FDM (as a storage load), the daemon reads them itself
+ * from the block device of the namespace with direct I/O. Sort also writes its
+ * runs in the extents of a temporary file.
+ * */
+
+#include "namespace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static struct {
+    int fd;     /* 0 if not opened, as the fds are above stdin */
+    int direct; /* with O_DIRECT, -1 if not a block device */
+    u32 block;  /* logical block size */
+} namespaces[NAMESPACE_MAX];
+
+int namespace_open(u32 nsid, const char *path) {
+    struct stat st;
+    int fd, flags, block = 512;
+
+    if (nsid < 1 || nsid > NAMESPACE_MAX) {
+        return -EINVAL;
+    }
+    // Read only if it cannot be written, the functions that write then fail
+    flags = O_RDWR;
+    fd = open(path, flags);
+    if (fd < 0 && (errno == EACCES || errno == EROFS)) {
+        flags = O_RDONLY;
+        fd = open(path, flags);
+    }
+    if (fd < 0) {
+        return -errno;
+    }
+    namespaces[nsid - 1].fd = fd;
+    namespaces[nsid - 1].direct = -1;
+    namespaces[nsid - 1].block = block;
+    // Direct I/O for block devices, in their logical blocks
+    if (fstat(fd, &st) == 0 && S_ISBLK(st.st_mode) && ioctl(fd, BLKSSZGET, &block) == 0) {
+        namespaces[nsid - 1].direct = open(path, flags | O_DIRECT);
+        namespaces[nsid - 1].block = block;
+    }
+    return 0;
+}
+
+int namespace_extents(namespace_extents_st *ext, const void *desc, size_t desc_bytes) {
+    const TspExtentList *list = desc;
+    u64 total = 0;
+    u32 nsid;
+
+    ext->starts = NULL;
+    if (desc_bytes < sizeof(*list) ||
+        list->NumExtents > (desc_bytes - sizeof(*list)) / sizeof(TspExtent)) {
+        return -EINVAL;
+    }
+    nsid = list->NamespaceId;
+    if (nsid < 1 || nsid > NAMESPACE_MAX || !namespaces[nsid - 1].fd) {
+        return -ENODEV;
+    }
+    // A shift of 0 is the format of the namespace, as for the storage loads
+    ext->block = list->LbaShift ? 1u << list->LbaShift : namespaces[nsid - 1].block;
+    if (ext->block < 512 || ext->block > NAMESPACE_MAX_BLOCK || (ext->block & (ext->block - 1))) {
+        return -EINVAL;
+    }
+    ext->fd = namespaces[nsid - 1].fd;
+    if (namespaces[nsid - 1].direct >= 0 && ext->block % namespaces[nsid - 1].block == 0) {
+        ext->fd = namespaces[nsid - 1].direct;
+    }
+
+    ext->starts = malloc((list->NumExtents + 1) * sizeof(*ext->starts));
+    if (!ext->starts) {
+        return -ENOMEM;
+    }
+    for (u32 i = 0; i < list->NumExtents; ++i) {
+        TspExtent extent;
+        memcpy(&extent, &list->Extents[i], sizeof(extent));
+        ext->starts[i] = total;
+        total += (u64)extent.NumBlocks * ext->block;
+    }
+    ext->starts[list->NumExtents] = total;
+    if (list->HeadBytes > total) {
+        return -EINVAL;
+    }
+    ext->bytes = list->Bytes ? list->Bytes : total - list->HeadBytes;
+    if (list->HeadBytes + ext->bytes > total) {
+        return -EINVAL;
+    }
+    ext->list = list;
+    return 0;
+}
+
+void namespace_extents_free(namespace_extents_st *ext) {
+    free(ext->starts);
+    ext->starts = NULL;
+}
+
+/* Blocks [pos, end) of the extents from buffer, or to buffer */
+static int namespace_io(const namespace_extents_st *ext, u64 pos, u64 end, u8 *buffer, int write) {
+    const TspExtentList *list = ext->list;
+    size_t lo = 0, hi = list->NumExtents;
+
+    // Extent of the first block
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (ext->starts[mid] <= pos) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    for (size_t e = lo; pos < end; ++e) {
+        TspExtent extent;
+        memcpy(&extent, &list->Extents[e], sizeof(extent));
+        u64 n = (ext->starts[e + 1] < end ? ext->starts[e + 1] : end) - pos;
+        off_t at = extent.Lba * ext->block + (pos - ext->starts[e]);
+
+        if (!write && (extent.Flags & TSP_EXTENT_ZERO)) {
+            memset(buffer, 0, n);
+        } else {
+            for (u64 done = 0; done < n;) {
+                ssize_t ret = write ? pwrite(ext->fd, buffer + done, n - done, at + done)
+                                    : pread(ext->fd, buffer + done, n - done, at + done);
+                if (ret <= 0) {
+                    if (ret < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    return -EIO;
+                }
+                done += ret;
+            }
+        }
+        buffer += n;
+        pos += n;
+    }
+    return 0;
+}
+
+/* The extents are whole blocks so the blocks read are aligned for direct I/O */
+const u8 *namespace_read(const namespace_extents_st *ext, u64 offset, size_t len, u8 *buffer,
+                         int *error) {
+    u64 start = offset + ext->list->HeadBytes, end = start + len;
+    u64 pos = start & ~(u64)(ext->block - 1);
+
+    end = (end + ext->block - 1) & ~(u64)(ext->block - 1);
+    if (namespace_io(ext, pos, end, buffer, 0)) {
+        __atomic_store_n(error, -EIO, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    return buffer + (start & (ext->block - 1));
+}
+
+int namespace_write(const namespace_extents_st *ext, u64 offset, size_t len, const u8 *buffer) {
+    u64 start = offset + ext->list->HeadBytes;
+
+    if ((start | len) & (ext->block - 1)) {
+        return -EINVAL;
+    }
+    return namespace_io(ext, start, start + len, (u8 *)buffer, 1);
+}
@@ -0,0 +1,81 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __NAMESPACE_H__
+#define __NAMESPACE_H__
+
+#include <stddef.h>
+#include "tsp.h"
+
+#define NAMESPACE_MAX 16               /* namespaces given to the daemon */
+#define NAMESPACE_MAX_BLOCK (64 << 10) /* logical block of a namespace */
+
+/* Data on a namespace, described by a TspExtentList */
+typedef struct {
+    const TspExtentList *list;
+    int fd;
+    u32 block;
+    u64 bytes;   /* of the data, from HeadBytes */
+    u64 *starts; /* position of the extents from the first byte of the first */
+} namespace_extents_st;
+
+/**
+ * @brief Opens the block device of a namespace for the functions that read
+ * their data from it (or write temporary data), with direct I/O if it is a
+ * block device
+ * @return 0, or a negative errno
+ * */
+int namespace_open(u32 nsid, const char *path);
+
+/**
+ * @brief Checks a TspExtentList and locates its extents
+ * @return 0, -EINVAL if it is invalid, -ENODEV if its namespace was not
+ * opened, -ENOMEM. namespace_extents_free() is called in any case.
+ * */
+int namespace_extents(namespace_extents_st *ext, const void *desc, size_t desc_bytes);
+
+void namespace_extents_free(namespace_extents_st *ext);
+
+/**
+ * @brief Reads the bytes [offset, offset + len) of the data
+ * @param[in] buffer : Aligned on NAMESPACE_MAX_BLOCK, of len + 2 *
+ * NAMESPACE_MAX_BLOCK bytes, the whole blocks that hold the bytes are read
+ * there
+ * @param[out] error : Set to -EIO if the namespace could not be read
+ * @return The bytes in buffer, NULL on error
+ * */
+const u8 *namespace_read(const namespace_extents_st *ext, u64 offset, size_t len, u8 *buffer,
+                         int *error);
+
+/**
+ * @brief Writes the bytes [offset, offset + len) of the data, whole blocks
+ * (from HeadBytes) of a buffer aligned on NAMESPACE_MAX_BLOCK. The extents
+ * flagged TSP_EXTENT_ZERO are written as the others.
+ * @return 0, -EINVAL if the bytes are not whole blocks, -EIO if the namespace
+ * could not be written (or is read only)
+ * */
+int namespace_write(const namespace_extents_st *ext, u64 offset, size_t len, const u8 *buffer);
+
+#endif /* __NAMESPACE_H__ */
@@ -0,0 +1,134 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Pool of threads that run the iterations of a loop, for the functions that
+ * split their data over the cores of the CSD. The daemon runs one request at a
+ * time, a single loop is in flight.
+ * */
+
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start; /* a loop was posted */
+    pthread_cond_t done;  /* the last iteration of the loop finished */
+    int threads;
+    uint64_t generation; /* of the loop, the workers wait for a new one */
+    parallel_fn fn;
+    void *ctx;
+    int n;
+    int next;             /* next iteration to run */
+    int remaining;        /* iterations not finished */
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .threads = 1,
+};
+
+/* Runs iterations of the current loop until there are none left, called with
+ * the lock held */
+static void parallel_run(int worker) {
+    while (pool.next < pool.n) {
+        int i = pool.next++;
+
+        pthread_mutex_unlock(&pool.lock);
+        pool.fn(pool.ctx, i, worker);
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.remaining == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+    }
+}
+
+static void *parallel_worker(void *arg) {
+    int worker = (int)(long)arg;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&pool.lock);
+    while (1) {
+        while (pool.generation == seen) {
+            pthread_cond_wait(&pool.start, &pool.lock);
+        }
+        seen = pool.generation;
+        parallel_run(worker);
+    }
+    return NULL;
+}
+
+int parallel_init(int threads) {
+    pthread_t thread;
+    int started = 1;
+
+    if (threads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? cores : 1;
+    }
+
+    for (int i = 1; i < threads; ++i) {
+        if (pthread_create(&thread, NULL, parallel_worker, (void *)(long)i)) {
+            break;
+        }
+        pthread_detach(thread);
+        started++;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.threads = started;
+    pthread_mutex_unlock(&pool.lock);
+    return started > 1 || threads == 1 ? 0 : -1;
+}
+
+int parallel_threads(void) {
+    return pool.threads;
+}
+
+void parallel_for(int n, parallel_fn fn, void *ctx) {
+    if (n <= 1 || pool.threads == 1) {
+        for (int i = 0; i < n; ++i) {
+            fn(ctx, i, 0);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.fn = fn;
+    pool.ctx = ctx;
+    pool.n = n;
+    pool.next = 0;
+    pool.remaining = n;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    parallel_run(0);
+    while (pool.remaining) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
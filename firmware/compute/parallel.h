@@ -0,0 +1,57 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+/**
+ * @brief Body of a parallel loop
+ * @param[in] ctx : Context given to parallel_for()
+ * @param[in] i : Index of the iteration
+ * @param[in] worker : Index of the thread running the iteration, below
+ * parallel_threads(), to select per thread state
+ * */
+typedef void (*parallel_fn)(void *ctx, int i, int worker);
+
+/**
+ * @brief Starts the workers, the calling thread is one of them
+ * @param[in] threads : Number of threads, 0 for one per online core
+ * @return 0, or -1 if no thread could be started (the loops then run on the
+ * calling thread only)
+ * */
+int parallel_init(int threads);
+
+/**
+ * @brief Returns the number of threads that run the loops
+ * */
+int parallel_threads(void);
+
+/**
+ * @brief Runs fn for the iterations [0, n) on the workers and returns when
+ * they are all done
+ * */
+void parallel_for(int n, parallel_fn fn, void *ctx);
+
+#endif /* __PARALLEL_H__ */
@@ -0,0 +1,1460 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Multi-pattern search (RegEx). The patterns of a set are parsed into one
+ * Thompson NFA, in front of which a loop over all the bytes makes the search
+ * unanchored, and the NFA is turned into a DFA by subset construction over
+ * classes of bytes that no pattern tells apart. The states of the DFA all hold
+ * the start of the patterns, either after a new line (L, with the patterns
+ * anchored by '^') or after any other byte (M), a state is kept as its base
+ * and the NFA nodes it holds beyond it, which keeps the construction of large
+ * sets of patterns linear. Searching costs one lookup per byte, and the bytes
+ * that leave state M unchanged are skipped in a tight loop.
+ *
+ * The chunks of the data are searched in parallel, each from the state M (or
+ * L after a new line), which holds fewer NFA states than the real one. The
+ * chunks are then taken in order : when the real state at the start of a
+ * chunk differs from the guess, the chunk is searched again from the real one
+ * until both searches agree on a state at one of the checkpoints of the first.
+ * The compiled sets are kept by the hash of their bytes.
+ * */
+
+#include "regex.h"
+#include "checksum.h"
+#include "parallel.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REGEX_CHUNK_BYTES (1 << 20) /* data searched by a worker at a time */
+#define REGEX_CHECK_BYTES 4096      /* between the checkpoints of a chunk */
+#define REGEX_CHECKS (REGEX_CHUNK_BYTES / REGEX_CHECK_BYTES)
+#define REGEX_MAX_NODES (1 << 20)
+#define REGEX_MAX_STATES 65536
+#define REGEX_MAX_TABLE (64 << 20)  /* bytes of the transitions of a DFA */
+#define REGEX_MAX_REPEAT 255
+#define REGEX_MAX_DEPTH 64          /* of the groups */
+#define REGEX_CACHE_SETS 16
+#define REGEX_ACCEPT (1u << 31)     /* transition to a state where patterns match */
+#define REGEX_MID (1u << 30)        /* transition to state M */
+#define REGEX_FLAGS (REGEX_ACCEPT | REGEX_MID)
+#define REGEX_NONE UINT32_MAX
+
+enum {
+    NFA_SET,   /* consumes a byte of the set */
+    NFA_EPS,
+    NFA_SPLIT,
+    NFA_MATCH, /* end of a pattern */
+};
+
+enum {
+    REGEX_BASE_L, /* start of a line */
+    REGEX_BASE_M,
+};
+
+typedef struct {
+    u64 w[4];
+} regex_bits_st;
+
+typedef struct {
+    u8 type;
+    u32 out;
+    u32 out1; /* of NFA_SPLIT */
+    u32 arg;  /* set of NFA_SET, pattern of NFA_MATCH */
+} nfa_node_st;
+
+typedef struct {
+    nfa_node_st *node;
+    u32 num_nodes;
+    u32 max_nodes;
+    regex_bits_st *set;
+    u32 num_sets;
+    u32 max_sets;
+    const u8 *p;       /* pattern being parsed */
+    const u8 *end;
+    u32 flags;         /* of the pattern */
+    int lines;
+    int error;
+    u32 start[2];      /* closure of the bases */
+    u32 loop[2];       /* SET nodes that lead to the bases */
+    u32 num_patterns;
+    u32 *ids;
+} nfa_st;
+
+/* Part of an NFA, end is an NFA_EPS node whose out is not set */
+typedef struct {
+    u32 start;
+    u32 end;
+} nfa_frag_st;
+
+typedef struct {
+    u32 num_states;
+    u32 num_classes;
+    u32 mid;           /* premultiplied state M */
+    u8 cls[256];
+    u8 stay[256];      /* bytes that leave state M unchanged */
+    int skip;          /* the only byte that leaves state M, or < 0 */
+    u32 *trans;        /* next state * num_classes, | REGEX_FLAGS */
+    u32 *accept_start; /* first pattern of the states in accept */
+    u32 *accept;
+    u32 *ids;
+    u32 num_patterns;
+    int lines;
+} regex_dfa_st;
+
+typedef struct {
+    u64 hash;
+    size_t bytes;
+    u8 *set;
+    regex_dfa_st *dfa;
+    u64 used;
+} regex_cache_st;
+
+static regex_cache_st regex_cache[REGEX_CACHE_SETS];
+static u64 regex_clock;
+
+static inline int regex_bit(const regex_bits_st *b, int c) {
+    return (b->w[c >> 6] >> (c & 63)) & 1;
+}
+
+static inline void regex_set_bit(regex_bits_st *b, int c) {
+    b->w[c >> 6] |= 1ull << (c & 63);
+}
+
+static void regex_set_range(regex_bits_st *b, int lo, int hi) {
+    for (int c = lo; c <= hi; ++c) {
+        regex_set_bit(b, c);
+    }
+}
+
+static void regex_invert(regex_bits_st *b) {
+    for (int i = 0; i < 4; ++i) {
+        b->w[i] = ~b->w[i];
+    }
+}
+
+/*-*****
+ * NFA *
+ *-*****/
+
+/* Node 0 is a scratch node returned on errors */
+static u32 nfa_node(nfa_st *n, int type, u32 out, u32 out1, u32 arg) {
+    if (n->num_nodes == n->max_nodes) {
+        u32 max = n->max_nodes ? n->max_nodes * 2 : 1024;
+        nfa_node_st *node;
+
+        if (n->max_nodes >= REGEX_MAX_NODES) {
+            n->error = -E2BIG;
+            return 0;
+        }
+        node = realloc(n->node, max * sizeof(*node));
+        if (!node) {
+            n->error = -ENOMEM;
+            return 0;
+        }
+        n->node = node;
+        n->max_nodes = max;
+    }
+    n->node[n->num_nodes] = (nfa_node_st) {
+        .type = type,
+        .out = out,
+        .out1 = out1,
+        .arg = arg,
+    };
+    return n->num_nodes++;
+}
+
+static u32 nfa_add_set(nfa_st *n, const regex_bits_st *b) {
+    if (n->num_sets == n->max_sets) {
+        u32 max = n->max_sets ? n->max_sets * 2 : 256;
+        regex_bits_st *set = realloc(n->set, max * sizeof(*set));
+
+        if (!set) {
+            n->error = -ENOMEM;
+            return 0;
+        }
+        n->set = set;
+        n->max_sets = max;
+    }
+    n->set[n->num_sets] = *b;
+    return nfa_node(n, NFA_SET, REGEX_NONE, REGEX_NONE, n->num_sets++);
+}
+
+/* Both cases of the letters of the set for a caseless pattern */
+static void regex_fold(const nfa_st *n, regex_bits_st *b) {
+    if (n->flags & TSP_REGEX_CASELESS) {
+        for (int c = 'a'; c <= 'z'; ++c) {
+            if (regex_bit(b, c) || regex_bit(b, c - 'a' + 'A')) {
+                regex_set_bit(b, c);
+                regex_set_bit(b, c - 'a' + 'A');
+            }
+        }
+    }
+}
+
+/* Set of a pattern, without the new line in line mode */
+static u32 nfa_set(nfa_st *n, regex_bits_st *b) {
+    if (n->lines) {
+        b->w[0] &= ~(1ull << '\n');
+    }
+    regex_fold(n, b);
+    return nfa_add_set(n, b);
+}
+
+static nfa_frag_st nfa_empty(nfa_st *n) {
+    u32 e = nfa_node(n, NFA_EPS, REGEX_NONE, REGEX_NONE, 0);
+    return (nfa_frag_st) {e, e};
+}
+
+static nfa_frag_st nfa_single(nfa_st *n, u32 node) {
+    u32 e = nfa_node(n, NFA_EPS, REGEX_NONE, REGEX_NONE, 0);
+
+    n->node[node].out = e;
+    return (nfa_frag_st) {node, e};
+}
+
+/* SPLIT nodes to all the nodes of out */
+static u32 nfa_fork(nfa_st *n, const u32 *out, u32 num) {
+    u32 s = out[num - 1];
+
+    for (u32 i = num - 1; i-- > 0;) {
+        s = nfa_node(n, NFA_SPLIT, out[i], s, 0);
+    }
+    return s;
+}
+
+/*-*********
+ * Parsing *
+ *-*********/
+
+static int regex_peek(const nfa_st *n) {
+    return n->p < n->end ? *n->p : -1;
+}
+
+static int regex_hex(int c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+/* Escape after a backslash, returns its byte or -1 for a class set in b */
+static int regex_escape(nfa_st *n, regex_bits_st *b) {
+    int c = regex_peek(n), h, l, invert = 0;
+
+    if (c < 0) {
+        n->error = -EINVAL;
+        return 0;
+    }
+    n->p++;
+    memset(b, 0, sizeof(*b));
+    switch (c) {
+    case 'D':
+        invert = 1;
+        /* fallthrough */
+    case 'd':
+        regex_set_range(b, '0', '9');
+        break;
+    case 'W':
+        invert = 1;
+        /* fallthrough */
+    case 'w':
+        regex_set_range(b, '0', '9');
+        regex_set_range(b, 'A', 'Z');
+        regex_set_range(b, 'a', 'z');
+        regex_set_bit(b, '_');
+        break;
+    case 'S':
+        invert = 1;
+        /* fallthrough */
+    case 's':
+        regex_set_range(b, '\t', '\r');
+        regex_set_bit(b, ' ');
+        break;
+    case 'n':
+        return '\n';
+    case 't':
+        return '\t';
+    case 'r':
+        return '\r';
+    case 'f':
+        return '\f';
+    case 'v':
+        return '\v';
+    case 'x':
+        h = n->end - n->p >= 2 ? regex_hex(n->p[0]) : -1;
+        l = h >= 0 ? regex_hex(n->p[1]) : -1;
+        if (l < 0) {
+            n->error = -EINVAL;
+            return 0;
+        }
+        n->p += 2;
+        return h << 4 | l;
+    default:
+        if ((c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')) {
+            n->error = -EINVAL;
+        }
+        return c;
+    }
+    if (invert) {
+        regex_invert(b);
+    }
+    return -1;
+}
+
+/* Bracket expression, after the '[' */
+static void regex_class(nfa_st *n, regex_bits_st *b) {
+    regex_bits_st e;
+    int negate = 0, first = 1, lo, hi;
+
+    memset(b, 0, sizeof(*b));
+    if (regex_peek(n) == '^') {
+        negate = 1;
+        n->p++;
+    }
+    while (!n->error) {
+        lo = regex_peek(n);
+        if (lo < 0) {
+            n->error = -EINVAL;
+            return;
+        }
+        n->p++;
+        if (lo == ']' && !first) {
+            break;
+        }
+        first = 0;
+        // Character classes ([:alpha:]) are not supported
+        if (lo == '[' && regex_peek(n) == ':') {
+            n->error = -EINVAL;
+            return;
+        }
+        if (lo == '\\') {
+            lo = regex_escape(n, &e);
+            if (lo < 0) {
+                for (int i = 0; i < 4; ++i) {
+                    b->w[i] |= e.w[i];
+                }
+                continue;
+            }
+        }
+        hi = lo;
+        if (n->end - n->p >= 2 && n->p[0] == '-' && n->p[1] != ']') {
+            n->p++;
+            hi = *n->p++;
+            if (hi == '\\') {
+                hi = regex_escape(n, &e);
+            }
+            if (hi < lo) {
+                n->error = -EINVAL;
+                return;
+            }
+        }
+        regex_set_range(b, lo, hi);
+    }
+    // [^a] of a caseless pattern excludes A as well
+    if (negate) {
+        regex_fold(n, b);
+        regex_invert(b);
+    }
+}
+
+static nfa_frag_st nfa_alt(nfa_st *n, int depth);
+
+static nfa_frag_st nfa_atom(nfa_st *n, int depth) {
+    regex_bits_st b = {0};
+    nfa_frag_st f;
+    int c = regex_peek(n);
+
+    switch (c) {
+    case '(':
+        n->p++;
+        if (regex_peek(n) == '?') {
+            if (n->end - n->p < 2 || n->p[1] != ':') {
+                break;
+            }
+            n->p += 2;
+        }
+        if (depth >= REGEX_MAX_DEPTH) {
+            break;
+        }
+        f = nfa_alt(n, depth + 1);
+        if (regex_peek(n) != ')') {
+            break;
+        }
+        n->p++;
+        return f;
+    case '[':
+        n->p++;
+        regex_class(n, &b);
+        return nfa_single(n, nfa_set(n, &b));
+    case '.':
+        n->p++;
+        regex_invert(&b);
+        b.w[0] &= ~(1ull << '\n');
+        return nfa_single(n, nfa_set(n, &b));
+    case '\\':
+        n->p++;
+        c = regex_escape(n, &b);
+        if (c >= 0) {
+            regex_set_bit(&b, c);
+        }
+        return nfa_single(n, nfa_set(n, &b));
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+    case ')':
+    case '|':
+    case '^':
+    case '$':
+    case -1:
+        break;
+    default:
+        n->p++;
+        regex_set_bit(&b, c);
+        return nfa_single(n, nfa_set(n, &b));
+    }
+    if (!n->error) {
+        n->error = -EINVAL;
+    }
+    return nfa_empty(n);
+}
+
+static int regex_number(nfa_st *n) {
+    int v = 0, digits = 0;
+
+    while (n->p < n->end && *n->p >= '0' && *n->p <= '9' && v <= REGEX_MAX_REPEAT) {
+        v = v * 10 + *n->p++ - '0';
+        digits++;
+    }
+    return digits ? v : -1;
+}
+
+/* Atom and its quantifier, the copies of the atom a quantifier needs are
+ * parsed again from the pattern */
+static nfa_frag_st nfa_repeat(nfa_st *n, int depth) {
+    const u8 *atom = n->p, *after;
+    nfa_frag_st f = nfa_atom(n, depth), g, r;
+    int min, max, c = regex_peek(n), copies;
+
+    switch (c) {
+    case '*':
+    case '+':
+    case '?':
+        n->p++;
+        min = c == '+';
+        max = c == '?' ? 1 : -1;
+        break;
+    case '{':
+        n->p++;
+        min = regex_number(n);
+        max = min;
+        if (regex_peek(n) == ',') {
+            n->p++;
+            max = regex_peek(n) == '}' ? -1 : regex_number(n);
+        }
+        if (regex_peek(n) != '}' || min < 0 || min > REGEX_MAX_REPEAT ||
+            max > REGEX_MAX_REPEAT || (max >= 0 && max < min)) {
+            n->error = -EINVAL;
+            return f;
+        }
+        n->p++;
+        break;
+    default:
+        return f;
+    }
+    // Lazy quantifiers end at the same places
+    if (regex_peek(n) == '?') {
+        n->p++;
+    }
+    c = regex_peek(n);
+    if (c == '*' || c == '+' || c == '?' || c == '{') {
+        n->error = -EINVAL;
+        return f;
+    }
+
+    after = n->p;
+    copies = min + (max < 0 ? 1 : max - min);
+    r = nfa_empty(n);
+    for (int i = 0; i < copies && !n->error; ++i) {
+        if (i) {
+            n->p = atom;
+            g = nfa_atom(n, depth);
+        } else {
+            g = f;
+        }
+        if (i >= min) {
+            u32 e = nfa_node(n, NFA_EPS, REGEX_NONE, REGEX_NONE, 0);
+            u32 s = nfa_node(n, NFA_SPLIT, g.start, e, 0);
+
+            n->node[g.end].out = max < 0 ? s : e;
+            g = (nfa_frag_st) {s, e};
+        }
+        n->node[r.end].out = g.start;
+        r.end = g.end;
+    }
+    n->p = after;
+    return r;
+}
+
+static nfa_frag_st nfa_concat(nfa_st *n, int depth) {
+    nfa_frag_st f = nfa_empty(n), g;
+
+    while (!n->error && n->p < n->end && *n->p != '|' && *n->p != ')') {
+        g = nfa_repeat(n, depth);
+        n->node[f.end].out = g.start;
+        f.end = g.end;
+    }
+    return f;
+}
+
+static nfa_frag_st nfa_alt(nfa_st *n, int depth) {
+    nfa_frag_st f = nfa_concat(n, depth), g;
+
+    while (!n->error && regex_peek(n) == '|') {
+        u32 s, e;
+
+        n->p++;
+        g = nfa_concat(n, depth);
+        e = nfa_node(n, NFA_EPS, REGEX_NONE, REGEX_NONE, 0);
+        s = nfa_node(n, NFA_SPLIT, f.start, g.start, 0);
+        n->node[f.end].out = e;
+        n->node[g.end].out = e;
+        f = (nfa_frag_st) {s, e};
+    }
+    return f;
+}
+
+/* Returns 1 if the pattern from start matches the empty string */
+static int nfa_nullable(const nfa_st *n, u32 start, u32 *stack, u8 *seen) {
+    int sp = 0, nullable = 0;
+
+    memset(seen, 0, n->num_nodes);
+    stack[sp++] = start;
+    seen[start] = 1;
+    while (sp) {
+        const nfa_node_st *x = &n->node[stack[--sp]];
+        u32 out[2] = {x->out, x->out1};
+
+        if (x->type == NFA_MATCH) {
+            nullable = 1;
+            break;
+        }
+        for (int i = 0; i < (x->type == NFA_SPLIT ? 2 : x->type == NFA_EPS); ++i) {
+            if (!seen[out[i]]) {
+                seen[out[i]] = 1;
+                stack[sp++] = out[i];
+            }
+        }
+    }
+    return nullable;
+}
+
+/* Parses the patterns of the set into n */
+static int nfa_build(nfa_st *n, const void *set, size_t bytes) {
+    const TspRegexSet *hdr = set;
+    u32 *start[2], num[2] = {0, 0}, *stack = NULL, base[2];
+    regex_bits_st b;
+    size_t off = sizeof(*hdr);
+    u8 *seen = NULL;
+    int ret = -ENOMEM;
+
+    if (bytes < sizeof(*hdr) || !hdr->NumPatterns || hdr->NumPatterns > TSP_REGEX_MAX_PATTERNS ||
+        hdr->Flags & ~TSP_REGEX_LINES) {
+        return -EINVAL;
+    }
+    n->lines = !!(hdr->Flags & TSP_REGEX_LINES);
+    n->num_patterns = hdr->NumPatterns;
+    n->ids = malloc(n->num_patterns * sizeof(*n->ids));
+    // [0] : anchored starts then room for the base, [1] : unanchored ones
+    start[0] = malloc((n->num_patterns + 1) * sizeof(u32));
+    start[1] = malloc((n->num_patterns + 2) * sizeof(u32));
+    if (!n->ids || !start[0] || !start[1]) {
+        goto out;
+    }
+    nfa_node(n, NFA_EPS, REGEX_NONE, REGEX_NONE, 0);
+
+    for (u32 i = 0; i < n->num_patterns && !n->error; ++i) {
+        const TspRegexPattern *pat = (const void *)((const u8 *)set + off);
+        nfa_frag_st f;
+        int anchored;
+
+        if (bytes - off < sizeof(*pat) || pat->Length > bytes - off - sizeof(*pat) ||
+            pat->Flags & ~TSP_REGEX_CASELESS) {
+            n->error = -EINVAL;
+            break;
+        }
+        n->ids[i] = pat->Id;
+        n->flags = pat->Flags;
+        n->p = (const u8 *)(pat + 1);
+        n->end = n->p + pat->Length;
+        anchored = regex_peek(n) == '^';
+        n->p += anchored;
+        f = nfa_alt(n, 0);
+        if (n->p != n->end && !n->error) {
+            n->error = -EINVAL;
+        }
+        n->node[f.end].out = nfa_node(n, NFA_MATCH, REGEX_NONE, REGEX_NONE, i);
+        start[!anchored][num[!anchored]++] = f.start;
+        off = (off + sizeof(*pat) + pat->Length + 7) & ~(size_t)7;
+        if (off > bytes) {
+            off = bytes;
+        }
+    }
+    if (n->error) {
+        ret = n->error;
+        goto out;
+    }
+
+    // Base M : loop on the bytes but the new line, new line to base L
+    memset(&b, 0xFF, sizeof(b));
+    b.w[0] &= ~(1ull << '\n');
+    n->loop[REGEX_BASE_M] = nfa_add_set(n, &b);
+    memset(&b, 0, sizeof(b));
+    regex_set_bit(&b, '\n');
+    n->loop[REGEX_BASE_L] = nfa_add_set(n, &b);
+    start[1][num[1]++] = n->loop[REGEX_BASE_M];
+    start[1][num[1]++] = n->loop[REGEX_BASE_L];
+    base[REGEX_BASE_M] = nfa_fork(n, start[1], num[1]);
+    start[0][num[0]++] = base[REGEX_BASE_M];
+    base[REGEX_BASE_L] = nfa_fork(n, start[0], num[0]);
+    n->node[n->loop[REGEX_BASE_M]].out = base[REGEX_BASE_M];
+    n->node[n->loop[REGEX_BASE_L]].out = base[REGEX_BASE_L];
+    n->start[REGEX_BASE_L] = base[REGEX_BASE_L];
+    n->start[REGEX_BASE_M] = base[REGEX_BASE_M];
+    if (n->error) {
+        ret = n->error;
+        goto out;
+    }
+
+    // A pattern that matches the empty string would match everywhere
+    stack = malloc(n->num_nodes * sizeof(*stack));
+    seen = malloc(n->num_nodes);
+    if (!stack || !seen) {
+        goto out;
+    }
+    ret = 0;
+    for (int k = 0; k < 2; ++k) {
+        for (u32 i = 0; i < num[k]; ++i) {
+            if (nfa_nullable(n, start[k][i], stack, seen) && start[k][i] != base[REGEX_BASE_M]) {
+                ret = -EINVAL;
+            }
+        }
+    }
+
+out:
+    free(start[0]);
+    free(start[1]);
+    free(stack);
+    free(seen);
+    return ret;
+}
+
+static void nfa_free(nfa_st *n) {
+    free(n->node);
+    free(n->set);
+    free(n->ids);
+}
+
+/*-*****
+ * DFA *
+ *-*****/
+
+typedef struct {
+    const nfa_st *n;
+    regex_dfa_st *d;
+    u32 *pool;          /* keys of the states : base then sorted nodes */
+    size_t pool_num;
+    size_t pool_max;
+    size_t *key;        /* start of the key of the states in pool */
+    u32 *key_len;
+    u32 max_states;
+    u32 *table;         /* hash table of the states, state + 1 */
+    u32 table_size;
+    u32 *mark;          /* per NFA node */
+    u32 gen;
+    u32 *stack;
+    u32 *list;          /* nodes of the state being built */
+    u32 num_list;
+    u8 *in_base[2];     /* NFA nodes held by the bases */
+    u32 *base_list[2];  /* nodes reached from the bases, per class */
+    u32 *base_start[2];
+    u8 rep[256];        /* byte of the classes */
+    u32 nl_class;
+} dfa_build_st;
+
+/* Adds the SET and MATCH nodes reachable from x to the list */
+static void dfa_closure(dfa_build_st *b, u32 x) {
+    const nfa_node_st *node = b->n->node;
+    u32 sp = 0;
+
+    if (b->mark[x] == b->gen) {
+        return;
+    }
+    b->mark[x] = b->gen;
+    b->stack[sp++] = x;
+    while (sp) {
+        const nfa_node_st *y;
+
+        x = b->stack[--sp];
+        y = &node[x];
+        if (y->type == NFA_SET || y->type == NFA_MATCH) {
+            b->list[b->num_list++] = x;
+            continue;
+        }
+        if (y->type == NFA_SPLIT && b->mark[y->out1] != b->gen) {
+            b->mark[y->out1] = b->gen;
+            b->stack[sp++] = y->out1;
+        }
+        if (b->mark[y->out] != b->gen) {
+            b->mark[y->out] = b->gen;
+            b->stack[sp++] = y->out;
+        }
+    }
+}
+
+static int dfa_cmp(const void *a, const void *b) {
+    u32 x = *(const u32 *)a, y = *(const u32 *)b;
+    return x < y ? -1 : x > y;
+}
+
+static u32 dfa_hash(const u32 *key, u32 len) {
+    u32 h = 2166136261u;
+
+    for (u32 i = 0; i < len; ++i) {
+        h = (h ^ key[i]) * 16777619u;
+    }
+    return h;
+}
+
+static int dfa_rehash(dfa_build_st *b) {
+    u32 size = b->table_size ? b->table_size * 2 : 1024;
+    u32 *table = calloc(size, sizeof(*table));
+
+    if (!table) {
+        return -ENOMEM;
+    }
+    for (u32 s = 0; s < b->d->num_states; ++s) {
+        u32 i = dfa_hash(b->pool + b->key[s], b->key_len[s]) & (size - 1);
+        while (table[i]) {
+            i = (i + 1) & (size - 1);
+        }
+        table[i] = s + 1;
+    }
+    free(b->table);
+    b->table = table;
+    b->table_size = size;
+    return 0;
+}
+
+/* Makes room for one more state */
+static int dfa_grow(dfa_build_st *b, size_t key_len) {
+    regex_dfa_st *d = b->d;
+
+    if (d->num_states == REGEX_MAX_STATES ||
+        (size_t)(d->num_states + 1) * d->num_classes * sizeof(u32) > REGEX_MAX_TABLE) {
+        return -E2BIG;
+    }
+    if (d->num_states == b->max_states) {
+        u32 max = b->max_states ? b->max_states * 2 : 256;
+        size_t *key = realloc(b->key, max * sizeof(*key));
+        u32 *key_len, *trans;
+
+        if (!key) {
+            return -ENOMEM;
+        }
+        b->key = key;
+        key_len = realloc(b->key_len, max * sizeof(*key_len));
+        if (!key_len) {
+            return -ENOMEM;
+        }
+        b->key_len = key_len;
+        trans = realloc(d->trans, (size_t)max * d->num_classes * sizeof(*trans));
+        if (!trans) {
+            return -ENOMEM;
+        }
+        d->trans = trans;
+        b->max_states = max;
+    }
+    if (b->pool_num + key_len > b->pool_max) {
+        size_t max = (b->pool_max ? b->pool_max * 2 : 4096) + key_len;
+        u32 *pool = realloc(b->pool, max * sizeof(*pool));
+
+        if (!pool) {
+            return -ENOMEM;
+        }
+        b->pool = pool;
+        b->pool_max = max;
+    }
+    return 0;
+}
+
+/* State of the nodes of the list over the base, added if new, returns it or
+ * a negative error. The list is filtered of the nodes of the base. */
+static int64_t dfa_state(dfa_build_st *b, int base) {
+    u32 num = 0, h, i, len;
+    const u32 *key;
+    int ret;
+
+    for (u32 k = 0; k < b->num_list; ++k) {
+        if (!b->in_base[base][b->list[k]]) {
+            b->list[num++] = b->list[k];
+        }
+    }
+    // The base is stored in place of the node 0, which no state holds
+    b->list[num++] = base;
+    qsort(b->list, num, sizeof(*b->list), dfa_cmp);
+    b->list[0] = base;
+    key = b->list;
+    len = num;
+
+    h = dfa_hash(key, len);
+    for (i = h & (b->table_size - 1); b->table[i]; i = (i + 1) & (b->table_size - 1)) {
+        u32 s = b->table[i] - 1;
+        if (b->key_len[s] == len && !memcmp(b->pool + b->key[s], key, len * sizeof(*key))) {
+            return s;
+        }
+    }
+
+    ret = dfa_grow(b, len);
+    if (ret) {
+        return ret;
+    }
+    b->key[b->d->num_states] = b->pool_num;
+    b->key_len[b->d->num_states] = len;
+    memcpy(b->pool + b->pool_num, key, len * sizeof(*key));
+    b->pool_num += len;
+    b->table[i] = ++b->d->num_states;
+    if (b->d->num_states * 2 > b->table_size && (ret = dfa_rehash(b))) {
+        return ret;
+    }
+    return b->d->num_states - 1;
+}
+
+/* Classes of the bytes : bytes in the same sets of the NFA */
+static void dfa_classes(dfa_build_st *b) {
+    regex_dfa_st *d = b->d;
+    u32 map[512];
+
+    memset(d->cls, 0, sizeof(d->cls));
+    d->num_classes = 1;
+    for (u32 s = 0; s < b->n->num_sets; ++s) {
+        const regex_bits_st *set = &b->n->set[s];
+        u32 num = 0;
+
+        memset(map, 0xFF, d->num_classes * 2 * sizeof(*map));
+        for (int c = 0; c < 256; ++c) {
+            u32 k = d->cls[c] * 2 + regex_bit(set, c);
+            if (map[k] == REGEX_NONE) {
+                map[k] = num++;
+            }
+            d->cls[c] = map[k];
+        }
+        d->num_classes = num;
+    }
+    for (int c = 255; c >= 0; --c) {
+        b->rep[d->cls[c]] = c;
+    }
+    b->nl_class = d->cls['\n'];
+}
+
+/* Nodes of the bases and the nodes they reach on each class, but the ones of
+ * their loops */
+static int dfa_bases(dfa_build_st *b) {
+    const nfa_st *n = b->n;
+    u32 nc = b->d->num_classes;
+
+    for (int base = 0; base < 2; ++base) {
+        u32 *list, num, total = 0;
+
+        b->in_base[base] = calloc(n->num_nodes, 1);
+        b->base_start[base] = malloc((nc + 1) * sizeof(u32));
+        if (!b->in_base[base] || !b->base_start[base]) {
+            return -ENOMEM;
+        }
+        b->gen++;
+        b->num_list = 0;
+        dfa_closure(b, n->start[base]);
+        num = b->num_list;
+        list = malloc(num * sizeof(*list));
+        if (!list) {
+            return -ENOMEM;
+        }
+        memcpy(list, b->list, num * sizeof(*list));
+        for (u32 k = 0; k < num; ++k) {
+            b->in_base[base][list[k]] = 1;
+        }
+
+        b->base_list[base] = NULL;
+        for (u32 c = 0; c < nc; ++c) {
+            u32 *more;
+
+            b->gen++;
+            b->num_list = 0;
+            for (u32 k = 0; k < num; ++k) {
+                const nfa_node_st *x = &n->node[list[k]];
+                if (x->type == NFA_SET && list[k] != n->loop[REGEX_BASE_L] &&
+                    list[k] != n->loop[REGEX_BASE_M] && regex_bit(&n->set[x->arg], b->rep[c])) {
+                    dfa_closure(b, x->out);
+                }
+            }
+            more = realloc(b->base_list[base], (total + b->num_list + 1) * sizeof(*more));
+            if (!more) {
+                free(list);
+                return -ENOMEM;
+            }
+            b->base_list[base] = more;
+            b->base_start[base][c] = total;
+            memcpy(more + total, b->list, b->num_list * sizeof(*more));
+            total += b->num_list;
+        }
+        b->base_start[base][nc] = total;
+        free(list);
+    }
+    return 0;
+}
+
+static int dfa_build(dfa_build_st *b) {
+    const nfa_st *n = b->n;
+    regex_dfa_st *d = b->d;
+    u32 nc, total = 0;
+    int ret;
+
+    dfa_classes(b);
+    nc = d->num_classes;
+    b->mark = calloc(n->num_nodes, sizeof(*b->mark));
+    b->stack = malloc(n->num_nodes * sizeof(*b->stack));
+    b->list = malloc((n->num_nodes + 1) * sizeof(*b->list));
+    if (!b->mark || !b->stack || !b->list || dfa_rehash(b)) {
+        return -ENOMEM;
+    }
+    ret = dfa_bases(b);
+    if (ret) {
+        return ret;
+    }
+
+    // State 0 is L (the start), state 1 is M
+    for (int base = 0; base < 2; ++base) {
+        b->num_list = 0;
+        ret = dfa_state(b, base);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    d->mid = REGEX_BASE_M * nc;
+
+    for (u32 s = 0; s < d->num_states; ++s) {
+        for (u32 c = 0; c < nc; ++c) {
+            int base = b->pool[b->key[s]];
+            const u32 *from = b->base_list[base] + b->base_start[base][c];
+            u32 num = b->base_start[base][c + 1] - b->base_start[base][c];
+            int64_t next;
+
+            b->gen++;
+            b->num_list = 0;
+            for (u32 k = 0; k < num; ++k) {
+                if (b->mark[from[k]] != b->gen) {
+                    b->mark[from[k]] = b->gen;
+                    b->list[b->num_list++] = from[k];
+                }
+            }
+            for (u32 k = 1; k < b->key_len[s]; ++k) {
+                const nfa_node_st *x = &n->node[b->pool[b->key[s] + k]];
+                if (x->type == NFA_SET && regex_bit(&n->set[x->arg], b->rep[c])) {
+                    dfa_closure(b, x->out);
+                }
+            }
+            next = dfa_state(b, c == b->nl_class ? REGEX_BASE_L : REGEX_BASE_M);
+            if (next < 0) {
+                return next;
+            }
+            d->trans[(size_t)s * nc + c] = next * nc;
+        }
+    }
+
+    // Patterns that match in each state
+    d->accept_start = malloc((d->num_states + 1) * sizeof(u32));
+    if (!d->accept_start) {
+        return -ENOMEM;
+    }
+    for (u32 s = 0; s < d->num_states; ++s) {
+        d->accept_start[s] = total;
+        for (u32 k = 1; k < b->key_len[s]; ++k) {
+            total += n->node[b->pool[b->key[s] + k]].type == NFA_MATCH;
+        }
+    }
+    d->accept_start[d->num_states] = total;
+    d->accept = malloc((total + 1) * sizeof(u32));
+    if (!d->accept) {
+        return -ENOMEM;
+    }
+    for (u32 s = 0, i = 0; s < d->num_states; ++s) {
+        for (u32 k = 1; k < b->key_len[s]; ++k) {
+            const nfa_node_st *x = &n->node[b->pool[b->key[s] + k]];
+            if (x->type == NFA_MATCH) {
+                d->accept[i++] = x->arg;
+            }
+        }
+    }
+    for (size_t t = 0; t < (size_t)d->num_states * nc; ++t) {
+        u32 s = d->trans[t] / nc;
+        if (d->accept_start[s + 1] > d->accept_start[s]) {
+            d->trans[t] |= REGEX_ACCEPT;
+        }
+        if (d->trans[t] == d->mid) {
+            d->trans[t] |= REGEX_MID;
+        }
+    }
+    d->skip = -1;
+    for (int c = 0, num = 0; c < 256; ++c) {
+        d->stay[c] = d->trans[d->mid + d->cls[c]] == (d->mid | REGEX_MID);
+        if (!d->stay[c]) {
+            d->skip = num++ ? -2 : c;
+        }
+    }
+    return 0;
+}
+
+static void regex_free(regex_dfa_st *d) {
+    if (d) {
+        free(d->trans);
+        free(d->accept_start);
+        free(d->accept);
+        free(d->ids);
+        free(d);
+    }
+}
+
+static int regex_compile(const void *set, size_t bytes, regex_dfa_st **dfa) {
+    nfa_st n = {0};
+    dfa_build_st b = {.n = &n};
+    regex_dfa_st *d = calloc(1, sizeof(*d));
+    int ret = -ENOMEM;
+
+    if (d) {
+        b.d = d;
+        ret = nfa_build(&n, set, bytes);
+        if (!ret) {
+            ret = dfa_build(&b);
+        }
+        d->ids = n.ids;
+        d->num_patterns = n.num_patterns;
+        d->lines = n.lines;
+        n.ids = NULL;
+    }
+
+    free(b.pool);
+    free(b.key);
+    free(b.key_len);
+    free(b.table);
+    free(b.mark);
+    free(b.stack);
+    free(b.list);
+    for (int base = 0; base < 2; ++base) {
+        free(b.in_base[base]);
+        free(b.base_list[base]);
+        free(b.base_start[base]);
+    }
+    nfa_free(&n);
+
+    if (ret) {
+        regex_free(d);
+        return ret;
+    }
+    *dfa = d;
+    return 0;
+}
+
+/* Compiled set, from the cache */
+static int regex_compiled(const void *set, size_t bytes, const regex_dfa_st **dfa) {
+    u64 hash = checksum_xxh3(set, bytes);
+    regex_cache_st *e = &regex_cache[0];
+    regex_dfa_st *d;
+    u8 *copy;
+    int ret;
+
+    for (int i = 0; i < REGEX_CACHE_SETS; ++i) {
+        regex_cache_st *c = &regex_cache[i];
+
+        if (c->dfa && c->hash == hash && c->bytes == bytes && !memcmp(c->set, set, bytes)) {
+            c->used = ++regex_clock;
+            *dfa = c->dfa;
+            return 0;
+        }
+        if (c->used < e->used) {
+            e = c;
+        }
+    }
+
+    copy = malloc(bytes);
+    if (!copy) {
+        return -ENOMEM;
+    }
+    ret = regex_compile(set, bytes, &d);
+    if (ret) {
+        free(copy);
+        return ret;
+    }
+    memcpy(copy, set, bytes);
+    free(e->set);
+    regex_free(e->dfa);
+    *e = (regex_cache_st) {
+        .hash = hash,
+        .bytes = bytes,
+        .set = copy,
+        .dfa = d,
+        .used = ++regex_clock,
+    };
+    *dfa = d;
+    return 0;
+}
+
+/*-********
+ * Search *
+ *-********/
+
+typedef struct {
+    u64 end;     /* of the match in the data */
+    u32 pattern; /* index */
+} regex_match_st;
+
+typedef struct {
+    size_t start; /* [start, end) of the data */
+    size_t end;
+    u32 guess;    /* premultiplied state the chunk is searched from */
+    u32 state;    /* at the end */
+    u32 check[REGEX_CHECKS]; /* states at the checkpoints */
+    regex_match_st *match;
+    size_t num_matches;
+    size_t max_matches;
+    u64 *line_end; /* of the last match of each pattern (lines) */
+    int error;
+} regex_chunk_st;
+
+typedef struct {
+    const regex_dfa_st *dfa;
+    const u8 *data;
+    size_t bytes;
+    regex_chunk_st *chunks;
+} regex_search_st;
+
+static void regex_add(regex_chunk_st *chunk, const regex_match_st *match) {
+    if (chunk->num_matches == chunk->max_matches) {
+        size_t max = chunk->max_matches ? chunk->max_matches * 2 : 256;
+        regex_match_st *m = realloc(chunk->match, max * sizeof(*m));
+
+        if (!m) {
+            chunk->error = -ENOMEM;
+            return;
+        }
+        chunk->match = m;
+        chunk->max_matches = max;
+    }
+    chunk->match[chunk->num_matches++] = *match;
+}
+
+static void regex_report(const regex_search_st *s, regex_chunk_st *chunk, size_t end, u32 state) {
+    const regex_dfa_st *d = s->dfa;
+
+    state /= d->num_classes;
+    for (u32 k = d->accept_start[state]; k < d->accept_start[state + 1]; ++k) {
+        regex_match_st m = {end, d->accept[k]};
+
+        // Once per line and pattern
+        if (d->lines) {
+            const u8 *nl;
+
+            if (end <= chunk->line_end[m.pattern]) {
+                continue;
+            }
+            nl = memchr(s->data + end, '\n', s->bytes - end);
+            chunk->line_end[m.pattern] = nl ? (size_t)(nl - s->data) : s->bytes;
+        }
+        regex_add(chunk, &m);
+    }
+}
+
+/* Skips the bytes that leave state M unchanged */
+static inline size_t regex_skip(const regex_dfa_st *d, const u8 *data, size_t pos, size_t end) {
+    if (d->skip >= 0) {
+        const u8 *p = memchr(data + pos, d->skip, end - pos);
+        return p ? (size_t)(p - data) : end;
+    }
+    while (end - pos >= 8 && d->stay[data[pos]] & d->stay[data[pos + 1]] &
+           d->stay[data[pos + 2]] & d->stay[data[pos + 3]] & d->stay[data[pos + 4]] &
+           d->stay[data[pos + 5]] & d->stay[data[pos + 6]] & d->stay[data[pos + 7]]) {
+        pos += 8;
+    }
+    while (pos < end && d->stay[data[pos]]) {
+        pos++;
+    }
+    return pos;
+}
+
+/* Searches [from, to) of the chunk from the state, the matches added to the
+ * chunk if report. At the checkpoints, the state is recorded in check if given,
+ * or compared to compare if given and the search stops where they agree (at
+ * *stop). Returns the state at *stop. */
+static u32 regex_run(const regex_search_st *s, regex_chunk_st *chunk, size_t from, size_t to,
+                     u32 state, int report, u32 *check, const u32 *compare, size_t *stop) {
+    const regex_dfa_st *d = s->dfa;
+    const u8 *data = s->data;
+    const u32 *trans = d->trans;
+    size_t pos = from, base = chunk->start;
+
+    while (pos < to) {
+        size_t next = base + ((pos - base) / REGEX_CHECK_BYTES + 1) * REGEX_CHECK_BYTES;
+        size_t k;
+
+        if (next > to) {
+            next = to;
+        }
+        if (state == d->mid) {
+            pos = regex_skip(d, data, pos, next);
+        }
+        while (pos < next) {
+            u32 t = trans[state + d->cls[data[pos++]]];
+
+            state = t & ~REGEX_FLAGS;
+            if (t & REGEX_FLAGS) {
+                if ((t & REGEX_ACCEPT) && report) {
+                    regex_report(s, chunk, pos, state);
+                }
+                if (t & REGEX_MID) {
+                    pos = regex_skip(d, data, pos, next);
+                }
+            }
+        }
+
+        k = (pos - base) / REGEX_CHECK_BYTES;
+        if ((pos - base) % REGEX_CHECK_BYTES || !k || k > REGEX_CHECKS) {
+            continue;
+        }
+        if (check) {
+            check[k - 1] = state;
+        } else if (compare && compare[k - 1] == state) {
+            break;
+        }
+    }
+    *stop = pos;
+    return state;
+}
+
+static void regex_chunk(void *arg, int i, int worker) {
+    regex_search_st *s = arg;
+    regex_chunk_st *chunk = &s->chunks[i];
+    size_t stop;
+
+    if (s->dfa->lines && !(chunk->line_end = calloc(s->dfa->num_patterns, sizeof(u64)))) {
+        chunk->error = -ENOMEM;
+        return;
+    }
+    chunk->state = regex_run(s, chunk, chunk->start, chunk->end, chunk->guess, 1, chunk->check,
+                             NULL, &stop);
+}
+
+/* Searches the chunk again from its real start state, up to where the first
+ * search agrees, the matches of the first search before are replaced */
+static int regex_verify(const regex_search_st *s, regex_chunk_st *chunk, u32 state) {
+    regex_chunk_st again = {.start = chunk->start, .end = chunk->end};
+    size_t stop, j = 0;
+    u32 end_state;
+
+    if (s->dfa->lines && !(again.line_end = calloc(s->dfa->num_patterns, sizeof(u64)))) {
+        return -ENOMEM;
+    }
+    end_state = regex_run(s, &again, chunk->start, chunk->end, state, 1, NULL, chunk->check, &stop);
+    if (stop == chunk->end) {
+        chunk->state = end_state;
+    }
+    while (j < chunk->num_matches && chunk->match[j].end <= stop) {
+        j++;
+    }
+    for (; j < chunk->num_matches && !again.error; ++j) {
+        regex_add(&again, &chunk->match[j]);
+    }
+
+    free(chunk->match);
+    free(again.line_end);
+    chunk->match = again.match;
+    chunk->num_matches = again.num_matches;
+    chunk->max_matches = again.max_matches;
+    chunk->guess = state;
+    return again.error;
+}
+
+typedef struct {
+    const regex_search_st *s;
+    u8 *out;
+    u64 max;         /* matches that fit */
+    u64 num;
+    u64 *line_start; /* of the last line reported of each pattern (lines) */
+    size_t line[2];  /* [start, end) of the line of the last match */
+} regex_out_st;
+
+/* Writes the match, returns -ENOSPC if it does not fit */
+static int regex_emit(regex_out_st *o, const regex_match_st *m, TspRegexMatch *r) {
+    const regex_search_st *s = o->s;
+
+    r->Offset = m->end;
+    r->PatternId = s->dfa->ids[m->pattern];
+    r->Length = 0;
+    if (s->dfa->lines) {
+        if (m->end <= o->line[0] || m->end > o->line[1]) {
+            const u8 *nl = memrchr(s->data, '\n', m->end);
+
+            o->line[0] = nl ? (size_t)(nl - s->data) + 1 : 0;
+            nl = memchr(s->data + m->end, '\n', s->bytes - m->end);
+            o->line[1] = nl ? (size_t)(nl - s->data) : s->bytes;
+        }
+        if (o->line_start[m->pattern] == o->line[0]) {
+            return 0;
+        }
+        r->Offset = o->line[0];
+        r->Length = o->line[1] - o->line[0];
+    }
+    if (o->num == o->max) {
+        return -ENOSPC;
+    }
+    if (s->dfa->lines) {
+        o->line_start[m->pattern] = o->line[0];
+    }
+    memcpy(o->out + o->num++ * sizeof(*r), r, sizeof(*r));
+    return 0;
+}
+
+/* Removes the matches written at the offset (of the position or the line) */
+static void regex_unemit(regex_out_st *o, u64 offset) {
+    TspRegexMatch r;
+
+    while (o->num) {
+        memcpy(&r, o->out + (o->num - 1) * sizeof(r), sizeof(r));
+        if (r.Offset != offset) {
+            break;
+        }
+        o->num--;
+    }
+}
+
+int regex_search(const void *set, size_t set_bytes, const void *data, size_t data_bytes,
+                 void *dst, size_t dst_bytes, u32 state, TspRegexResult *result) {
+    regex_search_st s = {.data = data, .bytes = data_bytes};
+    regex_out_st o = {.s = &s, .out = dst, .max = dst_bytes / sizeof(TspRegexMatch)};
+    const regex_dfa_st *d;
+    u32 start;
+    int n, ret;
+
+    memset(result, 0, sizeof(*result));
+    ret = regex_compiled(set, set_bytes, &d);
+    if (ret) {
+        return ret;
+    }
+    if (state >= d->num_states) {
+        return -EINVAL;
+    }
+    result->State = state;
+    if (!data_bytes) {
+        return 0;
+    }
+    s.dfa = d;
+    start = state * d->num_classes;
+
+    n = (data_bytes + REGEX_CHUNK_BYTES - 1) / REGEX_CHUNK_BYTES;
+    s.chunks = calloc(n, sizeof(*s.chunks));
+    if (d->lines) {
+        o.line_start = malloc(d->num_patterns * sizeof(*o.line_start));
+    }
+    if (!s.chunks || (d->lines && !o.line_start)) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    if (o.line_start) {
+        memset(o.line_start, 0xFF, d->num_patterns * sizeof(*o.line_start));
+    }
+    for (int i = 0; i < n; ++i) {
+        regex_chunk_st *chunk = &s.chunks[i];
+
+        chunk->start = (size_t)i * REGEX_CHUNK_BYTES;
+        chunk->end = i == n - 1 ? data_bytes : chunk->start + REGEX_CHUNK_BYTES;
+        chunk->guess = !i ? start : s.data[chunk->start - 1] == '\n' ? 0 : d->mid;
+    }
+    parallel_for(n, regex_chunk, &s);
+
+    // The chunks in order, from their real start state
+    state = start;
+    for (int i = 0; i < n && !ret; ++i) {
+        regex_chunk_st *chunk = &s.chunks[i];
+        TspRegexMatch r;
+
+        if (!chunk->error && chunk->guess != state) {
+            chunk->error = regex_verify(&s, chunk, state);
+        }
+        if (chunk->error) {
+            ret = chunk->error;
+            break;
+        }
+        for (size_t j = 0; j < chunk->num_matches; ++j) {
+            ret = regex_emit(&o, &chunk->match[j], &r);
+            if (!ret) {
+                continue;
+            }
+            // Continue before the matches of the position, or of the line
+            regex_unemit(&o, r.Offset);
+            if (d->lines) {
+                result->InBytes = r.Offset;
+                result->State = r.Offset ? 0 : start / d->num_classes;
+            } else {
+                size_t stop;
+                result->InBytes = r.Offset - 1;
+                result->State = regex_run(&s, chunk, chunk->start, r.Offset - 1, chunk->guess, 0,
+                                          NULL, NULL, &stop) / d->num_classes;
+            }
+            break;
+        }
+        state = chunk->state;
+    }
+    if (!ret) {
+        result->InBytes = data_bytes;
+        result->State = state / d->num_classes;
+    }
+    result->Matches = o.num;
+
+out:
+    for (int i = 0; s.chunks && i < n; ++i) {
+        free(s.chunks[i].match);
+        free(s.chunks[i].line_end);
+    }
+    free(s.chunks);
+    free(o.line_start);
+
+    // Running out of destination is not an error once data was searched
+    if (ret == -ENOSPC && result->InBytes) {
+        ret = 0;
+    }
+    return ret;
+}
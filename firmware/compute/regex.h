@@ -0,0 +1,46 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __REGEX_H__
+#define __REGEX_H__
+
+#include <stddef.h>
+#include "tsp.h"
+
+/**
+ * @brief Searches the data for the patterns of the set (a TspRegexSet, see
+ * tsp.h). The set is compiled on its first search and kept for the next ones,
+ * the chunks of the data are searched in parallel and the matches written to
+ * the destination in order
+ * @param[in] state : State of a previous result to continue its search, 0 to
+ * start one
+ * @return 0, -EINVAL if the set or the state is invalid, -E2BIG if the
+ * automaton of the set is too large, -ENOSPC if the first match does not fit,
+ * -ENOMEM
+ * */
+int regex_search(const void *set, size_t set_bytes, const void *data, size_t data_bytes,
+                 void *dst, size_t dst_bytes, u32 state, TspRegexResult *result);
+
+#endif /* __REGEX_H__ */
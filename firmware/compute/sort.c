@@ -0,0 +1,776 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Sort of fixed-width records (Sort).
+ *
+ * A run is sorted in the FDM : the workers sort parts of the records, each by
+ * a radix sort of a 64-bit prefix of the keys (the order preserving encodings
+ * of the first keys) with the ties of longer keys sorted by comparison, then
+ * the parts are merged back in the FDM. The merge is split between the workers
+ * by splitters taken in the largest part, each worker merges the records
+ * between two splitters with a heap.
+ *
+ * An external sort keeps the sorted runs in a temporary file on the namespace
+ * (or in memory) and merges them a destination at a time. Each run in the file
+ * has a window of its next records, read when it is empty. The records up to
+ * the last one of the window that ends first are ready, no record after the
+ * windows can come before them, they are merged as the parts of a run (the
+ * ones that fill the destination by a single worker).
+ * */
+
+#include "sort.h"
+#include "namespace.h"
+#include "parallel.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SORT_MIN_PART (16 << 10)  /* records sorted by a worker, at least */
+#define SORT_MIN_MERGE (64 << 10) /* records merged by a worker, at least */
+#define SORT_WINDOW (1 << 20)     /* bytes of a run written by a worker at a time */
+#define SORT_MERGE_BYTES (64 << 20) /* windows of the runs in the temporary file */
+#define SORT_MAX_SEQS TSP_SORT_MAX_RUNS
+
+#define INLINE inline __attribute__((always_inline))
+
+/*-******
+ * Keys *
+ *-******/
+
+typedef struct {
+    u32 record_bytes, num_keys;
+    TspSortKey keys[TSP_SORT_MAX_KEYS];
+    u32 prefix_keys; /* keys in the radix sort prefix */
+    int prefix_only; /* the prefix orders the records */
+} sort_spec_st;
+
+static u32 sort_key_width(const TspSortKey *key) {
+    switch (key->Type) {
+    case TSP_FILTER_I32:
+    case TSP_FILTER_U32:
+    case TSP_FILTER_F32:
+        return 4;
+    case TSP_FILTER_I64:
+    case TSP_FILTER_U64:
+    case TSP_FILTER_F64:
+        return 8;
+    case TSP_FILTER_STR:
+        return key->Width;
+    default:
+        return 0;
+    }
+}
+
+static int sort_spec(sort_spec_st *spec, const void *desc, size_t bytes) {
+    const TspSortSpec *s = desc;
+
+    if (bytes < sizeof(*s)) {
+        return -EINVAL;
+    }
+    memset(spec, 0, sizeof(*spec));
+    spec->record_bytes = s->RecordBytes;
+    spec->num_keys = s->NumKeys;
+    if (!spec->record_bytes || !spec->num_keys || spec->num_keys > TSP_SORT_MAX_KEYS ||
+        spec->num_keys > (bytes - sizeof(*s)) / sizeof(TspSortKey)) {
+        return -EINVAL;
+    }
+    memcpy(spec->keys, s->Keys, spec->num_keys * sizeof(TspSortKey));
+    for (u32 k = 0; k < spec->num_keys; ++k) {
+        u32 width = sort_key_width(&spec->keys[k]);
+        if (!width || spec->keys[k].Offset > spec->record_bytes - width ||
+            width > spec->record_bytes) {
+            return -EINVAL;
+        }
+    }
+
+    // The prefix holds the first keys, the part of the last one that fits
+    for (u32 bits = 0; spec->prefix_keys < spec->num_keys && bits < 64; spec->prefix_keys++) {
+        u32 width = sort_key_width(&spec->keys[spec->prefix_keys]);
+        bits += width < 8 ? 8 * width : 64;
+        spec->prefix_only = bits <= 64 && width <= 8;
+    }
+    spec->prefix_only &= spec->prefix_keys == spec->num_keys;
+    return 0;
+}
+
+/* Key as an unsigned integer of the same order, the first 8 bytes of strings */
+static INLINE u64 sort_normalize(const TspSortKey *key, const u8 *record) {
+    const u8 *p = record + key->Offset;
+    u32 v32;
+    u64 v64;
+
+    switch (key->Type) {
+    case TSP_FILTER_I32:
+        memcpy(&v32, p, 4);
+        return v32 ^ 0x80000000u;
+    case TSP_FILTER_U32:
+        memcpy(&v32, p, 4);
+        return v32;
+    case TSP_FILTER_F32:
+        memcpy(&v32, p, 4);
+        return v32 ^ (v32 >> 31 ? 0xFFFFFFFFu : 0x80000000u);
+    case TSP_FILTER_I64:
+        memcpy(&v64, p, 8);
+        return v64 ^ (1ULL << 63);
+    case TSP_FILTER_U64:
+        memcpy(&v64, p, 8);
+        return v64;
+    case TSP_FILTER_F64:
+        memcpy(&v64, p, 8);
+        return v64 ^ (v64 >> 63 ? ~0ULL : 1ULL << 63);
+    default:
+        v64 = 0;
+        for (u32 i = 0; i < 8; ++i) {
+            v64 = v64 << 8 | (i < key->Width ? p[i] : 0);
+        }
+        return v64;
+    }
+}
+
+/* Keys of the prefix as unsigned integers, from the most significant bits */
+static INLINE u64 sort_prefix(const sort_spec_st *spec, const u8 *record) {
+    u64 prefix = 0;
+    u32 bits = 0;
+
+    for (u32 k = 0; k < spec->prefix_keys; ++k) {
+        const TspSortKey *key = &spec->keys[k];
+        u32 width = sort_key_width(key) < 8 ? 8 * sort_key_width(key) : 64;
+        u64 v = sort_normalize(key, record) << (key->Type == TSP_FILTER_STR ? 0 : 64 - width);
+
+        if (key->Flags & TSP_SORT_DESCENDING) {
+            v = ~v & ~0ULL << (64 - width);
+        }
+        prefix |= v >> bits;
+        bits += width;
+    }
+    return prefix;
+}
+
+static INLINE int sort_compare(const sort_spec_st *spec, const u8 *a, const u8 *b) {
+    for (u32 k = 0; k < spec->num_keys; ++k) {
+        const TspSortKey *key = &spec->keys[k];
+        int c;
+
+        if (key->Type == TSP_FILTER_STR) {
+            c = memcmp(a + key->Offset, b + key->Offset, key->Width);
+        } else {
+            u64 x = sort_normalize(key, a), y = sort_normalize(key, b);
+            c = (x > y) - (x < y);
+        }
+        if (c) {
+            return key->Flags & TSP_SORT_DESCENDING ? -c : c;
+        }
+    }
+    return 0;
+}
+
+/*-*******
+ * Merge *
+ *-*******/
+
+typedef struct {
+    const u8 *records;
+    u64 n;
+} sort_seq_st;
+
+typedef struct {
+    const sort_spec_st *spec;
+    const sort_seq_st *seqs;
+    int num_seqs, tasks, splitter; /* sequence of the splitters */
+    u8 *out;
+} sort_merge_st;
+
+/* Order of the records, then of their sequences */
+static INLINE int sort_before(const sort_spec_st *spec, const u8 *a, int seq_a, const u8 *b,
+                              int seq_b) {
+    int c = sort_compare(spec, a, b);
+    return c ? c < 0 : seq_a < seq_b;
+}
+
+/* Records of sequence j before the splitter of task t */
+static u64 sort_rank(const sort_merge_st *m, int j, int t) {
+    const sort_seq_st *s = &m->seqs[m->splitter];
+    u64 pos = s->n * t / m->tasks, lo = 0, hi = m->seqs[j].n;
+    const u8 *x;
+
+    if (t == 0) {
+        return 0;
+    }
+    if (t == m->tasks) {
+        return m->seqs[j].n;
+    }
+    if (j == m->splitter) {
+        return pos;
+    }
+    x = s->records + pos * m->spec->record_bytes;
+    while (lo < hi) {
+        u64 mid = (lo + hi) / 2;
+        if (sort_before(m->spec, m->seqs[j].records + mid * m->spec->record_bytes, j, x,
+                        m->splitter)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Moves down the sequence at p of the heap of the sequences by their next record */
+static INLINE void sort_sift(const sort_spec_st *spec, const u8 **next, int *heap, int n, int p) {
+    for (int c; (c = 2 * p + 1) < n; p = c) {
+        if (c + 1 < n &&
+            sort_before(spec, next[heap[c + 1]], heap[c + 1], next[heap[c]], heap[c])) {
+            c++;
+        }
+        if (!sort_before(spec, next[heap[c]], heap[c], next[heap[p]], heap[p])) {
+            break;
+        }
+        int tmp = heap[p];
+        heap[p] = heap[c];
+        heap[c] = tmp;
+    }
+}
+
+/* Merges the records of the sequences from next to end in out, up to limit
+ * records, next is advanced past the records merged */
+static u8 *sort_heap_merge(const sort_spec_st *spec, int num_seqs, const u8 **next,
+                           const u8 *const *end, u8 *out, u64 limit) {
+    const u32 bytes = spec->record_bytes;
+    int heap[SORT_MAX_SEQS], n = 0;
+
+    for (int j = 0; j < num_seqs; ++j) {
+        if (next[j] < end[j]) {
+            heap[n++] = j;
+        }
+    }
+    for (int i = n / 2 - 1; i >= 0; --i) {
+        sort_sift(spec, next, heap, n, i);
+    }
+    for (; n > 1 && limit; --limit) {
+        int j = heap[0];
+
+        memcpy(out, next[j], bytes);
+        out += bytes;
+        next[j] += bytes;
+        if (next[j] == end[j]) {
+            heap[0] = heap[--n];
+        }
+        sort_sift(spec, next, heap, n, 0);
+    }
+    if (n && limit) {
+        u64 tail = (end[heap[0]] - next[heap[0]]) / bytes;
+        tail = tail < limit ? tail : limit;
+        memcpy(out, next[heap[0]], tail * bytes);
+        out += tail * bytes;
+        next[heap[0]] += tail * bytes;
+    }
+    return out;
+}
+
+static void sort_merge_task(void *ctx, int t, int worker) {
+    const sort_merge_st *m = ctx;
+    const u32 bytes = m->spec->record_bytes;
+    const u8 *next[SORT_MAX_SEQS], *end[SORT_MAX_SEQS];
+    u8 *out = m->out;
+
+    for (int j = 0; j < m->num_seqs; ++j) {
+        u64 lo = sort_rank(m, j, t), hi = sort_rank(m, j, t + 1);
+        out += lo * bytes;
+        next[j] = m->seqs[j].records + lo * bytes;
+        end[j] = m->seqs[j].records + hi * bytes;
+    }
+    sort_heap_merge(m->spec, m->num_seqs, next, end, out, UINT64_MAX);
+}
+
+/* Merges the sorted sequences in out */
+static void sort_merge(const sort_spec_st *spec, const sort_seq_st *seqs, int num_seqs, u8 *out) {
+    sort_merge_st m = {.spec = spec, .seqs = seqs, .num_seqs = num_seqs, .out = out};
+    u64 total = 0;
+
+    for (int j = 0; j < num_seqs; ++j) {
+        total += seqs[j].n;
+        if (seqs[j].n > seqs[m.splitter].n) {
+            m.splitter = j;
+        }
+    }
+    m.tasks = total / SORT_MIN_MERGE;
+    m.tasks = m.tasks < 1 ? 1 : m.tasks > parallel_threads() ? parallel_threads() : m.tasks;
+    parallel_for(m.tasks, sort_merge_task, &m);
+}
+
+/*-******
+ * Runs *
+ *-******/
+
+typedef struct {
+    u64 prefix;
+    u64 index;
+} sort_entry_st;
+
+typedef struct {
+    const sort_spec_st *spec;
+    const u8 *in;
+    u8 *out;
+    u64 n;
+    int parts;
+    sort_entry_st *entries, *tmp;
+} sort_parts_st;
+
+static int sort_entry_compare(const void *a, const void *b, void *ctx) {
+    const sort_parts_st *job = ctx;
+    const sort_entry_st *x = a, *y = b;
+    int c = sort_compare(job->spec, job->in + x->index * job->spec->record_bytes,
+                         job->in + y->index * job->spec->record_bytes);
+
+    return c ? c : (x->index > y->index) - (x->index < y->index);
+}
+
+/* Stable LSD radix sort of the prefixes, a byte at a time, the bytes that are
+ * the same for all the entries are skipped */
+static void sort_radix(sort_entry_st *e, sort_entry_st *tmp, u64 n) {
+    sort_entry_st *src = e, *dst = tmp;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        u64 count[256] = {0}, pos = 0;
+
+        for (u64 i = 0; i < n; ++i) {
+            count[(src[i].prefix >> shift) & 0xFF]++;
+        }
+        if (count[(src[0].prefix >> shift) & 0xFF] == n) {
+            continue;
+        }
+        for (int b = 0; b < 256; ++b) {
+            u64 c = count[b];
+            count[b] = pos;
+            pos += c;
+        }
+        for (u64 i = 0; i < n; ++i) {
+            dst[count[(src[i].prefix >> shift) & 0xFF]++] = src[i];
+        }
+        sort_entry_st *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != e) {
+        memcpy(e, src, n * sizeof(*e));
+    }
+}
+
+static void sort_part(void *ctx, int p, int worker) {
+    const sort_parts_st *job = ctx;
+    const u32 bytes = job->spec->record_bytes;
+    u64 lo = job->n * p / job->parts, n = job->n * (p + 1) / job->parts - lo;
+    sort_entry_st *e = job->entries + lo;
+
+    if (!n) {
+        return;
+    }
+    for (u64 i = 0; i < n; ++i) {
+        e[i].prefix = sort_prefix(job->spec, job->in + (lo + i) * bytes);
+        e[i].index = lo + i;
+    }
+    sort_radix(e, job->tmp + lo, n);
+    if (!job->spec->prefix_only) {
+        for (u64 i = 0, j; i < n; i = j) {
+            for (j = i + 1; j < n && e[j].prefix == e[i].prefix; ++j) {
+            }
+            if (j - i > 1) {
+                qsort_r(e + i, j - i, sizeof(*e), sort_entry_compare, (void *)job);
+            }
+        }
+    }
+    for (u64 i = 0; i < n; ++i) {
+        memcpy(job->out + (lo + i) * bytes, job->in + e[i].index * bytes, bytes);
+    }
+}
+
+/* Sorts the n records of data in place */
+static int sort_records(const sort_spec_st *spec, u8 *data, u64 n) {
+    sort_parts_st job = {.spec = spec, .in = data, .n = n};
+    sort_seq_st seqs[SORT_MAX_SEQS];
+    int ret = -ENOMEM;
+
+    if (n < 2) {
+        return 0;
+    }
+    job.parts = n / SORT_MIN_PART;
+    job.parts = job.parts < 1 ? 1 : job.parts > parallel_threads() ? parallel_threads() : job.parts;
+    job.parts = job.parts > SORT_MAX_SEQS ? SORT_MAX_SEQS : job.parts;
+    job.out = malloc(n * spec->record_bytes);
+    job.entries = malloc(n * sizeof(sort_entry_st));
+    job.tmp = malloc(n * sizeof(sort_entry_st));
+    if (!job.out || !job.entries || !job.tmp) {
+        goto out;
+    }
+    parallel_for(job.parts, sort_part, &job);
+    for (int p = 0; p < job.parts; ++p) {
+        u64 lo = n * p / job.parts;
+        seqs[p].records = job.out + lo * spec->record_bytes;
+        seqs[p].n = n * (p + 1) / job.parts - lo;
+    }
+    sort_merge(spec, seqs, job.parts, data);
+    ret = 0;
+
+out:
+    free(job.out);
+    free(job.entries);
+    free(job.tmp);
+    return ret;
+}
+
+/*-**********
+ * Sessions *
+ *-**********/
+
+typedef struct {
+    u8 *data;       /* in memory, NULL in the temporary file */
+    u64 offset;     /* in the temporary file */
+    u64 records;
+    u64 next;       /* first record not merged */
+    const u8 *window;
+    u64 window_records;
+    u8 *buffer;     /* of the window, for the temporary file */
+} sort_run_st;
+
+typedef struct {
+    int active, merging;
+    u32 record_bytes, num_runs;
+    sort_run_st runs[TSP_SORT_MAX_RUNS];
+    TspExtentList *list; /* temporary file, NULL in memory */
+    namespace_extents_st ext;
+    u64 used;            /* bytes of the temporary file */
+    u64 window_records;  /* of a run in the merge */
+    int error;
+} sort_session_st;
+
+static sort_session_st sort_sessions[TSP_SORT_MAX_SESSIONS];
+static u8 **sort_buffers; /* window written by each worker */
+
+static void sort_session_end(sort_session_st *s) {
+    for (u32 i = 0; i < s->num_runs; ++i) {
+        free(s->runs[i].data);
+        free(s->runs[i].buffer);
+    }
+    namespace_extents_free(&s->ext);
+    free(s->list);
+    memset(s, 0, sizeof(*s));
+}
+
+static int sort_session_begin(sort_session_st *s, u32 record_bytes, const void *scratch,
+                              size_t scratch_bytes) {
+    int ret;
+
+    sort_session_end(s);
+    s->active = 1;
+    s->record_bytes = record_bytes;
+    if (!scratch) {
+        return 0;
+    }
+
+    // The file is written before it is read, its unwritten extents are not zeros
+    s->list = malloc(scratch_bytes);
+    if (!s->list) {
+        return -ENOMEM;
+    }
+    memcpy(s->list, scratch, scratch_bytes);
+    for (u32 i = 0; scratch_bytes >= sizeof(*s->list) && i < s->list->NumExtents &&
+                    i < (scratch_bytes - sizeof(*s->list)) / sizeof(TspExtent);
+         ++i) {
+        TspExtent extent;
+        memcpy(&extent, &s->list->Extents[i], sizeof(extent));
+        extent.Flags &= ~TSP_EXTENT_ZERO;
+        memcpy(&s->list->Extents[i], &extent, sizeof(extent));
+    }
+    ret = namespace_extents(&s->ext, s->list, scratch_bytes);
+    if (ret == 0 && s->list->HeadBytes % s->ext.block) {
+        ret = -EINVAL; /* the runs are written a block at a time */
+    }
+    return ret;
+}
+
+typedef struct {
+    sort_session_st *s;
+    const u8 *data;
+    u64 bytes, offset;
+} sort_spill_st;
+
+static void sort_spill(void *ctx, int i, int worker) {
+    const sort_spill_st *job = ctx;
+    u64 start = (u64)i * SORT_WINDOW;
+    u64 n = job->bytes - start < SORT_WINDOW ? job->bytes - start : SORT_WINDOW;
+    u64 padded = (n + job->s->ext.block - 1) & ~(u64)(job->s->ext.block - 1);
+    int ret;
+
+    memcpy(sort_buffers[worker], job->data + start, n);
+    memset(sort_buffers[worker] + n, 0, padded - n);
+    ret = namespace_write(&job->s->ext, job->offset + start, padded, sort_buffers[worker]);
+    if (ret) {
+        __atomic_store_n(&job->s->error, ret, __ATOMIC_RELAXED);
+    }
+}
+
+/* Keeps the n sorted records as a run of the session */
+static int sort_session_add(sort_session_st *s, const u8 *data, u64 n) {
+    sort_run_st *run = &s->runs[s->num_runs];
+    u64 bytes = n * s->record_bytes;
+
+    if (s->merging) {
+        return -EINVAL;
+    }
+    if (!n) {
+        return 0;
+    }
+    if (s->num_runs == TSP_SORT_MAX_RUNS) {
+        return -E2BIG;
+    }
+    memset(run, 0, sizeof(*run));
+
+    if (!s->list) {
+        run->data = malloc(bytes);
+        if (!run->data) {
+            return -E2BIG;
+        }
+        memcpy(run->data, data, bytes);
+    } else {
+        sort_spill_st job = {.s = s, .data = data, .bytes = bytes, .offset = s->used};
+        u64 padded = (bytes + s->ext.block - 1) & ~(u64)(s->ext.block - 1);
+
+        if (padded > s->ext.bytes - s->used) {
+            return -E2BIG;
+        }
+        if (!sort_buffers) {
+            sort_buffers = calloc(parallel_threads(), sizeof(*sort_buffers));
+            if (!sort_buffers) {
+                return -ENOMEM;
+            }
+        }
+        for (int i = 0; i < parallel_threads(); ++i) {
+            if (!sort_buffers[i] &&
+                posix_memalign((void **)&sort_buffers[i], NAMESPACE_MAX_BLOCK, SORT_WINDOW)) {
+                sort_buffers[i] = NULL;
+                return -ENOMEM;
+            }
+        }
+        s->error = 0;
+        parallel_for((bytes + SORT_WINDOW - 1) / SORT_WINDOW, sort_spill, &job);
+        if (s->error) {
+            return s->error;
+        }
+        run->offset = s->used;
+        s->used += padded;
+    }
+    run->records = n;
+    s->num_runs++;
+    return 0;
+}
+
+typedef struct {
+    sort_session_st *s;
+    const u32 *runs;
+} sort_refill_st;
+
+/* Window of the next records of a run */
+static void sort_refill(void *ctx, int i, int worker) {
+    const sort_refill_st *job = ctx;
+    sort_session_st *s = job->s;
+    sort_run_st *run = &s->runs[job->runs[i]];
+    u64 n = run->records - run->next < s->window_records ? run->records - run->next
+                                                          : s->window_records;
+
+    if (run->data) {
+        n = run->records - run->next;
+        run->window = run->data + run->next * s->record_bytes;
+    } else {
+        run->window = namespace_read(&s->ext, run->offset + run->next * s->record_bytes,
+                                     n * s->record_bytes, run->buffer, &s->error);
+    }
+    run->window_records = run->window ? n : 0;
+}
+
+/* Merges the next records of the runs in out, as many as fit */
+static int sort_session_merge(sort_session_st *s, const sort_spec_st *spec, u8 *out,
+                              u64 capacity, TspSortResult *result) {
+    const u32 bytes = s->record_bytes;
+    sort_seq_st seqs[TSP_SORT_MAX_RUNS];
+    u32 refill[TSP_SORT_MAX_RUNS];
+    u64 done = 0;
+
+    if (!capacity) {
+        return -ENOSPC;
+    }
+    if (!s->merging) {
+        // The runs in memory are windows of all their records
+        s->window_records = SORT_MERGE_BYTES / (s->num_runs ? s->num_runs : 1) / bytes;
+        s->window_records = s->window_records ? s->window_records : 1;
+        for (u32 i = 0; i < s->num_runs; ++i) {
+            if (!s->runs[i].data &&
+                posix_memalign((void **)&s->runs[i].buffer, NAMESPACE_MAX_BLOCK,
+                               s->window_records * bytes + 2 * NAMESPACE_MAX_BLOCK)) {
+                s->runs[i].buffer = NULL;
+                return -E2BIG;
+            }
+        }
+        s->merging = 1;
+    }
+
+    for (;;) {
+        sort_refill_st job = {.s = s, .runs = refill};
+        u64 buffered = 0, ready = 0;
+        int num_refill = 0, bound = -1;
+        const u8 *last = NULL;
+
+        for (u32 i = 0; i < s->num_runs; ++i) {
+            if (!s->runs[i].window_records && s->runs[i].next < s->runs[i].records) {
+                refill[num_refill++] = i;
+            }
+        }
+        s->error = 0;
+        parallel_for(num_refill, sort_refill, &job);
+        if (s->error) {
+            return s->error;
+        }
+
+        // The window that ends first bounds the records that are ready
+        for (u32 i = 0; i < s->num_runs; ++i) {
+            const sort_run_st *run = &s->runs[i];
+            const u8 *end = run->window + (run->window_records - 1) * bytes;
+
+            buffered += run->window_records;
+            if (run->window_records && run->next + run->window_records < run->records &&
+                (bound < 0 || sort_before(spec, end, i, last, bound))) {
+                bound = i;
+                last = end;
+            }
+        }
+        if (!buffered) {
+            result->Flags = TSP_SORT_DONE;
+            break;
+        }
+        if (done == capacity) {
+            break;
+        }
+        for (u32 i = 0; i < s->num_runs; ++i) {
+            const sort_run_st *run = &s->runs[i];
+            u64 lo = run->window_records, hi = lo;
+
+            if (bound >= 0 && (int)i != bound) {
+                lo = 0;
+                while (lo < hi) {
+                    u64 mid = (lo + hi) / 2;
+                    if (sort_before(spec, run->window + mid * bytes, i, last, bound)) {
+                        lo = mid + 1;
+                    } else {
+                        hi = mid;
+                    }
+                }
+            }
+            seqs[i].records = run->window;
+            seqs[i].n = lo;
+            ready += lo;
+        }
+
+        // The records that do not fit are merged by a worker up to the end
+        if (ready > capacity - done) {
+            const u8 *next[TSP_SORT_MAX_RUNS], *end[TSP_SORT_MAX_RUNS];
+
+            for (u32 i = 0; i < s->num_runs; ++i) {
+                next[i] = seqs[i].records;
+                end[i] = seqs[i].records + seqs[i].n * bytes;
+            }
+            sort_heap_merge(spec, s->num_runs, next, end, out + done * bytes, capacity - done);
+            for (u32 i = 0; i < s->num_runs; ++i) {
+                seqs[i].n = (next[i] - seqs[i].records) / bytes;
+            }
+            ready = capacity - done;
+        } else {
+            sort_merge(spec, seqs, s->num_runs, out + done * bytes);
+        }
+        for (u32 i = 0; i < s->num_runs; ++i) {
+            s->runs[i].window += seqs[i].n * bytes;
+            s->runs[i].window_records -= seqs[i].n;
+            s->runs[i].next += seqs[i].n;
+        }
+        done += ready;
+    }
+    result->OutBytes = done * bytes;
+    result->Records = done;
+    return 0;
+}
+
+int sort_request(const void *spec_desc, size_t spec_bytes, void *data, size_t data_bytes,
+                 u32 options, const void *scratch, size_t scratch_bytes, TspSortResult *result) {
+    u32 op = options & 0xF, session = (options >> 8) & 0xFF;
+    sort_session_st *s;
+    sort_spec_st spec;
+    u64 n;
+    int ret;
+
+    memset(result, 0, sizeof(*result));
+    if (session >= TSP_SORT_MAX_SESSIONS || op > TSP_SORT_MERGE) {
+        return -EINVAL;
+    }
+    s = &sort_sessions[session];
+    ret = sort_spec(&spec, spec_desc, spec_bytes);
+    if (ret) {
+        return ret;
+    }
+    n = data_bytes / spec.record_bytes;
+
+    if (op == TSP_SORT_MERGE) {
+        if (!s->active || s->record_bytes != spec.record_bytes) {
+            return -EINVAL;
+        }
+        ret = sort_session_merge(s, &spec, data, n, result);
+        result->Runs = s->num_runs;
+        if ((ret && ret != -ENOSPC) || (result->Flags & TSP_SORT_DONE)) {
+            sort_session_end(s);
+        }
+        return ret;
+    }
+
+    ret = sort_records(&spec, data, n);
+    if (ret) {
+        return ret;
+    }
+    result->InBytes = result->OutBytes = n * spec.record_bytes;
+    result->Records = n;
+    if (op == TSP_SORT_RUN) {
+        if ((options & TSP_SORT_BEGIN) || !s->active) {
+            ret = sort_session_begin(s, spec.record_bytes, scratch, scratch_bytes);
+        } else if (s->record_bytes != spec.record_bytes) {
+            ret = -EINVAL;
+        }
+        if (ret == 0) {
+            ret = sort_session_add(s, data, n);
+        }
+        if (ret) {
+            sort_session_end(s);
+        }
+        result->Runs = s->num_runs;
+    }
+    return ret;
+}
@@ -0,0 +1,49 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __SORT_H__
+#define __SORT_H__
+
+#include <stddef.h>
+#include "tsp.h"
+
+/**
+ * @brief Sorts records, or merges the runs of a session (see TSP_SORT_* in
+ * tsp.h)
+ * @param[in] spec : TspSortSpec of spec_bytes
+ * @param[in,out] data : The records, sorted in place, or the destination of a
+ * merge
+ * @param[in] options : TSP_SORT_OPTIONS()
+ * @param[in] scratch : TspExtentList of the temporary file of a new session on
+ * a namespace opened with namespace_open(), NULL to keep the runs in memory
+ * @return 0, -EINVAL if the options, the spec or the temporary file are
+ * invalid, -ENOSPC if the destination of a merge is smaller than a record, -E2BIG if the
+ * runs do not fit in the temporary file (or in memory), -ENODEV if the
+ * namespace was not opened, -EIO if it could not be read or written, -ENOMEM
+ * */
+int sort_request(const void *spec, size_t spec_bytes, void *data, size_t data_bytes, u32 options,
+                 const void *scratch, size_t scratch_bytes, TspSortResult *result);
+
+#endif /* __SORT_H__ */
@@ -0,0 +1,837 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Similarity search of vectors (VectorSearch), e.g., of CLIP embeddings.
+ *
+ * The index holds the vectors quantized to 8 bits with a scale per vector, a
+ * vector of 512 dimensions takes 512 bytes instead of 2 KiB of floats. The dot
+ * products of the codes are exact in 32-bit integers and the score is the dot
+ * product times the scales of the query and of the vector. The kernels score
+ * VECTOR_GROUP vectors in a pass over the query, widened to 16 bits (AVX2
+ * vpmaddwd, NEON smull and sadalp).
+ *
+ * With IVF the vectors are grouped in lists by their closest centroid
+ * (k-means at the build), a search scans only the lists of the centroids
+ * closest to each query. The lists are split in chunks that the workers scan,
+ * a chunk is scored against every query that probes its list while it is in
+ * the cache, and each worker keeps a bounded heap of the best hits of each
+ * query, the heaps are merged at the end.
+ *
+ * An index on a namespace is read once and kept in memory, a search reads its
+ * header to check that it was not rebuilt since.
+ * */
+
+#include "vector.h"
+#include "namespace.h"
+#include "parallel.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define VECTOR_GROUP 4              /* vectors scored in a pass over the query */
+#define VECTOR_CHUNK 512            /* vectors scanned by a task */
+#define VECTOR_CACHE 4              /* indexes of the namespaces kept in memory */
+#define VECTOR_MAX_LISTS 0xFFFF
+#define VECTOR_TRAIN_PER_LIST 64    /* vectors of the k-means sample per list */
+#define VECTOR_TRAIN_ITERATIONS 10
+
+/*-*********
+ * Kernels *
+ *-*********/
+
+typedef struct {
+    s8 *codes;   /* padded to the row bytes */
+    s16 *wide;   /* the codes widened */
+    float scale; /* of the codes, divided by the norm of the query */
+} vector_query_st;
+
+typedef void (*vector_dot_fn)(const vector_query_st *q, const s8 *const *rows, u32 row_bytes,
+                              s32 *dots);
+
+static void vector_dot_scalar(const vector_query_st *q, const s8 *const *rows, u32 row_bytes,
+                              s32 *dots) {
+    for (int r = 0; r < VECTOR_GROUP; ++r) {
+        s32 sum = 0;
+        for (u32 i = 0; i < row_bytes; ++i) {
+            sum += q->wide[i] * rows[r][i];
+        }
+        dots[r] = sum;
+    }
+}
+
+#if defined(__x86_64__)
+TARGET_AVX2 static void vector_dot_avx2(const vector_query_st *q, const s8 *const *rows,
+                                        u32 row_bytes, s32 *dots) {
+    __m256i acc[VECTOR_GROUP];
+
+    for (int r = 0; r < VECTOR_GROUP; ++r) {
+        acc[r] = _mm256_setzero_si256();
+    }
+    for (u32 i = 0; i < row_bytes; i += 16) {
+        __m256i w = _mm256_loadu_si256((const __m256i *)(q->wide + i));
+        for (int r = 0; r < VECTOR_GROUP; ++r) {
+            __m256i x = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(rows[r] + i)));
+            acc[r] = _mm256_add_epi32(acc[r], _mm256_madd_epi16(w, x));
+        }
+    }
+    for (int r = 0; r < VECTOR_GROUP; ++r) {
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc[r]),
+                                  _mm256_extracti128_si256(acc[r], 1));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+        dots[r] = _mm_cvtsi128_si32(s);
+    }
+}
+#elif defined(__aarch64__)
+static void vector_dot_neon(const vector_query_st *q, const s8 *const *rows, u32 row_bytes,
+                            s32 *dots) {
+    int32x4_t acc[VECTOR_GROUP];
+
+    for (int r = 0; r < VECTOR_GROUP; ++r) {
+        acc[r] = vdupq_n_s32(0);
+    }
+    for (u32 i = 0; i < row_bytes; i += 16) {
+        int8x16_t w = vld1q_s8(q->codes + i);
+        for (int r = 0; r < VECTOR_GROUP; ++r) {
+            int8x16_t x = vld1q_s8(rows[r] + i);
+            acc[r] = vpadalq_s16(acc[r], vmull_s8(vget_low_s8(w), vget_low_s8(x)));
+            acc[r] = vpadalq_s16(acc[r], vmull_high_s8(w, x));
+        }
+    }
+    for (int r = 0; r < VECTOR_GROUP; ++r) {
+        dots[r] = vaddvq_s32(acc[r]);
+    }
+}
+#endif
+
+static vector_dot_fn vector_dot_kernel = vector_dot_scalar;
+static const char *kernel_name = "scalar";
+static u8 *vector_block; /* header of an index read from a namespace */
+
+int vector_init(void) {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+        vector_dot_kernel = vector_dot_avx2;
+        kernel_name = "avx2";
+    }
+#elif defined(__aarch64__)
+    // NEON is part of AArch64
+    vector_dot_kernel = vector_dot_neon;
+    kernel_name = "neon";
+#endif
+    if (posix_memalign((void **)&vector_block, NAMESPACE_MAX_BLOCK, 3 * NAMESPACE_MAX_BLOCK)) {
+        vector_block = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+const char *vector_kernels(void) {
+    return kernel_name;
+}
+
+/* Sum of the products, in 8 partial sums that the compiler vectorizes */
+static float vector_dot_float(const float *a, const float *b, u32 dim) {
+    float sum[8] = {0};
+    u32 i = 0;
+
+    for (; i + 8 <= dim; i += 8) {
+        for (int j = 0; j < 8; ++j) {
+            sum[j] += a[i + j] * b[i + j];
+        }
+    }
+    for (; i < dim; ++i) {
+        sum[0] += a[i] * b[i];
+    }
+    return ((sum[0] + sum[4]) + (sum[1] + sum[5])) + ((sum[2] + sum[6]) + (sum[3] + sum[7]));
+}
+
+/* Codes of x in [-127, 127], returns their scale for x / norm */
+static float vector_quantize(const float *x, u32 dim, float norm, s8 *codes, u32 row_bytes) {
+    float max = 0, inv;
+
+    for (u32 i = 0; i < dim; ++i) {
+        max = fabsf(x[i]) > max ? fabsf(x[i]) : max;
+    }
+    inv = max > 0 ? 127 / max : 0;
+    for (u32 i = 0; i < dim; ++i) {
+        codes[i] = (s8)lrintf(x[i] * inv);
+    }
+    memset(codes + dim, 0, row_bytes - dim);
+    return max / 127 / norm;
+}
+
+static float vector_norm(const float *x, u32 dim) {
+    float norm = sqrtf(vector_dot_float(x, x, dim));
+    return norm > 0 ? norm : 1;
+}
+
+/* Keeps the k best hits in a min-heap, the worst of them at the top */
+static void vector_heap_push(TspVectorHit *heap, u32 *size, u32 k, float score, u64 id) {
+    u32 i;
+
+    if (*size < k) {
+        for (i = (*size)++; i && heap[(i - 1) / 2].Score > score; i = (i - 1) / 2) {
+            heap[i] = heap[(i - 1) / 2];
+        }
+    } else {
+        if (score <= heap[0].Score) {
+            return;
+        }
+        for (i = 0;;) {
+            u32 c = 2 * i + 1;
+            if (c >= k) {
+                break;
+            }
+            if (c + 1 < k && heap[c + 1].Score < heap[c].Score) {
+                c++;
+            }
+            if (heap[c].Score >= score) {
+                break;
+            }
+            heap[i] = heap[c];
+            i = c;
+        }
+    }
+    heap[i] = (TspVectorHit){.Id = id, .Score = score};
+}
+
+static int vector_hit_compare(const void *a, const void *b) {
+    const TspVectorHit *x = a, *y = b;
+
+    if (x->Score != y->Score) {
+        return x->Score < y->Score ? 1 : -1;
+    }
+    return (x->Id > y->Id) - (x->Id < y->Id);
+}
+
+/*-*******
+ * Index *
+ *-*******/
+
+typedef struct {
+    TspVectorHeader header;
+    float *centroids;
+    u64 *starts; /* first vector of each list */
+    u64 *ids;
+    float *scales;
+    s8 *codes;
+    u32 row_bytes;
+} vector_index_st;
+
+/* Locates the sections of the index, its header is set */
+static void vector_index_layout(vector_index_st *idx, u8 *base) {
+    const TspVectorHeader *h = &idx->header;
+    u64 offset = sizeof(*h);
+
+    idx->row_bytes = TSP_VECTOR_ROW_BYTES(h->Dim);
+    idx->centroids = (float *)(base + offset);
+    offset += TSP_VECTOR_ALIGN((u64)h->NumLists * h->Dim * sizeof(float));
+    idx->starts = (u64 *)(base + offset);
+    offset += TSP_VECTOR_ALIGN(((u64)h->NumLists + 1) * sizeof(u64));
+    idx->ids = (u64 *)(base + offset);
+    offset += TSP_VECTOR_ALIGN(h->NumVectors * sizeof(u64));
+    idx->scales = (float *)(base + offset);
+    offset += TSP_VECTOR_ALIGN(h->NumVectors * sizeof(float));
+    idx->codes = (s8 *)(base + offset);
+}
+
+/* Checks the index of bytes at base */
+static int vector_index_map(vector_index_st *idx, const u8 *base, size_t bytes) {
+    const TspVectorHeader *h = &idx->header;
+
+    if (bytes < sizeof(*h) || (uintptr_t)base % 64) {
+        return -EINVAL;
+    }
+    memcpy(&idx->header, base, sizeof(*h));
+    if (h->Magic != TSP_VECTOR_MAGIC || !h->Dim || h->Dim > TSP_VECTOR_MAX_DIM ||
+        !h->NumLists || h->NumLists > VECTOR_MAX_LISTS || h->NumVectors > UINT32_MAX ||
+        h->Bytes > bytes || h->Bytes != TSP_VECTOR_INDEX_BYTES(h->NumVectors, h->Dim, h->NumLists)) {
+        return -EINVAL;
+    }
+    vector_index_layout(idx, (u8 *)base);
+    if (idx->starts[0] || idx->starts[h->NumLists] != h->NumVectors) {
+        return -EINVAL;
+    }
+    for (u32 l = 0; l < h->NumLists; ++l) {
+        if (idx->starts[l] > idx->starts[l + 1]) {
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+static struct {
+    u8 *buffer; /* the index, NULL if the entry is free */
+    u32 nsid;
+    u64 lba, head, generation, bytes;
+    u64 used;
+} vector_cache[VECTOR_CACHE];
+static u64 vector_clock;
+
+/* The index on the extents of a namespace, from the cache if its generation
+ * did not change, otherwise read in the least recently used entry */
+static int vector_index_namespace(vector_index_st *idx, const void *desc, size_t desc_bytes) {
+    namespace_extents_st ext;
+    TspVectorHeader header;
+    TspExtent first;
+    const u8 *p;
+    int ret, error = 0, slot = 0;
+
+    ret = namespace_extents(&ext, desc, desc_bytes);
+    if (ret) {
+        goto out;
+    }
+    ret = -EINVAL;
+    if (ext.bytes < sizeof(header)) {
+        goto out;
+    }
+    memcpy(&first, &ext.list->Extents[0], sizeof(first));
+    p = namespace_read(&ext, 0, sizeof(header), vector_block, &error);
+    if (!p) {
+        ret = error;
+        goto out;
+    }
+    memcpy(&header, p, sizeof(header));
+    if (header.Magic != TSP_VECTOR_MAGIC || header.Bytes < sizeof(header) ||
+        header.Bytes > ext.bytes) {
+        goto out;
+    }
+
+    for (int i = 0; i < VECTOR_CACHE; ++i) {
+        if (vector_cache[i].buffer && vector_cache[i].nsid == ext.list->NamespaceId &&
+            vector_cache[i].lba == first.Lba && vector_cache[i].head == ext.list->HeadBytes &&
+            vector_cache[i].generation == header.Generation &&
+            vector_cache[i].bytes == header.Bytes) {
+            slot = i;
+            goto found;
+        }
+        if (vector_cache[i].used < vector_cache[slot].used) {
+            slot = i;
+        }
+    }
+    free(vector_cache[slot].buffer);
+    vector_cache[slot].buffer = NULL;
+    if (posix_memalign((void **)&vector_cache[slot].buffer, NAMESPACE_MAX_BLOCK,
+                       header.Bytes + 2 * NAMESPACE_MAX_BLOCK)) {
+        vector_cache[slot].buffer = NULL;
+        ret = -ENOMEM;
+        goto out;
+    }
+    p = namespace_read(&ext, 0, header.Bytes, vector_cache[slot].buffer, &error);
+    if (!p) {
+        ret = error;
+        goto drop;
+    }
+    // The sections are aligned from the start of the index
+    memmove(vector_cache[slot].buffer, p, header.Bytes);
+    vector_cache[slot].nsid = ext.list->NamespaceId;
+    vector_cache[slot].lba = first.Lba;
+    vector_cache[slot].head = ext.list->HeadBytes;
+    vector_cache[slot].generation = header.Generation;
+    vector_cache[slot].bytes = header.Bytes;
+
+found:
+    vector_cache[slot].used = ++vector_clock;
+    ret = vector_index_map(idx, vector_cache[slot].buffer, vector_cache[slot].bytes);
+    if (ret == 0) {
+        goto out;
+    }
+drop:
+    free(vector_cache[slot].buffer);
+    vector_cache[slot].buffer = NULL;
+out:
+    namespace_extents_free(&ext);
+    return ret;
+}
+
+/*-********
+ * Search *
+ *-********/
+
+typedef struct {
+    u32 list, start, end;
+} vector_chunk_st;
+
+typedef struct {
+    const vector_index_st *idx;
+    const vector_query_st *queries;
+    u32 num_queries, k;
+    const vector_chunk_st *chunks;
+    const u32 *probe_starts; /* queries that probe each list, in probes */
+    const u32 *probes;
+    TspVectorHit *heaps;     /* [worker][query][k] */
+    u32 *sizes;              /* [worker][query] */
+} vector_search_st;
+
+static void vector_scan(void *ctx, int i, int worker) {
+    const vector_search_st *s = ctx;
+    const vector_index_st *idx = s->idx;
+    const vector_chunk_st *c = &s->chunks[i];
+    const u32 *probes = s->probes + s->probe_starts[c->list];
+    u32 num_probes = s->probe_starts[c->list + 1] - s->probe_starts[c->list];
+    TspVectorHit *heaps = s->heaps + (size_t)worker * s->num_queries * s->k;
+    u32 *sizes = s->sizes + (size_t)worker * s->num_queries;
+
+    for (u32 v = c->start; v < c->end; v += VECTOR_GROUP) {
+        int n = c->end - v < VECTOR_GROUP ? c->end - v : VECTOR_GROUP;
+        const s8 *rows[VECTOR_GROUP];
+        s32 dots[VECTOR_GROUP];
+
+        // The rows past the end score the last one again
+        for (int r = 0; r < VECTOR_GROUP; ++r) {
+            rows[r] = idx->codes + (size_t)(v + (r < n ? r : n - 1)) * idx->row_bytes;
+        }
+        for (u32 p = 0; p < num_probes; ++p) {
+            const vector_query_st *q = &s->queries[probes[p]];
+            vector_dot_kernel(q, rows, idx->row_bytes, dots);
+            for (int r = 0; r < n; ++r) {
+                vector_heap_push(heaps + (size_t)probes[p] * s->k, &sizes[probes[p]], s->k,
+                                 dots[r] * q->scale * idx->scales[v + r], idx->ids[v + r]);
+            }
+        }
+    }
+}
+
+/* Lists of the nprobe centroids closest to the query, as for the build
+ * (largest x.c - |c|^2 / 2) */
+static u32 vector_probe(const vector_index_st *idx, const float *query, const float *half_norms,
+                        u32 nprobe, TspVectorHit *heap, u32 *lists) {
+    u32 n = 0;
+
+    for (u32 l = 0; l < idx->header.NumLists; ++l) {
+        float score = vector_dot_float(query, idx->centroids + (size_t)l * idx->header.Dim,
+                                       idx->header.Dim) - half_norms[l];
+        vector_heap_push(heap, &n, nprobe, score, l);
+    }
+    for (u32 i = 0; i < n; ++i) {
+        lists[i] = heap[i].Id;
+    }
+    return n;
+}
+
+int vector_search(const void *index, size_t index_bytes, const void *queries,
+                  size_t queries_bytes, size_t num, u32 options, void *hits, size_t hits_bytes) {
+    vector_search_st s = {.num_queries = num, .k = (options >> 8) & 0xFFFF};
+    vector_index_st idx;
+    vector_query_st *q = NULL;
+    vector_chunk_st *chunks = NULL;
+    u32 *probe_starts = NULL, *probes = NULL, *lists = NULL, nprobe = options >> 24;
+    u32 dim, num_lists, num_chunks = 0, threads = parallel_threads();
+    float *x = NULL, *half_norms = NULL;
+    TspVectorHit *heap = NULL;
+    s8 *codes = NULL;
+    s16 *wide = NULL;
+    int ret;
+
+    if (!s.k || s.k > TSP_VECTOR_MAX_K || num > TSP_VECTOR_MAX_QUERIES) {
+        return -EINVAL;
+    }
+    if (options & TSP_VECTOR_NAMESPACE) {
+        ret = vector_index_namespace(&idx, index, index_bytes);
+    } else {
+        ret = vector_index_map(&idx, index, index_bytes);
+    }
+    if (ret || !num) {
+        return ret;
+    }
+    dim = idx.header.Dim;
+    num_lists = idx.header.NumLists;
+    if (nprobe == 0 || nprobe > num_lists) {
+        nprobe = num_lists;
+    }
+    if (num > queries_bytes / sizeof(float) / dim || num * s.k > hits_bytes / sizeof(TspVectorHit)) {
+        return -ENOSPC;
+    }
+
+    ret = -ENOMEM;
+    q = calloc(num, sizeof(*q));
+    codes = malloc(num * idx.row_bytes);
+    wide = aligned_alloc(32, num * idx.row_bytes * sizeof(*wide));
+    x = malloc(dim * sizeof(*x));
+    half_norms = malloc(num_lists * sizeof(*half_norms));
+    heap = malloc((nprobe > s.k ? nprobe : s.k) * sizeof(*heap));
+    lists = malloc((size_t)num * nprobe * sizeof(*lists));
+    probe_starts = calloc(num_lists + 1, sizeof(*probe_starts));
+    probes = malloc((size_t)num * nprobe * sizeof(*probes));
+    chunks = malloc((idx.header.NumVectors / VECTOR_CHUNK + num_lists) * sizeof(*chunks));
+    s.heaps = malloc((size_t)threads * num * s.k * sizeof(*s.heaps));
+    s.sizes = calloc((size_t)threads * num, sizeof(*s.sizes));
+    if (!q || !codes || !wide || !x || !half_norms || !heap || !lists || !probe_starts ||
+        !probes || !chunks || !s.heaps || !s.sizes) {
+        goto out;
+    }
+    for (u32 l = 0; l < num_lists; ++l) {
+        const float *c = idx.centroids + (size_t)l * dim;
+        half_norms[l] = vector_dot_float(c, c, dim) / 2;
+    }
+
+    // Quantized queries and the lists that they probe
+    for (size_t i = 0; i < num; ++i) {
+        float norm;
+
+        memcpy(x, (const u8 *)queries + i * dim * sizeof(float), dim * sizeof(float));
+        norm = idx.header.Flags & TSP_VECTOR_NORMALIZE ? vector_norm(x, dim) : 1;
+        q[i].codes = codes + i * idx.row_bytes;
+        q[i].wide = wide + i * idx.row_bytes;
+        q[i].scale = vector_quantize(x, dim, norm, q[i].codes, idx.row_bytes);
+        for (u32 j = 0; j < idx.row_bytes; ++j) {
+            q[i].wide[j] = q[i].codes[j];
+        }
+        if (nprobe == num_lists) {
+            for (u32 l = 0; l < num_lists; ++l) {
+                lists[i * nprobe + l] = l;
+            }
+        } else {
+            for (u32 j = 0; j < dim; ++j) {
+                x[j] /= norm;
+            }
+            vector_probe(&idx, x, half_norms, nprobe, heap, lists + i * nprobe);
+        }
+        for (u32 p = 0; p < nprobe; ++p) {
+            probe_starts[lists[i * nprobe + p] + 1]++;
+        }
+    }
+    for (u32 l = 0; l < num_lists; ++l) {
+        probe_starts[l + 1] += probe_starts[l];
+    }
+    // Queries in order in each list, the starts are shifted back as they fill
+    for (size_t i = 0; i < num; ++i) {
+        for (u32 p = 0; p < nprobe; ++p) {
+            probes[probe_starts[lists[i * nprobe + p]]++] = i;
+        }
+    }
+    for (u32 l = num_lists; l > 0; --l) {
+        probe_starts[l] = probe_starts[l - 1];
+    }
+    probe_starts[0] = 0;
+
+    // Chunks of the lists probed
+    for (u32 l = 0; l < num_lists; ++l) {
+        if (probe_starts[l] == probe_starts[l + 1]) {
+            continue;
+        }
+        for (u64 v = idx.starts[l]; v < idx.starts[l + 1]; v += VECTOR_CHUNK) {
+            chunks[num_chunks++] = (vector_chunk_st){
+                .list = l,
+                .start = v,
+                .end = v + VECTOR_CHUNK < idx.starts[l + 1] ? v + VECTOR_CHUNK : idx.starts[l + 1],
+            };
+        }
+    }
+    s.idx = &idx;
+    s.queries = q;
+    s.chunks = chunks;
+    s.probe_starts = probe_starts;
+    s.probes = probes;
+    parallel_for(num_chunks, vector_scan, &s);
+
+    // Best hits of the workers
+    for (size_t i = 0; i < num; ++i) {
+        u32 n = 0;
+
+        for (u32 w = 0; w < threads; ++w) {
+            const TspVectorHit *h = s.heaps + ((size_t)w * num + i) * s.k;
+            for (u32 j = 0; j < s.sizes[w * num + i]; ++j) {
+                vector_heap_push(heap, &n, s.k, h[j].Score, h[j].Id);
+            }
+        }
+        qsort(heap, n, sizeof(*heap), vector_hit_compare);
+        for (u32 j = n; j < s.k; ++j) {
+            heap[j] = (TspVectorHit){.Id = TSP_VECTOR_NO_ID};
+        }
+        memcpy((u8 *)hits + i * s.k * sizeof(*heap), heap, s.k * sizeof(*heap));
+    }
+    ret = 0;
+
+out:
+    free(q);
+    free(codes);
+    free(wide);
+    free(x);
+    free(half_norms);
+    free(heap);
+    free(lists);
+    free(probe_starts);
+    free(probes);
+    free(chunks);
+    free(s.heaps);
+    free(s.sizes);
+    return ret;
+}
+
+/*-*******
+ * Build *
+ *-*******/
+
+typedef struct {
+    const u8 *vectors;
+    u32 dim, num_lists, normalize;
+    u64 num;
+    const float *centroids;
+    const float *half_norms;
+    u32 *assign;
+    float *x; /* a vector per worker */
+    /* Quantization */
+    const u32 *order;
+    const u8 *ids;
+    vector_index_st *idx;
+} vector_build_st;
+
+/* Vector v in the buffer of the worker, its norm (1 without normalization) */
+static float vector_load(const vector_build_st *b, u64 v, int worker, float **x) {
+    *x = b->x + (size_t)worker * b->dim;
+    memcpy(*x, b->vectors + v * b->dim * sizeof(float), b->dim * sizeof(float));
+    return b->normalize ? vector_norm(*x, b->dim) : 1;
+}
+
+static u32 vector_closest(const vector_build_st *b, const float *x, float norm) {
+    float best = -INFINITY;
+    u32 list = 0;
+
+    for (u32 l = 0; l < b->num_lists; ++l) {
+        float score = vector_dot_float(x, b->centroids + (size_t)l * b->dim, b->dim) / norm -
+                      b->half_norms[l];
+        if (score > best) {
+            best = score;
+            list = l;
+        }
+    }
+    return list;
+}
+
+/* Lists of the vectors of a chunk, of the sample (normalized) or of the input */
+static void vector_assign_sample(void *ctx, int i, int worker) {
+    const vector_build_st *b = ctx;
+    u64 end = (u64)(i + 1) * VECTOR_CHUNK < b->num ? (u64)(i + 1) * VECTOR_CHUNK : b->num;
+
+    for (u64 v = (u64)i * VECTOR_CHUNK; v < end; ++v) {
+        b->assign[v] = vector_closest(b, (const float *)b->vectors + v * b->dim, 1);
+    }
+}
+
+static void vector_assign(void *ctx, int i, int worker) {
+    const vector_build_st *b = ctx;
+    u64 end = (u64)(i + 1) * VECTOR_CHUNK < b->num ? (u64)(i + 1) * VECTOR_CHUNK : b->num;
+    float *x;
+
+    for (u64 v = (u64)i * VECTOR_CHUNK; v < end; ++v) {
+        float norm = vector_load(b, v, worker, &x);
+        b->assign[v] = vector_closest(b, x, norm);
+    }
+}
+
+/* Rows of a chunk of the index, from the vectors in the order of the lists */
+static void vector_fill(void *ctx, int i, int worker) {
+    const vector_build_st *b = ctx;
+    vector_index_st *idx = b->idx;
+    u64 end = (u64)(i + 1) * VECTOR_CHUNK < b->num ? (u64)(i + 1) * VECTOR_CHUNK : b->num;
+    float *x;
+
+    for (u64 p = (u64)i * VECTOR_CHUNK; p < end; ++p) {
+        u64 v = b->order[p];
+        float norm = vector_load(b, v, worker, &x);
+
+        idx->scales[p] = vector_quantize(x, b->dim, norm, idx->codes + p * idx->row_bytes,
+                                         idx->row_bytes);
+        if (b->ids) {
+            memcpy(&idx->ids[p], b->ids + v * sizeof(u64), sizeof(u64));
+        } else {
+            idx->ids[p] = v;
+        }
+    }
+}
+
+/* Centroids of the lists by k-means on a sample of the vectors */
+static int vector_train(vector_build_st *b, float *centroids, float *half_norms) {
+    u32 dim = b->dim, lists = b->num_lists;
+    u64 m = (u64)lists * VECTOR_TRAIN_PER_LIST < b->num ? (u64)lists * VECTOR_TRAIN_PER_LIST
+                                                        : b->num;
+    float *sample = malloc(m * dim * sizeof(float));
+    u32 *assign = malloc(m * sizeof(u32)), *counts = malloc(lists * sizeof(u32));
+    vector_build_st t = *b;
+    int ret = -ENOMEM;
+
+    if (!sample || !assign || !counts) {
+        goto out;
+    }
+    for (u64 i = 0; i < m; ++i) {
+        float *x = sample + i * dim;
+        memcpy(x, b->vectors + (i * b->num / m) * dim * sizeof(float), dim * sizeof(float));
+        if (b->normalize) {
+            float norm = vector_norm(x, dim);
+            for (u32 j = 0; j < dim; ++j) {
+                x[j] /= norm;
+            }
+        }
+    }
+    for (u32 l = 0; l < lists; ++l) {
+        memcpy(centroids + (size_t)l * dim, sample + (l * m / lists) * dim, dim * sizeof(float));
+    }
+
+    t.vectors = (const u8 *)sample;
+    t.num = m;
+    t.assign = assign;
+    t.centroids = centroids;
+    t.half_norms = half_norms;
+    for (int it = 0; it < VECTOR_TRAIN_ITERATIONS; ++it) {
+        for (u32 l = 0; l < lists; ++l) {
+            const float *c = centroids + (size_t)l * dim;
+            half_norms[l] = vector_dot_float(c, c, dim) / 2;
+        }
+        parallel_for((m + VECTOR_CHUNK - 1) / VECTOR_CHUNK, vector_assign_sample, &t);
+
+        memset(centroids, 0, (size_t)lists * dim * sizeof(float));
+        memset(counts, 0, lists * sizeof(u32));
+        for (u64 i = 0; i < m; ++i) {
+            float *c = centroids + (size_t)assign[i] * dim;
+            for (u32 j = 0; j < dim; ++j) {
+                c[j] += sample[i * dim + j];
+            }
+            counts[assign[i]]++;
+        }
+        for (u32 l = 0; l < lists; ++l) {
+            float *c = centroids + (size_t)l * dim;
+            if (!counts[l]) {
+                // An empty list restarts from a vector of the sample
+                memcpy(c, sample + ((l * 7919 + it) % m) * dim, dim * sizeof(float));
+                continue;
+            }
+            for (u32 j = 0; j < dim; ++j) {
+                c[j] /= counts[l];
+            }
+        }
+    }
+    for (u32 l = 0; l < lists; ++l) {
+        const float *c = centroids + (size_t)l * dim;
+        half_norms[l] = vector_dot_float(c, c, dim) / 2;
+    }
+    ret = 0;
+
+out:
+    free(sample);
+    free(assign);
+    free(counts);
+    return ret;
+}
+
+int vector_build(void *index, size_t index_bytes, const void *vectors, size_t num, u32 dim,
+                 u32 options, const void *ids) {
+    u32 lists = (options >> 8) & 0xFFFF;
+    vector_build_st b = {
+        .vectors = vectors,
+        .dim = dim,
+        .normalize = !!(options & TSP_VECTOR_NORMALIZE),
+        .num = num,
+        .ids = ids,
+    };
+    vector_index_st idx;
+    struct timespec now;
+    float *half_norms = NULL;
+    u32 *order = NULL;
+    int ret;
+
+    lists = lists ? lists : 1;
+    if (!dim || dim > TSP_VECTOR_MAX_DIM || num > UINT32_MAX || (num && lists > num) ||
+        (uintptr_t)index % 64) {
+        return -EINVAL;
+    }
+    if (index_bytes < TSP_VECTOR_INDEX_BYTES(num, dim, lists)) {
+        return -ENOSPC;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    idx.header = (TspVectorHeader){
+        .Magic = TSP_VECTOR_MAGIC,
+        .Flags = options & TSP_VECTOR_NORMALIZE,
+        .Dim = dim,
+        .NumLists = lists,
+        .NumVectors = num,
+        .Generation = (u64)now.tv_sec * 1000000000 + now.tv_nsec,
+        .Bytes = TSP_VECTOR_INDEX_BYTES(num, dim, lists),
+    };
+    vector_index_layout(&idx, index);
+    // Everything but the codes, that are written with their padding
+    memset(index, 0, (u8 *)idx.codes - (u8 *)index);
+    memcpy(index, &idx.header, sizeof(idx.header));
+
+    ret = -ENOMEM;
+    b.num_lists = lists;
+    b.idx = &idx;
+    b.centroids = idx.centroids;
+    b.x = malloc((size_t)parallel_threads() * dim * sizeof(float));
+    b.assign = calloc(num ? num : 1, sizeof(u32));
+    order = malloc((num ? num : 1) * sizeof(u32));
+    half_norms = malloc(lists * sizeof(float));
+    if (!b.x || !b.assign || !order || !half_norms) {
+        goto out;
+    }
+    if (lists > 1) {
+        ret = vector_train(&b, idx.centroids, half_norms);
+        if (ret) {
+            goto out;
+        }
+        b.half_norms = half_norms;
+        parallel_for((num + VECTOR_CHUNK - 1) / VECTOR_CHUNK, vector_assign, &b);
+    }
+
+    // Vectors in the order of their lists (counting sort)
+    for (u64 v = 0; v < num; ++v) {
+        idx.starts[b.assign[v] + 1]++;
+    }
+    for (u32 l = 0; l < lists; ++l) {
+        idx.starts[l + 1] += idx.starts[l];
+    }
+    for (u64 v = 0; v < num; ++v) {
+        order[idx.starts[b.assign[v]]++] = v;
+    }
+    for (u32 l = lists; l > 0; --l) {
+        idx.starts[l] = idx.starts[l - 1];
+    }
+    idx.starts[0] = 0;
+
+    b.order = order;
+    parallel_for((num + VECTOR_CHUNK - 1) / VECTOR_CHUNK, vector_fill, &b);
+    ret = 0;
+
+out:
+    free(b.x);
+    free(b.assign);
+    free(order);
+    free(half_norms);
+    return ret;
+}
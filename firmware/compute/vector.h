@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#ifndef __VECTOR_H__
+#define __VECTOR_H__
+
+#include <stddef.h>
+#include "tsp.h"
+
+/**
+ * @brief Selects the kernels for the CPU, called once after parallel_init()
+ * @return 0, or -1 if there is not enough memory
+ * */
+int vector_init(void);
+
+/**
+ * @brief Returns the names of the selected kernels
+ * */
+const char *vector_kernels(void);
+
+/**
+ * @brief Builds the index of vectors, quantized and grouped in IVF lists
+ * @param[out] index : TSP_VECTOR_INDEX_BYTES() bytes, 64-byte aligned
+ * @param[in] vectors : num vectors of dim floats
+ * @param[in] options : TSP_VECTOR_OPTIONS() of TSP_VECTOR_BUILD (see tsp.h)
+ * @param[in] ids : u64 ID of each vector, NULL for their position
+ * @return 0, -EINVAL if the options or the dimension are invalid, -ENOSPC if
+ * the index does not fit, -ENOMEM
+ * */
+int vector_build(void *index, size_t index_bytes, const void *vectors, size_t num, u32 dim,
+                 u32 options, const void *ids);
+
+/**
+ * @brief Finds the k best vectors of the index for each query
+ * @param[in] index : The index, or its TspExtentList with TSP_VECTOR_NAMESPACE
+ * (the namespace opened with namespace_open())
+ * @param[in] queries : num vectors of the dimension of the index
+ * @param[in] options : TSP_VECTOR_OPTIONS() of TSP_VECTOR_SEARCH (see tsp.h)
+ * @param[out] hits : k TspVectorHit per query, the best first
+ * @return 0, -EINVAL if the options or the index are invalid, -ENOSPC if the
+ * queries or the hits are not in their buffers, -ENODEV if the namespace was
+ * not opened, -EIO if it could not be read, -ENOMEM
+ * */
+int vector_search(const void *index, size_t index_bytes, const void *queries,
+                  size_t queries_bytes, size_t num, u32 options, void *hits, size_t hits_bytes);
+
+#endif /* __VECTOR_H__ */
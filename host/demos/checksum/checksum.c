@@ -65,10 +65,11 @@ int main(int argc, char *argv[]) {
     char* path = "";
     char* file = "test.bin";
     int iterations = 1;
+    int load_extents = 0; // The CSD loads the file from storage itself
 
     int c;
     opterr = 0;
-    while ((c = getopt(argc, argv, "d:f:i:")) != -1) {
+    while ((c = getopt(argc, argv, "d:f:i:x")) != -1) {
         switch (c)
         {
         case 'd':
@@ -80,6 +81,9 @@ int main(int argc, char *argv[]) {
         case 'i':
             iterations = atoi(optarg);
             break;
+        case 'x':
+            load_extents = 1;
+            break;
         default:
             printf("Unknown option\n");
             return -1;
@@ -178,7 +182,22 @@ int main(int argc, char *argv[]) {
     //    ERROR_OUT("Could not set the O_DIRECT flag");
     //}
 
-    if (!vaArray[0]) {
+    if (load_extents) {
+        // The file is resolved to its extents on the backend storage and the
+        // CSD loads them into the AFDM, the data does not go through the host
+        CsStorageRequest storageReq = {0,};
+        storageReq.Mode = CS_STORAGE_FILE_IO;
+        storageReq.DevHandle = dev;
+        storageReq.u.FileIo.Type = CS_STORAGE_LOAD_TYPE;
+        storageReq.u.FileIo.FileHandle = (void *)(intptr_t)hFile;
+        storageReq.u.FileIo.Offset = 0;
+        storageReq.u.FileIo.Bytes = FILESIZE;
+        storageReq.u.FileIo.DevMem.MemHandle = AFDMArray[0];
+        storageReq.u.FileIo.DevMem.ByteOffset = 0;
+        status = csQueueStorageRequest(&storageReq, NULL, NULL, NULL, NULL);
+        if (status != CS_SUCCESS)
+            ERROR_QUIT("Could not load file from storage to AFDM\n");
+    } else if (!vaArray[0]) {
         ERROR_QUIT("Memory is not mapped to userspace\n");
     } else {
         int ret = 0;
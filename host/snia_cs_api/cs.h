@@ -442,8 +442,30 @@ typedef void(*csQueryPluginCallbackFn)(CS_PLUGIN_TYPE Type, char *Buffer);
  * Device Discovery *
  *-******************/
 
+/**
+ * @brief This function returns the CSEs that provide the specified function
+ * @param[in] FunctionName : Name of the function, NULL to list all CSEs
+ * @param[inout] Length : Length of buffer passed for output, set to the length
+ * required (including the terminating null character)
+ * @param[out] Buffer : Returns the names of the CSEs separated by commas
+ * @return This function returns CS_SUCCESS if there is no error. Otherwise, the
+ * function returns a status of CS_INVALID_ARG, CS_INVALID_OPTION,
+ * CS_NO_SUCH_ENTITY_EXISTS or CS_INVALID_LENGTH as defined in 6.3.2.
+ * */
 extern CS_STATUS csQueryCSEList(char *FunctionName, int *Length, char *Buffer);
 
+/**
+ * @brief This function returns the functions provided by the CSx associated
+ * with the specified path
+ * @param[in] Path : A path to a file, directory or device (see
+ * csGetCSxFromPath()), NULL to list the functions of all CSxes
+ * @param[inout] Length : Length of buffer passed for output, set to the length
+ * required (including the terminating null character)
+ * @param[out] Buffer : Returns the names of the functions separated by commas
+ * @return This function returns CS_SUCCESS if there is no error. Otherwise, the
+ * function returns a status of CS_INVALID_ARG, CS_ENTITY_NOT_ON_DEVICE,
+ * CS_NO_SUCH_ENTITY_EXISTS or CS_INVALID_LENGTH as defined in 6.3.2.
+ * */
 extern CS_STATUS csQueryFunctionList(char *Path, int *Length, char *Buffer);
 
 /**
@@ -452,7 +474,8 @@ extern CS_STATUS csQueryFunctionList(char *Path, int *Length, char *Buffer);
  * @param[in] Path : A string that denotes a path to a file, directory that
  * resides on a device or a device path. The file/directory may indirectly
  * refer to a namespace and partition.
- * @param[inout] Length : Length of buffer passed for output
+ * @param[inout] Length : Length of buffer passed for output, set to the length
+ * required (including the terminating null character) if it is too short
  * @param[out] DevName : Returns the qualified name to the CSx
  * @return This function returns CS_SUCCESS if there is no error and a CSx was
  * found to be associated with the path specified. Otherwise, the function
@@ -479,6 +502,13 @@ extern CS_STATUS csGetCSxFromPath(char *Path, unsigned int *Length, char *DevNam
 extern CS_STATUS csOpenCSx(char *DevName, void *DevContext,
                            CS_DEV_HANDLE *DevHandle);
 
+/**
+ * @brief Closes a CSx handle, the FDM still allocated through this handle is
+ * released.
+ * @param[in] DevHandle : Handle to CSx
+ * @return This function returns CS_SUCCESS if there is no error. Otherwise,
+ * the function returns a status of CS_INVALID_HANDLE.
+ * */
 extern CS_STATUS csCloseCSx(CS_DEV_HANDLE DevHandle);
 
 /**
@@ -540,6 +570,13 @@ NotifyFn);
 extern CS_STATUS csAllocMem(CS_DEV_HANDLE DevHandle, int Bytes, unsigned int MemFlags,
                             CS_MEM_HANDLE *MemHandle, CS_MEM_PTR *VAddressPtr);
 
+/**
+ * @brief Frees FDM previously allocated with csAllocMem(), the host mapping
+ * of the memory (VAddressPtr) is no longer valid.
+ * @param[in] MemHandle : Memory handle returned by csAllocMem()
+ * @return This function returns CS_SUCCESS if there were no errors.
+ * Otherwise, the function returns a status of CS_INVALID_HANDLE.
+ * */
 extern CS_STATUS csFreeMem(CS_MEM_HANDLE MemHandle);
 
 /*-*************
@@ -697,11 +734,34 @@ extern CS_STATUS csQueryDeviceProperties(CS_DEV_HANDLE DevHandle, int *Length,
 extern CS_STATUS csQueryDeviceCapabilities(CS_DEV_HANDLE DevHandle,
                                            CsCapabilities *Caps);
 
+/**
+ * @brief Queries the usage statistics of a CSx, of its CSE or of one of its
+ * functions
+ * @param[in] DevHandle : Handle to CSx
+ * @param[in] Type : Statistics to query
+ * @param[in] Identifier : A pointer to the CS_FUNCTION_ID of the function for
+ * CS_STAT_FUNCTION, not used otherwise
+ * @param[out] Stats : A pointer to a buffer that is able to hold the
+ * statistics
+ * @return CS_SUCCESS is returned if there are no errors. Otherwise, the
+ * function returns an error status of CS_INVALID_ARG, CS_INVALID_HANDLE,
+ * CS_INVALID_OPTION, CS_INVALID_FUNCTION, or CS_DEVICE_NOT_AVAILABLE as
+ * defined in 6.3.2.
+ * */
 extern CS_STATUS csQueryDeviceStatistics(CS_DEV_HANDLE DevHandle,
                                          CS_STAT_TYPE Type,
                                          void *Identifier,
                                          CsStatsInfo *Stats);
 
+/**
+ * @brief Sets a capability of a CSx, e.g., the maximum of outstanding I/Os
+ * @param[in] DevHandle : Handle to CSx
+ * @param[in] Type : Capability to set
+ * @param[in] Details : A pointer to the value of the capability
+ * @return CS_SUCCESS is returned if there are no errors. Otherwise, the
+ * function returns an error status of CS_INVALID_ARG, CS_INVALID_HANDLE,
+ * CS_UNSUPPORTED, or CS_NOT_ENOUGH_MEMORY as defined in 6.3.2.
+ * */
 extern CS_STATUS csSetDeviceCapability(CS_DEV_HANDLE DevHandle,
                                        CS_CAP_TYPE Type,
                                        CsCapabilityInfo *Details);
@@ -0,0 +1,427 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Header only C++ interface on top of the CS API (cs.h), C++17.
+ *
+ * The handles of the CS API are wrapped in move-only RAII types (Device for a
+ * CSx, Engine for a CSE, Buffer for an FDM allocation and Event), their
+ * constructors throw cs::Error when the underlying call fails. Compute
+ * functions are typed, e.g. :
+ *
+ *     cs::Device dev("nvme0");
+ *     cs::Engine cse(dev);
+ *     cs::Function<cs::Mem, u32, cs::Mem> checksum(cse, "Checksum");
+ *     cs::Buffer data(dev, 4096), result(dev, 4096);
+ *     CS_STATUS status = checksum(data, 4096, result);
+ *     std::future<CS_STATUS> done = checksum.async(data, 4096, result);
+ *
+ * The type of every argument (FDM, 32-bit or 64-bit value) is resolved at
+ * compile time and the request is built on the stack, without allocation nor
+ * call to csHelperSetComputeArg(). Compute calls return the CS_STATUS of the
+ * request rather than throwing, as failed requests are an expected outcome.
+ * */
+
+#ifndef __CS_HPP__
+#define __CS_HPP__
+
+#include "cs.h"
+#include "cs_tsp.h"
+
+#include <cstddef>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace cs {
+
+/**
+ * @brief Thrown when a handle cannot be acquired
+ * */
+class Error : public std::runtime_error {
+public:
+    Error(const char *call, CS_STATUS status) :
+        std::runtime_error(std::string(call) + " failed with status " + std::to_string(status)),
+        status_(status) {}
+
+    CS_STATUS status() const noexcept { return status_; }
+
+private:
+    CS_STATUS status_;
+};
+
+namespace detail {
+
+inline void check(CS_STATUS status, const char *call) {
+    if (status != CS_SUCCESS) {
+        throw Error(call, status);
+    }
+}
+
+/* Calls fn(Buffer, &Length) with a buffer large enough for the string result */
+template <typename Fn>
+std::string query_name(Fn fn, const char *call) {
+    std::string name(64, '\0');
+    unsigned int length = name.size();
+    CS_STATUS status = fn(&name[0], &length);
+
+    if (status == CS_INVALID_LENGTH) {
+        name.resize(length);
+        status = fn(&name[0], &length);
+    }
+    check(status, call);
+    name.resize(name.find('\0'));
+    return name;
+}
+
+} // namespace detail
+
+/*-*********
+ * Handles *
+ *-*********/
+
+class Buffer;
+
+/**
+ * @brief A computational storage device (CSx), closed on destruction
+ * */
+class Device {
+public:
+    explicit Device(const std::string &name) {
+        detail::check(csOpenCSx(const_cast<char *>(name.c_str()), nullptr, &handle_), "csOpenCSx");
+    }
+
+    /**
+     * @brief Opens the CSx associated with a path (e.g., a file, a namespace)
+     * */
+    static Device fromPath(const std::string &path) {
+        return Device(detail::query_name([&](char *name, unsigned int *length) {
+            return csGetCSxFromPath(const_cast<char *>(path.c_str()), length, name);
+        }, "csGetCSxFromPath"));
+    }
+
+    ~Device() { reset(); }
+
+    Device(Device &&other) noexcept : handle_(std::exchange(other.handle_, -1)) {}
+    Device &operator=(Device &&other) noexcept {
+        if (this != &other) {
+            reset();
+            handle_ = std::exchange(other.handle_, -1);
+        }
+        return *this;
+    }
+    Device(const Device &) = delete;
+    Device &operator=(const Device &) = delete;
+
+    CS_DEV_HANDLE handle() const noexcept { return handle_; }
+
+    CsCapabilities capabilities() const {
+        CsCapabilities caps;
+        detail::check(csQueryDeviceCapabilities(handle_, &caps), "csQueryDeviceCapabilities");
+        return caps;
+    }
+
+    /* Name of the CSE of the CSx */
+    std::string engineName() const {
+        return detail::query_name([&](char *name, unsigned int *length) {
+            return csGetCSEFromCSx(handle_, length, name);
+        }, "csGetCSEFromCSx");
+    }
+
+private:
+    void reset() noexcept {
+        if (handle_ >= 0) {
+            csCloseCSx(handle_);
+            handle_ = -1;
+        }
+    }
+
+    CS_DEV_HANDLE handle_ = -1;
+};
+
+/**
+ * @brief A computational storage engine (CSE), closed on destruction
+ * */
+class Engine {
+public:
+    explicit Engine(const std::string &name) {
+        detail::check(csOpenCSE(const_cast<char *>(name.c_str()), nullptr, &handle_), "csOpenCSE");
+    }
+
+    /* Opens the CSE of a CSx */
+    explicit Engine(const Device &dev) : Engine(dev.engineName()) {}
+
+    ~Engine() { reset(); }
+
+    Engine(Engine &&other) noexcept : handle_(std::exchange(other.handle_, -1)) {}
+    Engine &operator=(Engine &&other) noexcept {
+        if (this != &other) {
+            reset();
+            handle_ = std::exchange(other.handle_, -1);
+        }
+        return *this;
+    }
+    Engine(const Engine &) = delete;
+    Engine &operator=(const Engine &) = delete;
+
+    CS_CSE_HANDLE handle() const noexcept { return handle_; }
+
+    CS_FUNCTION_ID function(const std::string &name) const {
+        CS_FUNCTION_ID id;
+        detail::check(csGetFunction(handle_, const_cast<char *>(name.c_str()), nullptr, &id),
+                      "csGetFunction");
+        return id;
+    }
+
+private:
+    void reset() noexcept {
+        if (handle_ >= 0) {
+            csCloseCSE(handle_);
+            handle_ = -1;
+        }
+    }
+
+    CS_CSE_HANDLE handle_ = -1;
+};
+
+/**
+ * @brief Location in the FDM, the type of the FDM arguments of a Function
+ * */
+struct Mem {
+    Mem(CS_MEM_HANDLE handle, u64 offset = 0) noexcept : handle(handle), offset(offset) {}
+    Mem(const Buffer &buffer) noexcept;
+
+    CS_MEM_HANDLE handle;
+    u64 offset;
+};
+
+/**
+ * @brief An FDM allocation with its host mapping, freed on destruction
+ * */
+class Buffer {
+public:
+    Buffer(const Device &dev, int bytes, unsigned int flags = 0) : bytes_(bytes) {
+        detail::check(csAllocMem(dev.handle(), bytes, flags, &handle_, &va_), "csAllocMem");
+    }
+
+    ~Buffer() { reset(); }
+
+    Buffer(Buffer &&other) noexcept :
+        handle_(std::exchange(other.handle_, 0)), va_(std::exchange(other.va_, nullptr)),
+        bytes_(std::exchange(other.bytes_, 0)) {}
+    Buffer &operator=(Buffer &&other) noexcept {
+        if (this != &other) {
+            reset();
+            handle_ = std::exchange(other.handle_, 0);
+            va_ = std::exchange(other.va_, nullptr);
+            bytes_ = std::exchange(other.bytes_, 0);
+        }
+        return *this;
+    }
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
+    CS_MEM_HANDLE handle() const noexcept { return handle_; }
+    size_t size() const noexcept { return bytes_; }
+
+    /* Host view of the buffer, NULL if the FDM is not host visible */
+    template <typename T = void>
+    T *data() const noexcept { return static_cast<T *>(va_); }
+
+    Mem at(u64 offset) const noexcept { return Mem(handle_, offset); }
+
+private:
+    void reset() noexcept {
+        if (handle_) {
+            csFreeMem(handle_);
+            handle_ = 0;
+        }
+    }
+
+    CS_MEM_HANDLE handle_ = 0;
+    CS_MEM_PTR va_ = nullptr;
+    size_t bytes_;
+};
+
+inline Mem::Mem(const Buffer &buffer) noexcept : handle(buffer.handle()), offset(0) {}
+
+/**
+ * @brief An event signaled by the requests queued with it, deleted on destruction
+ * */
+class Event {
+public:
+    Event() { detail::check(csCreateEvent(&handle_), "csCreateEvent"); }
+
+    ~Event() {
+        if (handle_) {
+            csDeleteEvent(handle_);
+        }
+    }
+
+    Event(Event &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Event &operator=(Event &&other) noexcept {
+        std::swap(handle_, other.handle_);
+        return *this;
+    }
+    Event(const Event &) = delete;
+    Event &operator=(const Event &) = delete;
+
+    CS_EVT_HANDLE handle() const noexcept { return handle_; }
+
+    /* CS_NOT_DONE while requests are pending, their status otherwise */
+    CS_STATUS poll() const noexcept { return csPollEvent(handle_, nullptr); }
+    /* Waits for the pending requests, returns their status (the first error) */
+    CS_STATUS wait() const noexcept { return csTspWaitEvent(handle_); }
+
+private:
+    CS_EVT_HANDLE handle_ = nullptr;
+};
+
+/*-*******************
+ * Compute functions *
+ *-*******************/
+
+namespace detail {
+
+template <typename T>
+struct dependent_false : std::false_type {};
+
+/* How an argument of type T is stored in a CsComputeArg */
+template <typename T, typename = void>
+struct arg_traits {
+    static_assert(dependent_false<T>::value,
+                  "compute arguments are cs::Mem or integers of at most 64 bits");
+};
+
+template <typename T>
+struct arg_traits<T, std::enable_if_t<std::is_integral_v<T> && sizeof(T) <= 4>> {
+    static void set(CsComputeArg &arg, T value) noexcept {
+        arg.Type = CS_32BIT_VALUE_TYPE;
+        arg.u.Value32 = static_cast<u32>(value);
+    }
+};
+
+template <typename T>
+struct arg_traits<T, std::enable_if_t<std::is_integral_v<T> && sizeof(T) == 8>> {
+    static void set(CsComputeArg &arg, T value) noexcept {
+        arg.Type = CS_64BIT_VALUE_TYPE;
+        arg.u.Value64 = static_cast<u64>(value);
+    }
+};
+
+template <>
+struct arg_traits<Mem> {
+    static void set(CsComputeArg &arg, const Mem &mem) noexcept {
+        arg.Type = CS_AFDM_TYPE;
+        arg.u.DevMem.MemHandle = mem.handle;
+        arg.u.DevMem.ByteOffset = mem.offset;
+    }
+};
+
+/* A request with N arguments, laid out as the CS API expects (packed, the
+ * arguments past the first one follow the structure) */
+template <size_t N>
+struct __attribute__((packed)) Request {
+    CsComputeRequest req;
+    CsComputeArg more[N > 1 ? N - 1 : 1];
+};
+
+inline void fulfil(void *context, CS_STATUS status) {
+    auto *promise = static_cast<std::promise<CS_STATUS> *>(context);
+    promise->set_value(status);
+    delete promise;
+}
+
+} // namespace detail
+
+/**
+ * @brief A compute function of a CSE, called with arguments of types Params
+ * (cs::Mem, or integers stored as 32 or 64-bit values after their size). The
+ * Engine has to outlive the Function.
+ * */
+template <typename... Params>
+class Function {
+public:
+    Function(const Engine &cse, CS_FUNCTION_ID id) noexcept : cse_(cse.handle()), id_(id) {}
+    Function(const Engine &cse, const std::string &name) : cse_(cse.handle()), id_(cse.function(name)) {}
+
+    CS_FUNCTION_ID id() const noexcept { return id_; }
+
+    /* Executes the function synchronously */
+    CS_STATUS operator()(Params... args) const {
+        detail::Request<sizeof...(Params)> r;
+        build(r.req, args...);
+        return csQueueComputeRequest(&r.req, nullptr, nullptr, nullptr, nullptr);
+    }
+
+    /* Queues the function, the event is signaled once it completed */
+    CS_STATUS queue(const Event &event, Params... args) const {
+        detail::Request<sizeof...(Params)> r;
+        build(r.req, args...);
+        return csQueueComputeRequest(&r.req, nullptr, nullptr, event.handle(), nullptr);
+    }
+
+    /* Queues the function, fn(context, status) is called once it completed */
+    CS_STATUS queue(csQueueCallbackFn fn, void *context, Params... args) const {
+        detail::Request<sizeof...(Params)> r;
+        build(r.req, args...);
+        return csQueueComputeRequest(&r.req, context, fn, nullptr, nullptr);
+    }
+
+    /* Queues the function, the future holds the status once it completed */
+    std::future<CS_STATUS> async(Params... args) const {
+        auto *promise = new std::promise<CS_STATUS>();
+        std::future<CS_STATUS> future = promise->get_future();
+        CS_STATUS status = queue(detail::fulfil, promise, args...);
+
+        if (status != CS_QUEUED) {
+            // Not queued, the callback will not be called
+            promise->set_value(status);
+            delete promise;
+        }
+        return future;
+    }
+
+private:
+    void build(CsComputeRequest &req, const Params &... args) const noexcept {
+        // The arguments are contiguous in the packed Request
+        CsComputeArg *arg = req.Args;
+
+        req.CSEHandle = cse_;
+        req.FunctionId = id_;
+        req.NumArgs = sizeof...(Params);
+        (detail::arg_traits<Params>::set(*arg++, args), ...);
+        (void)arg;
+    }
+
+    CS_CSE_HANDLE cse_;
+    CS_FUNCTION_ID id_;
+};
+
+} // namespace cs
+
+#endif /* __CS_HPP__ */
@@ -0,0 +1,487 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Admission control of the compute requests.
+ *
+ * Without limits a burst of requests from many threads only grows the queues
+ * of the device, and with them the latency of every request. The limits of a
+ * CSx bound the requests this process has in flight on it, in total and per
+ * function, and the rate of each tenant (token bucket). The state belongs to
+ * the controller, the limits set through any of its handles apply to the
+ * requests of all of them (CSx and CSEs). It is created with the first limit,
+ * the CSx without limits only pay for a pointer test.
+ *
+ * Requests over the limits are refused, or wait in a FIFO queue. Every change
+ * (a completion, tokens earned) grants the waiting requests in order, and new
+ * requests queue behind them. A request that the limits of the CSx or of its
+ * function hold back also holds back the ones behind it, only a request that
+ * waits for the tokens of its tenant lets the others (e.g., the other tenants)
+ * go first.
+ *
+ * Completion callbacks run on the threads that complete the requests (ring
+ * reaper, io_uring completions), the requests they issue are refused instead
+ * of waiting, which could wait for their own thread.
+ * */
+
+#include "cs.h"
+#include "cs_tsp.h"
+#include "tsp_device.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#define TSP_ADMIT_MAX_TENANTS 64
+/* Tokens are counted in millionths */
+#define TSP_ADMIT_TOKEN 1000000LL
+/* Time taken into account at once to earn tokens, avoids overflows */
+#define TSP_ADMIT_MAX_ELAPSED_NS (1000ULL * 1000000000ULL)
+
+typedef struct {
+    CS_FUNCTION_ID id;
+    u32 max;          /* 0 : no limit */
+    u32 outstanding;
+} tsp_admit_function_st;
+
+typedef struct {
+    CS_TSP_TENANT_ID id;
+    u32 rate;         /* tokens per second, 0 : no limit */
+    u32 burst;
+    s64 tokens;       /* in millionths, negative after a request larger than burst */
+    u64 last_ns;      /* tokens were last earned then */
+} tsp_admit_tenant_st;
+
+/* Request waiting for its admission */
+typedef struct tsp_admit_waiter {
+    tsp_admit_ticket_st *ticket;
+    int granted;
+    u64 wait_ns;      /* time until the tenant has enough tokens, 0 if unknown */
+    pthread_cond_t cond;
+    struct tsp_admit_waiter *next;
+} tsp_admit_waiter_st;
+
+struct tsp_admit {
+    pthread_mutex_t lock;
+    CS_TSP_ADMISSION policy;
+    u32 max_queued;
+    u32 max_outstanding;  /* 0 : no limit */
+    u32 outstanding;
+    tsp_admit_function_st functions[TSP_ADMIT_MAX_FUNCTIONS];
+    int num_functions;
+    tsp_admit_tenant_st tenants[TSP_ADMIT_MAX_TENANTS];
+    int num_tenants;
+    tsp_admit_waiter_st *head;
+    tsp_admit_waiter_st *tail;
+    u32 num_queued;
+};
+
+/* Tenant of the requests of the calling thread */
+static __thread CS_TSP_TENANT_ID tsp_admit_tenant;
+/* Completions the calling thread is running, see tsp_admit_completion() */
+static __thread int tsp_admit_completing;
+/* Serializes the creation of the states */
+static pthread_mutex_t tsp_admit_create_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static u64 tsp_admit_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Admission control state of the controller of a CSx, created if needed */
+static struct tsp_admit *tsp_admit_get(tsp_device_st *dev) {
+    tsp_ctrl_st *ctrl = dev->ctrl;
+    struct tsp_admit *admit = __atomic_load_n(&ctrl->admit, __ATOMIC_ACQUIRE);
+
+    if (admit) {
+        return admit;
+    }
+
+    pthread_mutex_lock(&tsp_admit_create_lock);
+    admit = ctrl->admit;
+    if (!admit) {
+        admit = calloc(1, sizeof(struct tsp_admit));
+        if (admit) {
+            pthread_mutex_init(&admit->lock, NULL);
+            __atomic_store_n(&ctrl->admit, admit, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&tsp_admit_create_lock);
+    return admit;
+}
+
+static tsp_admit_tenant_st *tsp_admit_find_tenant(struct tsp_admit *admit, CS_TSP_TENANT_ID id) {
+    for (int i = 0; i < admit->num_tenants; ++i) {
+        if (admit->tenants[i].id == id) {
+            return &admit->tenants[i];
+        }
+    }
+    return NULL;
+}
+
+/* Earns the tokens of the time elapsed since the last time */
+static void tsp_admit_refill(tsp_admit_tenant_st *t, u64 now) {
+    u64 elapsed = now - t->last_ns;
+    s64 max = (s64)t->burst * TSP_ADMIT_TOKEN;
+
+    if (elapsed > TSP_ADMIT_MAX_ELAPSED_NS) {
+        elapsed = TSP_ADMIT_MAX_ELAPSED_NS;
+    }
+    t->last_ns = now;
+    t->tokens += (s64)(elapsed / 1000000000ULL) * t->rate * TSP_ADMIT_TOKEN +
+                 (s64)((elapsed % 1000000000ULL) * t->rate / 1000);
+    if (t->tokens > max) {
+        t->tokens = max;
+    }
+}
+
+/**
+ * @brief Admits the ticket if the limits allow it, with admit->lock held
+ * @param[out] wait_ns : time until the tenant has enough tokens if the
+ * ticket is only held back by its rate, 0 otherwise
+ * @return 1 if admitted, 0 otherwise
+ * */
+static int tsp_admit_try(struct tsp_admit *admit, tsp_admit_ticket_st *ticket, u64 now,
+                         u64 *wait_ns) {
+    tsp_admit_tenant_st *t = tsp_admit_find_tenant(admit, ticket->tenant);
+
+    *wait_ns = 0;
+    if (admit->max_outstanding && admit->outstanding + ticket->requests > admit->max_outstanding &&
+        admit->outstanding) {
+        return 0;
+    }
+    for (int i = 0; i < admit->num_functions; ++i) {
+        const tsp_admit_function_st *f = &admit->functions[i];
+        if (ticket->functions[i] && f->max && f->outstanding &&
+            f->outstanding + ticket->functions[i] > f->max) {
+            return 0;
+        }
+    }
+    if (t && t->rate) {
+        // A request larger than the burst waits for a full bucket
+        s64 need = (s64)(ticket->requests < t->burst ? ticket->requests : t->burst) * TSP_ADMIT_TOKEN;
+        tsp_admit_refill(t, now);
+        if (t->tokens < need) {
+            *wait_ns = (u64)(need - t->tokens) * 1000 / t->rate + 1;
+            return 0;
+        }
+        t->tokens -= (s64)ticket->requests * TSP_ADMIT_TOKEN;
+    }
+
+    admit->outstanding += ticket->requests;
+    for (int i = 0; i < admit->num_functions; ++i) {
+        admit->functions[i].outstanding += ticket->functions[i];
+    }
+    return 1;
+}
+
+/* Admits the waiting requests in order, up to the first one held back by the
+ * limits (not by its tenant), with admit->lock held */
+static void tsp_admit_grant(struct tsp_admit *admit) {
+    tsp_admit_waiter_st **link = &admit->head, *prev = NULL;
+    u64 now = tsp_admit_now_ns();
+
+    while (*link) {
+        tsp_admit_waiter_st *w = *link;
+
+        if (!tsp_admit_try(admit, w->ticket, now, &w->wait_ns)) {
+            if (!w->wait_ns) {
+                break;
+            }
+            prev = w;
+            link = &w->next;
+            continue;
+        }
+        *link = w->next;
+        if (admit->tail == w) {
+            admit->tail = prev;
+        }
+        admit->num_queued--;
+        w->granted = 1;
+        pthread_cond_signal(&w->cond);
+    }
+}
+
+/* Queues the ticket and waits until it is admitted, with admit->lock held */
+static void tsp_admit_wait(struct tsp_admit *admit, tsp_admit_ticket_st *ticket) {
+    tsp_admit_waiter_st w = {
+        .ticket = ticket,
+    };
+    pthread_condattr_t attr;
+
+    // The deadlines are on the monotonic clock
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&w.cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (admit->tail) {
+        admit->tail->next = &w;
+    } else {
+        admit->head = &w;
+    }
+    admit->tail = &w;
+    admit->num_queued++;
+    // Admitted right away if only requests waiting for their tenant are ahead
+    tsp_admit_grant(admit);
+
+    while (!w.granted) {
+        if (w.wait_ns) {
+            // Held back by the rate of the tenant, the tokens are earned in time
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += (deadline.tv_nsec + w.wait_ns) / 1000000000ULL;
+            deadline.tv_nsec = (deadline.tv_nsec + w.wait_ns) % 1000000000ULL;
+            if (pthread_cond_timedwait(&w.cond, &admit->lock, &deadline) == ETIMEDOUT) {
+                tsp_admit_grant(admit);
+            }
+        } else {
+            pthread_cond_wait(&w.cond, &admit->lock);
+        }
+    }
+    pthread_cond_destroy(&w.cond);
+}
+
+CS_STATUS tsp_admit_acquire(CS_DEV_HANDLE fd, const CS_FUNCTION_ID *fids, int n,
+                            tsp_admit_ticket_st *ticket) {
+    tsp_device_st *dev = tsp_device_get(fd);
+    struct tsp_admit *admit = dev ? __atomic_load_n(&dev->ctrl->admit, __ATOMIC_ACQUIRE) : NULL;
+    CS_STATUS status = CS_SUCCESS;
+    u64 wait_ns = 0;
+
+    memset(ticket, 0, sizeof(*ticket));
+    if (!admit) {
+        return CS_SUCCESS;
+    }
+    ticket->tenant = tsp_admit_tenant;
+    ticket->requests = n;
+
+    pthread_mutex_lock(&admit->lock);
+    for (int i = 0; i < admit->num_functions; ++i) {
+        for (int r = 0; r < n; ++r) {
+            ticket->functions[i] += fids[r] == admit->functions[i].id;
+        }
+    }
+    // The requests already waiting go first, the ticket queues behind them
+    tsp_admit_grant(admit);
+    if (admit->head || !tsp_admit_try(admit, ticket, tsp_admit_now_ns(), &wait_ns)) {
+        if (admit->policy == CS_TSP_ADMIT_QUEUE && admit->num_queued < admit->max_queued &&
+            !tsp_admit_completing) {
+            tsp_admit_wait(admit, ticket);
+        } else {
+            status = CS_OUT_OF_RESOURCES;
+        }
+    }
+    pthread_mutex_unlock(&admit->lock);
+
+    if (status == CS_SUCCESS) {
+        ticket->admit = admit;
+    }
+    return status;
+}
+
+void tsp_admit_release(tsp_admit_ticket_st *ticket) {
+    struct tsp_admit *admit = ticket->admit;
+
+    if (!admit) {
+        return;
+    }
+    pthread_mutex_lock(&admit->lock);
+    admit->outstanding -= ticket->requests;
+    for (int i = 0; i < admit->num_functions; ++i) {
+        admit->functions[i].outstanding -= ticket->functions[i];
+    }
+    tsp_admit_grant(admit);
+    pthread_mutex_unlock(&admit->lock);
+    ticket->admit = NULL;
+}
+
+void tsp_admit_completion(int delta) {
+    tsp_admit_completing += delta;
+}
+
+void tsp_admit_destroy(tsp_ctrl_st *ctrl) {
+    if (ctrl->admit) {
+        pthread_mutex_destroy(&ctrl->admit->lock);
+        free(ctrl->admit);
+        ctrl->admit = NULL;
+    }
+}
+
+/**
+ * @copydoc csSetDeviceCapability
+ * @note the maximum of outstanding I/Os is enforced by the library for the
+ * compute requests of the process (0 for no limit), the temperature cannot
+ * be set
+ * */
+CS_STATUS csSetDeviceCapability(CS_DEV_HANDLE DevHandle, CS_CAP_TYPE Type,
+                                CsCapabilityInfo *Details) {
+    tsp_device_st *dev = tsp_device_get(DevHandle);
+    struct tsp_admit *admit;
+
+    if (!dev) {
+        return CS_INVALID_HANDLE;
+    }
+    if (!Details) {
+        return CS_INVALID_ARG;
+    }
+    if (Type != CS_CAPABILITY_CSx_MAX_IOS) {
+        return CS_UNSUPPORTED;
+    }
+
+    admit = tsp_admit_get(dev);
+    if (!admit) {
+        return CS_NOT_ENOUGH_MEMORY;
+    }
+    pthread_mutex_lock(&admit->lock);
+    admit->max_outstanding = Details->MaxIOs.TotalOutstandingIOs;
+    tsp_admit_grant(admit);
+    pthread_mutex_unlock(&admit->lock);
+    return CS_SUCCESS;
+}
+
+/**
+ * @copydoc csTspSetAdmissionPolicy
+ * */
+CS_STATUS csTspSetAdmissionPolicy(CS_DEV_HANDLE DevHandle, CS_TSP_ADMISSION Policy,
+                                  u32 MaxQueued) {
+    tsp_device_st *dev = tsp_device_get(DevHandle);
+    struct tsp_admit *admit;
+
+    if (!dev) {
+        return CS_INVALID_HANDLE;
+    }
+    if (Policy != CS_TSP_ADMIT_REJECT && (Policy != CS_TSP_ADMIT_QUEUE || !MaxQueued)) {
+        return CS_INVALID_ARG;
+    }
+
+    admit = tsp_admit_get(dev);
+    if (!admit) {
+        return CS_NOT_ENOUGH_MEMORY;
+    }
+    pthread_mutex_lock(&admit->lock);
+    admit->policy = Policy;
+    admit->max_queued = MaxQueued;
+    pthread_mutex_unlock(&admit->lock);
+    return CS_SUCCESS;
+}
+
+/**
+ * @copydoc csTspSetFunctionLimit
+ * */
+CS_STATUS csTspSetFunctionLimit(CS_DEV_HANDLE DevHandle, CS_FUNCTION_ID FunctionId,
+                                u32 MaxOutstanding) {
+    tsp_device_st *dev = tsp_device_get(DevHandle);
+    CS_STATUS status = CS_SUCCESS;
+    struct tsp_admit *admit;
+    int i;
+
+    if (!dev) {
+        return CS_INVALID_HANDLE;
+    }
+    admit = tsp_admit_get(dev);
+    if (!admit) {
+        return CS_NOT_ENOUGH_MEMORY;
+    }
+
+    // Entries are never removed, the tickets in flight count on their index
+    pthread_mutex_lock(&admit->lock);
+    for (i = 0; i < admit->num_functions; ++i) {
+        if (admit->functions[i].id == FunctionId) {
+            break;
+        }
+    }
+    if (i < admit->num_functions) {
+        admit->functions[i].max = MaxOutstanding;
+    } else if (!MaxOutstanding) {
+        // No limit on a function without one
+    } else if (i == TSP_ADMIT_MAX_FUNCTIONS) {
+        status = CS_NOT_ENOUGH_MEMORY;
+    } else {
+        admit->functions[i].id = FunctionId;
+        admit->functions[i].max = MaxOutstanding;
+        admit->num_functions++;
+    }
+    tsp_admit_grant(admit);
+    pthread_mutex_unlock(&admit->lock);
+    return status;
+}
+
+/**
+ * @copydoc csTspSetTenantRate
+ * */
+CS_STATUS csTspSetTenantRate(CS_DEV_HANDLE DevHandle, CS_TSP_TENANT_ID TenantId,
+                             u32 RequestsPerSec, u32 Burst) {
+    tsp_device_st *dev = tsp_device_get(DevHandle);
+    CS_STATUS status = CS_SUCCESS;
+    struct tsp_admit *admit;
+    tsp_admit_tenant_st *t;
+
+    if (!dev) {
+        return CS_INVALID_HANDLE;
+    }
+    if (RequestsPerSec && !Burst) {
+        return CS_INVALID_ARG;
+    }
+    admit = tsp_admit_get(dev);
+    if (!admit) {
+        return CS_NOT_ENOUGH_MEMORY;
+    }
+
+    pthread_mutex_lock(&admit->lock);
+    t = tsp_admit_find_tenant(admit, TenantId);
+    if (!t && RequestsPerSec) {
+        if (admit->num_tenants == TSP_ADMIT_MAX_TENANTS) {
+            status = CS_NOT_ENOUGH_MEMORY;
+        } else {
+            // A new tenant starts with a full bucket
+            t = &admit->tenants[admit->num_tenants++];
+            t->id = TenantId;
+            t->tokens = (s64)Burst * TSP_ADMIT_TOKEN;
+            t->last_ns = tsp_admit_now_ns();
+        }
+    }
+    if (t) {
+        t->rate = RequestsPerSec;
+        t->burst = Burst;
+        if (t->tokens > (s64)Burst * TSP_ADMIT_TOKEN) {
+            t->tokens = (s64)Burst * TSP_ADMIT_TOKEN;
+        }
+    }
+    tsp_admit_grant(admit);
+    pthread_mutex_unlock(&admit->lock);
+    return status;
+}
+
+/**
+ * @copydoc csTspSetTenant
+ * */
+void csTspSetTenant(CS_TSP_TENANT_ID TenantId) {
+    tsp_admit_tenant = TenantId;
+}
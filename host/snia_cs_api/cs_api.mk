@@ -0,0 +1,5 @@
+# Objects of the CS API, applications include this file after setting
+# CS_API_PATH to this directory and link against $(CS_API_OBJS)
+CS_API_SOURCES = cs_admit.c cs_api_nvme_tsp.c cs_discovery.c cs_event.c cs_job.c cs_mem.c cs_memo.c cs_ring.c cs_sched.c cs_stats.c cs_storage.c cs_utils.c tsp_device.c tsp_emu.c tsp_transport.c tsp_uring.c
+CS_API_OBJS = $(addprefix $(CS_API_PATH)/,$(CS_API_SOURCES:.c=.o))
+LDLIBS += -lpthread
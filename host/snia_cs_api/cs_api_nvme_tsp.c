@@ -24,9 +24,16 @@
  ******************************************************************************/
 
 #include "cs.h"
+#include "tsp.h"
+#include "tsp_wire.h"
+#include "cs_tsp.h"
+#include "tsp_device.h"
+#include "tsp_emu.h"
+#include "tsp_transport.h"
 #include "debug.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include <stdarg.h>
 
 #include <unistd.h>
@@ -37,13 +44,13 @@
 
 #include <libnvme.h>
 
-/* Set to 1 to route compute requests through user space */
+/* Set to TSP_CS_COMPUTE_USER to route compute requests through the compute
+ * daemon of the CSD (firmware/compute) */
 #define ROUTE_CS_COMPUTE_THROUGH_USER_SPACE 0
 
 typedef void* PHYSICAL_ADDR;
 
 #define __CS_PLACE_HOLDER_DEV_NAME "Simulated_Device"
-#define __CS_PLACE_HOLDER_CSE_NAME "Simulated_CSE"
 #define __CS_PLACE_HOLDER_FUNCTION "Checksum"
 #define __CS_PLACE_HOLDER_DEV_HANDLE (CS_DEV_HANDLE)42
 #define __CS_PLACE_HOLDER_CSE_HANDLE (CS_CSE_HANDLE)43
@@ -60,32 +67,18 @@ static int is_blkdev(struct stat s) {
 
 const char *TSP_CS_ID_STRING = "This device has compute";
 
-typedef enum {
-    TSP_CS_IDENTIFY = 0,
-    TSP_CS_GET = 8,
-    TSP_CS_ALLOCATE = 16,
-    TSP_CS_DEALLOCATE = 17,
-    TSP_CS_COMPUTE = 32,
-    TSP_CS_COMM = 64,
-} TSP_CDW10;
-
-typedef enum {
-    TSP_CS_CSX = 0,
-    TSP_CS_PROPS = 8,
-    TSP_CS_CAPS = 16,
-    TSP_CS_FUN = 32,
-    TSP_CS_MEM = 64,
-} TSP_CDW11;
-
 static int tsp_nvme_device_has_cs(CS_DEV_HANDLE fd) {
     int ret = 0;
     const unsigned int buffer_len = 4096;
     char buffer[buffer_len];
-    ret = nvme_admin_passthru(fd, 0xc0 /*opcode*/, 0 /*flags*/, 0 /*rsvd*/,
-		0 /** @todo ?*/ /*nsid*/, 0 /*cdw2*/, 0 /*cdw3*/, TSP_CS_IDENTIFY /*cdw10*/, TSP_CS_CSX /*cdw11*/,
-		0 /*cdw12*/, 0 /*cdw13*/, 0 /*cdw14*/, 0 /*cdw15*/,
-		buffer_len /*data_len*/, buffer /*data*/, 0 /*metadata_len*/, NULL /*metadata*/,
-		0 /*timeout_ms*/, NULL /*result*/);
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_IDENTIFY,
+        .cdw11 = TSP_CS_CSX,
+        .dir = TSP_DIR_FROM_DEV,
+        .data_len = buffer_len,
+        .data = buffer,
+    };
+    ret = tsp_submit_admin(fd, &cmd);
     if (ret) {
         MSG_PRINT_ERROR("Device could not identify compute storage capabilities");
         return 0;
@@ -94,55 +87,63 @@ static int tsp_nvme_device_has_cs(CS_DEV_HANDLE fd) {
     }
 }
 
-static CS_STATUS tsp_nvme_get_properties(CS_DEV_HANDLE fd, int *Length, CSxProperties *props) {
+static CS_STATUS tsp_nvme_get_properties(CS_DEV_HANDLE fd, void *buffer) {
     int ret = 0;
-    size_t size = *Length;
     const unsigned int buffer_len = 4096;
-    char buffer[buffer_len];
-    ret = nvme_admin_passthru(fd, 0xc0 /*opcode*/, 0 /*flags*/, 0 /*rsvd*/,
-		0 /** @todo ?*/ /*nsid*/, 0 /*cdw2*/, 0 /*cdw3*/, TSP_CS_GET /*cdw10*/, TSP_CS_PROPS /*cdw11*/,
-		0 /*cdw12*/, 0 /*cdw13*/, 0 /*cdw14*/, 0 /*cdw15*/,
-		buffer_len /*data_len*/, buffer /*data*/, 0 /*metadata_len*/, NULL /*metadata*/,
-		0 /*timeout_ms*/, NULL /*result*/);
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_GET,
+        .cdw11 = TSP_CS_PROPS,
+        .dir = TSP_DIR_FROM_DEV,
+        .data_len = buffer_len,
+        .data = buffer,
+    };
+    ret = tsp_submit_admin(fd, &cmd);
     if (ret) {
         MSG_PRINT_ERROR("Device could not provide properties");
         /** @todo this error code doesn't seem appropriate, but other possibilities in
          * csQueryDeviceProperties() documentation seem even less so... */
         return CS_DEVICE_NOT_AVAILABLE;
-    } else {
-        size_t required_size = sizeof(CSxProperties);
-        uint16_t NumCSEs = ((CSxProperties *)buffer)->NumCSEs;
-        if (NumCSEs > 1) {
-            required_size += sizeof(CSEProperties) * (NumCSEs - 1);
-            if (required_size > 4096) {
-                MSG_PRINT_ERROR("TSP 4k buffer does not suffice for all CSEs ! TODO\n"
-                                "This fails because our implementation of CS is not done");
-                required_size = 4096;
-            }
-        }
+    }
+    return CS_SUCCESS;
+}
 
-        if (size < required_size) {
-            if (size >= sizeof(CSxProperties)) {
-                memcpy(props, buffer, sizeof(CSxProperties));
-            }
-            return CS_INVALID_LENGTH;
-        } else {
-            memcpy(props, buffer, required_size);
+static CS_STATUS tsp_copy_properties(const void *buffer, int *Length, CSxProperties *props) {
+    size_t size = *Length;
+    size_t required_size = sizeof(CSxProperties);
+    uint16_t NumCSEs = ((CSxProperties *)buffer)->NumCSEs;
+    if (NumCSEs > 1) {
+        required_size += sizeof(CSEProperties) * (NumCSEs - 1);
+        if (required_size > 4096) {
+            MSG_PRINT_ERROR("TSP 4k buffer does not suffice for all CSEs ! TODO\n"
+                            "This fails because our implementation of CS is not done");
+            required_size = 4096;
         }
+    }
 
-        return CS_SUCCESS;
+    if (size < required_size) {
+        if (size >= sizeof(CSxProperties)) {
+            memcpy(props, buffer, sizeof(CSxProperties));
+        }
+        return CS_INVALID_LENGTH;
+    } else {
+        memcpy(props, buffer, required_size);
     }
+
+    return CS_SUCCESS;
 }
 
 static CS_STATUS tsp_nvme_get_capabilities(CS_DEV_HANDLE fd, CsCapabilities *caps) {
     int ret = 0;
     const unsigned int buffer_len = 4096;
     char buffer[buffer_len];
-    ret = nvme_admin_passthru(fd, 0xc0 /*opcode*/, 0 /*flags*/, 0 /*rsvd*/,
-		0 /** @todo ?*/ /*nsid*/, 0 /*cdw2*/, 0 /*cdw3*/, TSP_CS_GET /*cdw10*/, TSP_CS_CAPS /*cdw11*/,
-		0 /*cdw12*/, 0 /*cdw13*/, 0 /*cdw14*/, 0 /*cdw15*/,
-		buffer_len /*data_len*/, buffer /*data*/, 0 /*metadata_len*/, NULL /*metadata*/,
-		0 /*timeout_ms*/, NULL /*result*/);
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_GET,
+        .cdw11 = TSP_CS_CAPS,
+        .dir = TSP_DIR_FROM_DEV,
+        .data_len = buffer_len,
+        .data = buffer,
+    };
+    ret = tsp_submit_admin(fd, &cmd);
     if (ret) {
         MSG_PRINT_ERROR("Device could not provide capabilities");
         /** @todo this error code doesn't seem appropriate, but other possibilities in
@@ -160,51 +161,415 @@ static CS_STATUS tsp_nvme_get_function_id(CS_DEV_HANDLE fd, CsFunctionBitSelect
     char buffer[buffer_len];
 
     const uint64_t f = *((uint64_t*)&fun);
-    const uint32_t CDW12 = (uint32_t)(f & 0xFFFFFFFF);
-    const uint32_t CDW13 = (uint32_t)((f >> 32) & 0xFFFFFFFF);
-
-    ret = nvme_admin_passthru(fd, 0xc0 /*opcode*/, 0 /*flags*/, 0 /*rsvd*/,
-		0 /** @todo ?*/ /*nsid*/, 0 /*cdw2*/, 0 /*cdw3*/, TSP_CS_GET /*cdw10*/, TSP_CS_FUN /*cdw11*/,
-		CDW12 /*cdw12*/, CDW13 /*cdw13*/, 0 /*cdw14*/, 0 /*cdw15*/,
-		buffer_len /*data_len*/, buffer /*data*/, 0 /*metadata_len*/, NULL /*metadata*/,
-		0 /*timeout_ms*/, NULL /*result*/);
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_GET,
+        .cdw11 = TSP_CS_FUN,
+        .cdw12 = (uint32_t)(f & 0xFFFFFFFF),
+        .cdw13 = (uint32_t)((f >> 32) & 0xFFFFFFFF),
+        .dir = TSP_DIR_FROM_DEV,
+        .data_len = buffer_len,
+        .data = buffer,
+    };
+
+    ret = tsp_submit_admin(fd, &cmd);
     if (ret) {
         MSG_PRINT_ERROR("Device could not provide function ID");
         /** @todo this error code doesn't seem most appropriate */
         return CS_DEVICE_NOT_AVAILABLE;
     } else {
-        memcpy(fid, buffer, sizeof(fid));
+        memcpy(fid, buffer, sizeof(*fid));
         return CS_SUCCESS;
     }
 }
 
-static CS_STATUS tsp_allocate_memory(CS_DEV_HANDLE fd, int Bytes, unsigned int MemFlags, PHYSICAL_ADDR *addr) {
-    int ret = 0;
-    const unsigned int buffer_len = 4096;
-    char buffer[buffer_len];
+/* Devices that do not answer only support the legacy format (version 0) */
+static void tsp_nvme_get_wire_info(CS_DEV_HANDLE fd, TspWireInfo *info) {
+    char buffer[TSP_BUFFER_SIZE];
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_GET,
+        .cdw11 = TSP_CS_WIRE,
+        .dir = TSP_DIR_FROM_DEV,
+        .data_len = sizeof(buffer),
+        .data = buffer,
+    };
+
+    memset(info, 0, sizeof(*info));
+    if (tsp_submit_admin(fd, &cmd) == 0) {
+        memcpy(info, buffer, sizeof(*info));
+    }
+    if (info->Magic != TSP_WIRE_MAGIC) {
+        memset(info, 0, sizeof(*info));
+    }
+    info->Versions |= 1; // the legacy format is always supported
+    if (!info->MaxTransfer || info->MaxTransfer > TSP_MDTS) {
+        info->MaxTransfer = TSP_MDTS;
+    }
+    if (!info->MaxRequests) {
+        info->MaxRequests = 1;
+    }
+}
 
-    ret = nvme_admin_passthru(fd, 0xc0 /*opcode*/, 0 /*flags*/, 0 /*rsvd*/,
-		0 /** @todo ?*/ /*nsid*/, 0 /*cdw2*/, 0 /*cdw3*/, TSP_CS_ALLOCATE /*cdw10*/, TSP_CS_MEM /*cdw11*/,
-		Bytes /*cdw12*/, 0 /*cdw13*/, 0 /*cdw14*/, 0 /*cdw15*/,
-		buffer_len /*data_len*/, buffer /*data*/, 0 /*metadata_len*/, NULL /*metadata*/,
-		0 /*timeout_ms*/, NULL /*result*/);
-    if (ret) {
-        MSG_PRINT_ERROR("Device could not handle memory allocation request");
-        /** @todo this error code doesn't seem most appropriate */
-        return CS_DEVICE_NOT_AVAILABLE;
-    } else {
-        if (!addr) {
-            return CS_INVALID_ARG;
+/* Devices that do not answer are described from their CsCapabilities, the
+ * signature of their functions is unknown */
+static CS_STATUS tsp_nvme_get_functions(CS_DEV_HANDLE fd, tsp_functions_st *fns) {
+    char buffer[TSP_BUFFER_SIZE];
+    const TspFunctionTable *table = (const TspFunctionTable *)buffer;
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_GET,
+        .cdw11 = TSP_CS_FUNCTIONS,
+        .dir = TSP_DIR_FROM_DEV,
+        .data_len = sizeof(buffer),
+        .data = buffer,
+    };
+    CsCapabilities caps;
+    u64 bits;
+    CS_STATUS status;
+
+    memset(fns, 0, sizeof(*fns));
+    if (tsp_submit_admin(fd, &cmd) == 0 && table->NumFunctions <= TSP_FUNCTIONS_MAX) {
+        fns->num = table->NumFunctions;
+        memcpy(fns->entry, table->Functions, fns->num * sizeof(TspFunctionEntry));
+        return CS_SUCCESS;
+    }
+
+    status = tsp_nvme_get_capabilities(fd, &caps);
+    if (status != CS_SUCCESS) {
+        return status;
+    }
+    memcpy(&bits, &caps, sizeof(bits));
+    for (; bits && fns->num < TSP_FUNCTIONS_MAX; bits &= bits - 1) {
+        int bit = __builtin_ctzll(bits);
+        TspFunctionEntry *e = &fns->entry[fns->num];
+        CsFunctionBitSelect fun;
+        u64 f = 1ULL << bit;
+        CS_FUNCTION_ID fid;
+
+        if (!tsp_function_name(bit)) {
+            continue;
+        }
+        memcpy(&fun, &f, sizeof(fun));
+        if (tsp_nvme_get_function_id(fd, fun, &fid) != CS_SUCCESS) {
+            continue;
         }
-        memcpy(addr, buffer, sizeof(addr));
-        if (*addr) {
-            // If the returned physical addr is non zero then it "worked"
-            return CS_SUCCESS;
-        } else {
-            /// @todo more checks and correct error code
+        e->FunctionId = fid;
+        e->Bit = bit;
+        e->NumUnits = 1;
+        snprintf(e->Name, sizeof(e->Name), "%s", tsp_function_name(bit));
+        fns->num++;
+    }
+    return CS_SUCCESS;
+}
+
+/*-***********
+ * Functions *
+ *-***********/
+
+/* Names of the functions of CsCapabilities, in bit order */
+static const char *tsp_function_names[TSP_NUM_FUNCTIONS] = {
+    "Compression", "Decompression", "Encryption", "Decryption", "RAID", "EC",
+    "Dedup", "Hash", "Checksum", "RegEx", "DbFilter", "ImageEncode", "VideoEncode",
+    "VectorSearch", "Sort", "GroupBy",
+};
+
+const char *tsp_function_name(int bit) {
+    if (bit < 0 || bit >= TSP_NUM_FUNCTIONS) {
+        return NULL;
+    }
+    return tsp_function_names[bit];
+}
+
+int tsp_function_bit(const char *name) {
+    for (int i = 0; i < TSP_NUM_FUNCTIONS; ++i) {
+        if (!strcmp(name, tsp_function_names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* FNV-1a of the name, at most the size of TspFunctionEntry.Name */
+static u32 tsp_function_hash(const char *name) {
+    u32 h = 2166136261u;
+
+    for (size_t i = 0; i < sizeof(((TspFunctionEntry *)0)->Name) && name[i]; ++i) {
+        h = (h ^ (u8)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+static const TspFunctionEntry *tsp_functions_find(const tsp_functions_st *fns, const char *name) {
+    u32 h = tsp_function_hash(name) & (TSP_FUNCTION_INDEX_SIZE - 1);
+
+    for (; fns->index[h]; h = (h + 1) & (TSP_FUNCTION_INDEX_SIZE - 1)) {
+        const TspFunctionEntry *e = &fns->entry[fns->index[h] - 1];
+        if (!strncmp(e->Name, name, sizeof(e->Name))) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/* Indexes the names of the table, the first of the functions sharing a name
+ * is the one found */
+static void tsp_functions_index(tsp_functions_st *fns) {
+    memset(fns->index, 0, sizeof(fns->index));
+    for (u32 i = 0; i < fns->num; ++i) {
+        TspFunctionEntry *e = &fns->entry[i];
+        u32 h;
+
+        e->Name[sizeof(e->Name) - 1] = '\0';
+        if (!e->Name[0] || tsp_functions_find(fns, e->Name)) {
+            continue;
+        }
+        h = tsp_function_hash(e->Name) & (TSP_FUNCTION_INDEX_SIZE - 1);
+        while (fns->index[h]) {
+            h = (h + 1) & (TSP_FUNCTION_INDEX_SIZE - 1);
+        }
+        fns->index[h] = i + 1;
+    }
+}
+
+/*-******************
+ * Cached discovery *
+ *-******************/
+
+/* Device information does not change unless the CSx is reset or reconfigured,
+ * it is queried from the device once and served from the cache of the CSx
+ * context afterwards. Readers share the lock, only misses take it exclusively
+ * (and the first one fills the cache for everybody). */
+
+int tsp_cached_has_cs(CS_DEV_HANDLE fd) {
+    tsp_device_st *dev = tsp_device_get(fd);
+    int has_cs;
+
+    if (!dev) {
+        return tsp_nvme_device_has_cs(fd);
+    }
+
+    pthread_rwlock_rdlock(&dev->cache_lock);
+    has_cs = dev->cache.has_cs;
+    pthread_rwlock_unlock(&dev->cache_lock);
+    if (has_cs) {
+        return has_cs;
+    }
+
+    pthread_rwlock_wrlock(&dev->cache_lock);
+    if (!dev->cache.has_cs) {
+        // Only positive answers are cached, failures may be transient
+        dev->cache.has_cs = tsp_nvme_device_has_cs(fd);
+    }
+    has_cs = dev->cache.has_cs;
+    pthread_rwlock_unlock(&dev->cache_lock);
+    return has_cs;
+}
+
+static CS_STATUS tsp_cached_properties(CS_DEV_HANDLE fd, int *Length, CSxProperties *props) {
+    tsp_device_st *dev = tsp_device_get(fd);
+    CS_STATUS status = CS_SUCCESS;
+
+    if (!dev) {
+        char buffer[TSP_BUFFER_SIZE];
+        status = tsp_nvme_get_properties(fd, buffer);
+        return status == CS_SUCCESS ? tsp_copy_properties(buffer, Length, props) : status;
+    }
+
+    pthread_rwlock_rdlock(&dev->cache_lock);
+    if (dev->cache.props_valid) {
+        status = tsp_copy_properties(dev->cache.props, Length, props);
+        pthread_rwlock_unlock(&dev->cache_lock);
+        return status;
+    }
+    pthread_rwlock_unlock(&dev->cache_lock);
+
+    pthread_rwlock_wrlock(&dev->cache_lock);
+    if (!dev->cache.props_valid) {
+        status = tsp_nvme_get_properties(fd, dev->cache.props);
+        dev->cache.props_valid = status == CS_SUCCESS;
+    }
+    if (status == CS_SUCCESS) {
+        status = tsp_copy_properties(dev->cache.props, Length, props);
+    }
+    pthread_rwlock_unlock(&dev->cache_lock);
+    return status;
+}
+
+CS_STATUS tsp_cached_capabilities(CS_DEV_HANDLE fd, CsCapabilities *caps) {
+    tsp_device_st *dev = tsp_device_get(fd);
+    CS_STATUS status = CS_SUCCESS;
+
+    if (!dev) {
+        return tsp_nvme_get_capabilities(fd, caps);
+    }
+
+    pthread_rwlock_rdlock(&dev->cache_lock);
+    if (dev->cache.caps_valid) {
+        *caps = dev->cache.caps;
+        pthread_rwlock_unlock(&dev->cache_lock);
+        return CS_SUCCESS;
+    }
+    pthread_rwlock_unlock(&dev->cache_lock);
+
+    pthread_rwlock_wrlock(&dev->cache_lock);
+    if (!dev->cache.caps_valid) {
+        status = tsp_nvme_get_capabilities(fd, &dev->cache.caps);
+        dev->cache.caps_valid = status == CS_SUCCESS;
+    }
+    if (status == CS_SUCCESS) {
+        *caps = dev->cache.caps;
+    }
+    pthread_rwlock_unlock(&dev->cache_lock);
+    return status;
+}
+
+CS_STATUS tsp_cached_ctrl_path(CS_DEV_HANDLE fd, char *ctrl_path) {
+    tsp_device_st *dev = tsp_device_get(fd);
+    CS_STATUS status = CS_SUCCESS;
+
+    if (!dev) {
+        return tsp_sysfs_ctrl_path(fd, ctrl_path);
+    }
+
+    pthread_rwlock_rdlock(&dev->cache_lock);
+    if (dev->cache.ctrl_valid) {
+        strcpy(ctrl_path, dev->cache.ctrl_path);
+        pthread_rwlock_unlock(&dev->cache_lock);
+        return CS_SUCCESS;
+    }
+    pthread_rwlock_unlock(&dev->cache_lock);
+
+    pthread_rwlock_wrlock(&dev->cache_lock);
+    if (!dev->cache.ctrl_valid) {
+        status = tsp_sysfs_ctrl_path(fd, dev->cache.ctrl_path);
+        dev->cache.ctrl_valid = status == CS_SUCCESS;
+    }
+    if (status == CS_SUCCESS) {
+        strcpy(ctrl_path, dev->cache.ctrl_path);
+    }
+    pthread_rwlock_unlock(&dev->cache_lock);
+    return status;
+}
+
+static CS_STATUS tsp_cached_function_id(CS_DEV_HANDLE fd, CsFunctionBitSelect fun, CS_FUNCTION_ID *fid) {
+    tsp_device_st *dev = tsp_device_get(fd);
+    CS_STATUS status = CS_SUCCESS;
+    u64 f;
+    int bit;
+
+    memcpy(&f, &fun, sizeof(f));
+    // Only one-hot selections are cached
+    if (!dev || !f || (f & (f - 1))) {
+        return tsp_nvme_get_function_id(fd, fun, fid);
+    }
+    bit = __builtin_ctzll(f);
+
+    pthread_rwlock_rdlock(&dev->cache_lock);
+    if (dev->cache.fid_valid & (1ULL << bit)) {
+        *fid = dev->cache.fid[bit];
+        pthread_rwlock_unlock(&dev->cache_lock);
+        return CS_SUCCESS;
+    }
+    pthread_rwlock_unlock(&dev->cache_lock);
+
+    pthread_rwlock_wrlock(&dev->cache_lock);
+    if (!(dev->cache.fid_valid & (1ULL << bit))) {
+        status = tsp_nvme_get_function_id(fd, fun, &dev->cache.fid[bit]);
+        if (status == CS_SUCCESS) {
+            dev->cache.fid_valid |= 1ULL << bit;
+        }
+    }
+    if (status == CS_SUCCESS) {
+        *fid = dev->cache.fid[bit];
+    }
+    pthread_rwlock_unlock(&dev->cache_lock);
+    return status;
+}
+
+/* Wire formats supported by the device, queried once (an unanswered query is
+ * cached as well, as the legacy format always works) */
+static void tsp_cached_wire_info(CS_DEV_HANDLE fd, TspWireInfo *info) {
+    tsp_device_st *dev = tsp_device_get(fd);
+
+    if (!dev) {
+        tsp_nvme_get_wire_info(fd, info);
+        return;
+    }
+
+    pthread_rwlock_rdlock(&dev->cache_lock);
+    if (dev->cache.wire_valid) {
+        *info = dev->cache.wire;
+        pthread_rwlock_unlock(&dev->cache_lock);
+        return;
+    }
+    pthread_rwlock_unlock(&dev->cache_lock);
+
+    pthread_rwlock_wrlock(&dev->cache_lock);
+    if (!dev->cache.wire_valid) {
+        tsp_nvme_get_wire_info(fd, &dev->cache.wire);
+        dev->cache.wire_valid = 1;
+    }
+    *info = dev->cache.wire;
+    pthread_rwlock_unlock(&dev->cache_lock);
+}
+
+typedef CS_STATUS (*tsp_functions_fn)(const tsp_functions_st *fns, void *ctx);
+
+/* Calls fn with the function table of the CSx, queried once and indexed. The
+ * table is only valid during the call. */
+static CS_STATUS tsp_with_functions(CS_DEV_HANDLE fd, tsp_functions_fn fn, void *ctx) {
+    tsp_device_st *dev = tsp_device_get(fd);
+    CS_STATUS status = CS_SUCCESS;
+
+    if (!dev) {
+        tsp_functions_st *fns = malloc(sizeof(*fns));
+        if (!fns) {
             return CS_NOT_ENOUGH_MEMORY;
         }
+        status = tsp_nvme_get_functions(fd, fns);
+        if (status == CS_SUCCESS) {
+            tsp_functions_index(fns);
+            status = fn(fns, ctx);
+        }
+        free(fns);
+        return status;
     }
+
+    pthread_rwlock_rdlock(&dev->cache_lock);
+    if (dev->cache.functions_valid) {
+        status = fn(&dev->cache.functions, ctx);
+        pthread_rwlock_unlock(&dev->cache_lock);
+        return status;
+    }
+    pthread_rwlock_unlock(&dev->cache_lock);
+
+    pthread_rwlock_wrlock(&dev->cache_lock);
+    if (!dev->cache.functions_valid) {
+        status = tsp_nvme_get_functions(fd, &dev->cache.functions);
+        if (status == CS_SUCCESS) {
+            tsp_functions_index(&dev->cache.functions);
+            dev->cache.functions_valid = 1;
+        }
+    }
+    if (status == CS_SUCCESS) {
+        status = fn(&dev->cache.functions, ctx);
+    }
+    pthread_rwlock_unlock(&dev->cache_lock);
+    return status;
+}
+
+typedef struct {
+    const char *name;
+    TspFunctionEntry entry;
+} tsp_function_lookup_st;
+
+static CS_STATUS tsp_function_lookup(const tsp_functions_st *fns, void *ctx) {
+    tsp_function_lookup_st *lookup = ctx;
+    const TspFunctionEntry *e = tsp_functions_find(fns, lookup->name);
+
+    if (!e) {
+        return CS_INVALID_OPTION;
+    }
+    lookup->entry = *e;
+    return CS_SUCCESS;
 }
 
 static inline size_t get_request_size(CsComputeRequest *req) {
@@ -231,28 +596,283 @@ static inline size_t get_request_size(CsComputeRequest *req) {
      *  remain the case... */
 }
 
-static CS_STATUS tsp_compute_operation(CsComputeRequest *req) {
-    /// @todo this is a CS_DEV_HANDLE for the moment
-    CS_DEV_HANDLE fd = req->CSEHandle;
-    int ret = 0;
-    const unsigned int buffer_len = 4096;
-    char buffer[buffer_len];
+/* Encodes requests in a version 1 transfer of length bytes at data */
+static void tsp_wire_encode(CsComputeRequest **reqs, int n, void *data, u32 length) {
+    TspWireHeader *h = data;
+    TspWireRequest *w = (TspWireRequest *)(h + 1);
+
+    h->Magic = TSP_WIRE_MAGIC;
+    h->Version = TSP_WIRE_VERSION;
+    h->Flags = 0;
+    h->Length = length;
+    h->NumRequests = n;
+    h->Reserved = 0;
+
+    for (int i = 0; i < n; ++i) {
+        const CsComputeRequest *req = reqs[i];
+
+        w->Length = tsp_wire_request_size(req->NumArgs);
+        w->FunctionId = req->FunctionId;
+        w->NumArgs = req->NumArgs;
+        w->Reserved = 0;
+        for (int j = 0; j < req->NumArgs; ++j) {
+            const CsComputeArg *arg = &req->Args[j];
+            TspWireArg *wa = &w->Args[j];
+
+            wa->Type = arg->Type;
+            wa->Reserved = 0;
+            wa->u.DevMem.ByteOffset = 0;
+            switch (arg->Type) {
+            case CS_AFDM_TYPE:
+                wa->u.DevMem.MemHandle = arg->u.DevMem.MemHandle;
+                wa->u.DevMem.ByteOffset = arg->u.DevMem.ByteOffset;
+                break;
+            case CS_32BIT_VALUE_TYPE:
+                wa->u.Value64 = arg->u.Value32;
+                break;
+            default:
+                wa->u.Value64 = arg->u.Value64;
+                break;
+            }
+        }
+        w = (TspWireRequest *)tsp_wire_next(w);
+    }
+}
+
+/* Fills the command for a compute transfer of length bytes at data */
+static void tsp_compute_fill(tsp_cmd_st *cmd, void *data, u32 length, u32 version) {
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->cdw10 = TSP_CS_COMPUTE | ROUTE_CS_COMPUTE_THROUGH_USER_SPACE; /* userspace has bit 0 set */
+    cmd->cdw11 = 0; /** synchronous @note this is for dev only */
+    cmd->cdw12 = length;
+    cmd->cdw13 = version;
+    cmd->dir = TSP_DIR_TO_DEV;
+    cmd->data_len = version ? (length + 3) & ~3u : TSP_BUFFER_SIZE;
+    cmd->data = data;
+    cmd->timeout_ms = 3600000; /* 1h */
+}
 
-    // Copy the request in the buffer
-    /// @todo check request size (unlikely to be more than 4k)
-    size_t req_size = get_request_size(req);
-    memcpy(buffer, req, req_size);
+CS_STATUS tsp_compute_command(CsComputeRequest **reqs, int n, tsp_cmd_st *cmd,
+                                     char *buffer, void **heap) {
+    CS_DEV_HANDLE fd = reqs[0]->CSEHandle;
+    TspWireInfo info;
+    u64 length = sizeof(TspWireHeader);
+    void *data = buffer;
 
-    /* Use 0xC0 opcode */
-    ret = nvme_admin_passthru(fd, 0xc0 /*opcode*/, 0 /*flags*/, 0 /*rsvd*/,
-		0 /** @todo ?*/ /*nsid*/, 0 /*cdw2*/, 0 /*cdw3*/, TSP_CS_COMPUTE | ROUTE_CS_COMPUTE_THROUGH_USER_SPACE /* userspace has bit 0 set */ /*cdw10*/, 0 /** synchronous @note this is for dev only */ /*cdw11*/,
-		req_size /*cdw12*/, 0 /*cdw13*/, 0 /*cdw14*/, 0 /*cdw15*/,
-		buffer_len /*data_len*/, buffer /*data*/, 0 /*metadata_len*/, NULL /*metadata*/,
-		3600000 /* 1h, timeout_ms */, NULL /*result*/);
+    *heap = NULL;
+    tsp_cached_wire_info(fd, &info);
+
+    if (!(info.Versions & (1u << TSP_WIRE_VERSION))) {
+        size_t req_size = get_request_size(reqs[0]);
+        if (n != 1) {
+            return CS_UNSUPPORTED;
+        }
+        if (req_size > TSP_BUFFER_SIZE) {
+            MSG_PRINT_ERROR("The request does not fit in a command of the device");
+            return CS_INVALID_LENGTH;
+        }
+        memcpy(buffer, reqs[0], req_size);
+        tsp_compute_fill(cmd, buffer, req_size, 0);
+        return CS_SUCCESS;
+    }
+
+    if ((u32)n > info.MaxRequests) {
+        return CS_INVALID_ARG;
+    }
+    for (int i = 0; i < n; ++i) {
+        if (reqs[i]->NumArgs < 0 || reqs[i]->CSEHandle != fd) {
+            return CS_INVALID_ARG;
+        }
+        length += tsp_wire_request_size(reqs[i]->NumArgs);
+    }
+    if (length > info.MaxTransfer) {
+        MSG_PRINT_ERROR("The requests do not fit in a command of the device");
+        return CS_INVALID_LENGTH;
+    }
+    if (length > TSP_BUFFER_SIZE) {
+        data = aligned_alloc(TSP_BUFFER_SIZE, (length + TSP_BUFFER_SIZE - 1) & ~(u64)(TSP_BUFFER_SIZE - 1));
+        if (!data) {
+            return CS_NOT_ENOUGH_MEMORY;
+        }
+        *heap = data;
+    }
+
+    tsp_wire_encode(reqs, n, data, length);
+    tsp_compute_fill(cmd, data, length, TSP_WIRE_VERSION);
+    return CS_SUCCESS;
+}
+
+/* Admits n requests on their CSE, see cs_admit.c */
+static CS_STATUS tsp_compute_admit(CsComputeRequest **reqs, int n, tsp_admit_ticket_st *ticket) {
+    CS_FUNCTION_ID fids[n];
+
+    for (int i = 0; i < n; ++i) {
+        fids[i] = reqs[i]->FunctionId;
+    }
+    return tsp_admit_acquire(reqs[0]->CSEHandle, fids, n, ticket);
+}
+
+/* Same for the requests of a transfer in the wire format */
+static CS_STATUS tsp_wire_admit(CS_CSE_HANDLE fd, const TspWireHeader *h,
+                                tsp_admit_ticket_st *ticket) {
+    CS_FUNCTION_ID fids[h->NumRequests];
+    const TspWireRequest *req = tsp_wire_first(h, h->Length);
+    int n = 0;
+
+    for (; req && (u32)n < h->NumRequests && tsp_wire_check(h, req); req = tsp_wire_next(req)) {
+        fids[n++] = req->FunctionId;
+    }
+    return tsp_admit_acquire(fd, fids, n, ticket);
+}
+
+/* Status of a compute command from the result of tsp_submit(), the same for
+ * synchronous and asynchronous requests */
+static CS_STATUS tsp_compute_status(int ret) {
+    return ret == 0 ? CS_SUCCESS : ret < 0 ? CS_DEVICE_NOT_AVAILABLE : CS_ERROR_IN_EXECUTION;
+}
+
+/* Sends a command prepared by tsp_compute_command() and waits for it
+ * @return the result of tsp_submit() */
+static int tsp_compute_submit(CS_DEV_HANDLE fd, tsp_cmd_st *cmd) {
+    int ret = 0;
+
+    tsp_device_busy(fd, 1);
+    ret = tsp_submit(fd, cmd);
+    tsp_device_busy(fd, -1);
 
     return ret;
 }
 
+/**
+ * @brief Executes n compute requests on the same CSE synchronously
+ * @param[out] completed : Number of requests that succeeded (the device stops
+ * at the first failure), may be NULL
+ * */
+static CS_STATUS tsp_compute_operation(CsComputeRequest **reqs, int n, u32 *completed) {
+    /// @todo this is a CS_DEV_HANDLE for the moment
+    CS_DEV_HANDLE fd = reqs[0]->CSEHandle;
+    char buffer[TSP_BUFFER_SIZE] __attribute__((aligned(TSP_WIRE_ALIGN)));
+    tsp_admit_ticket_st ticket;
+    tsp_cmd_st cmd;
+    void *heap;
+    CS_STATUS status;
+
+    if (completed) {
+        *completed = 0;
+    }
+    status = tsp_compute_command(reqs, n, &cmd, buffer, &heap);
+    if (status != CS_SUCCESS) {
+        return status;
+    }
+    status = tsp_compute_admit(reqs, n, &ticket);
+    if (status != CS_SUCCESS) {
+        free(heap);
+        return status;
+    }
+
+    status = tsp_compute_status(tsp_compute_submit(fd, &cmd));
+    tsp_admit_release(&ticket);
+    free(heap);
+    if (completed) {
+        // Legacy commands hold a single request and leave the result to 0
+        *completed = status == CS_SUCCESS ? (u32)n : cmd.cdw13 ? cmd.result : 0;
+    }
+    return status;
+}
+
+/* Asynchronous compute request, freed once completed */
+typedef struct {
+    tsp_cmd_st cmd;
+    CS_DEV_HANDLE fd;
+    void *Context;
+    csQueueCallbackFn CallbackFn;
+    CS_EVT_HANDLE EventHandle;
+    void *heap; // transfer larger than buffer, NULL otherwise
+    tsp_admit_ticket_st ticket;
+    struct tsp_memo_key *memo; // result to cache, NULL if none
+    char buffer[TSP_BUFFER_SIZE] __attribute__((aligned(TSP_WIRE_ALIGN)));
+} tsp_async_compute_st;
+
+static void tsp_compute_done(tsp_cmd_st *cmd, int ret) {
+    tsp_async_compute_st *a = (tsp_async_compute_st *)cmd;
+    CS_STATUS status = tsp_compute_status(ret);
+
+    tsp_admit_release(&a->ticket);
+    tsp_device_busy(a->fd, -1);
+    tsp_memo_insert(a->memo, status);
+    // Possibly on the thread that completes the other requests, see cs_admit.c
+    tsp_admit_completion(1);
+    if (a->EventHandle) {
+        tsp_event_signal(a->EventHandle, status);
+    }
+    if (a->CallbackFn) {
+        a->CallbackFn(a->Context, status);
+    }
+    tsp_admit_completion(-1);
+    free(a->heap);
+    free(a);
+}
+
+/* Queues a command prepared in a (see tsp_compute_command()) */
+static CS_STATUS tsp_compute_queue(tsp_async_compute_st *a, CS_DEV_HANDLE fd, void *Context,
+                                   csQueueCallbackFn CallbackFn,
+                                   CS_EVT_HANDLE EventHandle) {
+    a->cmd.done = tsp_compute_done;
+    a->fd = fd;
+    a->Context = Context;
+    a->CallbackFn = CallbackFn;
+    a->EventHandle = EventHandle;
+
+    if (EventHandle) {
+        tsp_event_arm(EventHandle);
+    }
+    tsp_device_busy(a->fd, 1);
+    if (tsp_submit_async(a->fd, &a->cmd) < 0) {
+        tsp_admit_release(&a->ticket);
+        tsp_device_busy(a->fd, -1);
+        tsp_memo_insert(a->memo, CS_DEVICE_NOT_AVAILABLE);
+        if (EventHandle) {
+            tsp_event_signal(EventHandle, CS_DEVICE_NOT_AVAILABLE);
+        }
+        free(a->heap);
+        free(a);
+        return CS_DEVICE_NOT_AVAILABLE;
+    }
+
+    return CS_QUEUED;
+}
+
+/* memo is the key of the result of the single request to cache, if any */
+static CS_STATUS tsp_compute_operation_async(CsComputeRequest **reqs, int n, void *Context,
+                                             csQueueCallbackFn CallbackFn,
+                                             CS_EVT_HANDLE EventHandle,
+                                             struct tsp_memo_key *memo) {
+    tsp_async_compute_st *a = malloc(sizeof(tsp_async_compute_st));
+    CS_STATUS status;
+
+    if (!a) {
+        tsp_memo_insert(memo, CS_NOT_ENOUGH_MEMORY);
+        return CS_NOT_ENOUGH_MEMORY;
+    }
+
+    status = tsp_compute_command(reqs, n, &a->cmd, a->buffer, &a->heap);
+    if (status != CS_SUCCESS) {
+        tsp_memo_insert(memo, status);
+        free(a);
+        return status;
+    }
+    status = tsp_compute_admit(reqs, n, &a->ticket);
+    if (status != CS_SUCCESS) {
+        tsp_memo_insert(memo, status);
+        free(a->heap);
+        free(a);
+        return status;
+    }
+    a->memo = memo;
+
+    return tsp_compute_queue(a, reqs[0]->CSEHandle, Context, CallbackFn, EventHandle);
+}
+
 /// @deprecated
 static int tsp_nvme_get_csx_request(int fd, unsigned int data_len, void *data) {
     int ret = 0;
@@ -277,14 +897,36 @@ CS_STATUS csGetCSxFromPath(char *Path, unsigned int *Length, char *DevName) {
     // CS_ENXIO failed to do IO
     int ret, fd;
     struct stat nvme_stat;
+    char ctrl_path[PATH_MAX];
+    char *devicename;
 
     // Check arguments
     if (!Path || !Length || !DevName) {
         return CS_INVALID_ARG;
     }
 
+    // Emulated CSx have no device file, see tsp_emu.h
+    if (tsp_emu_is_name(Path)) {
+        if (*Length < strlen(Path) + 1) {
+            *Length = strlen(Path) + 1;
+            return CS_INVALID_LENGTH;
+        }
+        strcpy(DevName, Path);
+        return CS_SUCCESS;
+    }
+
+    // A file or directory resolves to the controller of the namespace it is on
+    if (stat(Path, &nvme_stat) == 0 && !is_chardev(nvme_stat) && !is_blkdev(nvme_stat)) {
+        if (tsp_sysfs_ctrl_path_dev(nvme_stat.st_dev, 0, ctrl_path) != CS_SUCCESS) {
+            MSG_PRINT_ERROR("%s is not on a block device", Path);
+            return CS_ENTITY_NOT_ON_DEVICE;
+        }
+        devicename = basename(ctrl_path);
+    } else {
+        devicename = basename(Path);
+    }
+
     // Open device
-    char *devicename = basename(Path);
     ret = nvme_open(devicename);
     if (ret < 0) {
         MSG_PRINT_ERROR("Could not open device : %s\n"
@@ -319,6 +961,7 @@ CS_STATUS csGetCSxFromPath(char *Path, unsigned int *Length, char *DevName) {
     // Copy the device name
     size_t len = strlen(devicename);
     if (*Length < len+1) {
+        *Length = len+1;
         close(fd);
         return CS_INVALID_LENGTH;
     }
@@ -342,7 +985,7 @@ CS_STATUS csOpenCSx(char *DevName, void *DevContext,
 
     // Note : Checks have been performed in csGetCSxFromPath()
     /// @todo Maybe add checks here if called without the above
-    ret = nvme_open(DevName);
+    ret = tsp_emu_is_name(DevName) ? tsp_emu_open(DevName) : nvme_open(DevName);
     if (ret < 0) {
         MSG_PRINT_ERROR("Could not open device : %s\n", DevName);
         //return CS_ENOENT; // CS_ENOENT is not defined
@@ -355,24 +998,52 @@ CS_STATUS csOpenCSx(char *DevName, void *DevContext,
     return CS_SUCCESS;
 }
 
+/**
+ * @copydoc csCloseCSx
+ * */
+CS_STATUS csCloseCSx(CS_DEV_HANDLE DevHandle) {
+    if (DevHandle < 0) {
+        return CS_INVALID_HANDLE;
+    }
+
+    // Releases the FDM and the resources of the library for this CSx
+    tsp_device_release(DevHandle);
+    tsp_emu_close(DevHandle);
+
+    if (close(DevHandle) < 0) {
+        return CS_INVALID_HANDLE;
+    }
+    return CS_SUCCESS;
+}
+
 /**
  * @copydoc csGetCSEFromCSx
- * @todo This is still a stub
+ * @note A TSP CSx has a single CSE, it is named after the NVMe controller
+ * (e.g., "nvme0") and its handle is a handle to the controller.
  * */
 CS_STATUS csGetCSEFromCSx(CS_DEV_HANDLE DevHandle, unsigned int *Length,
                           char *CSEName) {
+    char ctrl_path[PATH_MAX];
+    const char *name;
+
     if (DevHandle <0) {
         return CS_INVALID_ARG;
     }
 
-    if (!Length) {
+    if (!Length || !CSEName) {
         return CS_INVALID_ARG;
     }
 
-    if (*Length < strlen(__CS_PLACE_HOLDER_CSE_NAME)+1) {
+    if (tsp_cached_ctrl_path(DevHandle, ctrl_path) != CS_SUCCESS) {
+        return CS_INVALID_HANDLE;
+    }
+    name = basename(ctrl_path);
+
+    if (*Length < strlen(name)+1) {
+        *Length = strlen(name)+1;
         return CS_INVALID_LENGTH;
     } else {
-        strncpy(CSEName, __CS_PLACE_HOLDER_CSE_NAME, strlen(__CS_PLACE_HOLDER_CSE_NAME)+1);
+        strncpy(CSEName, name, strlen(name)+1);
         MSG_PRINT_DEBUG("Returned CSE : %s", CSEName);
         return CS_SUCCESS;
     }
@@ -411,83 +1082,42 @@ CS_STATUS csGetCSEFromCSx(CS_DEV_HANDLE DevHandle, unsigned int *Length,
 
 /**
  * @copydoc csOpenCSE
- * @todo this is still a stub
+ * @note The CSE handle is a handle to the controller, it is closed with
+ * csCloseCSx()
  * */
 CS_STATUS csOpenCSE(char *CSEName, void *CSEContext,
                     CS_CSE_HANDLE *CSEHandle) {
-    if (strcmp(CSEName, __CS_PLACE_HOLDER_CSE_NAME)) {
-        return CS_ENTITY_NOT_ON_DEVICE;
-    }
+    CS_DEV_HANDLE fd;
+    CS_STATUS status;
 
-    *CSEHandle = __CS_PLACE_HOLDER_CSE_HANDLE;
-    return CS_SUCCESS;
-}
-
-/**
- * @copydoc csAllocMem
- * @todo this is still a stub
- * */
-CS_STATUS csAllocMem(CS_DEV_HANDLE DevHandle, int Bytes, unsigned int MemFlags,
-                     CS_MEM_HANDLE *MemHandle, CS_MEM_PTR *VAddressPtr) {
-    //if (DevHandle != __CS_PLACE_HOLDER_DEV_HANDLE) {
-    //    return CS_INVALID_HANDLE;
-    //}
-
-    // Here we need to allocate memory on the CMB
-    // If the Linux kernel/driver supports it, map it to userspace and assign VAddressPtr
-    if (Bytes <= 0) {
-        return CS_INVALID_ARG;
-    } else if (Bytes > 4096*1024) {
-        return CS_NOT_ENOUGH_MEMORY;
-    }
-
-    // Request memory on the CMB of the device
-    if (!MemHandle) {
+    if (!CSEName || !CSEHandle) {
         return CS_INVALID_ARG;
     }
 
-    PHYSICAL_ADDR phys_addr = NULL;
-    int ret = tsp_allocate_memory(DevHandle, Bytes, MemFlags, &phys_addr);
-    // The device will return a physical address
-    if (ret != CS_SUCCESS) {
-        return ret;
+    status = csOpenCSx(CSEName, CSEContext, &fd);
+    if (status != CS_SUCCESS) {
+        return status;
     }
-    *MemHandle = (CS_MEM_HANDLE)phys_addr;
-
-    if (VAddressPtr) {
-        //*VAddressPtr = NULL; // return CS_COULD_NOT_MAP_MEMORY ?
-        //*VAddressPtr = mmap(...);
 
-        // Memory map it in userspace with /dev/mem
-        int fd = open("/dev/mem", O_RDWR | O_SYNC /* | O_DIRECT */);
-        if (fd < 0) {
-            return CS_COULD_NOT_MAP_MEMORY;
-        }
-        void *mapped_mem = mmap(NULL, Bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)phys_addr /* offset */);
-        /* man mmap(2) :
-        * After the mmap() call has returned, the file descriptor, fd, can
-        * be closed immediately without invalidating the mapping. */
-        close(fd);
-        if (mapped_mem == MAP_FAILED) {
-            // errno holds more information
-            return CS_COULD_NOT_MAP_MEMORY;
-        }
-        // This will be replaced by memory mapping part of the CMB fs entry
-
-        *VAddressPtr = mapped_mem;
+    if (!tsp_cached_has_cs(fd)) {
+        csCloseCSx(fd);
+        return CS_ENTITY_NOT_ON_DEVICE;
     }
 
+    *CSEHandle = fd;
     return CS_SUCCESS;
 }
 
-CS_STATUS csFreeMem(CS_MEM_HANDLE MemHandle) {
-
-    return CS_SUCCESS;
+/**
+ * @copydoc csCloseCSE
+ * @note The CSE handle is the handle of its CSx, opened by csOpenCSE()
+ * */
+CS_STATUS csCloseCSE(CS_CSE_HANDLE CSEHandle) {
+    return csCloseCSx(CSEHandle);
 }
 
 /**
  * @copydoc csGetFunction
- * @todo this is still a stub
  * */
 CS_STATUS csGetFunction(CS_CSE_HANDLE CSEHandle, char *FunctionName,
                         void *Context, CS_FUNCTION_ID *FunctionId) {
@@ -502,25 +1132,39 @@ CS_STATUS csGetFunction(CS_CSE_HANDLE CSEHandle, char *FunctionName,
         return CS_INVALID_ARG;
     }
 
-    // Here we would test against available functions
-    if (strcmp(FunctionName, "Checksum") == 0) {
-        CsFunctionBitSelect fun = {0,};
-        fun.Functions.Checksum = 1;
-        //*FunctionId = __CS_PLACE_HOLDER_FUNCTION_ID;
-        /** @todo Replace the CS_DEV_HANDLE in this function by an actual CS_CSE_HANDLE */
-        CS_STATUS ret = tsp_nvme_get_function_id(CSEHandle, fun, FunctionId);
-        if (ret == CS_SUCCESS) {
-            MSG_PRINT_DEBUG("Returned function : %s", FunctionName);
-        }
-        return ret;
+    // The function table of the CSx first, then the functions of CsCapabilities
+    // the table may not list
+    /** @todo Replace the CS_DEV_HANDLE in this function by an actual CS_CSE_HANDLE */
+    tsp_function_lookup_st lookup = {.name = FunctionName};
+    CS_STATUS ret = tsp_with_functions(CSEHandle, tsp_function_lookup, &lookup);
+    if (ret == CS_SUCCESS) {
+        *FunctionId = lookup.entry.FunctionId;
     } else {
-        MSG_PRINT_WARNING("Function %s is not supported yet", FunctionName);
-        return CS_INVALID_OPTION;
+        int bit = tsp_function_bit(FunctionName);
+        CsCapabilities caps;
+        u64 f = 0;
+
+        if (bit >= 0 && tsp_cached_capabilities(CSEHandle, &caps) == CS_SUCCESS) {
+            memcpy(&f, &caps, sizeof(f));
+            f &= 1ULL << bit;
+        }
+        if (!f) {
+            MSG_PRINT_WARNING("Function %s is not provided by the CSx", FunctionName);
+            return CS_INVALID_OPTION;
+        }
+
+        CsFunctionBitSelect fun = {0,};
+        memcpy(&fun, &f, sizeof(fun));
+        ret = tsp_cached_function_id(CSEHandle, fun, FunctionId);
     }
+    if (ret == CS_SUCCESS) {
+        MSG_PRINT_DEBUG("Returned function : %s", FunctionName);
+    }
+    return ret;
 }
 
 CS_STATUS xxDoComputeRequest(CsComputeRequest *Req) {
-    return tsp_compute_operation(Req);
+    return tsp_compute_operation(&Req, 1, NULL);
 #if 0
     // Look CSE up in registry
     // Send request to that CSE
@@ -557,7 +1201,8 @@ CS_STATUS xxDoComputeRequest(CsComputeRequest *Req) {
 
 /**
  * @copydoc csQueueComputeRequest
- * @todo this is still a stub
+ * @note The request is asynchronous if CallbackFn or EventHandle is given, the
+ * request structure can be reused as soon as this function returns
  * */
 CS_STATUS csQueueComputeRequest(CsComputeRequest *Req, void *Context,
                                 csQueueCallbackFn CallbackFn,
@@ -571,15 +1216,214 @@ CS_STATUS csQueueComputeRequest(CsComputeRequest *Req, void *Context,
 
     //MSG_PRINT_INFO("CSE associated with this request : 0x%08lx", (unsigned long)Req->CSEHandle);
 
-    CS_STATUS status = xxDoComputeRequest(Req);
+    struct tsp_memo_key *memo;
+    CS_STATUS status;
+
+    // Results of memoized functions may already be known
+    if (tsp_memo_lookup(Req, &memo)) {
+        if (EventHandle) {
+            tsp_event_arm(EventHandle);
+            tsp_event_signal(EventHandle, CS_SUCCESS);
+        }
+        if (CallbackFn) {
+            CallbackFn(Context, CS_SUCCESS);
+        }
+        return CallbackFn || EventHandle ? CS_QUEUED : CS_SUCCESS;
+    }
+
+    // Small requests go through the request rings of the CSE if enabled,
+    // except those whose result is cached once completed
+    if (!memo) {
+        status = tsp_ring_compute(Req, get_request_size(Req), Context, CallbackFn, EventHandle);
+        if (status != CS_UNSUPPORTED) {
+            return status;
+        }
+    }
+
+    if (CallbackFn || EventHandle) {
+        return tsp_compute_operation_async(&Req, 1, Context, CallbackFn, EventHandle, memo);
+    }
+
+    status = xxDoComputeRequest(Req);
+    tsp_memo_insert(memo, status);
     /// @note synchronous is only when parameters other than req are NULL
     //MSG_PRINT_WARNING("This is a synchronous request so result should be available now");
     return status;
 }
 
+/**
+ * @brief Queues the requests of a batch in commands of chunk requests
+ *
+ * Every command is built before the first one is queued, so that a request
+ * that does not fit or a lack of memory leaves nothing in flight. Only the
+ * admission and the submission can fail once commands are queued, the
+ * requests of those stay in flight and are counted in queued.
+ * */
+static CS_STATUS tsp_compute_batch_async(int NumReqs, CsComputeRequest **Reqs, u32 chunk,
+                                         void *Context, csQueueCallbackFn CallbackFn,
+                                         CS_EVT_HANDLE EventHandle, u32 *queued) {
+    int cmds = (NumReqs + chunk - 1) / chunk;
+    tsp_async_compute_st **as = calloc(cmds, sizeof(*as));
+    CS_STATUS status = CS_SUCCESS;
+
+    if (!as) {
+        return CS_NOT_ENOUGH_MEMORY;
+    }
+    for (int c = 0; c < cmds; ++c) {
+        int i = c * chunk, n = NumReqs - i < (int)chunk ? NumReqs - i : (int)chunk;
+
+        as[c] = malloc(sizeof(tsp_async_compute_st));
+        if (!as[c]) {
+            status = CS_NOT_ENOUGH_MEMORY;
+            break;
+        }
+        as[c]->memo = NULL;
+        status = tsp_compute_command(Reqs + i, n, &as[c]->cmd, as[c]->buffer, &as[c]->heap);
+        if (status != CS_SUCCESS) {
+            free(as[c]);
+            as[c] = NULL;
+            break;
+        }
+    }
+
+    for (int c = 0; c < cmds && status == CS_SUCCESS; ++c) {
+        int i = c * chunk, n = NumReqs - i < (int)chunk ? NumReqs - i : (int)chunk;
+
+        status = tsp_compute_admit(Reqs + i, n, &as[c]->ticket);
+        if (status != CS_SUCCESS) {
+            break;
+        }
+        // Freed once completed, or by tsp_compute_queue() if it fails
+        status = tsp_compute_queue(as[c], Reqs[0]->CSEHandle, Context, CallbackFn, EventHandle);
+        as[c] = NULL;
+        if (status != CS_QUEUED) {
+            break;
+        }
+        if (queued) {
+            *queued += n;
+        }
+        status = CS_SUCCESS;
+    }
+
+    // Commands built but not queued
+    for (int c = 0; c < cmds; ++c) {
+        if (as[c]) {
+            free(as[c]->heap);
+            free(as[c]);
+        }
+    }
+    free(as);
+    return status == CS_SUCCESS ? CS_QUEUED : status;
+}
+
+/**
+ * @copydoc csTspQueueComputeBatch
+ * */
+CS_STATUS csTspQueueComputeBatch(int NumReqs, CsComputeRequest **Reqs, void *Context,
+                                 csQueueCallbackFn CallbackFn,
+                                 CS_EVT_HANDLE EventHandle, u32 *CompValue) {
+    CS_STATUS status = CS_SUCCESS;
+    TspWireInfo info;
+    u32 chunk, done;
+
+    if (NumReqs <= 0 || !Reqs) {
+        return CS_INVALID_ARG;
+    }
+    for (int i = 0; i < NumReqs; ++i) {
+        if (!Reqs[i] || Reqs[i]->CSEHandle != Reqs[0]->CSEHandle) {
+            return CS_INVALID_ARG;
+        }
+    }
+    if (CompValue) {
+        *CompValue = 0;
+    }
+    tsp_memo_invalidate_args(Reqs, NumReqs);
+
+    // As many requests per command as the device takes, one without the wire format
+    tsp_cached_wire_info(Reqs[0]->CSEHandle, &info);
+    chunk = info.Versions & (1u << TSP_WIRE_VERSION) ? info.MaxRequests : 1;
+
+    if (CallbackFn || EventHandle) {
+        return tsp_compute_batch_async(NumReqs, Reqs, chunk, Context, CallbackFn, EventHandle,
+                                       CompValue);
+    }
+
+    for (int i = 0; i < NumReqs; i += chunk) {
+        int n = (u32)(NumReqs - i) < chunk ? NumReqs - i : (int)chunk;
+
+        status = tsp_compute_operation(Reqs + i, n, &done);
+        if (CompValue) {
+            *CompValue += done;
+        }
+        if (status != CS_SUCCESS) {
+            break;
+        }
+    }
+
+    return status;
+}
+
+/**
+ * @copydoc csTspQueueWireRequests
+ * */
+CS_STATUS csTspQueueWireRequests(CS_CSE_HANDLE CSEHandle, void *Buffer, u32 Length,
+                                 void *Context, csQueueCallbackFn CallbackFn,
+                                 CS_EVT_HANDLE EventHandle, u32 *CompValue) {
+    const TspWireHeader *h = Buffer;
+    tsp_admit_ticket_st ticket;
+    tsp_async_compute_st *a;
+    TspWireInfo info;
+    tsp_cmd_st cmd;
+    CS_STATUS status;
+
+    if (!tsp_device_get(CSEHandle)) {
+        return CS_INVALID_HANDLE;
+    }
+    if (!Buffer || !tsp_wire_first(Buffer, Length) || h->Length != Length ||
+        (Length & (TSP_WIRE_ALIGN - 1)) || !h->NumRequests) {
+        return CS_INVALID_ARG;
+    }
+
+    tsp_cached_wire_info(CSEHandle, &info);
+    if (!(info.Versions & (1u << TSP_WIRE_VERSION))) {
+        return CS_UNSUPPORTED;
+    }
+    if (Length > info.MaxTransfer || h->NumRequests > info.MaxRequests) {
+        return CS_INVALID_LENGTH;
+    }
+
+    status = tsp_wire_admit(CSEHandle, h, &ticket);
+    if (status != CS_SUCCESS) {
+        return status;
+    }
+    // The FDM written by the requests is not decoded
+    tsp_memo_invalidate_device(CSEHandle);
+
+    // The buffer is the data of the command, it is not copied
+    if (CallbackFn || EventHandle) {
+        a = malloc(sizeof(tsp_async_compute_st));
+        if (!a) {
+            tsp_admit_release(&ticket);
+            return CS_NOT_ENOUGH_MEMORY;
+        }
+        tsp_compute_fill(&a->cmd, Buffer, Length, TSP_WIRE_VERSION);
+        a->heap = NULL;
+        a->ticket = ticket;
+        a->memo = NULL;
+        return tsp_compute_queue(a, CSEHandle, Context, CallbackFn, EventHandle);
+    }
+
+    tsp_compute_fill(&cmd, Buffer, Length, TSP_WIRE_VERSION);
+    status = tsp_compute_status(tsp_compute_submit(CSEHandle, &cmd));
+    tsp_admit_release(&ticket);
+    if (CompValue) {
+        *CompValue = status == CS_SUCCESS ? h->NumRequests : cmd.result;
+    }
+    return status;
+}
+
 /**
  * @copydoc csHelperSetComputeArg
- * @todo this is still a stub
  * */
 void csHelperSetComputeArg(CsComputeArg *ArgPtr,
                            CS_COMPUTE_ARG_TYPE Type, ...) {
@@ -618,23 +1462,48 @@ void csHelperSetComputeArg(CsComputeArg *ArgPtr,
     }
 }
 
+typedef struct {
+    int *size;
+    CsFunctionInfo *info;
+} tsp_function_list_st;
+
+static CS_STATUS tsp_function_list(const tsp_functions_st *fns, void *ctx) {
+    tsp_function_list_st *list = ctx;
+    int n = *list->size / (int)sizeof(CsFunctionInfo);
+
+    for (int i = 0; i < n && i < (int)fns->num; ++i) {
+        const TspFunctionEntry *e = &fns->entry[i];
+
+        list->info[i].FunctionId = e->FunctionId;
+        list->info[i].NumUnits = e->NumUnits;
+        memcpy(list->info[i].Name, e->Name, sizeof(list->info[i].Name));
+    }
+    *list->size = fns->num * sizeof(CsFunctionInfo);
+    return n < (int)fns->num ? CS_INVALID_LENGTH : CS_SUCCESS;
+}
+
 /**
  * @copydoc csQueryDeviceForComputeList
- * @todo this is still a stub
+ * @note Size is in bytes, it is set to the size of the whole list (which is
+ * also returned with CS_INVALID_LENGTH if the buffer is too small, FunctionInfo
+ * can then be NULL)
  * */
 CS_STATUS csQueryDeviceForComputeList(CS_DEV_HANDLE DevHandle,
                                       int *Size,
                                       CsFunctionInfo *FunctionInfo) {
-    if (DevHandle != __CS_PLACE_HOLDER_DEV_HANDLE) {
+    tsp_function_list_st list = {.size = Size, .info = FunctionInfo};
+
+    if (DevHandle < 0) {
         return CS_INVALID_HANDLE;
     }
+    if (!tsp_cached_has_cs(DevHandle)) {
+        return CS_DEVICE_NOT_AVAILABLE;
+    }
 
-    if (!FunctionInfo) {
+    if (!Size || *Size < 0 || (*Size && !FunctionInfo)) {
         return CS_INVALID_ARG;
-    } else {
-        /// @todo TODO fill the buffer
-        return CS_SUCCESS;
     }
+    return tsp_with_functions(DevHandle, tsp_function_list, &list);
 }
 
 /**
@@ -645,7 +1514,7 @@ CS_STATUS csQueryDeviceProperties(CS_DEV_HANDLE DevHandle, int *Length,
     if (DevHandle < 0) {
         return CS_INVALID_HANDLE;
     }
-    if (!tsp_nvme_device_has_cs(DevHandle)) {
+    if (!tsp_cached_has_cs(DevHandle)) {
         /// @todo maybe not the correct error code
         return CS_DEVICE_NOT_AVAILABLE;
     }
@@ -661,7 +1530,7 @@ CS_STATUS csQueryDeviceProperties(CS_DEV_HANDLE DevHandle, int *Length,
     if (!Buffer) {
         return CS_INVALID_ARG;
     } else {
-        return tsp_nvme_get_properties(DevHandle, Length, Buffer);
+        return tsp_cached_properties(DevHandle, Length, Buffer);
     }
 }
 
@@ -678,5 +1547,112 @@ CS_STATUS csQueryDeviceCapabilities(CS_DEV_HANDLE DevHandle,
         return CS_INVALID_ARG;
     }
 
-    return tsp_nvme_get_capabilities(DevHandle, Caps);
+    return tsp_cached_capabilities(DevHandle, Caps);
+}
+
+/**
+ * @copydoc csTspInvalidateDeviceCache
+ * */
+CS_STATUS csTspInvalidateDeviceCache(CS_DEV_HANDLE DevHandle) {
+    tsp_device_st *dev;
+
+    if (DevHandle < 0) {
+        return CS_INVALID_HANDLE;
+    }
+
+    dev = tsp_device_get(DevHandle);
+    if (!dev) {
+        return CS_INVALID_HANDLE;
+    }
+
+    tsp_device_invalidate(dev);
+    return CS_SUCCESS;
+}
+
+/**
+ * @copydoc csTspQueryFunctionInfo
+ * */
+CS_STATUS csTspQueryFunctionInfo(CS_DEV_HANDLE DevHandle, const char *FunctionName,
+                                 CsTspFunctionInfo *Info) {
+    tsp_function_lookup_st lookup = {.name = FunctionName};
+    const TspFunctionEntry *e = &lookup.entry;
+    CS_STATUS status;
+
+    if (DevHandle < 0) {
+        return CS_INVALID_HANDLE;
+    }
+    if (!FunctionName || !Info) {
+        return CS_INVALID_ARG;
+    }
+
+    status = tsp_with_functions(DevHandle, tsp_function_lookup, &lookup);
+    if (status != CS_SUCCESS) {
+        return status;
+    }
+
+    memset(Info, 0, sizeof(*Info));
+    Info->FunctionId = e->FunctionId;
+    Info->FunctionBit = e->Bit == TSP_FUNCTION_NO_BIT ? -1 : e->Bit;
+    Info->NumUnits = e->NumUnits;
+    if (e->Flags & TSP_FUNCTION_SIGNATURE) {
+        Info->HasSignature = 1;
+        Info->MinArgs = e->MinArgs;
+        Info->MaxArgs = e->MaxArgs < CS_TSP_FUNCTION_MAX_ARGS ? e->MaxArgs : CS_TSP_FUNCTION_MAX_ARGS;
+        Info->Variadic = !!(e->Flags & TSP_FUNCTION_VARIADIC);
+        for (u32 i = 0; i < Info->MaxArgs; ++i) {
+            Info->ArgTypes[i] = e->ArgTypes[i];
+        }
+    }
+    memcpy(Info->Name, e->Name, sizeof(Info->Name));
+    return CS_SUCCESS;
+}
+
+/**
+ * @copydoc csDownload
+ * @todo There is no download command in TSP yet, the device information cached
+ * by the library is dropped because a download changes the functions.
+ * */
+CS_STATUS csDownload(CS_DEV_HANDLE DevHandle, CsDownloadInfo *ProgramInfo) {
+    if (DevHandle < 0) {
+        return CS_INVALID_HANDLE;
+    }
+
+    if (!ProgramInfo) {
+        return CS_INVALID_ARG;
+    }
+
+    csTspInvalidateDeviceCache(DevHandle);
+    return CS_UNSUPPORTED;
+}
+
+/**
+ * @copydoc csConfig
+ * @todo There is no configuration command in TSP yet, the device information
+ * cached by the library is dropped because a configuration changes it.
+ * */
+CS_STATUS csConfig(CS_CSE_HANDLE CSEHandle, CsConfigInfo *Info) {
+    if (CSEHandle < 0) {
+        return CS_INVALID_HANDLE;
+    }
+
+    if (!Info) {
+        return CS_INVALID_ARG;
+    }
+
+    csTspInvalidateDeviceCache(CSEHandle);
+    return CS_UNSUPPORTED;
+}
+
+/**
+ * @copydoc csResetCSE
+ * @todo There is no reset command in TSP yet, the device information cached by
+ * the library is dropped so that it is queried again after the reset.
+ * */
+CS_STATUS csResetCSE(CS_CSE_HANDLE CSEHandle) {
+    if (CSEHandle < 0) {
+        return CS_INVALID_HANDLE;
+    }
+
+    csTspInvalidateDeviceCache(CSEHandle);
+    return CS_UNSUPPORTED;
 }
@@ -0,0 +1,237 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Discovery of the CSxes and CSEs of the host.
+ *
+ * Every NVMe controller of the host (/sys/class/nvme) is probed with the TSP
+ * identify command, controllers that have compute are CSxes with a single CSE
+ * named after the controller. The emulated CSxes (TSP_EMU_DEVICES, see
+ * tsp_emu.h) are listed after the controllers.
+ * */
+
+#include "cs.h"
+#include "tsp_device.h"
+#include "tsp_emu.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <limits.h>
+
+#define TSP_SYSFS_NVME_CLASS "/sys/class/nvme"
+
+typedef void (*tsp_csx_fn)(const char *name, const CsCapabilities *caps, void *ctx);
+
+static int tsp_nvme_filter(const struct dirent *d) {
+    return !strncmp(d->d_name, "nvme", 4);
+}
+
+/* Calls fn if the device is a CSx, returns 1 if it is */
+static int tsp_visit_csx(char *name, tsp_csx_fn fn, void *ctx) {
+    CS_DEV_HANDLE fd;
+    CsCapabilities caps;
+    int is_csx = 0;
+
+    if (csOpenCSx(name, NULL, &fd) == CS_SUCCESS) {
+        if (tsp_cached_has_cs(fd) &&
+            tsp_cached_capabilities(fd, &caps) == CS_SUCCESS) {
+            MSG_PRINT_DEBUG("Found CSx : %s", name);
+            fn(name, &caps, ctx);
+            is_csx = 1;
+        }
+        csCloseCSx(fd);
+    }
+    return is_csx;
+}
+
+/* Calls fn for every CSx of the host, then for the emulated CSxes, returns the
+ * number of CSxes */
+static int tsp_for_each_csx(tsp_csx_fn fn, void *ctx) {
+    struct dirent **list;
+    char name[32];
+    int n, num_csx = 0;
+
+    n = scandir(TSP_SYSFS_NVME_CLASS, &list, tsp_nvme_filter, versionsort);
+    if (n < 0) {
+        // Not an error on hosts that only use emulated CSxes
+        if (!tsp_emu_count()) {
+            MSG_PRINT_ERROR("Could not list %s", TSP_SYSFS_NVME_CLASS);
+        }
+        n = 0;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        num_csx += tsp_visit_csx(list[i]->d_name, fn, ctx);
+        free(list[i]);
+    }
+    if (n) {
+        free(list);
+    }
+
+    for (int i = 0; i < tsp_emu_count(); ++i) {
+        snprintf(name, sizeof(name), TSP_EMU_PREFIX "%d", i);
+        num_csx += tsp_visit_csx(name, fn, ctx);
+    }
+
+    return num_csx;
+}
+
+/* Comma separated list of names, Used counts the required size even when the
+ * buffer is too small */
+typedef struct {
+    char *Buffer;
+    int Length;
+    int Used;
+    int Count;
+} tsp_list_st;
+
+static void tsp_list_append(tsp_list_st *list, const char *name) {
+    int len = strlen(name);
+    int sep = list->Count ? 1 : 0;
+
+    if (list->Buffer && list->Used + sep + len + 1 <= list->Length) {
+        if (sep) {
+            list->Buffer[list->Used] = ',';
+        }
+        memcpy(list->Buffer + list->Used + sep, name, len + 1);
+    }
+    list->Used += sep + len;
+    list->Count++;
+}
+
+static CS_STATUS tsp_list_finish(tsp_list_st *list, int *Length) {
+    int required = list->Used + 1;
+
+    if (!list->Count) {
+        return CS_NO_SUCH_ENTITY_EXISTS;
+    }
+    if (required > *Length) {
+        *Length = required;
+        return CS_INVALID_LENGTH;
+    }
+    *Length = required;
+    return CS_SUCCESS;
+}
+
+static int tsp_caps_has(const CsCapabilities *caps, int bit) {
+    u64 f;
+    memcpy(&f, caps, sizeof(f));
+    return (f >> bit) & 1;
+}
+
+typedef struct {
+    tsp_list_st list;
+    int bit;
+} tsp_cse_list_st;
+
+static void tsp_cse_list_add(const char *name, const CsCapabilities *caps, void *ctx) {
+    tsp_cse_list_st *l = ctx;
+    if (l->bit < 0 || tsp_caps_has(caps, l->bit)) {
+        tsp_list_append(&l->list, name);
+    }
+}
+
+/**
+ * @copydoc csQueryCSEList
+ * */
+CS_STATUS csQueryCSEList(char *FunctionName, int *Length, char *Buffer) {
+    tsp_cse_list_st l = {0,};
+
+    if (!Length || (*Length && !Buffer)) {
+        return CS_INVALID_ARG;
+    }
+
+    l.list.Buffer = Buffer;
+    l.list.Length = *Length;
+    l.bit = -1;
+    if (FunctionName) {
+        l.bit = tsp_function_bit(FunctionName);
+        if (l.bit < 0) {
+            return CS_INVALID_OPTION;
+        }
+    }
+
+    tsp_for_each_csx(tsp_cse_list_add, &l);
+    return tsp_list_finish(&l.list, Length);
+}
+
+static void tsp_caps_merge(const char *name, const CsCapabilities *caps, void *ctx) {
+    u64 *functions = ctx;
+    u64 f;
+    memcpy(&f, caps, sizeof(f));
+    *functions |= f;
+}
+
+/**
+ * @copydoc csQueryFunctionList
+ * */
+CS_STATUS csQueryFunctionList(char *Path, int *Length, char *Buffer) {
+    tsp_list_st list = {0,};
+    u64 functions = 0;
+
+    if (!Length || (*Length && !Buffer)) {
+        return CS_INVALID_ARG;
+    }
+
+    if (Path) {
+        char path[PATH_MAX];
+        char name[NAME_MAX + 1];
+        unsigned int len = sizeof(name);
+        CsCapabilities caps;
+        CS_DEV_HANDLE fd;
+        CS_STATUS status;
+
+        // csGetCSxFromPath() may modify the path
+        snprintf(path, sizeof(path), "%s", Path);
+        status = csGetCSxFromPath(path, &len, name);
+        if (status != CS_SUCCESS) {
+            return status;
+        }
+        status = csOpenCSx(name, NULL, &fd);
+        if (status != CS_SUCCESS) {
+            return status;
+        }
+        status = tsp_cached_capabilities(fd, &caps);
+        csCloseCSx(fd);
+        if (status != CS_SUCCESS) {
+            return status;
+        }
+        tsp_caps_merge(name, &caps, &functions);
+    } else {
+        tsp_for_each_csx(tsp_caps_merge, &functions);
+    }
+
+    list.Buffer = Buffer;
+    list.Length = *Length;
+    for (int i = 0; i < TSP_NUM_FUNCTIONS; ++i) {
+        if ((functions >> i) & 1) {
+            tsp_list_append(&list, tsp_function_name(i));
+        }
+    }
+
+    return tsp_list_finish(&list, Length);
+}
@@ -0,0 +1,159 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Events, signaled by the completion of asynchronous requests.
+ *
+ * An event is armed when a request that refers to it is queued and signaled
+ * with the status of the request once it completed. An event can be reused
+ * for another request once signaled.
+ * */
+
+#include "cs.h"
+#include "cs_tsp.h"
+#include "tsp_device.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;       /* requests queued and not completed yet */
+    CS_STATUS status;  /* status of the last completed request */
+} tsp_event_st;
+
+void tsp_event_arm(CS_EVT_HANDLE EventHandle) {
+    tsp_event_st *evt = EventHandle;
+
+    pthread_mutex_lock(&evt->lock);
+    evt->pending++;
+    pthread_mutex_unlock(&evt->lock);
+}
+
+void tsp_event_signal(CS_EVT_HANDLE EventHandle, CS_STATUS status) {
+    tsp_event_st *evt = EventHandle;
+
+    pthread_mutex_lock(&evt->lock);
+    evt->pending--;
+    // The first error is kept until the event is polled
+    if (evt->status == CS_SUCCESS) {
+        evt->status = status;
+    }
+    pthread_cond_broadcast(&evt->cond);
+    pthread_mutex_unlock(&evt->lock);
+}
+
+/**
+ * @copydoc csCreateEvent
+ * */
+CS_STATUS csCreateEvent(CS_EVT_HANDLE *EventHandle) {
+    tsp_event_st *evt;
+
+    if (!EventHandle) {
+        return CS_INVALID_ARG;
+    }
+
+    evt = calloc(1, sizeof(tsp_event_st));
+    if (!evt) {
+        return CS_NOT_ENOUGH_MEMORY;
+    }
+    pthread_mutex_init(&evt->lock, NULL);
+    pthread_cond_init(&evt->cond, NULL);
+    evt->status = CS_SUCCESS;
+
+    *EventHandle = evt;
+    return CS_SUCCESS;
+}
+
+/**
+ * @copydoc csDeleteEvent
+ * */
+CS_STATUS csDeleteEvent(CS_EVT_HANDLE EventHandle) {
+    tsp_event_st *evt = EventHandle;
+
+    if (!evt) {
+        return CS_INVALID_EVENT;
+    }
+
+    pthread_mutex_lock(&evt->lock);
+    if (evt->pending) {
+        pthread_mutex_unlock(&evt->lock);
+        return CS_HANDLE_IN_USE;
+    }
+    pthread_mutex_unlock(&evt->lock);
+
+    pthread_cond_destroy(&evt->cond);
+    pthread_mutex_destroy(&evt->lock);
+    free(evt);
+    return CS_SUCCESS;
+}
+
+/**
+ * @copydoc csPollEvent
+ * @note Returns CS_NOT_DONE while requests are pending, otherwise the status of
+ * the completed requests (the first error if any), which is then cleared
+ * */
+CS_STATUS csPollEvent(CS_EVT_HANDLE EventHandle, void *Context) {
+    tsp_event_st *evt = EventHandle;
+    CS_STATUS status;
+
+    if (!evt) {
+        return CS_INVALID_EVENT;
+    }
+
+    pthread_mutex_lock(&evt->lock);
+    if (evt->pending) {
+        status = CS_NOT_DONE;
+    } else {
+        status = evt->status;
+        evt->status = CS_SUCCESS;
+    }
+    pthread_mutex_unlock(&evt->lock);
+
+    return status;
+}
+
+/**
+ * @copydoc csTspWaitEvent
+ * */
+CS_STATUS csTspWaitEvent(CS_EVT_HANDLE EventHandle) {
+    tsp_event_st *evt = EventHandle;
+    CS_STATUS status;
+
+    if (!evt) {
+        return CS_INVALID_EVENT;
+    }
+
+    pthread_mutex_lock(&evt->lock);
+    while (evt->pending) {
+        pthread_cond_wait(&evt->cond, &evt->lock);
+    }
+    status = evt->status;
+    evt->status = CS_SUCCESS;
+    pthread_mutex_unlock(&evt->lock);
+
+    return status;
+}
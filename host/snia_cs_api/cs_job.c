@@ -0,0 +1,246 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Detached compute jobs.
+ *
+ * A job is a compute request that the device runs on its own : the command
+ * that submits it completes once the job is accepted, so a long function does
+ * not hold a host thread nor an NVMe command for its whole duration. The host
+ * then polls the job, reads its (partial) result and cancels or releases it
+ * with short commands, see TSP_CS_JOB in tsp.h.
+ * */
+
+#include "cs.h"
+#include "tsp.h"
+#include "cs_tsp.h"
+#include "tsp_device.h"
+#include "tsp_transport.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Polling interval of csTspWaitJob(), doubled up to the maximum */
+#define TSP_JOB_POLL_MIN_US 100
+#define TSP_JOB_POLL_MAX_US 100000
+
+_Static_assert(CS_TSP_JOB_CANCELLED == (int)TSP_JOB_CANCELLED, "job states differ");
+
+static CS_STATUS tsp_job_status(int ret) {
+    switch (ret) {
+    case 0:
+        return CS_SUCCESS;
+    case TSP_SC_JOB_LIMIT:
+        return CS_OUT_OF_RESOURCES;
+    case TSP_SC_JOB_UNKNOWN:
+        return CS_INVALID_ID;
+    case TSP_SC_JOB_BUSY:
+        return CS_HANDLE_IN_USE;
+    default:
+        return ret < 0 ? CS_DEVICE_NOT_AVAILABLE : CS_ERROR_IN_EXECUTION;
+    }
+}
+
+/* Sends a TSP_CS_JOB command for an existing job, data may be NULL */
+static CS_STATUS tsp_job_command(CS_CSE_HANDLE cse, TSP_JOB_ACTION action, CS_TSP_JOB_ID id,
+                                 tsp_cmd_st *cmd) {
+    cmd->cdw10 = TSP_CS_JOB;
+    cmd->cdw11 = action;
+    cmd->cdw12 = id;
+
+    if (!tsp_device_get(cse)) {
+        return CS_INVALID_HANDLE;
+    }
+    return tsp_job_status(tsp_submit(cse, cmd));
+}
+
+/**
+ * @copydoc csTspSubmitJob
+ * */
+CS_STATUS csTspSubmitJob(CsComputeRequest *Req, CS_TSP_JOB_ID *JobId) {
+    char buffer[TSP_BUFFER_SIZE] __attribute__((aligned(TSP_WIRE_ALIGN)));
+    tsp_cmd_st cmd;
+    void *heap;
+    CS_STATUS status;
+    int ret;
+
+    if (!Req || !JobId) {
+        return CS_INVALID_ARG;
+    }
+    if (!tsp_device_get(Req->CSEHandle)) {
+        return CS_INVALID_HANDLE;
+    }
+
+    // Same payload as a compute command, in the format the device supports
+    status = tsp_compute_command(&Req, 1, &cmd, buffer, &heap);
+    if (status != CS_SUCCESS) {
+        return status;
+    }
+    cmd.cdw10 = TSP_CS_JOB;
+    cmd.cdw11 = TSP_JOB_SUBMIT;
+    cmd.timeout_ms = 0;
+    // The job writes its outputs at any time until it ends
+    tsp_memo_invalidate_args(&Req, 1);
+
+    ret = tsp_submit(Req->CSEHandle, &cmd);
+    free(heap);
+    if (ret) {
+        MSG_PRINT_ERROR("The job could not be submitted (status 0x%x)", ret);
+        return tsp_job_status(ret);
+    }
+
+    *JobId = cmd.result;
+    MSG_PRINT_DEBUG("Submitted job %u", *JobId);
+    return CS_SUCCESS;
+}
+
+/**
+ * @copydoc csTspQueryJob
+ * */
+CS_STATUS csTspQueryJob(CS_CSE_HANDLE CSEHandle, CS_TSP_JOB_ID JobId,
+                        CsTspJobStatus *Status) {
+    char buffer[TSP_BUFFER_SIZE];
+    TspJobStatus st;
+    tsp_cmd_st cmd = {
+        .dir = TSP_DIR_FROM_DEV,
+        .data_len = sizeof(buffer),
+        .data = buffer,
+    };
+    CS_STATUS status;
+
+    if (!Status) {
+        return CS_INVALID_ARG;
+    }
+
+    status = tsp_job_command(CSEHandle, TSP_JOB_STATUS, JobId, &cmd);
+    if (status != CS_SUCCESS) {
+        return status;
+    }
+
+    memcpy(&st, buffer, sizeof(st));
+    memset(Status, 0, sizeof(*Status));
+    Status->State = st.State;
+    Status->Status = st.Status ? CS_ERROR_IN_EXECUTION : CS_SUCCESS;
+    Status->Progress = st.Progress;
+    Status->ResultBytes = st.ResultBytes;
+    Status->RuntimeUs = st.RuntimeUs;
+    return CS_SUCCESS;
+}
+
+/**
+ * @copydoc csTspWaitJob
+ * */
+CS_STATUS csTspWaitJob(CS_CSE_HANDLE CSEHandle, CS_TSP_JOB_ID JobId,
+                       u32 TimeoutMs, CsTspJobStatus *Status) {
+    struct timespec start, now, delay = {0};
+    u64 poll_us = TSP_JOB_POLL_MIN_US;
+    CsTspJobStatus st;
+    CS_STATUS status;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        status = csTspQueryJob(CSEHandle, JobId, &st);
+        if (status != CS_SUCCESS) {
+            return status;
+        }
+        if (Status) {
+            *Status = st;
+        }
+        if (st.State != CS_TSP_JOB_QUEUED && st.State != CS_TSP_JOB_RUNNING) {
+            return CS_SUCCESS;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (TimeoutMs && (u64)(now.tv_sec - start.tv_sec) * 1000 +
+            (now.tv_nsec - start.tv_nsec) / 1000000 >= TimeoutMs) {
+            return CS_NOT_DONE;
+        }
+
+        // Long jobs are polled less and less often
+        delay.tv_sec = poll_us / 1000000;
+        delay.tv_nsec = (poll_us % 1000000) * 1000;
+        nanosleep(&delay, NULL);
+        if (poll_us < TSP_JOB_POLL_MAX_US) {
+            poll_us *= 2;
+        }
+    }
+}
+
+/**
+ * @copydoc csTspReadJobResult
+ * */
+CS_STATUS csTspReadJobResult(CS_CSE_HANDLE CSEHandle, CS_TSP_JOB_ID JobId,
+                             u64 Offset, u32 Length, void *Buffer, u32 *BytesRead) {
+    tsp_cmd_st cmd = {
+        .cdw13 = (u32)Offset,
+        .cdw14 = (u32)(Offset >> 32),
+        .dir = TSP_DIR_FROM_DEV,
+        .data_len = Length,
+        .data = Buffer,
+    };
+    CS_STATUS status;
+
+    if (!Buffer || !BytesRead || !Length) {
+        return CS_INVALID_ARG;
+    }
+    if (Length > TSP_MDTS || (Length & 3)) {
+        return CS_INVALID_LENGTH;
+    }
+
+    status = tsp_job_command(CSEHandle, TSP_JOB_RESULT, JobId, &cmd);
+    *BytesRead = status == CS_SUCCESS ? cmd.result : 0;
+    return status;
+}
+
+/**
+ * @copydoc csTspCancelJob
+ * */
+CS_STATUS csTspCancelJob(CS_CSE_HANDLE CSEHandle, CS_TSP_JOB_ID JobId) {
+    tsp_cmd_st cmd = {.dir = TSP_DIR_TO_DEV};
+
+    return tsp_job_command(CSEHandle, TSP_JOB_CANCEL, JobId, &cmd);
+}
+
+/**
+ * @copydoc csTspReleaseJob
+ * */
+CS_STATUS csTspReleaseJob(CS_CSE_HANDLE CSEHandle, CS_TSP_JOB_ID JobId) {
+    tsp_cmd_st cmd = {.dir = TSP_DIR_TO_DEV};
+
+    return tsp_job_command(CSEHandle, TSP_JOB_RELEASE, JobId, &cmd);
+}
+
+/**
+ * @copydoc csAbortCSE
+ * @note Cancels the jobs of the CSE (see csTspSubmitJob()), compute commands
+ * already sent to the device run to completion
+ * */
+CS_STATUS csAbortCSE(CS_CSE_HANDLE CSEHandle) {
+    tsp_cmd_st cmd = {.dir = TSP_DIR_TO_DEV};
+
+    return tsp_job_command(CSEHandle, TSP_JOB_CANCEL, TSP_JOB_ALL, &cmd);
+}
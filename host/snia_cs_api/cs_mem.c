@@ -0,0 +1,1047 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * FDM management (csAllocMem(), csFreeMem())
+ *
+ * Sending an allocation command to the device for every buffer is slow and the
+ * device only hands out a limited number of allocations. Instead, large arenas
+ * of FDM are reserved from the device once and allocations are served by the
+ * library :
+ * - Small buffers (up to TSP_SLAB_MAX_SIZE) come from size-class slabs, a slab
+ *   is a page split in objects of the same size.
+ * - Larger buffers come from a buddy allocator over the pages of the arena.
+ * - Buffers larger than an arena get a dedicated ("direct") allocation.
+ *
+ * The metadata is kept on the host, the FDM itself is never touched. Memory
+ * handles are the device physical addresses, as before, so that they can be
+ * used as is in compute requests.
+ * */
+
+#include "cs.h"
+#include "cs_tsp.h"
+#include "tsp.h"
+#include "tsp_device.h"
+#include "tsp_emu.h"
+#include "tsp_transport.h"
+#include "debug.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <stdio.h>
+#include <limits.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+#define TSP_PAGE_SHIFT 12
+#define TSP_PAGE_SIZE (1ULL << TSP_PAGE_SHIFT)
+
+/* Arenas are first requested with the max size, the size shrinks down to the
+ * min size if the device cannot provide them */
+#define TSP_ARENA_MAX_SHIFT 26 /* 64 MiB */
+#define TSP_ARENA_MIN_SHIFT 22 /* 4 MiB */
+#define TSP_MAX_ORDER (TSP_ARENA_MAX_SHIFT - TSP_PAGE_SHIFT)
+
+/* Slab size classes 64, 128, ..., 2048 bytes */
+#define TSP_SLAB_MIN_SHIFT 6
+#define TSP_SLAB_CLASSES 6
+#define TSP_SLAB_MAX_SIZE (1 << (TSP_SLAB_MIN_SHIFT + TSP_SLAB_CLASSES - 1))
+#define TSP_SLAB_MAX_OBJS (TSP_PAGE_SIZE >> TSP_SLAB_MIN_SHIFT)
+
+/* Page states, the order of the block is stored in the low bits */
+#define TSP_BLOCK_NONE 0x00 /* not the first page of a block */
+#define TSP_BLOCK_FREE 0x80
+#define TSP_BLOCK_USED 0x40
+#define TSP_BLOCK_ORDER 0x3f
+
+#define TSP_NO_PAGE UINT32_MAX
+
+struct tsp_arena;
+
+typedef struct tsp_slab {
+    struct tsp_slab *next; /* partial slabs of the size class */
+    struct tsp_slab *prev;
+    struct tsp_arena *arena;
+    u32 page;
+    u16 class;
+    u16 nfree;
+    u64 free_map;                   /* bit set if the object is free */
+    u16 requested[TSP_SLAB_MAX_OBJS]; /* bytes requested per object, for stats */
+} tsp_slab_st;
+
+typedef struct tsp_arena {
+    struct tsp_arena *next;
+    u64 base;          /* device physical address */
+    u64 size;
+    u32 npages;
+    u32 max_order;     /* the arena is a single block of this order */
+    int direct;        /* dedicated to a single large allocation */
+    u64 direct_requested; /* bytes requested for the direct allocation */
+    void *va;          /* host mapping, done on first request */
+    int va_owned;      /* va is a mapping of its own, not part of the device window */
+    u8 *state;         /* per page TSP_BLOCK_* */
+    u32 *next_free;    /* per page free list links */
+    u32 *prev_free;
+    u64 *requested;    /* per page bytes requested if first page of a used block */
+    tsp_slab_st **slab; /* per page, slab that occupies the page */
+    u32 free_head[TSP_MAX_ORDER + 1];
+    u64 free_bytes;
+} tsp_arena_st;
+
+struct tsp_mem {
+    tsp_arena_st *arenas;
+    u32 arena_shift;
+    tsp_slab_st *partial[TSP_SLAB_CLASSES];
+    CsTspMemStats stats;
+};
+
+static CS_STATUS tsp_allocate_memory(CS_DEV_HANDLE fd, u64 Bytes, unsigned int MemFlags, u64 *addr) {
+    int ret = 0;
+    const unsigned int buffer_len = 4096;
+    char buffer[buffer_len];
+
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_ALLOCATE,
+        .cdw11 = TSP_CS_MEM,
+        .cdw12 = Bytes,
+        .dir = TSP_DIR_FROM_DEV,
+        .data_len = buffer_len,
+        .data = buffer,
+    };
+
+    ret = tsp_submit(fd, &cmd);
+    if (ret) {
+        MSG_PRINT_ERROR("Device could not handle memory allocation request");
+        /** @todo this error code doesn't seem most appropriate */
+        return CS_DEVICE_NOT_AVAILABLE;
+    } else {
+        if (!addr) {
+            return CS_INVALID_ARG;
+        }
+        memcpy(addr, buffer, sizeof(*addr));
+        if (*addr) {
+            // If the returned physical addr is non zero then it "worked"
+            return CS_SUCCESS;
+        } else {
+            /// @todo more checks and correct error code
+            return CS_NOT_ENOUGH_MEMORY;
+        }
+    }
+}
+
+static CS_STATUS tsp_deallocate_memory(CS_DEV_HANDLE fd, u64 addr) {
+    int ret = 0;
+
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_DEALLOCATE,
+        .cdw11 = TSP_CS_MEM,
+        .cdw12 = (u32)addr,
+        .cdw13 = (u32)(addr >> 32),
+        .dir = TSP_DIR_TO_DEV,
+    };
+
+    ret = tsp_submit(fd, &cmd);
+    if (ret) {
+        MSG_PRINT_WARNING("Device could not handle memory deallocation request");
+        return CS_DEVICE_NOT_AVAILABLE;
+    }
+    return CS_SUCCESS;
+}
+
+/*-*****************
+ * Buddy allocator *
+ *-*****************/
+
+static void free_list_push(tsp_arena_st *a, u32 page, u32 order) {
+    u32 head = a->free_head[order];
+
+    a->state[page] = TSP_BLOCK_FREE | order;
+    a->prev_free[page] = TSP_NO_PAGE;
+    a->next_free[page] = head;
+    if (head != TSP_NO_PAGE) {
+        a->prev_free[head] = page;
+    }
+    a->free_head[order] = page;
+}
+
+static void free_list_remove(tsp_arena_st *a, u32 page, u32 order) {
+    u32 next = a->next_free[page];
+    u32 prev = a->prev_free[page];
+
+    if (prev != TSP_NO_PAGE) {
+        a->next_free[prev] = next;
+    } else {
+        a->free_head[order] = next;
+    }
+    if (next != TSP_NO_PAGE) {
+        a->prev_free[next] = prev;
+    }
+    a->state[page] = TSP_BLOCK_NONE;
+}
+
+static u32 buddy_alloc(tsp_arena_st *a, u32 order) {
+    u32 o = order;
+    u32 page;
+
+    while (o <= a->max_order && a->free_head[o] == TSP_NO_PAGE) {
+        o++;
+    }
+    if (o > a->max_order) {
+        return TSP_NO_PAGE;
+    }
+
+    page = a->free_head[o];
+    free_list_remove(a, page, o);
+    // Split down to the requested order, the upper halves go to the free lists
+    while (o > order) {
+        o--;
+        free_list_push(a, page + (1U << o), o);
+    }
+
+    a->state[page] = TSP_BLOCK_USED | order;
+    a->free_bytes -= TSP_PAGE_SIZE << order;
+    return page;
+}
+
+static void buddy_free(tsp_arena_st *a, u32 page) {
+    u32 order = a->state[page] & TSP_BLOCK_ORDER;
+
+    a->free_bytes += TSP_PAGE_SIZE << order;
+    a->state[page] = TSP_BLOCK_NONE;
+    // Merge with the buddies as long as they are free
+    while (order < a->max_order) {
+        u32 buddy = page ^ (1U << order);
+        if (a->state[buddy] != (TSP_BLOCK_FREE | order)) {
+            break;
+        }
+        free_list_remove(a, buddy, order);
+        page &= ~(1U << order);
+        order++;
+    }
+    free_list_push(a, page, order);
+}
+
+static u32 size_to_order(u64 bytes) {
+    u32 order = 0;
+
+    while ((TSP_PAGE_SIZE << order) < bytes) {
+        order++;
+    }
+    return order;
+}
+
+/*-********
+ * Arenas *
+ *-********/
+
+static void tsp_arena_destroy(CS_DEV_HANDLE fd, tsp_arena_st *a) {
+    tsp_memo_freed((CS_MEM_HANDLE)a->base, a->size);
+    if (a->va && a->va_owned) {
+        munmap(a->va, a->size);
+    }
+    tsp_deallocate_memory(fd, a->base);
+    free(a->state);
+    free(a->next_free);
+    free(a->prev_free);
+    free(a->requested);
+    free(a->slab);
+    free(a);
+}
+
+static tsp_arena_st *tsp_arena_create(u64 base, u32 shift, int direct) {
+    tsp_arena_st *a = calloc(1, sizeof(tsp_arena_st));
+
+    if (!a) {
+        return NULL;
+    }
+    a->base = base;
+    a->size = 1ULL << shift;
+    a->direct = direct;
+    if (direct) {
+        return a;
+    }
+
+    a->max_order = shift - TSP_PAGE_SHIFT;
+    a->npages = 1U << a->max_order;
+    a->state = calloc(a->npages, sizeof(*a->state));
+    a->next_free = malloc(a->npages * sizeof(*a->next_free));
+    a->prev_free = malloc(a->npages * sizeof(*a->prev_free));
+    a->requested = calloc(a->npages, sizeof(*a->requested));
+    a->slab = calloc(a->npages, sizeof(*a->slab));
+    if (!a->state || !a->next_free || !a->prev_free || !a->requested || !a->slab) {
+        free(a->state);
+        free(a->next_free);
+        free(a->prev_free);
+        free(a->requested);
+        free(a->slab);
+        free(a);
+        return NULL;
+    }
+
+    for (u32 o = 0; o <= TSP_MAX_ORDER; ++o) {
+        a->free_head[o] = TSP_NO_PAGE;
+    }
+    free_list_push(a, 0, a->max_order);
+    a->free_bytes = a->size;
+    return a;
+}
+
+/**
+ * @brief Reserves a new arena from the device, the size of the arenas shrinks
+ * as long as the device refuses them
+ * */
+static tsp_arena_st *tsp_arena_reserve(tsp_device_st *dev) {
+    struct tsp_mem *mem = dev->mem;
+    tsp_arena_st *a;
+    u64 base = 0;
+
+    while (tsp_allocate_memory(dev->fd, 1ULL << mem->arena_shift, 0, &base) != CS_SUCCESS) {
+        if (mem->arena_shift == TSP_ARENA_MIN_SHIFT) {
+            return NULL;
+        }
+        mem->arena_shift--;
+    }
+    mem->stats.DeviceAllocations++;
+
+    if (base & (TSP_PAGE_SIZE - 1)) {
+        MSG_PRINT_ERROR("Device returned unaligned FDM 0x%016llx", (unsigned long long)base);
+        tsp_deallocate_memory(dev->fd, base);
+        return NULL;
+    }
+
+    a = tsp_arena_create(base, mem->arena_shift, 0);
+    if (!a) {
+        tsp_deallocate_memory(dev->fd, base);
+        return NULL;
+    }
+    a->next = mem->arenas;
+    mem->arenas = a;
+    MSG_PRINT_DEBUG("Reserved FDM arena of %llu bytes at 0x%016llx",
+                    (unsigned long long)a->size, (unsigned long long)base);
+    return a;
+}
+
+static void tsp_arena_unlink(struct tsp_mem *mem, tsp_arena_st *a) {
+    tsp_arena_st **pp = &mem->arenas;
+
+    while (*pp && *pp != a) {
+        pp = &(*pp)->next;
+    }
+    if (*pp) {
+        *pp = a->next;
+    }
+}
+
+static tsp_arena_st *tsp_arena_find(struct tsp_mem *mem, u64 addr) {
+    for (tsp_arena_st *a = mem->arenas; a; a = a->next) {
+        if (addr >= a->base && addr < a->base + a->size) {
+            return a;
+        }
+    }
+    return NULL;
+}
+
+/* Allocates a block of pages from any arena, reserves a new arena if needed */
+static u64 tsp_pages_alloc(tsp_device_st *dev, u32 order, tsp_arena_st **arena) {
+    tsp_arena_st *a;
+    u32 page;
+
+    for (a = dev->mem->arenas; a; a = a->next) {
+        if (!a->direct && order <= a->max_order) {
+            page = buddy_alloc(a, order);
+            if (page != TSP_NO_PAGE) {
+                *arena = a;
+                return page;
+            }
+        }
+    }
+
+    a = tsp_arena_reserve(dev);
+    if (!a || order > a->max_order) {
+        return TSP_NO_PAGE;
+    }
+    *arena = a;
+    return buddy_alloc(a, order);
+}
+
+/* Releases arenas that became completely free, one is always kept */
+static void tsp_arena_trim(tsp_device_st *dev, tsp_arena_st *a) {
+    struct tsp_mem *mem = dev->mem;
+
+    if (a->free_bytes == a->size && (mem->arenas != a || a->next)) {
+        tsp_arena_unlink(mem, a);
+        tsp_arena_destroy(dev->fd, a);
+    }
+}
+
+/*-*******
+ * Slabs *
+ *-*******/
+
+static inline u32 slab_objs(u32 class) {
+    return TSP_PAGE_SIZE >> (TSP_SLAB_MIN_SHIFT + class);
+}
+
+static void slab_partial_push(struct tsp_mem *mem, tsp_slab_st *s) {
+    s->prev = NULL;
+    s->next = mem->partial[s->class];
+    if (s->next) {
+        s->next->prev = s;
+    }
+    mem->partial[s->class] = s;
+}
+
+static void slab_partial_remove(struct tsp_mem *mem, tsp_slab_st *s) {
+    if (s->prev) {
+        s->prev->next = s->next;
+    } else {
+        mem->partial[s->class] = s->next;
+    }
+    if (s->next) {
+        s->next->prev = s->prev;
+    }
+}
+
+static CS_STATUS tsp_slab_alloc(tsp_device_st *dev, u32 bytes, u64 *addr, tsp_arena_st **arena) {
+    struct tsp_mem *mem = dev->mem;
+    u32 class = 0;
+    tsp_slab_st *s;
+    u32 obj;
+
+    while ((1U << (TSP_SLAB_MIN_SHIFT + class)) < bytes) {
+        class++;
+    }
+
+    s = mem->partial[class];
+    if (!s) {
+        tsp_arena_st *a;
+        u32 page = tsp_pages_alloc(dev, 0, &a);
+        if (page == TSP_NO_PAGE) {
+            return CS_NOT_ENOUGH_MEMORY;
+        }
+        s = calloc(1, sizeof(tsp_slab_st));
+        if (!s) {
+            buddy_free(a, page);
+            return CS_NOT_ENOUGH_MEMORY;
+        }
+        s->arena = a;
+        s->page = page;
+        s->class = class;
+        s->nfree = slab_objs(class);
+        s->free_map = s->nfree == 64 ? ~0ULL : (1ULL << s->nfree) - 1;
+        a->slab[page] = s;
+        slab_partial_push(mem, s);
+    }
+
+    obj = __builtin_ctzll(s->free_map);
+    s->free_map &= ~(1ULL << obj);
+    s->requested[obj] = bytes;
+    if (!--s->nfree) {
+        slab_partial_remove(mem, s);
+    }
+
+    mem->stats.UsedBytes += 1U << (TSP_SLAB_MIN_SHIFT + class);
+    mem->stats.RequestedBytes += bytes;
+    *arena = s->arena;
+    *addr = s->arena->base + ((u64)s->page << TSP_PAGE_SHIFT) +
+            ((u64)obj << (TSP_SLAB_MIN_SHIFT + class));
+    return CS_SUCCESS;
+}
+
+static CS_STATUS tsp_slab_free(tsp_device_st *dev, tsp_slab_st *s, u64 addr) {
+    struct tsp_mem *mem = dev->mem;
+    tsp_arena_st *a = s->arena;
+    u32 shift = TSP_SLAB_MIN_SHIFT + s->class;
+    u64 offset = (addr - a->base) & (TSP_PAGE_SIZE - 1);
+    u32 obj = offset >> shift;
+
+    if ((offset & ((1U << shift) - 1)) || (s->free_map & (1ULL << obj))) {
+        return CS_INVALID_HANDLE;
+    }
+
+    s->free_map |= 1ULL << obj;
+    mem->stats.UsedBytes -= 1U << shift;
+    mem->stats.RequestedBytes -= s->requested[obj];
+    if (!s->nfree++) {
+        slab_partial_push(mem, s);
+    }
+    if (s->nfree == slab_objs(s->class)) {
+        // Empty slab, give the page back
+        slab_partial_remove(mem, s);
+        a->slab[s->page] = NULL;
+        buddy_free(a, s->page);
+        free(s);
+        tsp_arena_trim(dev, a);
+    }
+    return CS_SUCCESS;
+}
+
+/*-*********************
+ * Allocation and free *
+ *-*********************/
+
+static CS_STATUS tsp_mem_init(tsp_device_st *dev) {
+    if (!dev->mem) {
+        dev->mem = calloc(1, sizeof(struct tsp_mem));
+        if (!dev->mem) {
+            return CS_NOT_ENOUGH_MEMORY;
+        }
+        dev->mem->arena_shift = TSP_ARENA_MAX_SHIFT;
+    }
+    return CS_SUCCESS;
+}
+
+static CS_STATUS tsp_mem_alloc(tsp_device_st *dev, u64 bytes, u64 *addr, tsp_arena_st **arena) {
+    struct tsp_mem *mem = dev->mem;
+    CS_STATUS status;
+    tsp_arena_st *a;
+    u32 order;
+    u32 page;
+    u64 base;
+
+    if (bytes <= TSP_SLAB_MAX_SIZE) {
+        status = tsp_slab_alloc(dev, bytes, addr, arena);
+        if (status == CS_SUCCESS) {
+            mem->stats.NumAllocations++;
+        }
+        return status;
+    }
+
+    order = size_to_order(bytes);
+    if (order <= mem->arena_shift - TSP_PAGE_SHIFT) {
+        page = tsp_pages_alloc(dev, order, &a);
+        if (page != TSP_NO_PAGE) {
+            a->requested[page] = bytes;
+            mem->stats.UsedBytes += TSP_PAGE_SIZE << order;
+            mem->stats.RequestedBytes += bytes;
+            mem->stats.NumAllocations++;
+            *addr = a->base + ((u64)page << TSP_PAGE_SHIFT);
+            *arena = a;
+            return CS_SUCCESS;
+        }
+        // The arenas may have shrunk below the requested size
+        if (order <= mem->arena_shift - TSP_PAGE_SHIFT) {
+            return CS_NOT_ENOUGH_MEMORY;
+        }
+    }
+
+    // Larger than an arena, dedicated allocation
+    status = tsp_allocate_memory(dev->fd, TSP_PAGE_SIZE << order, 0, &base);
+    if (status != CS_SUCCESS) {
+        return status;
+    }
+    mem->stats.DeviceAllocations++;
+    a = tsp_arena_create(base, order + TSP_PAGE_SHIFT, 1);
+    if (!a) {
+        tsp_deallocate_memory(dev->fd, base);
+        return CS_NOT_ENOUGH_MEMORY;
+    }
+    a->direct_requested = bytes;
+    a->next = mem->arenas;
+    mem->arenas = a;
+    mem->stats.UsedBytes += a->size;
+    mem->stats.RequestedBytes += bytes;
+    mem->stats.NumAllocations++;
+    *addr = base;
+    *arena = a;
+    return CS_SUCCESS;
+}
+
+static CS_STATUS tsp_mem_free(tsp_device_st *dev, tsp_arena_st *a, u64 addr) {
+    struct tsp_mem *mem = dev->mem;
+    u64 offset = addr - a->base;
+    u32 page = offset >> TSP_PAGE_SHIFT;
+    CS_STATUS status = CS_SUCCESS;
+
+    if (a->direct) {
+        if (offset) {
+            return CS_INVALID_HANDLE;
+        }
+        mem->stats.UsedBytes -= a->size;
+        mem->stats.RequestedBytes -= a->direct_requested;
+        tsp_arena_unlink(mem, a);
+        tsp_arena_destroy(dev->fd, a);
+    } else if (a->slab[page]) {
+        status = tsp_slab_free(dev, a->slab[page], addr);
+    } else {
+        if ((offset & (TSP_PAGE_SIZE - 1)) || !(a->state[page] & TSP_BLOCK_USED)) {
+            return CS_INVALID_HANDLE;
+        }
+        mem->stats.UsedBytes -= TSP_PAGE_SIZE << (a->state[page] & TSP_BLOCK_ORDER);
+        mem->stats.RequestedBytes -= a->requested[page];
+        buddy_free(a, page);
+        tsp_arena_trim(dev, a);
+    }
+
+    if (status == CS_SUCCESS) {
+        mem->stats.NumFrees++;
+    }
+    return status;
+}
+
+/*-***************
+ * Host mappings *
+ *-***************/
+
+/**
+ * @brief Maps the device memory window (the PCI BAR of the CSx that holds
+ * addr) once for the CSx. The sysfs resource file is used, with write-combining
+ * if the BAR is prefetchable, so /dev/mem is not needed (access to the sysfs
+ * files can be granted to non root users with a udev rule).
+ * */
+static CS_STATUS tsp_window_map(tsp_device_st *dev, u64 addr) {
+    char ctrl_path[PATH_MAX];
+    char path[PATH_MAX + 32];
+    unsigned long long start, end, flags;
+    CS_STATUS status;
+    FILE *resources;
+    struct tsp_emu *emu;
+    int bar = -1;
+    int fd;
+
+    if (dev->window_state) {
+        return dev->window_state > 0 ? CS_SUCCESS : CS_COULD_NOT_MAP_MEMORY;
+    }
+    dev->window_state = -1;
+
+    // The window of an emulated CSx is its whole FDM
+    emu = tsp_emu_lookup(dev->fd);
+    if (emu) {
+        status = tsp_emu_map_window(emu, &dev->window_va, &dev->window_base, &dev->window_size);
+        if (status == CS_SUCCESS) {
+            dev->window_state = 1;
+        }
+        return status;
+    }
+
+    status = tsp_sysfs_ctrl_path(dev->fd, ctrl_path);
+    if (status != CS_SUCCESS) {
+        return CS_COULD_NOT_MAP_MEMORY;
+    }
+
+    // One line per resource : start end flags
+    snprintf(path, sizeof(path), "%s/device/resource", ctrl_path);
+    resources = fopen(path, "r");
+    if (!resources) {
+        return CS_COULD_NOT_MAP_MEMORY;
+    }
+    for (int i = 0; fscanf(resources, "%llx %llx %llx", &start, &end, &flags) == 3; ++i) {
+        if (end > start && addr >= start && addr <= end) {
+            bar = i;
+            break;
+        }
+    }
+    fclose(resources);
+    if (bar < 0) {
+        MSG_PRINT_DEBUG("FDM at 0x%016llx is not in a BAR of the CSx", (unsigned long long)addr);
+        return CS_COULD_NOT_MAP_MEMORY;
+    }
+
+    snprintf(path, sizeof(path), "%s/device/resource%d_wc", ctrl_path, bar);
+    fd = open(path, O_RDWR);
+    if (fd < 0) {
+        snprintf(path, sizeof(path), "%s/device/resource%d", ctrl_path, bar);
+        fd = open(path, O_RDWR | O_SYNC);
+    }
+    if (fd < 0) {
+        MSG_PRINT_WARNING("Could not open %s, do you have the rights ?", path);
+        return CS_COULD_NOT_MAP_MEMORY;
+    }
+
+    void *va = mmap(NULL, end - start + 1, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (va == MAP_FAILED) {
+        return CS_COULD_NOT_MAP_MEMORY;
+    }
+
+    dev->window_va = va;
+    dev->window_base = start;
+    dev->window_size = end - start + 1;
+    dev->window_state = 1;
+    MSG_PRINT_DEBUG("Mapped device memory window %s", path);
+    return CS_SUCCESS;
+}
+
+/* Maps a whole arena in the host address space (once) */
+static void *tsp_arena_map(tsp_device_st *dev, tsp_arena_st *a) {
+    if (a->va) {
+        return a->va;
+    }
+
+    // Prefer the device window, mapped once for all arenas
+    if (tsp_window_map(dev, a->base) == CS_SUCCESS &&
+        a->base >= dev->window_base &&
+        a->base + a->size <= dev->window_base + dev->window_size) {
+        a->va = (char *)dev->window_va + (a->base - dev->window_base);
+        a->va_owned = 0;
+        return a->va;
+    }
+
+    // Memory map it in userspace with /dev/mem
+    int fd = open("/dev/mem", O_RDWR | O_SYNC /* | O_DIRECT */);
+    if (fd < 0) {
+        return NULL;
+    }
+    void *mapped_mem = mmap(NULL, a->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)a->base /* offset */);
+    /* man mmap(2) :
+    * After the mmap() call has returned, the file descriptor, fd, can
+    * be closed immediately without invalidating the mapping. */
+    close(fd);
+    if (mapped_mem == MAP_FAILED) {
+        // errno holds more information
+        return NULL;
+    }
+    a->va = mapped_mem;
+    a->va_owned = 1;
+    return a->va;
+}
+
+/**
+ * @brief Returns the live allocation of an arena that holds addr, its first
+ * byte and size (the size of its block, slab object or direct allocation)
+ * @return 0 if addr is not in an allocation
+ * */
+static int tsp_arena_block(const tsp_arena_st *a, u64 addr, u64 *start, u64 *size) {
+    u64 offset = addr - a->base;
+    u32 page = offset >> TSP_PAGE_SHIFT;
+
+    if (a->direct) {
+        *start = a->base;
+        *size = a->size;
+        return 1;
+    }
+
+    // The first page of the block holds its state, blocks are aligned on their size
+    for (u32 o = 0; o <= a->max_order; ++o) {
+        u32 first = page & ~((1U << o) - 1);
+        u8 state = a->state[first];
+
+        if (!(state & (TSP_BLOCK_USED | TSP_BLOCK_FREE)) || (state & TSP_BLOCK_ORDER) < o) {
+            continue;
+        }
+        if (!(state & TSP_BLOCK_USED)) {
+            return 0;
+        }
+        if (a->slab[first]) {
+            const tsp_slab_st *sl = a->slab[first];
+            u32 shift = TSP_SLAB_MIN_SHIFT + sl->class;
+            u32 obj = (offset & (TSP_PAGE_SIZE - 1)) >> shift;
+
+            if (obj >= slab_objs(sl->class) || (sl->free_map & (1ULL << obj))) {
+                return 0;
+            }
+            *start = a->base + ((u64)first << TSP_PAGE_SHIFT) + ((u64)obj << shift);
+            *size = 1ULL << shift;
+            return 1;
+        }
+        *start = a->base + ((u64)first << TSP_PAGE_SHIFT);
+        *size = TSP_PAGE_SIZE << (state & TSP_BLOCK_ORDER);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Host address of [addr, addr + bytes) in the FDM, the range has to be
+ * inside a single live allocation, owner is set to the context of the CSx
+ * */
+static CS_STATUS tsp_mem_lookup_va(u64 addr, u64 bytes, void **va, tsp_device_st **owner) {
+    for (tsp_device_st *dev = tsp_device_next(0); dev; dev = tsp_device_next(dev->fd + 1)) {
+        CS_STATUS status = CS_COULD_NOT_MAP_MEMORY;
+        u64 start, size;
+        void *arena_va;
+
+        pthread_mutex_lock(&dev->mem_lock);
+        tsp_arena_st *a = dev->mem ? tsp_arena_find(dev->mem, addr) : NULL;
+        if (a) {
+            if (!tsp_arena_block(a, addr, &start, &size)) {
+                status = CS_UNKNOWN_MEMORY;
+            } else if (bytes > start + size - addr) {
+                status = CS_INVALID_LENGTH;
+            } else if ((arena_va = tsp_arena_map(dev, a))) {
+                *va = (char *)arena_va + (addr - a->base);
+                *owner = dev;
+                status = CS_SUCCESS;
+            }
+        }
+        pthread_mutex_unlock(&dev->mem_lock);
+        if (a) {
+            return status;
+        }
+    }
+    return CS_UNKNOWN_MEMORY;
+}
+
+/**
+ * @brief Copies to the device memory, the write-combining buffers are flushed
+ * before returning so that the data is visible to the device.
+ * */
+static void tsp_copy_to_device(void *dst, const void *src, size_t bytes) {
+    memcpy(dst, src, bytes);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Copies from the device memory, the mapping is uncached (or write
+ * combining) so streaming loads are used when available, these fetch whole
+ * lines instead of individual words.
+ * */
+static void tsp_copy_from_device(void *dst, const void *src, size_t bytes) {
+#if defined(__SSE4_1__)
+    if (!(((uintptr_t)src | (uintptr_t)dst) & 15)) {
+        __m128i *d = (__m128i *)dst;
+        __m128i *s = (__m128i *)src;
+        for (; bytes >= 64; bytes -= 64, d += 4, s += 4) {
+            __m128i x0 = _mm_stream_load_si128(s);
+            __m128i x1 = _mm_stream_load_si128(s + 1);
+            __m128i x2 = _mm_stream_load_si128(s + 2);
+            __m128i x3 = _mm_stream_load_si128(s + 3);
+            _mm_store_si128(d, x0);
+            _mm_store_si128(d + 1, x1);
+            _mm_store_si128(d + 2, x2);
+            _mm_store_si128(d + 3, x3);
+        }
+        dst = d;
+        src = s;
+    }
+#endif
+    memcpy(dst, src, bytes);
+}
+
+void tsp_mem_release(tsp_device_st *dev) {
+    struct tsp_mem *mem = dev->mem;
+
+    while (mem && mem->arenas) {
+        tsp_arena_st *a = mem->arenas;
+        mem->arenas = a->next;
+        if (!a->direct) {
+            for (u32 i = 0; i < a->npages; ++i) {
+                free(a->slab[i]);
+            }
+        }
+        tsp_arena_destroy(dev->fd, a);
+    }
+    free(mem);
+    dev->mem = NULL;
+
+    if (dev->window_state > 0) {
+        munmap(dev->window_va, dev->window_size);
+    }
+    dev->window_state = 0;
+}
+
+/**
+ * @copydoc csAllocMem
+ * */
+CS_STATUS csAllocMem(CS_DEV_HANDLE DevHandle, int Bytes, unsigned int MemFlags,
+                     CS_MEM_HANDLE *MemHandle, CS_MEM_PTR *VAddressPtr) {
+    tsp_device_st *dev;
+    tsp_arena_st *arena;
+    CS_STATUS status;
+    u64 addr;
+
+    if (Bytes <= 0 || !MemHandle) {
+        return CS_INVALID_ARG;
+    }
+
+    dev = tsp_device_get(DevHandle);
+    if (!dev) {
+        return CS_INVALID_HANDLE;
+    }
+
+    pthread_mutex_lock(&dev->mem_lock);
+    status = tsp_mem_init(dev);
+    if (status == CS_SUCCESS) {
+        status = tsp_mem_alloc(dev, Bytes, &addr, &arena);
+    }
+    if (status == CS_SUCCESS && VAddressPtr) {
+        // The memory window (or arena) is mapped once, allocations are offsets in it
+        void *va = tsp_arena_map(dev, arena);
+        if (!va) {
+            tsp_mem_free(dev, arena, addr);
+            status = CS_COULD_NOT_MAP_MEMORY;
+        } else {
+            *VAddressPtr = (char *)va + (addr - arena->base);
+        }
+    }
+    pthread_mutex_unlock(&dev->mem_lock);
+
+    if (status == CS_SUCCESS) {
+        *MemHandle = (CS_MEM_HANDLE)addr;
+    }
+    return status;
+}
+
+/**
+ * @copydoc csFreeMem
+ * @note memory handles are device addresses, if several CSx are open the
+ * handle is freed from the first CSx that holds an arena covering it.
+ * */
+CS_STATUS csFreeMem(CS_MEM_HANDLE MemHandle) {
+    u64 addr = (u64)MemHandle;
+
+    tsp_memo_written(MemHandle, 0, UINT64_MAX);
+
+    for (tsp_device_st *dev = tsp_device_next(0); dev; dev = tsp_device_next(dev->fd + 1)) {
+        pthread_mutex_lock(&dev->mem_lock);
+        tsp_arena_st *a = dev->mem ? tsp_arena_find(dev->mem, addr) : NULL;
+        CS_STATUS status = a ? tsp_mem_free(dev, a, addr) : CS_INVALID_HANDLE;
+        pthread_mutex_unlock(&dev->mem_lock);
+        if (a) {
+            return status;
+        }
+    }
+
+    return CS_INVALID_HANDLE;
+}
+
+/**
+ * @copydoc csTspQueryMemStats
+ * */
+CS_STATUS csTspQueryMemStats(CS_DEV_HANDLE DevHandle, CsTspMemStats *Stats) {
+    tsp_device_st *dev;
+
+    if (!Stats) {
+        return CS_INVALID_ARG;
+    }
+    dev = tsp_device_get(DevHandle);
+    if (!dev) {
+        return CS_INVALID_HANDLE;
+    }
+
+    memset(Stats, 0, sizeof(CsTspMemStats));
+    pthread_mutex_lock(&dev->mem_lock);
+    if (dev->mem) {
+        *Stats = dev->mem->stats;
+        Stats->ArenaBytes = 0;
+        Stats->FreeBytes = 0;
+        Stats->LargestFreeBlock = 0;
+        Stats->NumArenas = 0;
+        for (tsp_arena_st *a = dev->mem->arenas; a; a = a->next) {
+            Stats->NumArenas++;
+            Stats->ArenaBytes += a->size;
+            if (a->direct) {
+                continue;
+            }
+            Stats->FreeBytes += a->free_bytes;
+            for (int o = a->max_order; o >= 0; --o) {
+                if (a->free_head[o] != TSP_NO_PAGE) {
+                    u64 block = TSP_PAGE_SIZE << o;
+                    if (block > Stats->LargestFreeBlock) {
+                        Stats->LargestFreeBlock = block;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+    pthread_mutex_unlock(&dev->mem_lock);
+
+    if (Stats->FreeBytes) {
+        Stats->ExternalFragmentation = 1000 - (Stats->LargestFreeBlock * 1000) / Stats->FreeBytes;
+    }
+    if (Stats->UsedBytes) {
+        Stats->InternalFragmentation = 1000 - (Stats->RequestedBytes * 1000) / Stats->UsedBytes;
+    }
+    return CS_SUCCESS;
+}
+
+CS_STATUS tsp_mem_copy(const CsCopyMemRequest *CopyReq) {
+    tsp_device_st *dev;
+    CS_STATUS status;
+    void *va;
+
+    if (CopyReq->DevMem.ByteOffset > UINT64_MAX - (u64)CopyReq->DevMem.MemHandle) {
+        return CS_INVALID_LENGTH;
+    }
+    status = tsp_mem_lookup_va(CopyReq->DevMem.MemHandle + CopyReq->DevMem.ByteOffset,
+                               CopyReq->Bytes, &va, &dev);
+    if (status != CS_SUCCESS) {
+        return status;
+    }
+
+    switch (CopyReq->Type) {
+    case CS_COPY_TO_DEVICE:
+        tsp_copy_to_device(va, CopyReq->HostVAddress, CopyReq->Bytes);
+        __atomic_add_fetch(&dev->host_to_fdm, CopyReq->Bytes, __ATOMIC_RELAXED);
+        break;
+    case CS_COPY_FROM_DEVICE:
+        tsp_copy_from_device(CopyReq->HostVAddress, va, CopyReq->Bytes);
+        __atomic_add_fetch(&dev->fdm_to_host, CopyReq->Bytes, __ATOMIC_RELAXED);
+        break;
+    default:
+        return CS_INVALID_OPTION;
+    }
+
+    return CS_SUCCESS;
+}
+
+/**
+ * @copydoc csQueueCopyMemRequest
+ * @note the copy is done by the host through the mapping of the device memory
+ * window before this function returns, asynchronous requests (CallbackFn or
+ * EventHandle) are completed with its status and CS_QUEUED is returned
+ * @note CompValue is set to the number of bytes copied
+ * */
+CS_STATUS csQueueCopyMemRequest(CsCopyMemRequest *CopyReq, void *Context,
+                                csQueueCallbackFn CallbackFn,
+                                CS_EVT_HANDLE EventHandle,
+                                u32 *CompValue) {
+    CS_STATUS status;
+
+    if (!CopyReq || !CopyReq->HostVAddress) {
+        return CS_INVALID_ARG;
+    }
+    if (EventHandle) {
+        tsp_event_arm(EventHandle);
+    }
+
+    status = tsp_mem_copy(CopyReq);
+    if (status == CS_SUCCESS && CopyReq->Type == CS_COPY_TO_DEVICE) {
+        // The FDM does not hold what was loaded from storage anymore
+        tsp_memo_written(CopyReq->DevMem.MemHandle, CopyReq->DevMem.ByteOffset, CopyReq->Bytes);
+    }
+    if (CompValue) {
+        *CompValue = status == CS_SUCCESS ? CopyReq->Bytes : 0;
+    }
+
+    if (!CallbackFn && !EventHandle) {
+        return status;
+    }
+    if (EventHandle) {
+        tsp_event_signal(EventHandle, status);
+    }
+    if (CallbackFn) {
+        CallbackFn(Context, status);
+    }
+    return CS_QUEUED;
+}
@@ -0,0 +1,687 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Result cache of the deterministic functions (memoization).
+ *
+ * A request is identified by its function, its values and the identity of the
+ * data in its input FDM arguments. The library knows the identity of the FDM
+ * that was loaded from storage : the extents it was loaded from and the write
+ * generation of these extents, returned by the device with the load (see
+ * TSP_STORAGE_GEN_VALID). Loading the same extents again gives the same
+ * identity as long as nothing was written to them, the result of a request on
+ * these inputs is then served from the cache without any command. The FDM
+ * written by the host or by other requests loses its identity.
+ *
+ * The result of a memoized function is its last FDM argument, it is read from
+ * the FDM once the request completed and written back to the FDM on a hit,
+ * through the host mapping of the device memory.
+ *
+ * The FDM belongs to the controller, so do the identities, the memoized
+ * functions and the results : they are shared by the handles of a controller
+ * (CSx and CSEs) and are identified by its id, which is never reused.
+ * */
+
+#include "cs.h"
+#include "cs_tsp.h"
+#include "tsp.h"
+#include "tsp_device.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define TSP_MEMO_MAX_ORIGINS 256
+#define TSP_MEMO_MAX_FUNCTIONS 64
+#define TSP_MEMO_MAX_ARGS 32
+#define TSP_MEMO_BUCKETS 4096
+/* Logical block size assumed when the extent list does not give it, the
+ * smallest one, so that the loaded bytes are never overestimated */
+#define TSP_MEMO_LBA_SHIFT 9
+
+/* Identity of FDM loaded from storage */
+typedef struct {
+    int used;
+    u64 ctrl;
+    CS_MEM_HANDLE mem;
+    u64 offset;        /* FDM holding the data */
+    u64 bytes;
+    u32 nsid;
+    u64 start;         /* bytes of the namespace spanned by the extents */
+    u64 end;
+    u64 digest;        /* of the extent lists */
+    u64 generation;
+} tsp_memo_origin_st;
+
+typedef struct {
+    u64 ctrl;
+    CS_FUNCTION_ID id;
+    u32 result_bytes;
+} tsp_memo_function_st;
+
+typedef struct tsp_memo_entry {
+    struct tsp_memo_entry *hnext; /* bucket chain */
+    struct tsp_memo_entry *prev;  /* LRU list, most recently used first */
+    struct tsp_memo_entry *next;
+    u64 hash;
+    u64 ctrl;
+    u32 nsid;                     /* inputs loaded from [start, end) of nsid */
+    u64 start;
+    u64 end;
+    u64 size;                     /* memory used by the entry */
+    u32 key_words;
+    u32 result_bytes;
+    u64 data[];                   /* key words then the result */
+} tsp_memo_entry_st;
+
+/* Key of a request that may be cached, see tsp_memo_lookup() */
+struct tsp_memo_key {
+    u64 hash;
+    u64 ctrl;
+    u32 nsid;
+    u64 start;
+    u64 end;
+    CsDevAFDM result;
+    u32 result_bytes;
+    u32 key_words;
+    u64 words[];
+};
+
+static struct {
+    pthread_mutex_t lock;
+    u64 max_bytes;                /* 0 : disabled, also read without the lock */
+    tsp_memo_entry_st **buckets;
+    tsp_memo_entry_st *lru_head;
+    tsp_memo_entry_st *lru_tail;
+    tsp_memo_origin_st origins[TSP_MEMO_MAX_ORIGINS];
+    u32 next_origin;
+    tsp_memo_function_st functions[TSP_MEMO_MAX_FUNCTIONS];
+    int num_functions;
+    CsTspMemoStats stats;
+} tsp_memo = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static int tsp_memo_enabled(void) {
+    return __atomic_load_n(&tsp_memo.max_bytes, __ATOMIC_RELAXED) != 0;
+}
+
+static u64 tsp_memo_mix(u64 h, u64 v) {
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    return h ^ (h >> 33);
+}
+
+static u64 tsp_memo_end(u64 offset, u64 bytes) {
+    return bytes > UINT64_MAX - offset ? UINT64_MAX : offset + bytes;
+}
+
+/*-*********
+ * Entries *
+ *-*********/
+
+static void tsp_memo_lru_unlink(tsp_memo_entry_st *e) {
+    if (e->prev) {
+        e->prev->next = e->next;
+    } else {
+        tsp_memo.lru_head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    } else {
+        tsp_memo.lru_tail = e->prev;
+    }
+}
+
+static void tsp_memo_lru_push(tsp_memo_entry_st *e) {
+    e->prev = NULL;
+    e->next = tsp_memo.lru_head;
+    if (e->next) {
+        e->next->prev = e;
+    } else {
+        tsp_memo.lru_tail = e;
+    }
+    tsp_memo.lru_head = e;
+}
+
+static void tsp_memo_drop(tsp_memo_entry_st *e) {
+    tsp_memo_entry_st **link = &tsp_memo.buckets[e->hash % TSP_MEMO_BUCKETS];
+
+    while (*link != e) {
+        link = &(*link)->hnext;
+    }
+    *link = e->hnext;
+    tsp_memo_lru_unlink(e);
+    tsp_memo.stats.Entries--;
+    tsp_memo.stats.Bytes -= e->size;
+    free(e);
+}
+
+/* Drops the least recently used entries until bytes more fit */
+static void tsp_memo_evict(u64 bytes) {
+    while (tsp_memo.lru_tail && tsp_memo.stats.Bytes + bytes > tsp_memo.max_bytes) {
+        tsp_memo_drop(tsp_memo.lru_tail);
+        tsp_memo.stats.Evictions++;
+    }
+}
+
+static tsp_memo_entry_st *tsp_memo_find(const struct tsp_memo_key *key) {
+    tsp_memo_entry_st *e = tsp_memo.buckets[key->hash % TSP_MEMO_BUCKETS];
+
+    for (; e; e = e->hnext) {
+        if (e->hash == key->hash && e->key_words == key->key_words &&
+            !memcmp(e->data, key->words, key->key_words * sizeof(u64))) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/*-*********
+ * Origins *
+ *-*********/
+
+/* Forgets the identity of the FDM in [offset, offset + bytes) of mem */
+static void tsp_memo_forget(CS_MEM_HANDLE mem, u64 offset, u64 bytes) {
+    u64 end = tsp_memo_end(offset, bytes);
+
+    for (int i = 0; i < TSP_MEMO_MAX_ORIGINS; ++i) {
+        tsp_memo_origin_st *o = &tsp_memo.origins[i];
+        if (o->used && o->mem == mem && o->offset < end && offset < tsp_memo_end(o->offset, o->bytes)) {
+            o->used = 0;
+        }
+    }
+}
+
+/* Id of the controller of a handle, 0 if the handle is not valid */
+static u64 tsp_memo_ctrl(CS_DEV_HANDLE fd) {
+    tsp_device_st *dev = tsp_device_get(fd);
+    return dev ? dev->ctrl->id : 0;
+}
+
+static tsp_memo_origin_st *tsp_memo_origin(u64 ctrl, const CsDevAFDM *dev_mem) {
+    for (int i = 0; i < TSP_MEMO_MAX_ORIGINS; ++i) {
+        tsp_memo_origin_st *o = &tsp_memo.origins[i];
+        if (o->used && o->ctrl == ctrl && o->mem == dev_mem->MemHandle &&
+            dev_mem->ByteOffset >= o->offset && dev_mem->ByteOffset - o->offset < o->bytes) {
+            return o;
+        }
+    }
+    return NULL;
+}
+
+static tsp_memo_origin_st *tsp_memo_new_origin(void) {
+    for (int i = 0; i < TSP_MEMO_MAX_ORIGINS; ++i) {
+        if (!tsp_memo.origins[i].used) {
+            return &tsp_memo.origins[i];
+        }
+    }
+    return &tsp_memo.origins[tsp_memo.next_origin++ % TSP_MEMO_MAX_ORIGINS];
+}
+
+void tsp_memo_storage(CS_DEV_HANDLE fd, CS_STORAGE_IO_TYPE type, const TspExtentList *list,
+                      u32 result, int append) {
+    u32 shift = list->LbaShift ? list->LbaShift : TSP_MEMO_LBA_SHIFT;
+    u64 digest = 0, bytes = 0, start = UINT64_MAX, end = 0;
+    tsp_memo_origin_st *o = NULL;
+    u64 ctrl;
+
+    if (!tsp_memo_enabled()) {
+        return;
+    }
+    ctrl = tsp_memo_ctrl(fd);
+
+    digest = tsp_memo_mix(tsp_memo_mix(list->NamespaceId, shift), list->HeadBytes);
+    for (u32 i = 0; i < list->NumExtents; ++i) {
+        const TspExtent *e = &list->Extents[i];
+        digest = tsp_memo_mix(tsp_memo_mix(tsp_memo_mix(digest, e->Lba), e->NumBlocks), e->Flags);
+        bytes += (u64)e->NumBlocks << shift;
+        start = e->Lba << shift < start ? e->Lba << shift : start;
+        end = (e->Lba + e->NumBlocks) << shift > end ? (e->Lba + e->NumBlocks) << shift : end;
+    }
+    bytes = bytes > list->HeadBytes ? bytes - list->HeadBytes : 0;
+    if (list->Bytes && list->Bytes < bytes) {
+        bytes = list->Bytes;
+    }
+    digest = tsp_memo_mix(digest, bytes);
+
+    pthread_mutex_lock(&tsp_memo.lock);
+    if (type == CS_STORAGE_STORE_TYPE) {
+        // The results computed on the previous content are stale
+        for (tsp_memo_entry_st *e = tsp_memo.lru_head, *next; e; e = next) {
+            next = e->next;
+            if (e->end && e->nsid == list->NamespaceId && e->start < end && start < e->end) {
+                tsp_memo_drop(e);
+                tsp_memo.stats.Invalidations++;
+            }
+        }
+        pthread_mutex_unlock(&tsp_memo.lock);
+        return;
+    }
+
+    // A load continuing the previous one (same request) extends its identity
+    if (append) {
+        for (int i = 0; i < TSP_MEMO_MAX_ORIGINS && !o; ++i) {
+            tsp_memo_origin_st *p = &tsp_memo.origins[i];
+            if (p->used && p->ctrl == ctrl && p->mem == list->DevMem.MemHandle &&
+                p->offset + p->bytes == list->DevMem.ByteOffset && p->nsid == list->NamespaceId) {
+                o = p;
+            }
+        }
+    }
+    tsp_memo_forget(list->DevMem.MemHandle, list->DevMem.ByteOffset, bytes);
+    if (!(result & TSP_STORAGE_GEN_VALID) || !bytes) {
+        // Without generation, the data cannot be identified
+        if (o) {
+            o->used = 0;
+        }
+    } else if (o) {
+        o->used = 1;
+        o->bytes += bytes;
+        o->digest = tsp_memo_mix(o->digest, digest);
+        o->generation = tsp_memo_mix(o->generation, result);
+        o->start = start < o->start ? start : o->start;
+        o->end = end > o->end ? end : o->end;
+    } else {
+        o = tsp_memo_new_origin();
+        *o = (tsp_memo_origin_st) {
+            .used = 1,
+            .ctrl = ctrl,
+            .mem = list->DevMem.MemHandle,
+            .offset = list->DevMem.ByteOffset,
+            .bytes = bytes,
+            .nsid = list->NamespaceId,
+            .start = start,
+            .end = end,
+            .digest = digest,
+            .generation = result,
+        };
+    }
+    pthread_mutex_unlock(&tsp_memo.lock);
+}
+
+void tsp_memo_written(CS_MEM_HANDLE mem, u64 offset, u64 bytes) {
+    if (!tsp_memo_enabled()) {
+        return;
+    }
+    pthread_mutex_lock(&tsp_memo.lock);
+    tsp_memo_forget(mem, offset, bytes);
+    pthread_mutex_unlock(&tsp_memo.lock);
+}
+
+void tsp_memo_invalidate_args(CsComputeRequest **reqs, int n) {
+    if (!tsp_memo_enabled()) {
+        return;
+    }
+    // The functions may write anywhere after their FDM arguments
+    pthread_mutex_lock(&tsp_memo.lock);
+    for (int r = 0; r < n; ++r) {
+        for (int i = 0; i < reqs[r]->NumArgs; ++i) {
+            const CsComputeArg *arg = &reqs[r]->Args[i];
+            if (arg->Type == CS_AFDM_TYPE) {
+                tsp_memo_forget(arg->u.DevMem.MemHandle, arg->u.DevMem.ByteOffset, UINT64_MAX);
+            }
+        }
+    }
+    pthread_mutex_unlock(&tsp_memo.lock);
+}
+
+void tsp_memo_invalidate_device(CS_DEV_HANDLE fd) {
+    u64 ctrl;
+
+    if (!tsp_memo_enabled()) {
+        return;
+    }
+    ctrl = tsp_memo_ctrl(fd);
+    pthread_mutex_lock(&tsp_memo.lock);
+    for (int i = 0; i < TSP_MEMO_MAX_ORIGINS; ++i) {
+        if (tsp_memo.origins[i].ctrl == ctrl) {
+            tsp_memo.origins[i].used = 0;
+        }
+    }
+    pthread_mutex_unlock(&tsp_memo.lock);
+}
+
+void tsp_memo_freed(CS_MEM_HANDLE base, u64 bytes) {
+    u64 end = tsp_memo_end((u64)base, bytes);
+
+    if (!tsp_memo_enabled()) {
+        return;
+    }
+    pthread_mutex_lock(&tsp_memo.lock);
+    for (int i = 0; i < TSP_MEMO_MAX_ORIGINS; ++i) {
+        tsp_memo_origin_st *o = &tsp_memo.origins[i];
+        if (o->used && (u64)o->mem >= (u64)base && (u64)o->mem < end) {
+            o->used = 0;
+        }
+    }
+    pthread_mutex_unlock(&tsp_memo.lock);
+}
+
+void tsp_memo_release(u64 ctrl) {
+    int n = 0;
+
+    pthread_mutex_lock(&tsp_memo.lock);
+    for (int i = 0; i < TSP_MEMO_MAX_ORIGINS; ++i) {
+        if (tsp_memo.origins[i].ctrl == ctrl) {
+            tsp_memo.origins[i].used = 0;
+        }
+    }
+    for (int i = 0; i < tsp_memo.num_functions; ++i) {
+        if (tsp_memo.functions[i].ctrl != ctrl) {
+            tsp_memo.functions[n++] = tsp_memo.functions[i];
+        }
+    }
+    tsp_memo.num_functions = n;
+    for (tsp_memo_entry_st *e = tsp_memo.lru_head, *next; e; e = next) {
+        next = e->next;
+        if (e->ctrl == ctrl) {
+            tsp_memo_drop(e);
+        }
+    }
+    pthread_mutex_unlock(&tsp_memo.lock);
+}
+
+/*-**********
+ * Requests *
+ *-**********/
+
+static const tsp_memo_function_st *tsp_memo_function(u64 ctrl, CS_FUNCTION_ID id) {
+    for (int i = 0; i < tsp_memo.num_functions; ++i) {
+        if (tsp_memo.functions[i].ctrl == ctrl && tsp_memo.functions[i].id == id) {
+            return &tsp_memo.functions[i];
+        }
+    }
+    return NULL;
+}
+
+/* Builds the key of a request of a memoized function, with tsp_memo.lock held
+ * @return 0 if the inputs of the request cannot be identified */
+static int tsp_memo_key(const CsComputeRequest *req, const tsp_memo_function_st *f, int out,
+                        struct tsp_memo_key *key) {
+    u64 *w = key->words;
+
+    key->ctrl = f->ctrl;
+    key->end = 0;
+    *w++ = f->ctrl;
+    *w++ = req->FunctionId;
+    *w++ = f->result_bytes;
+    *w++ = req->NumArgs;
+    for (int i = 0; i < req->NumArgs; ++i) {
+        const CsComputeArg *arg = &req->Args[i];
+        const tsp_memo_origin_st *o;
+
+        *w++ = arg->Type;
+        switch (arg->Type) {
+        case CS_32BIT_VALUE_TYPE:
+            *w++ = arg->u.Value32;
+            break;
+        case CS_64BIT_VALUE_TYPE:
+            *w++ = arg->u.Value64;
+            break;
+        case CS_AFDM_TYPE:
+            if (i == out) {
+                break;
+            }
+            o = tsp_memo_origin(f->ctrl, &arg->u.DevMem);
+            if (!o || (key->end && o->nsid != key->nsid)) {
+                return 0;
+            }
+            *w++ = o->digest;
+            *w++ = o->generation;
+            *w++ = o->bytes;
+            *w++ = arg->u.DevMem.ByteOffset - o->offset;
+            key->start = key->end && key->start < o->start ? key->start : o->start;
+            key->end = o->end > key->end ? o->end : key->end;
+            key->nsid = o->nsid;
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    key->key_words = w - key->words;
+    key->hash = 0;
+    for (u32 i = 0; i < key->key_words; ++i) {
+        key->hash = tsp_memo_mix(key->hash, key->words[i]);
+    }
+    return 1;
+}
+
+int tsp_memo_lookup(const CsComputeRequest *req, struct tsp_memo_key **key) {
+    const tsp_memo_function_st *f;
+    struct tsp_memo_key *k;
+    tsp_memo_entry_st *e;
+    int out = -1;
+    u64 ctrl;
+
+    *key = NULL;
+    if (!tsp_memo_enabled()) {
+        return 0;
+    }
+
+    ctrl = tsp_memo_ctrl(req->CSEHandle);
+    pthread_mutex_lock(&tsp_memo.lock);
+    f = ctrl ? tsp_memo_function(ctrl, req->FunctionId) : NULL;
+    if (!f) {
+        pthread_mutex_unlock(&tsp_memo.lock);
+        tsp_memo_invalidate_args((CsComputeRequest **)&req, 1);
+        return 0;
+    }
+
+    for (int i = 0; i < req->NumArgs; ++i) {
+        if (req->Args[i].Type == CS_AFDM_TYPE) {
+            out = i;
+        }
+    }
+    if (out < 0 || req->NumArgs > TSP_MEMO_MAX_ARGS) {
+        tsp_memo.stats.Uncacheable++;
+        pthread_mutex_unlock(&tsp_memo.lock);
+        return 0;
+    }
+    // Whether the result comes from the cache or not, it overwrites the FDM
+    tsp_memo_forget(req->Args[out].u.DevMem.MemHandle, req->Args[out].u.DevMem.ByteOffset,
+                    f->result_bytes);
+
+    // Type and up to 4 words per argument
+    k = malloc(sizeof(*k) + (4 + req->NumArgs * 5) * sizeof(u64));
+    if (!k || !tsp_memo_key(req, f, out, k)) {
+        tsp_memo.stats.Uncacheable++;
+        pthread_mutex_unlock(&tsp_memo.lock);
+        free(k);
+        return 0;
+    }
+    k->result = req->Args[out].u.DevMem;
+    k->result_bytes = f->result_bytes;
+
+    e = tsp_memo_find(k);
+    if (e) {
+        CsCopyMemRequest copy = {
+            .Type = CS_COPY_TO_DEVICE,
+            .HostVAddress = (u8 *)(e->data + e->key_words),
+            .DevMem = k->result,
+            .Bytes = e->result_bytes,
+        };
+        if (tsp_mem_copy(&copy) == CS_SUCCESS) {
+            tsp_memo_lru_unlink(e);
+            tsp_memo_lru_push(e);
+            tsp_memo.stats.Hits++;
+            pthread_mutex_unlock(&tsp_memo.lock);
+            free(k);
+            return 1;
+        }
+        // The FDM is not host visible, results can neither be read
+        tsp_memo.stats.Uncacheable++;
+        pthread_mutex_unlock(&tsp_memo.lock);
+        free(k);
+        return 0;
+    }
+
+    tsp_memo.stats.Misses++;
+    pthread_mutex_unlock(&tsp_memo.lock);
+    *key = k;
+    return 0;
+}
+
+void tsp_memo_insert(struct tsp_memo_key *key, CS_STATUS status) {
+    u64 size = key ? sizeof(tsp_memo_entry_st) + key->key_words * sizeof(u64) + key->result_bytes : 0;
+    tsp_memo_entry_st *e;
+
+    if (!key || status != CS_SUCCESS || !tsp_memo_enabled()) {
+        free(key);
+        return;
+    }
+
+    e = malloc(size);
+    if (!e) {
+        free(key);
+        return;
+    }
+    CsCopyMemRequest copy = {
+        .Type = CS_COPY_FROM_DEVICE,
+        .HostVAddress = (u8 *)(e->data + key->key_words),
+        .DevMem = key->result,
+        .Bytes = key->result_bytes,
+    };
+    if (tsp_mem_copy(&copy) != CS_SUCCESS) {
+        free(e);
+        free(key);
+        return;
+    }
+    e->hash = key->hash;
+    e->ctrl = key->ctrl;
+    e->nsid = key->nsid;
+    e->start = key->start;
+    e->end = key->end;
+    e->size = size;
+    e->key_words = key->key_words;
+    e->result_bytes = key->result_bytes;
+    memcpy(e->data, key->words, key->key_words * sizeof(u64));
+
+    pthread_mutex_lock(&tsp_memo.lock);
+    // Another thread may have computed the same result meanwhile
+    if (size > tsp_memo.max_bytes || !tsp_memo.buckets || tsp_memo_find(key)) {
+        pthread_mutex_unlock(&tsp_memo.lock);
+        free(e);
+        free(key);
+        return;
+    }
+    tsp_memo_evict(size);
+    e->hnext = tsp_memo.buckets[e->hash % TSP_MEMO_BUCKETS];
+    tsp_memo.buckets[e->hash % TSP_MEMO_BUCKETS] = e;
+    tsp_memo_lru_push(e);
+    tsp_memo.stats.Entries++;
+    tsp_memo.stats.Bytes += size;
+    tsp_memo.stats.Insertions++;
+    pthread_mutex_unlock(&tsp_memo.lock);
+    free(key);
+}
+
+/*-*****
+ * API *
+ *-*****/
+
+/**
+ * @copydoc csTspSetMemoCache
+ * */
+CS_STATUS csTspSetMemoCache(u64 MaxBytes) {
+    CS_STATUS status = CS_SUCCESS;
+
+    pthread_mutex_lock(&tsp_memo.lock);
+    if (MaxBytes && !tsp_memo.buckets) {
+        tsp_memo.buckets = calloc(TSP_MEMO_BUCKETS, sizeof(tsp_memo_entry_st *));
+        if (!tsp_memo.buckets) {
+            status = CS_NOT_ENOUGH_MEMORY;
+        }
+    }
+    if (status == CS_SUCCESS) {
+        __atomic_store_n(&tsp_memo.max_bytes, MaxBytes, __ATOMIC_RELAXED);
+        tsp_memo_evict(0);
+        if (!MaxBytes) {
+            // The identities are not tracked while disabled
+            memset(tsp_memo.origins, 0, sizeof(tsp_memo.origins));
+        }
+    }
+    pthread_mutex_unlock(&tsp_memo.lock);
+    return status;
+}
+
+/**
+ * @copydoc csTspMemoizeFunction
+ * */
+CS_STATUS csTspMemoizeFunction(CS_DEV_HANDLE DevHandle, CS_FUNCTION_ID FunctionId,
+                               u32 ResultBytes) {
+    CS_STATUS status = CS_SUCCESS;
+    u64 ctrl = tsp_memo_ctrl(DevHandle);
+    int i;
+
+    if (!ctrl) {
+        return CS_INVALID_HANDLE;
+    }
+
+    pthread_mutex_lock(&tsp_memo.lock);
+    for (i = 0; i < tsp_memo.num_functions; ++i) {
+        if (tsp_memo.functions[i].ctrl == ctrl && tsp_memo.functions[i].id == FunctionId) {
+            break;
+        }
+    }
+    if (!ResultBytes) {
+        if (i < tsp_memo.num_functions) {
+            tsp_memo.functions[i] = tsp_memo.functions[--tsp_memo.num_functions];
+        }
+    } else if (i == TSP_MEMO_MAX_FUNCTIONS) {
+        status = CS_NOT_ENOUGH_MEMORY;
+    } else {
+        tsp_memo.functions[i].ctrl = ctrl;
+        tsp_memo.functions[i].id = FunctionId;
+        tsp_memo.functions[i].result_bytes = ResultBytes;
+        if (i == tsp_memo.num_functions) {
+            tsp_memo.num_functions++;
+        }
+    }
+    pthread_mutex_unlock(&tsp_memo.lock);
+    return status;
+}
+
+/**
+ * @copydoc csTspQueryMemoStats
+ * */
+CS_STATUS csTspQueryMemoStats(CsTspMemoStats *Stats) {
+    u64 lookups;
+
+    if (!Stats) {
+        return CS_INVALID_ARG;
+    }
+    pthread_mutex_lock(&tsp_memo.lock);
+    *Stats = tsp_memo.stats;
+    Stats->MaxBytes = tsp_memo.max_bytes;
+    pthread_mutex_unlock(&tsp_memo.lock);
+
+    lookups = Stats->Hits + Stats->Misses;
+    Stats->HitRate = lookups ? (Stats->Hits * 1000) / lookups : 0;
+    return CS_SUCCESS;
+}
@@ -0,0 +1,541 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Shared-memory request rings.
+ *
+ * A submission and a completion ring live in the FDM of the CSx, mapped in the
+ * host address space. Compute requests are written to the submission ring with
+ * ordinary stores and the device is notified by a store to the doorbell, it
+ * polls the doorbell, executes the requests and posts their completions, which
+ * the host polls. Apart from the setup, no NVMe command is sent, this removes
+ * the per command overhead (system call, interrupt, DMA of the request) for
+ * small and frequent requests. See tsp.h for the layout.
+ *
+ * At most entries - 1 requests are in flight, so that the completion ring
+ * cannot overflow without the device having to know how far the host went.
+ * Command IDs index the host side state of the requests in flight.
+ * Completed asynchronous requests are taken off the ring and their IDs freed
+ * under the ring locks, their events and callbacks run once the locks are
+ * released, so that a callback can queue new requests.
+ *
+ * The device polls a single pair of rings, so they belong to the controller
+ * and are used by all its handles. Their FDM is allocated by the handle that
+ * enabled them, which disables them when it is closed. The threads using the
+ * rings hold the read side of the ring lock of the controller, disabling
+ * unpublishes the rings and takes the write side before they are stopped and
+ * freed.
+ * */
+
+#include "cs.h"
+#include "cs_tsp.h"
+#include "tsp.h"
+#include "tsp_device.h"
+#include "tsp_transport.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+/* Waiters spin on the completion ring for this long, then yield the CPU */
+#define TSP_RING_SPIN_NS 2000L
+/* The reaper of asynchronous requests sleeps this long between polls */
+#define TSP_RING_POLL_NS 10000L
+/* Asynchronous completions taken off the ring at once */
+#define TSP_RING_REAP_BATCH 32
+
+/* Host side state of a request in flight */
+typedef struct {
+    int sync;          /* a thread waits for the completion */
+    int done;          /* synchronous requests, set once completed */
+    u32 status;        /* device status */
+    CS_DEV_HANDLE fd;
+    void *Context;
+    csQueueCallbackFn CallbackFn;
+    CS_EVT_HANDLE EventHandle;
+    tsp_admit_ticket_st ticket;
+} tsp_ring_req_st;
+
+struct tsp_ring {
+    CS_DEV_HANDLE fd;         /* handle the rings were enabled by */
+    CS_MEM_HANDLE mem;
+    u32 entries;
+    TspRingDoorbell *db;
+    TspRingSqe *sq;
+    TspRingCqe *cq;
+    /* Submission, protected by sq_lock */
+    pthread_mutex_t sq_lock;
+    pthread_cond_t sq_cond;   /* signaled when a command ID is freed */
+    u32 sq_tail;
+    u16 *free_ids;
+    u32 num_free;
+    /* Completion, reaped by one thread at a time (holding cq_lock) */
+    pthread_mutex_t cq_lock;
+    u32 cq_head;
+    u16 phase;
+    tsp_ring_req_st *reqs;
+    /* Reaper of the asynchronous requests */
+    pthread_t reaper;
+    int reaper_started;
+    int stop;
+    u32 async_inflight;       /* protected by sq_lock */
+};
+
+static void tsp_ring_put_id(struct tsp_ring *r, u16 id) {
+    pthread_mutex_lock(&r->sq_lock);
+    r->free_ids[r->num_free++] = id;
+    // The reaper waits on the same condition
+    pthread_cond_broadcast(&r->sq_cond);
+    pthread_mutex_unlock(&r->sq_lock);
+}
+
+static CS_STATUS tsp_ring_status(u32 status) {
+    return status ? CS_ERROR_IN_EXECUTION : CS_SUCCESS;
+}
+
+/* Completes an asynchronous request taken off the ring, without any lock of
+ * the ring held : the callback may queue new requests */
+static void tsp_ring_complete_async(tsp_ring_req_st *req) {
+    CS_STATUS status = tsp_ring_status(req->status);
+
+    tsp_admit_release(&req->ticket);
+    tsp_device_busy(req->fd, -1);
+    tsp_admit_completion(1);
+    if (req->EventHandle) {
+        tsp_event_signal(req->EventHandle, status);
+    }
+    if (req->CallbackFn) {
+        req->CallbackFn(req->Context, status);
+    }
+    tsp_admit_completion(-1);
+}
+
+/**
+ * @brief Consumes the posted completions, called with cq_lock held. The
+ * synchronous requests are marked done, the asynchronous ones (up to
+ * TSP_RING_REAP_BATCH) are copied to done and their IDs freed, the caller
+ * completes them once cq_lock is released.
+ * @return number of completions consumed, *num_done of them are in done
+ * */
+static u32 tsp_ring_reap(struct tsp_ring *r, tsp_ring_req_st *done, u32 *num_done) {
+    u16 ids[TSP_RING_REAP_BATCH];
+    u32 consumed = 0, n = 0;
+
+    while (n < TSP_RING_REAP_BATCH) {
+        TspRingCqe *cqe = &r->cq[r->cq_head];
+        tsp_ring_req_st *req;
+        u16 id;
+
+        if (__atomic_load_n(&cqe->Phase, __ATOMIC_ACQUIRE) != r->phase) {
+            break;
+        }
+        id = cqe->CommandId;
+        if (++r->cq_head == r->entries) {
+            r->cq_head = 0;
+            r->phase ^= 1;
+        }
+        consumed++;
+        if (id >= r->entries) {
+            MSG_PRINT_ERROR("Completion for unknown command %u", id);
+            continue;
+        }
+
+        req = &r->reqs[id];
+        req->status = cqe->Status;
+        if (req->sync) {
+            __atomic_store_n(&req->done, 1, __ATOMIC_RELEASE);
+        } else {
+            done[n] = *req;
+            ids[n++] = id;
+        }
+    }
+
+    if (n) {
+        pthread_mutex_lock(&r->sq_lock);
+        for (u32 i = 0; i < n; ++i) {
+            r->free_ids[r->num_free++] = ids[i];
+        }
+        r->async_inflight -= n;
+        pthread_cond_broadcast(&r->sq_cond);
+        pthread_mutex_unlock(&r->sq_lock);
+    }
+    *num_done = n;
+    return consumed;
+}
+
+/**
+ * @brief Reaps the completions, waits for cq_lock if wait is set, gives up if
+ * another thread holds it otherwise. The asynchronous requests are completed
+ * once the lock is released.
+ * @return number of completions consumed
+ * */
+static u32 tsp_ring_poll(struct tsp_ring *r, int wait) {
+    tsp_ring_req_st done[TSP_RING_REAP_BATCH];
+    u32 consumed, n;
+
+    if (wait) {
+        pthread_mutex_lock(&r->cq_lock);
+    } else if (pthread_mutex_trylock(&r->cq_lock)) {
+        return 0;
+    }
+    consumed = tsp_ring_reap(r, done, &n);
+    pthread_mutex_unlock(&r->cq_lock);
+
+    for (u32 i = 0; i < n; ++i) {
+        tsp_ring_complete_async(&done[i]);
+    }
+    return consumed;
+}
+
+/* Polls the completions while asynchronous requests are in flight */
+static void *tsp_ring_reaper(void *arg) {
+    struct tsp_ring *r = arg;
+    const struct timespec poll = {.tv_nsec = TSP_RING_POLL_NS};
+
+    pthread_mutex_lock(&r->sq_lock);
+    while (!r->stop) {
+        if (!r->async_inflight) {
+            pthread_cond_wait(&r->sq_cond, &r->sq_lock);
+            continue;
+        }
+        pthread_mutex_unlock(&r->sq_lock);
+
+        if (!tsp_ring_poll(r, 1)) {
+            nanosleep(&poll, NULL);
+        }
+
+        pthread_mutex_lock(&r->sq_lock);
+    }
+    pthread_mutex_unlock(&r->sq_lock);
+    return NULL;
+}
+
+/* Writes the request in the submission ring and rings the doorbell */
+static int tsp_ring_submit(struct tsp_ring *r, const CsComputeRequest *request, size_t size,
+                           const tsp_ring_req_st *state) {
+    TspRingSqe *sqe;
+    struct timespec t;
+    u32 consumed;
+    u16 id;
+
+    pthread_mutex_lock(&r->sq_lock);
+    while (!r->num_free) {
+        // The caller may be the reaper (a completion callback), it reaps itself
+        pthread_mutex_unlock(&r->sq_lock);
+        consumed = tsp_ring_poll(r, 0);
+        pthread_mutex_lock(&r->sq_lock);
+        if (!consumed && !r->num_free) {
+            clock_gettime(CLOCK_REALTIME, &t);
+            t.tv_nsec += TSP_RING_POLL_NS;
+            if (t.tv_nsec >= 1000000000L) {
+                t.tv_sec++;
+                t.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&r->sq_cond, &r->sq_lock, &t);
+        }
+    }
+    id = r->free_ids[--r->num_free];
+    r->reqs[id] = *state;
+    if (!state->sync) {
+        r->async_inflight++;
+        pthread_cond_broadcast(&r->sq_cond);
+    }
+
+    sqe = &r->sq[r->sq_tail % r->entries];
+    sqe->CommandId = id;
+    sqe->Length = size;
+    memcpy(sqe->Request, request, size);
+    r->sq_tail++;
+    // The entry has to be visible (write combining buffers flushed) first
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    __atomic_store_n(&r->db->SqTail, r->sq_tail, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&r->sq_lock);
+
+    return id;
+}
+
+static u32 tsp_ring_wait(struct tsp_ring *r, u16 id) {
+    tsp_ring_req_st *req = &r->reqs[id];
+    struct timespec t0, t;
+    int spinning = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (!__atomic_load_n(&req->done, __ATOMIC_ACQUIRE)) {
+        if (tsp_ring_poll(r, 0) && __atomic_load_n(&req->done, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        if (spinning) {
+            clock_gettime(CLOCK_MONOTONIC, &t);
+            spinning = (t.tv_sec - t0.tv_sec) * 1000000000L + (t.tv_nsec - t0.tv_nsec) < TSP_RING_SPIN_NS;
+        } else {
+            // Long request, let the device (or the other threads) run
+            sched_yield();
+        }
+    }
+    return req->status;
+}
+
+CS_STATUS tsp_ring_compute(CsComputeRequest *req, size_t size, void *Context,
+                           csQueueCallbackFn CallbackFn, CS_EVT_HANDLE EventHandle) {
+    tsp_device_st *dev = tsp_device_get(req->CSEHandle);
+    tsp_ctrl_st *ctrl = dev ? dev->ctrl : NULL;
+    struct tsp_ring *r;
+    tsp_ring_req_st state = {
+        .sync = !CallbackFn && !EventHandle,
+        .fd = req->CSEHandle,
+        .Context = Context,
+        .CallbackFn = CallbackFn,
+        .EventHandle = EventHandle,
+    };
+    CS_FUNCTION_ID fid = req->FunctionId;
+    CS_STATUS status;
+    int id;
+
+    // Large requests are sent as commands
+    if (!ctrl || !__atomic_load_n(&ctrl->ring, __ATOMIC_ACQUIRE) ||
+        size > sizeof(((TspRingSqe *)0)->Request)) {
+        return CS_UNSUPPORTED;
+    }
+    // The rings are not freed while the lock is held
+    pthread_rwlock_rdlock(&ctrl->ring_lock);
+    r = __atomic_load_n(&ctrl->ring, __ATOMIC_ACQUIRE);
+    if (!r) {
+        pthread_rwlock_unlock(&ctrl->ring_lock);
+        return CS_UNSUPPORTED;
+    }
+    status = tsp_admit_acquire(req->CSEHandle, &fid, 1, &state.ticket);
+    if (status != CS_SUCCESS) {
+        pthread_rwlock_unlock(&ctrl->ring_lock);
+        return status;
+    }
+
+    if (EventHandle) {
+        tsp_event_arm(EventHandle);
+    }
+    tsp_device_busy(req->CSEHandle, 1);
+    id = tsp_ring_submit(r, req, size, &state);
+    if (!state.sync) {
+        // Disabling the rings waits for the requests in flight
+        pthread_rwlock_unlock(&ctrl->ring_lock);
+        return CS_QUEUED;
+    }
+
+    state.status = tsp_ring_wait(r, id);
+    tsp_admit_release(&state.ticket);
+    tsp_device_busy(req->CSEHandle, -1);
+    tsp_ring_put_id(r, id);
+    pthread_rwlock_unlock(&ctrl->ring_lock);
+    return tsp_ring_status(state.status);
+}
+
+/* Tells the device where the rings are (entries 0 : stop polling) */
+static int tsp_ring_setup_command(CS_DEV_HANDLE fd, u64 addr, u32 entries) {
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_RING_SETUP,
+        .cdw12 = (u32)addr,
+        .cdw13 = (u32)(addr >> 32),
+        .cdw14 = entries,
+        .cdw15 = TSP_RING_SQE_SIZE,
+        .dir = TSP_DIR_TO_DEV,
+    };
+
+    return tsp_submit(fd, &cmd);
+}
+
+static void tsp_ring_destroy(struct tsp_ring *r) {
+    if (r->reaper_started) {
+        pthread_mutex_lock(&r->sq_lock);
+        r->stop = 1;
+        pthread_cond_broadcast(&r->sq_cond);
+        pthread_mutex_unlock(&r->sq_lock);
+        pthread_join(r->reaper, NULL);
+    }
+    if (r->mem) {
+        csFreeMem(r->mem);
+    }
+    pthread_cond_destroy(&r->sq_cond);
+    pthread_mutex_destroy(&r->sq_lock);
+    pthread_mutex_destroy(&r->cq_lock);
+    free(r->free_ids);
+    free(r->reqs);
+    free(r);
+}
+
+/* Waits until the requests in flight completed and stops the device */
+static void tsp_ring_stop(struct tsp_ring *r) {
+    const struct timespec poll = {.tv_nsec = TSP_RING_POLL_NS};
+
+    pthread_mutex_lock(&r->sq_lock);
+    while (r->num_free != r->entries - 1) {
+        pthread_mutex_unlock(&r->sq_lock);
+        if (!tsp_ring_poll(r, 1)) {
+            nanosleep(&poll, NULL);
+        }
+        pthread_mutex_lock(&r->sq_lock);
+    }
+    pthread_mutex_unlock(&r->sq_lock);
+
+    if (tsp_ring_setup_command(r->fd, 0, 0)) {
+        MSG_PRINT_WARNING("CSx %d did not stop polling its request rings", r->fd);
+    }
+}
+
+/* Unpublishes the rings of the controller once no thread uses them, then
+ * stops and frees them. Called with ctrl->ring_setup held. */
+static void tsp_ring_disable(tsp_ctrl_st *ctrl) {
+    struct tsp_ring *r = ctrl->ring;
+
+    // New requests are sent as commands, the threads using the rings are waited for
+    __atomic_store_n(&ctrl->ring, NULL, __ATOMIC_RELEASE);
+    pthread_rwlock_wrlock(&ctrl->ring_lock);
+    pthread_rwlock_unlock(&ctrl->ring_lock);
+
+    // Completions of asynchronous requests may queue new ones, as commands
+    if (r) {
+        tsp_ring_stop(r);
+        tsp_ring_destroy(r);
+    }
+}
+
+void tsp_ring_release(tsp_device_st *dev) {
+    tsp_ctrl_st *ctrl = dev->ctrl;
+
+    pthread_mutex_lock(&ctrl->ring_setup);
+    if (ctrl->ring && ctrl->ring->fd == dev->fd) {
+        tsp_ring_disable(ctrl);
+    }
+    pthread_mutex_unlock(&ctrl->ring_setup);
+}
+
+/* Allocates the rings in the FDM of fd and tells the device to poll them */
+static CS_STATUS tsp_ring_create(CS_DEV_HANDLE fd, u32 NumEntries, struct tsp_ring **ring) {
+    struct tsp_ring *r;
+    CS_MEM_PTR va = NULL;
+    CS_STATUS status;
+
+    r = calloc(1, sizeof(struct tsp_ring));
+    if (!r) {
+        return CS_NOT_ENOUGH_MEMORY;
+    }
+    r->fd = fd;
+    pthread_mutex_init(&r->sq_lock, NULL);
+    pthread_mutex_init(&r->cq_lock, NULL);
+    pthread_cond_init(&r->sq_cond, NULL);
+    r->entries = NumEntries;
+    r->phase = 1;
+    r->reqs = calloc(NumEntries, sizeof(tsp_ring_req_st));
+    r->free_ids = malloc(NumEntries * sizeof(u16));
+    if (!r->reqs || !r->free_ids) {
+        tsp_ring_destroy(r);
+        return CS_NOT_ENOUGH_MEMORY;
+    }
+    // One ID less than entries, see above
+    for (u32 i = 0; i < NumEntries - 1; ++i) {
+        r->free_ids[r->num_free++] = NumEntries - 2 - i;
+    }
+
+    // The rings have to be host visible, the completions are zeroed (phase 0)
+    status = csAllocMem(fd, TSP_RING_BYTES(NumEntries), 0, &r->mem, &va);
+    if (status != CS_SUCCESS) {
+        r->mem = 0;
+        tsp_ring_destroy(r);
+        return status;
+    }
+    memset(va, 0, TSP_RING_BYTES(NumEntries));
+    r->db = (TspRingDoorbell *)va;
+    r->sq = (TspRingSqe *)(r->db + 1);
+    r->cq = (TspRingCqe *)(r->sq + NumEntries);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (pthread_create(&r->reaper, NULL, tsp_ring_reaper, r)) {
+        tsp_ring_destroy(r);
+        return CS_NOT_ENOUGH_MEMORY;
+    }
+    r->reaper_started = 1;
+
+    if (tsp_ring_setup_command(fd, (u64)r->mem, NumEntries)) {
+        MSG_PRINT_ERROR("CSx %d does not support request rings", fd);
+        tsp_ring_destroy(r);
+        return CS_DEVICE_NOT_AVAILABLE;
+    }
+
+    *ring = r;
+    return CS_SUCCESS;
+}
+
+/**
+ * @copydoc csTspEnableRequestRings
+ * */
+CS_STATUS csTspEnableRequestRings(CS_DEV_HANDLE DevHandle, u32 NumEntries) {
+    tsp_device_st *dev = tsp_device_get(DevHandle);
+    tsp_ctrl_st *ctrl;
+    struct tsp_ring *r;
+    CS_STATUS status;
+
+    if (!dev) {
+        return CS_INVALID_HANDLE;
+    }
+    if (NumEntries < 2 || NumEntries > TSP_RING_MAX_ENTRIES) {
+        return CS_INVALID_ARG;
+    }
+
+    ctrl = dev->ctrl;
+    pthread_mutex_lock(&ctrl->ring_setup);
+    if (ctrl->ring) {
+        status = CS_HANDLE_IN_USE;
+    } else {
+        status = tsp_ring_create(DevHandle, NumEntries, &r);
+    }
+    if (status == CS_SUCCESS) {
+        __atomic_store_n(&ctrl->ring, r, __ATOMIC_RELEASE);
+        MSG_PRINT_DEBUG("CSx %d uses request rings of %u entries", DevHandle, NumEntries);
+    }
+    pthread_mutex_unlock(&ctrl->ring_setup);
+    return status;
+}
+
+/**
+ * @copydoc csTspDisableRequestRings
+ * */
+CS_STATUS csTspDisableRequestRings(CS_DEV_HANDLE DevHandle) {
+    tsp_device_st *dev = tsp_device_get(DevHandle);
+    CS_STATUS status = CS_SUCCESS;
+
+    if (!dev) {
+        return CS_INVALID_HANDLE;
+    }
+
+    pthread_mutex_lock(&dev->ctrl->ring_setup);
+    if (dev->ctrl->ring) {
+        tsp_ring_disable(dev->ctrl);
+    } else {
+        status = CS_INVALID_ARG;
+    }
+    pthread_mutex_unlock(&dev->ctrl->ring_setup);
+    return status;
+}
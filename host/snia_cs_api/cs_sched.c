@@ -0,0 +1,152 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Scheduling of compute requests over several CSEs.
+ *
+ * A request that reads data from storage is sent to the CSE of the controller
+ * that holds the data, so that the data does not move between drives. Other
+ * requests (stateless functions, replicated data) go to the CSE with the fewest
+ * commands in flight, counted per controller over all of its handles.
+ * */
+
+#include "cs_tsp.h"
+#include "tsp_device.h"
+#include "debug.h"
+
+#include <string.h>
+#include <limits.h>
+
+#include <sys/stat.h>
+
+/* Rotates the starting point so that ties between idle CSEs are spread */
+static unsigned int tsp_sched_next;
+
+static CS_STATUS tsp_locality_ctrl_path(const CsTspDataLocality *Locality, char *ctrl_path) {
+    struct stat s;
+
+    if (fstat(Locality->Handle, &s) < 0) {
+        return CS_INVALID_HANDLE;
+    }
+
+    switch (Locality->Type) {
+    case CS_TSP_DATA_FILE:
+        // The file system is on a namespace (or a partition of it)
+        return tsp_sysfs_ctrl_path_dev(s.st_dev, 0, ctrl_path);
+    case CS_TSP_DATA_NAMESPACE:
+        if (!S_ISBLK(s.st_mode) && !S_ISCHR(s.st_mode)) {
+            return CS_INVALID_HANDLE;
+        }
+        return tsp_sysfs_ctrl_path_dev(s.st_rdev, S_ISCHR(s.st_mode), ctrl_path);
+    default:
+        return CS_INVALID_ARG;
+    }
+}
+
+/**
+ * @copydoc csTspSelectCSE
+ * */
+CS_STATUS csTspSelectCSE(int NumCSEs, CS_CSE_HANDLE *CSEs,
+                         const CsTspDataLocality *Locality,
+                         CS_CSE_HANDLE *CSEHandle) {
+    char data_path[PATH_MAX];
+    char cse_path[PATH_MAX];
+    int local[NumCSEs > 0 ? NumCSEs : 1];
+    int num_local = 0;
+    unsigned int start;
+    u32 best_load = UINT32_MAX;
+    int best = -1;
+
+    if (NumCSEs <= 0 || !CSEs || !CSEHandle) {
+        return CS_INVALID_ARG;
+    }
+
+    // Find the CSEs that hold the data
+    if (Locality && Locality->Type != CS_TSP_DATA_NONE && !Locality->Replicated) {
+        CS_STATUS status = tsp_locality_ctrl_path(Locality, data_path);
+        if (status != CS_SUCCESS) {
+            return status;
+        }
+
+        for (int i = 0; i < NumCSEs; ++i) {
+            if (tsp_cached_ctrl_path(CSEs[i], cse_path) == CS_SUCCESS &&
+                !strcmp(cse_path, data_path)) {
+                local[num_local++] = i;
+            }
+        }
+
+        if (!num_local) {
+            MSG_PRINT_DEBUG("Data on %s is not held by any of the CSEs", data_path);
+        }
+    }
+
+    // Otherwise any CSE will do
+    if (!num_local) {
+        for (int i = 0; i < NumCSEs; ++i) {
+            local[num_local++] = i;
+        }
+    }
+
+    // Least loaded of the candidates
+    start = __atomic_fetch_add(&tsp_sched_next, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < num_local; ++i) {
+        int idx = local[(start + i) % num_local];
+        tsp_device_st *dev = tsp_device_get(CSEs[idx]);
+        u32 load;
+
+        if (!dev) {
+            continue;
+        }
+        load = __atomic_load_n(&dev->ctrl->outstanding, __ATOMIC_RELAXED);
+        if (load < best_load) {
+            best_load = load;
+            best = idx;
+        }
+    }
+
+    if (best < 0) {
+        return CS_INVALID_HANDLE;
+    }
+
+    *CSEHandle = CSEs[best];
+    return CS_SUCCESS;
+}
+
+/**
+ * @copydoc csTspQueryCSELoad
+ * */
+CS_STATUS csTspQueryCSELoad(CS_CSE_HANDLE CSEHandle, u32 *Outstanding) {
+    tsp_device_st *dev = tsp_device_get(CSEHandle);
+
+    if (!dev) {
+        return CS_INVALID_HANDLE;
+    }
+    if (!Outstanding) {
+        return CS_INVALID_ARG;
+    }
+
+    *Outstanding = __atomic_load_n(&dev->ctrl->outstanding, __ATOMIC_RELAXED);
+    return CS_SUCCESS;
+}
@@ -0,0 +1,173 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Usage statistics of a CSx.
+ *
+ * The device keeps its counters per core without any lock and sums them when
+ * queried, a single TSP_CS_STATS command returns the counters of the CSE, of
+ * the FDM and of every function (see tsp.h). The copies between the host and
+ * the FDM go through the mapping of the device memory and are counted by the
+ * library instead.
+ * */
+
+#include "cs.h"
+#include "tsp.h"
+#include "cs_tsp.h"
+#include "tsp_device.h"
+#include "tsp_transport.h"
+#include "debug.h"
+
+#include <string.h>
+
+#define TSP_US_PER_MIN 60000000ULL
+
+/* Value of a host counter, the change since the last delta query if delta */
+static u64 tsp_stats_host(u64 *counter, u64 *base, int delta) {
+    u64 cur = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    return delta ? cur - __atomic_exchange_n(base, cur, __ATOMIC_RELAXED) : cur;
+}
+
+/**
+ * @copydoc csTspQueryDeviceStatistics
+ * */
+CS_STATUS csTspQueryDeviceStatistics(CS_DEV_HANDLE DevHandle, u32 Flags,
+                                     CsTspDeviceStats *Stats) {
+    char buffer[TSP_BUFFER_SIZE] __attribute__((aligned(8)));
+    const TspStats *st = (const TspStats *)buffer;
+    int delta = Flags & CS_TSP_STATS_DELTA;
+    tsp_device_st *dev;
+    u64 idle_us;
+    int ret;
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_GET,
+        .cdw11 = TSP_CS_STATS,
+        .cdw12 = delta ? TSP_STATS_DELTA : 0,
+        .dir = TSP_DIR_FROM_DEV,
+        .data_len = sizeof(buffer),
+        .data = buffer,
+    };
+
+    if (!Stats || (Flags & ~CS_TSP_STATS_DELTA)) {
+        return CS_INVALID_ARG;
+    }
+    dev = tsp_device_get(DevHandle);
+    if (!dev) {
+        return CS_INVALID_HANDLE;
+    }
+
+    memset(buffer, 0, sizeof(TspStats));
+    ret = tsp_submit_admin(DevHandle, &cmd);
+    if (ret) {
+        MSG_PRINT_ERROR("Could not query the statistics (status 0x%x)", ret);
+        return CS_DEVICE_NOT_AVAILABLE;
+    }
+    if (st->NumFunctions > TSP_STATS_MAX_FUNCTIONS) {
+        MSG_PRINT_ERROR("Invalid statistics, %u functions", st->NumFunctions);
+        return CS_DEVICE_NOT_AVAILABLE;
+    }
+
+    memset(Stats, 0, sizeof(CsTspDeviceStats));
+    Stats->IntervalUs = st->IntervalUs;
+    Stats->BusyUs = st->BusyNs / 1000;
+    idle_us = st->IntervalUs > Stats->BusyUs ? st->IntervalUs - Stats->BusyUs : 0;
+    Stats->Cse.PowerOnMins = st->PowerOnUs / TSP_US_PER_MIN;
+    Stats->Cse.IdleTimeMins = idle_us / TSP_US_PER_MIN;
+    Stats->Cse.TotalFunctionExecutions = st->Executions;
+
+    Stats->Memory.TotalAllocatedFDM = st->FdmAllocatedBytes;
+    Stats->Memory.LargestBlockAvailableFDM = st->FdmLargestFree;
+    if (st->FdmLiveAllocations) {
+        Stats->Memory.AverageAllocatedSizeFDM = st->FdmAllocatedBytes / st->FdmLiveAllocations;
+    }
+    Stats->Memory.TotalFreeCSFM = st->FdmFreeBytes;
+    Stats->Memory.TotalAllocationsFDM = st->FdmAllocations;
+    Stats->Memory.TotalDeAllocationsFDM = st->FdmDeallocations;
+    Stats->Memory.TotalFDMtoHostinMB = tsp_stats_host(&dev->fdm_to_host, &dev->fdm_to_host_base,
+                                                      delta) >> 20;
+    Stats->Memory.TotalHosttoFDMinMB = tsp_stats_host(&dev->host_to_fdm, &dev->host_to_fdm_base,
+                                                      delta) >> 20;
+    Stats->Memory.TotalFDMtoStorageinMB = st->FdmToStorageBytes >> 20;
+    Stats->Memory.TotalStoragetoFDMinMB = st->StorageToFdmBytes >> 20;
+
+    for (u32 i = 0; i < st->NumFunctions && i < CS_TSP_STATS_MAX_FUNCTIONS; ++i) {
+        const TspFunctionStats *f = &st->Functions[i];
+        CSFUsage *u = &Stats->Functions[i].Usage;
+
+        Stats->Functions[i].FunctionId = f->FunctionId;
+        u->TotalUptimeSeconds = f->TotalNs / 1000000000ULL;
+        u->TotalExecutions = f->Executions;
+        u->ShortestTimeUsecs = f->MinNs / 1000;
+        u->LongestTimeUsecs = f->MaxNs / 1000;
+        u->AverageTimeUsecs = f->Executions ? f->TotalNs / f->Executions / 1000 : 0;
+        Stats->NumFunctions++;
+    }
+
+    return CS_SUCCESS;
+}
+
+/**
+ * @copydoc csQueryDeviceStatistics
+ * @note the counters are those since the device was powered on, see
+ * csTspQueryDeviceStatistics() for the changes over an interval
+ * */
+CS_STATUS csQueryDeviceStatistics(CS_DEV_HANDLE DevHandle, CS_STAT_TYPE Type,
+                                  void *Identifier, CsStatsInfo *Stats) {
+    CsTspDeviceStats all;
+    CS_FUNCTION_ID id;
+    CS_STATUS status;
+
+    if (!Stats || (Type == CS_STAT_FUNCTION && !Identifier)) {
+        return CS_INVALID_ARG;
+    }
+    if (Type != CS_STAT_CSE_USAGE && Type != CS_STAT_CSx_MEM_USAGE && Type != CS_STAT_FUNCTION) {
+        return CS_INVALID_OPTION;
+    }
+
+    status = csTspQueryDeviceStatistics(DevHandle, 0, &all);
+    if (status != CS_SUCCESS) {
+        return status;
+    }
+
+    switch (Type) {
+    case CS_STAT_CSE_USAGE:
+        Stats->CSEDetails = all.Cse;
+        break;
+    case CS_STAT_CSx_MEM_USAGE:
+        Stats->MemoryDetails = all.Memory;
+        break;
+    default:
+        id = *(CS_FUNCTION_ID *)Identifier;
+        for (u32 i = 0; i < all.NumFunctions; ++i) {
+            if (all.Functions[i].FunctionId == id) {
+                Stats->FunctionDetails = all.Functions[i].Usage;
+                return CS_SUCCESS;
+            }
+        }
+        return CS_INVALID_FUNCTION;
+    }
+
+    return CS_SUCCESS;
+}
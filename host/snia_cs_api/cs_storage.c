@@ -0,0 +1,507 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Storage requests (csQueueStorageRequest()), the CSD loads/stores data
+ * directly from/to the backend namespace into/from the AFDM.
+ *
+ * For CS_STORAGE_FILE_IO the file range is resolved to physical extents with
+ * FIEMAP on the host, the extents are translated to namespace LBAs and sent to
+ * the CSD as a single extent list (TspExtentList), so the file data never goes
+ * through the host page cache.
+ * */
+
+#include "cs.h"
+#include "tsp.h"
+#include "tsp_device.h"
+#include "tsp_transport.h"
+#include "debug.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+
+/* Number of extents requested per FIEMAP ioctl */
+#define FIEMAP_BATCH 256
+
+/* Extents whose data is not stored as is at fe_physical, the CSD cannot use them */
+#define FIEMAP_EXTENT_UNUSABLE (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | \
+                                FIEMAP_EXTENT_ENCODED | FIEMAP_EXTENT_DATA_ENCRYPTED | \
+                                FIEMAP_EXTENT_NOT_ALIGNED | FIEMAP_EXTENT_DATA_INLINE | \
+                                FIEMAP_EXTENT_DATA_TAIL)
+
+/* Storage requests can take some time for large ranges */
+#define TSP_STORAGE_TIMEOUT_MS 600000
+
+/* Number of extent lists sent at once */
+#define TSP_STORAGE_BATCH 16
+
+typedef struct {
+    u32 nsid;
+    u32 lba_shift;
+    u64 part_start; /* Start of the partition in the namespace, in bytes */
+} tsp_namespace_st;
+
+typedef struct {
+    TspExtent *extents;
+    u32 num;
+    u32 capacity;
+} tsp_extent_vec_st;
+
+/**
+ * @brief Finds the namespace (and partition offset) of the block device that
+ * holds a file system and checks that it belongs to the CSx.
+ * */
+static CS_STATUS tsp_resolve_namespace(CS_DEV_HANDLE fd, dev_t dev, tsp_namespace_st *ns) {
+    char path[PATH_MAX];
+    char ns_path[PATH_MAX];
+    char ctrl_path[PATH_MAX];
+    CS_STATUS status;
+    size_t len;
+    u64 val;
+
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u", major(dev), minor(dev));
+    if (!realpath(path, ns_path)) {
+        MSG_PRINT_ERROR("The file does not reside on a block device");
+        return CS_ENTITY_NOT_ON_DEVICE;
+    }
+
+    ns->part_start = 0;
+    if (tsp_sysfs_read_u64(ns_path, "partition", &val) == 0) {
+        if (tsp_sysfs_read_u64(ns_path, "start", &val)) {
+            return CS_ENXIO;
+        }
+        // sysfs always reports the start in 512 byte sectors
+        ns->part_start = val << 9;
+        tsp_path_strip(ns_path);
+    }
+
+    /** @todo namespaces of multipath subsystems live under nvme-subsystem */
+    status = tsp_sysfs_ctrl_path(fd, ctrl_path);
+    if (status != CS_SUCCESS) {
+        return status;
+    }
+    len = strlen(ctrl_path);
+    if (strncmp(ns_path, ctrl_path, len) || ns_path[len] != '/') {
+        MSG_PRINT_ERROR("The file does not reside on the CSx (%s is not under %s)", ns_path, ctrl_path);
+        return CS_ENTITY_NOT_ON_DEVICE;
+    }
+
+    if (tsp_sysfs_read_u64(ns_path, "nsid", &val) == 0) {
+        ns->nsid = (u32)val;
+    } else if (sscanf(strrchr(ns_path, '/'), "/nvme%*un%u", &ns->nsid) != 1) {
+        return CS_ENXIO;
+    }
+
+    if (tsp_sysfs_read_u64(ns_path, "queue/logical_block_size", &val) || !val || (val & (val - 1))) {
+        return CS_ENXIO;
+    }
+    ns->lba_shift = __builtin_ctzll(val);
+
+    return CS_SUCCESS;
+}
+
+/* Appends an extent, merging it with the previous one when contiguous */
+static CS_STATUS extent_vec_push(tsp_extent_vec_st *vec, u64 lba, u64 num_blocks, u32 flags) {
+    while (num_blocks) {
+        u32 blocks = num_blocks > UINT32_MAX ? UINT32_MAX : (u32)num_blocks;
+
+        if (vec->num) {
+            TspExtent *prev = &vec->extents[vec->num - 1];
+            if (prev->Flags == flags &&
+                ((flags & TSP_EXTENT_ZERO) || prev->Lba + prev->NumBlocks == lba) &&
+                (u64)prev->NumBlocks + blocks <= UINT32_MAX) {
+                prev->NumBlocks += blocks;
+                lba += blocks;
+                num_blocks -= blocks;
+                continue;
+            }
+        }
+
+        if (vec->num == vec->capacity) {
+            u32 capacity = vec->capacity ? vec->capacity * 2 : 64;
+            TspExtent *extents = realloc(vec->extents, capacity * sizeof(TspExtent));
+            if (!extents) {
+                return CS_NOT_ENOUGH_MEMORY;
+            }
+            vec->extents = extents;
+            vec->capacity = capacity;
+        }
+
+        vec->extents[vec->num].Lba = (flags & TSP_EXTENT_ZERO) ? 0 : lba;
+        vec->extents[vec->num].NumBlocks = blocks;
+        vec->extents[vec->num].Flags = flags;
+        vec->num++;
+        lba += blocks;
+        num_blocks -= blocks;
+    }
+
+    return CS_SUCCESS;
+}
+
+/**
+ * @brief Maps the file range [start, end) (start is LBA aligned) to namespace
+ * extents. Holes and unwritten extents become zero fill extents.
+ * */
+static CS_STATUS tsp_file_extents(int file, u64 start, u64 end, const tsp_namespace_st *ns,
+                                  tsp_extent_vec_st *vec) {
+    const u64 lba_mask = (1ULL << ns->lba_shift) - 1;
+    const size_t fm_size = sizeof(struct fiemap) + FIEMAP_BATCH * sizeof(struct fiemap_extent);
+    struct fiemap *fm = malloc(fm_size);
+    CS_STATUS status = CS_SUCCESS;
+    u64 pos = start;
+    int last = 0;
+
+    if (!fm) {
+        return CS_NOT_ENOUGH_MEMORY;
+    }
+
+    while (pos < end && !last && status == CS_SUCCESS) {
+        memset(fm, 0, sizeof(struct fiemap));
+        fm->fm_start = pos;
+        fm->fm_length = end - pos;
+        fm->fm_extent_count = FIEMAP_BATCH;
+        if (ioctl(file, FS_IOC_FIEMAP, fm) < 0) {
+            MSG_PRINT_ERROR("FIEMAP is not supported for this file (errno %d)", errno);
+            status = CS_UNSUPPORTED;
+            break;
+        }
+        if (!fm->fm_mapped_extents) {
+            break; // Hole until the end of the range
+        }
+
+        for (u32 i = 0; i < fm->fm_mapped_extents && pos < end; ++i) {
+            struct fiemap_extent *fe = &fm->fm_extents[i];
+            u64 fe_end = fe->fe_logical + fe->fe_length;
+
+            last = !!(fe->fe_flags & FIEMAP_EXTENT_LAST);
+            if (fe_end <= pos) {
+                continue;
+            }
+            if (fe->fe_flags & FIEMAP_EXTENT_UNUSABLE) {
+                MSG_PRINT_ERROR("File extent at offset %llu cannot be accessed directly (flags 0x%x)",
+                                (unsigned long long)fe->fe_logical, fe->fe_flags);
+                status = CS_UNSUPPORTED;
+                break;
+            }
+            if ((fe->fe_logical | fe->fe_physical) & lba_mask) {
+                MSG_PRINT_ERROR("File extents are not aligned on logical blocks");
+                status = CS_UNSUPPORTED;
+                break;
+            }
+
+            // Hole before this extent
+            if (fe->fe_logical > pos) {
+                u64 hole_end = fe->fe_logical < end ? fe->fe_logical : end;
+                status = extent_vec_push(vec, 0, (hole_end - pos + lba_mask) >> ns->lba_shift, TSP_EXTENT_ZERO);
+                if (status != CS_SUCCESS) {
+                    break;
+                }
+                pos = hole_end;
+                if (pos >= end) {
+                    break;
+                }
+            }
+
+            u64 piece_end = fe_end < end ? fe_end : end;
+            u64 phys = ns->part_start + fe->fe_physical + (pos - fe->fe_logical);
+            status = extent_vec_push(vec, phys >> ns->lba_shift,
+                                     (piece_end - pos + lba_mask) >> ns->lba_shift,
+                                     (fe->fe_flags & FIEMAP_EXTENT_UNWRITTEN) ? TSP_EXTENT_ZERO : 0);
+            if (status != CS_SUCCESS) {
+                break;
+            }
+            pos = piece_end;
+        }
+    }
+
+    // Trailing hole (sparse file)
+    if (status == CS_SUCCESS && pos < end) {
+        status = extent_vec_push(vec, 0, (end - pos + lba_mask) >> ns->lba_shift, TSP_EXTENT_ZERO);
+    }
+
+    free(fm);
+    return status;
+}
+
+/* Maps the status of a storage command */
+static CS_STATUS tsp_storage_status(int ret) {
+    if (ret < 0) {
+        MSG_PRINT_ERROR("Storage request could not be sent to the device");
+        return CS_DEVICE_NOT_AVAILABLE;
+    } else if (ret) {
+        MSG_PRINT_ERROR("Device failed storage request with status 0x%x", ret);
+        return CS_ERROR_IN_EXECUTION;
+    }
+
+    return CS_SUCCESS;
+}
+
+/**
+ * @brief Sends the extent lists with as few system calls as the transport
+ * allows, the lists are independent (each has its own AFDM offset) and may be
+ * processed in parallel by the device. continued is set if the lists continue
+ * the previous ones of the same request (see tsp_memo_storage()).
+ * */
+static CS_STATUS tsp_storage_commands(CS_DEV_HANDLE fd, CS_STORAGE_IO_TYPE type,
+                                      TspExtentList **lists, u32 n, int continued) {
+    tsp_cmd_st cmds[TSP_STORAGE_BATCH];
+    tsp_cmd_st *cmdp[TSP_STORAGE_BATCH];
+    int ret;
+
+    for (u32 i = 0; i < n; ++i) {
+        u32 len = sizeof(TspExtentList) + lists[i]->NumExtents * sizeof(TspExtent);
+        /* The extent list holds the namespace of the extents */
+        cmds[i] = (tsp_cmd_st) {
+            .cdw10 = TSP_CS_STORAGE_IO,
+            .cdw11 = type,
+            .cdw12 = len,
+            .dir = TSP_DIR_TO_DEV,
+            .data_len = len,
+            .data = lists[i],
+            .timeout_ms = TSP_STORAGE_TIMEOUT_MS,
+        };
+        cmdp[i] = &cmds[i];
+    }
+
+    tsp_device_busy(fd, n);
+    ret = tsp_submit_batch(fd, cmdp, n);
+    tsp_device_busy(fd, -(int)n);
+
+    if (ret == 0) {
+        for (u32 i = 0; i < n; ++i) {
+            tsp_memo_storage(fd, type, lists[i], cmds[i].result, i > 0 || continued);
+        }
+    }
+    return tsp_storage_status(ret);
+}
+
+/**
+ * @brief Sends the extents as few extent lists as possible, each command
+ * carries up to TSP_EXTENTS_PER_CMD extents and continues where the previous
+ * one stopped in the AFDM. Up to TSP_STORAGE_BATCH commands are sent at once.
+ * */
+static CS_STATUS tsp_storage_send_extents(CS_DEV_HANDLE fd, CS_STORAGE_IO_TYPE type,
+                                          const tsp_namespace_st *ns, const tsp_extent_vec_st *vec,
+                                          u32 head_bytes, u64 bytes, CsDevAFDM dev_mem) {
+    u32 max_extents = vec->num < TSP_EXTENTS_PER_CMD ? vec->num : TSP_EXTENTS_PER_CMD;
+    TspExtentList *lists[TSP_STORAGE_BATCH] = {NULL,};
+    CS_STATUS status = CS_SUCCESS;
+    u32 done = 0;
+    u32 num_lists = 0;
+    int continued = 0;
+
+    while (done < vec->num && bytes && status == CS_SUCCESS) {
+        u32 n = vec->num - done < max_extents ? vec->num - done : max_extents;
+        TspExtentList *list = lists[num_lists];
+        u64 span = 0;
+
+        if (!list) {
+            list = malloc(sizeof(TspExtentList) + max_extents * sizeof(TspExtent));
+            if (!list) {
+                status = CS_NOT_ENOUGH_MEMORY;
+                break;
+            }
+            lists[num_lists] = list;
+        }
+
+        for (u32 i = 0; i < n; ++i) {
+            span += (u64)vec->extents[done + i].NumBlocks << ns->lba_shift;
+        }
+        span -= head_bytes;
+
+        memset(list, 0, sizeof(TspExtentList));
+        list->NamespaceId = ns->nsid;
+        list->LbaShift = ns->lba_shift;
+        list->HeadBytes = head_bytes;
+        list->Bytes = span < bytes ? (u32)span : (u32)bytes;
+        list->DevMem = dev_mem;
+        list->NumExtents = n;
+        memcpy(list->Extents, &vec->extents[done], n * sizeof(TspExtent));
+        num_lists++;
+
+        dev_mem.ByteOffset += list->Bytes;
+        bytes -= list->Bytes;
+        head_bytes = 0;
+        done += n;
+
+        if (num_lists == TSP_STORAGE_BATCH || done == vec->num || !bytes) {
+            status = tsp_storage_commands(fd, type, lists, num_lists, continued);
+            num_lists = 0;
+            continued = 1;
+        }
+    }
+
+    for (u32 i = 0; i < TSP_STORAGE_BATCH; ++i) {
+        free(lists[i]);
+    }
+    return status;
+}
+
+static CS_STATUS tsp_storage_command(CS_DEV_HANDLE fd, CS_STORAGE_IO_TYPE type,
+                                     TspExtentList *list) {
+    return tsp_storage_commands(fd, type, &list, 1, 0);
+}
+
+static CS_STATUS tsp_file_io(CS_DEV_HANDLE fd, CsFileIo *io) {
+    int file = (int)(intptr_t)io->FileHandle;
+    tsp_extent_vec_st vec = {0,};
+    tsp_namespace_st ns;
+    CS_STATUS status;
+    struct stat s;
+    u64 start, end;
+
+    if (fstat(file, &s) < 0 || !S_ISREG(s.st_mode)) {
+        return CS_INVALID_HANDLE;
+    }
+    if (!io->Bytes || io->Offset + io->Bytes > (u64)s.st_size) {
+        /* Stores never extend the file, the file system would not know */
+        return CS_INVALID_LENGTH;
+    }
+
+    status = tsp_resolve_namespace(fd, s.st_dev, &ns);
+    if (status != CS_SUCCESS) {
+        return status;
+    }
+
+    // Dirty pages have to reach the storage before the CSD accesses it
+    if (sync_file_range(file, io->Offset, io->Bytes, SYNC_FILE_RANGE_WAIT_BEFORE |
+                        SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) < 0) {
+        MSG_PRINT_WARNING("Could not flush file range, falling back to fdatasync()");
+        if (fdatasync(file) < 0) {
+            return CS_ENXIO;
+        }
+    }
+
+    start = io->Offset & ~((1ULL << ns.lba_shift) - 1);
+    end = io->Offset + io->Bytes;
+    status = tsp_file_extents(file, start, end, &ns, &vec);
+
+    if (status == CS_SUCCESS && io->Type == CS_STORAGE_STORE_TYPE) {
+        for (u32 i = 0; i < vec.num; ++i) {
+            if (vec.extents[i].Flags & TSP_EXTENT_ZERO) {
+                MSG_PRINT_ERROR("Stores require the file range to be allocated and written");
+                status = CS_UNSUPPORTED;
+                break;
+            }
+        }
+    }
+
+    if (status == CS_SUCCESS) {
+        MSG_PRINT_DEBUG("File range of %u bytes is made of %u extents", io->Bytes, vec.num);
+        status = tsp_storage_send_extents(fd, io->Type, &ns, &vec, (u32)(io->Offset - start),
+                                          io->Bytes, io->DevMem);
+    }
+
+    if (status == CS_SUCCESS && io->Type == CS_STORAGE_STORE_TYPE) {
+        // The page cache may hold stale copies of what the CSD has written
+        posix_fadvise(file, io->Offset, io->Bytes, POSIX_FADV_DONTNEED);
+    }
+
+    free(vec.extents);
+    return status;
+}
+
+static CS_STATUS tsp_block_io(CS_DEV_HANDLE fd, CsBlockIo *io) {
+    /* A single extent, LbaShift and Bytes of 0 let the CSD use the namespace
+     * format and transfer all the blocks */
+    struct {
+        TspExtentList list;
+        TspExtent extent;
+    } __attribute__((packed)) desc = {0,};
+
+    if (!io->NumBlocks) {
+        return CS_INVALID_LENGTH;
+    }
+
+    desc.list.NamespaceId = io->NamespaceId;
+    desc.list.DevMem = io->DevMem;
+    desc.list.NumExtents = 1;
+    desc.extent.Lba = io->StartLba;
+    desc.extent.NumBlocks = io->NumBlocks;
+
+    return tsp_storage_command(fd, io->Type, &desc.list);
+}
+
+/**
+ * @copydoc csQueueStorageRequest
+ * @note FileIo.FileHandle is a file descriptor cast to a pointer, e.g.,
+ * (void *)(intptr_t)open(...)
+ * @note the request is executed before this function returns, asynchronous
+ * requests (CallbackFn or EventHandle) are completed with its status and
+ * CS_QUEUED is returned
+ * */
+CS_STATUS csQueueStorageRequest(CsStorageRequest *Req, void *Context,
+                                csQueueCallbackFn CallbackFn,
+                                CS_EVT_HANDLE EventHandle,
+                                u32 *CompValue) {
+    CS_STATUS status;
+
+    if (!Req) {
+        return CS_INVALID_ARG;
+    }
+    if (Req->DevHandle < 0) {
+        return CS_INVALID_HANDLE;
+    }
+
+    switch (Req->Mode) {
+    case CS_STORAGE_BLOCK_IO:
+        if (Req->u.BlockIo.Type != CS_STORAGE_LOAD_TYPE && Req->u.BlockIo.Type != CS_STORAGE_STORE_TYPE) {
+            return CS_INVALID_OPTION;
+        }
+        status = tsp_block_io(Req->DevHandle, &Req->u.BlockIo);
+        break;
+    case CS_STORAGE_FILE_IO:
+        if (Req->u.FileIo.Type != CS_STORAGE_LOAD_TYPE && Req->u.FileIo.Type != CS_STORAGE_STORE_TYPE) {
+            return CS_INVALID_OPTION;
+        }
+        status = tsp_file_io(Req->DevHandle, &Req->u.FileIo);
+        break;
+    default:
+        return CS_INVALID_OPTION;
+    }
+
+    if (!CallbackFn && !EventHandle) {
+        return status;
+    }
+    if (EventHandle) {
+        tsp_event_arm(EventHandle);
+        tsp_event_signal(EventHandle, status);
+    }
+    if (CallbackFn) {
+        CallbackFn(Context, status);
+    }
+    return CS_QUEUED;
+}
@@ -0,0 +1,637 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Extensions of the CS API that are specific to this implementation (TSP).
+ * These are not part of the SNIA Computational Storage API, applications that
+ * use them include this header in addition to "cs.h".
+ * */
+
+#ifndef __CS_TSP_H__
+#define __CS_TSP_H__
+
+#include "cs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*-****************
+ * FDM Management *
+ *-****************/
+
+/**
+ * @brief Statistics of the host side FDM sub-allocator of a CSx.
+ *
+ * FDM is reserved from the device in large arenas, allocations are then served
+ * by the library, from size-class slabs for small buffers and from a buddy
+ * allocator for larger ones.
+ * */
+typedef struct {
+    u64 ArenaBytes;            // FDM reserved from the device in bytes
+    u64 UsedBytes;             // bytes handed out, rounded up to the block sizes
+    u64 RequestedBytes;        // bytes requested by the live allocations
+    u64 FreeBytes;             // free bytes in the arenas
+    u64 LargestFreeBlock;      // largest allocation possible without reserving FDM
+    u64 NumAllocations;        // total number of allocations served
+    u64 NumFrees;              // total number of allocations freed
+    u64 DeviceAllocations;     // total number of allocation commands sent to the device
+    u32 NumArenas;             // number of arenas currently reserved
+    u32 ExternalFragmentation; // 1 - LargestFreeBlock / FreeBytes, in per mille
+    u32 InternalFragmentation; // 1 - RequestedBytes / UsedBytes, in per mille
+    u32 Reserved;
+} CsTspMemStats;
+
+/**
+ * @brief Queries the statistics of the FDM sub-allocator of a CSx
+ * @param[in] DevHandle : Handle to CSx
+ * @param[out] Stats : Statistics of the allocator
+ * @return CS_SUCCESS, CS_INVALID_HANDLE or CS_INVALID_ARG
+ * */
+extern CS_STATUS csTspQueryMemStats(CS_DEV_HANDLE DevHandle, CsTspMemStats *Stats);
+
+/*-*******************
+ * Device Management *
+ *-*******************/
+
+/**
+ * @brief Drops the device information cached for a CSx
+ *
+ * The properties, capabilities and functions of a CSx are queried from the
+ * device once and cached by the library. The cache is dropped by csResetCSE(),
+ * csConfig() and csDownload(), this is only needed when the CSx was changed by
+ * other means (e.g., by another process).
+ * @param[in] DevHandle : Handle to CSx
+ * @return CS_SUCCESS or CS_INVALID_HANDLE
+ * */
+extern CS_STATUS csTspInvalidateDeviceCache(CS_DEV_HANDLE DevHandle);
+
+/*-***********
+ * Functions *
+ *-***********/
+
+#define CS_TSP_FUNCTION_MAX_ARGS 16
+
+/**
+ * @brief A function of a CSx, as returned by csTspQueryFunctionInfo()
+ *
+ * The signature is only known if the device reports it, devices that only
+ * report their CsCapabilities list the functions of their capabilities.
+ * */
+typedef struct {
+    CS_FUNCTION_ID FunctionId;
+    int FunctionBit;      // bit in CsCapabilities, -1 if none
+    u32 NumUnits;         // instances that can run concurrently
+    u32 HasSignature;     // the fields below are valid
+    u32 MinArgs;          // required arguments
+    u32 MaxArgs;          // typed arguments in ArgTypes
+    u32 Variadic;         // arguments past MaxArgs are accepted
+    CS_COMPUTE_ARG_TYPE ArgTypes[CS_TSP_FUNCTION_MAX_ARGS];
+    char Name[32];
+} CsTspFunctionInfo;
+
+/**
+ * @brief Looks a function of a CSx up by name
+ *
+ * The function table of the CSx is queried once and indexed by name, lookups
+ * (including the ones of csGetFunction()) are served from the cache.
+ * @param[in] DevHandle : Handle to CSx
+ * @param[in] FunctionName : Name of the function, as listed by
+ * csQueryDeviceForComputeList()
+ * @param[out] Info : Description of the function
+ * @return CS_SUCCESS, CS_INVALID_ARG, CS_INVALID_HANDLE, CS_INVALID_OPTION if
+ * the CSx has no such function, or CS_DEVICE_NOT_AVAILABLE
+ * */
+extern CS_STATUS csTspQueryFunctionInfo(CS_DEV_HANDLE DevHandle, const char *FunctionName,
+                                        CsTspFunctionInfo *Info);
+
+/*-************
+ * Statistics *
+ *-************/
+
+/* Counters since the previous delta query instead of since power on */
+#define CS_TSP_STATS_DELTA (1 << 0)
+#define CS_TSP_STATS_MAX_FUNCTIONS 64
+
+/**
+ * @brief Usage of a CSx, as returned by csTspQueryDeviceStatistics()
+ *
+ * Memory is the view of the device : the allocations are the FDM reserved by
+ * the library (see csTspQueryMemStats() for the allocations it serves) and the
+ * host transfers are the copies made by this process.
+ * */
+typedef struct {
+    u64 IntervalUs;    // time covered by the counters
+    u64 BusyUs;        // time spent executing functions, summed over the cores
+    CSEUsage Cse;
+    CSxMemory Memory;
+    u32 NumFunctions;
+    u32 Reserved;
+    struct {
+        CS_FUNCTION_ID FunctionId;
+        u32 Reserved;
+        CSFUsage Usage;
+    } Functions[CS_TSP_STATS_MAX_FUNCTIONS];
+} CsTspDeviceStats;
+
+/**
+ * @brief Queries all the usage counters of a CSx with a single command
+ *
+ * csQueryDeviceStatistics() returns one of the parts of this query. With
+ * CS_TSP_STATS_DELTA the counters, the shortest and the longest execution
+ * times are those of the interval since the previous delta query (by any
+ * process), the gauges (allocated, free and largest FDM) are current values.
+ * @param[in] DevHandle : Handle to CSx
+ * @param[in] Flags : 0 or CS_TSP_STATS_DELTA
+ * @param[out] Stats : Counters of the CSx, of its CSE and of its functions
+ * @return CS_SUCCESS, CS_INVALID_HANDLE, CS_INVALID_ARG or
+ * CS_DEVICE_NOT_AVAILABLE
+ * */
+extern CS_STATUS csTspQueryDeviceStatistics(CS_DEV_HANDLE DevHandle, u32 Flags,
+                                            CsTspDeviceStats *Stats);
+
+/*-************
+ * Scheduling *
+ *-************/
+
+typedef enum {
+    CS_TSP_DATA_NONE,      // the function does not read from storage (stateless)
+    CS_TSP_DATA_FILE,      // the data is in a file, Handle is a descriptor of the file
+    CS_TSP_DATA_NAMESPACE, // the data is on a namespace, Handle is a descriptor of its device
+} CS_TSP_DATA_TYPE;
+
+/**
+ * @brief Where the data read by a compute request is stored
+ * */
+typedef struct {
+    CS_TSP_DATA_TYPE Type;
+    int Replicated; // the data is available to every CSE, only the load matters
+    int Handle;
+} CsTspDataLocality;
+
+/**
+ * @brief Selects the CSE a compute request should be sent to
+ *
+ * If the request reads data from storage, the CSE of the controller that holds
+ * the data is selected. If the data is replicated, the function is stateless or
+ * none of the CSEs holds the data, the CSE with the fewest commands in flight
+ * is selected (ties are spread over the CSEs). The FDM of the request is then
+ * allocated on the selected CSE.
+ * @param[in] NumCSEs : Number of CSEs in CSEs
+ * @param[in] CSEs : Handles of the CSEs to choose from (see csQueryCSEList())
+ * @param[in] Locality : Location of the data, NULL if none
+ * @param[out] CSEHandle : Selected CSE
+ * @return CS_SUCCESS, CS_INVALID_ARG or CS_INVALID_HANDLE
+ * */
+extern CS_STATUS csTspSelectCSE(int NumCSEs, CS_CSE_HANDLE *CSEs,
+                                const CsTspDataLocality *Locality,
+                                CS_CSE_HANDLE *CSEHandle);
+
+/**
+ * @brief Returns the number of commands in flight on a CSE
+ * @param[in] CSEHandle : Handle to CSE
+ * @param[out] Outstanding : Number of commands sent by this process to the
+ * controller of the CSE (through any of its handles) that have not completed
+ * yet
+ * @return CS_SUCCESS, CS_INVALID_HANDLE or CS_INVALID_ARG
+ * */
+extern CS_STATUS csTspQueryCSELoad(CS_CSE_HANDLE CSEHandle, u32 *Outstanding);
+
+/*-*******************
+ * Admission Control *
+ *-*******************/
+
+/*
+ * The library limits the compute requests a process has in flight on a CSx :
+ * in total (csSetDeviceCapability() with CS_CAPABILITY_CSx_MAX_IOS), per
+ * function and per tenant with a token bucket. A request over a limit is
+ * either refused with CS_OUT_OF_RESOURCES or waits in a bounded queue, in
+ * the order of arrival. Waiting requests that are only held back by the rate
+ * of their tenant do not hold back the others. CSx without limits (the
+ * default) are not affected. Jobs are not subject to admission control.
+ * The limits apply to the controller, whichever of its handles (CSx or CSE)
+ * they are set through and the requests are sent to.
+ * */
+
+typedef u32 CS_TSP_TENANT_ID;
+
+typedef enum {
+    CS_TSP_ADMIT_REJECT = 0, // requests over the limits fail (default)
+    CS_TSP_ADMIT_QUEUE = 1,  // requests over the limits wait, the caller blocks
+} CS_TSP_ADMISSION;
+
+/**
+ * @brief Sets what happens to the requests over the limits of a CSx
+ * @param[in] DevHandle : Handle to CSx
+ * @param[in] Policy : CS_TSP_ADMIT_REJECT or CS_TSP_ADMIT_QUEUE
+ * @param[in] MaxQueued : Requests (callers) that may wait with
+ * CS_TSP_ADMIT_QUEUE, the others are refused, as are those issued from
+ * completion callbacks
+ * @return CS_SUCCESS, CS_INVALID_HANDLE, CS_INVALID_ARG or
+ * CS_NOT_ENOUGH_MEMORY
+ * */
+extern CS_STATUS csTspSetAdmissionPolicy(CS_DEV_HANDLE DevHandle, CS_TSP_ADMISSION Policy,
+                                         u32 MaxQueued);
+
+/**
+ * @brief Limits the requests of a function in flight on a CSx
+ * @param[in] DevHandle : Handle to CSx
+ * @param[in] FunctionId : Function to limit
+ * @param[in] MaxOutstanding : Requests in flight, 0 for no limit
+ * @return CS_SUCCESS, CS_INVALID_HANDLE or CS_NOT_ENOUGH_MEMORY if too many
+ * functions are limited
+ * */
+extern CS_STATUS csTspSetFunctionLimit(CS_DEV_HANDLE DevHandle, CS_FUNCTION_ID FunctionId,
+                                       u32 MaxOutstanding);
+
+/**
+ * @brief Limits the rate of the requests of a tenant on a CSx
+ *
+ * The tenant earns RequestsPerSec tokens per second, up to Burst tokens, and
+ * each request takes one.
+ * @param[in] DevHandle : Handle to CSx
+ * @param[in] TenantId : Tenant to limit (see csTspSetTenant())
+ * @param[in] RequestsPerSec : Rate of the tenant, 0 for no limit
+ * @param[in] Burst : Requests the tenant may send at once after being idle
+ * @return CS_SUCCESS, CS_INVALID_HANDLE, CS_INVALID_ARG or
+ * CS_NOT_ENOUGH_MEMORY if too many tenants are limited
+ * */
+extern CS_STATUS csTspSetTenantRate(CS_DEV_HANDLE DevHandle, CS_TSP_TENANT_ID TenantId,
+                                    u32 RequestsPerSec, u32 Burst);
+
+/**
+ * @brief Sets the tenant of the requests sent by the calling thread
+ * @param[in] TenantId : Tenant, 0 (the default) for none
+ * */
+extern void csTspSetTenant(CS_TSP_TENANT_ID TenantId);
+
+/*-**************
+ * Result Cache *
+ *-**************/
+
+/*
+ * Deterministic functions may be memoized : their results are cached by the
+ * library, keyed by the function, the values of the arguments and the
+ * identity of the input FDM. The input FDM has an identity when it was
+ * loaded from storage (csQueueStorageRequest()), it is the extents that were
+ * read and their write generation, returned by the device. A request whose
+ * key is cached completes without sending any command. Writing to the
+ * extents, to the FDM from the host or from other requests invalidates the
+ * concerned results and identities. The result of a memoized function is its
+ * last FDM argument and has a fixed size, the FDM has to be host visible.
+ * The cache is disabled by default.
+ * */
+
+/**
+ * @brief Usage of the result cache, as returned by csTspQueryMemoStats()
+ * */
+typedef struct {
+    u64 Hits;          // requests completed from the cache
+    u64 Misses;        // cacheable requests sent to the CSE
+    u64 Uncacheable;   // requests of memoized functions whose inputs are unknown
+    u64 Insertions;
+    u64 Evictions;     // entries dropped to stay under MaxBytes
+    u64 Invalidations; // entries dropped because their inputs were written
+    u64 Entries;
+    u64 Bytes;
+    u64 MaxBytes;
+    u32 HitRate;       // hits per thousand lookups
+    u32 Reserved;
+} CsTspMemoStats;
+
+/**
+ * @brief Enables the result cache
+ * @param[in] MaxBytes : Memory used by the cached results, the least recently
+ * used are evicted beyond, 0 disables the cache and drops its content
+ * @return CS_SUCCESS or CS_NOT_ENOUGH_MEMORY
+ * */
+extern CS_STATUS csTspSetMemoCache(u64 MaxBytes);
+
+/**
+ * @brief Marks a function of a CSx as deterministic, its results are cached
+ * @param[in] DevHandle : Handle to CSx
+ * @param[in] FunctionId : Function whose results are cached
+ * @param[in] ResultBytes : Bytes of the result, written at the last FDM
+ * argument, 0 to stop caching the function
+ * @return CS_SUCCESS, CS_INVALID_HANDLE or CS_NOT_ENOUGH_MEMORY if too many
+ * functions are memoized
+ * */
+extern CS_STATUS csTspMemoizeFunction(CS_DEV_HANDLE DevHandle, CS_FUNCTION_ID FunctionId,
+                                      u32 ResultBytes);
+
+/**
+ * @brief Returns the usage of the result cache of the process
+ * @param[out] Stats : Counters since the process started
+ * @return CS_SUCCESS or CS_INVALID_ARG
+ * */
+extern CS_STATUS csTspQueryMemoStats(CsTspMemoStats *Stats);
+
+/*-***************
+ * Request Rings *
+ *-***************/
+
+/**
+ * @brief Enables the shared-memory request rings of a CSx
+ *
+ * The rings belong to the controller, they are used by the requests sent to
+ * any handle of the CSx or of its CSEs, and are disabled when the handle they
+ * were enabled by is closed.
+ * A submission and a completion ring are allocated in the FDM of the CSx (it
+ * has to be host visible) and a single command tells the device where they
+ * are. From then on, compute requests sent to the CSE that fit in an entry
+ * (a few arguments, see TSP_RING_SQE_SIZE) are written to the submission ring
+ * with ordinary stores followed by a doorbell write, the device polls the
+ * ring and posts the completions, which are polled by the host. No NVMe
+ * command is sent per request, which suits high rates of small requests.
+ * Larger requests are still sent as commands.
+ * @param[in] DevHandle : Handle to CSx
+ * @param[in] NumEntries : Entries of each ring (2 to 4096), up to NumEntries - 1
+ * requests are in flight
+ * @return CS_SUCCESS, CS_INVALID_HANDLE, CS_INVALID_ARG, CS_HANDLE_IN_USE if
+ * already enabled on the controller, CS_NOT_ENOUGH_MEMORY, CS_COULD_NOT_MAP_MEMORY or
+ * CS_DEVICE_NOT_AVAILABLE if the device does not support the rings
+ * */
+extern CS_STATUS csTspEnableRequestRings(CS_DEV_HANDLE DevHandle, u32 NumEntries);
+
+/**
+ * @brief Waits for the requests in flight on the rings, stops the device from
+ * polling them and frees them, requests are sent as commands again. This is
+ * done by csCloseCSx() too, for the handle the rings were enabled by. The
+ * requests queued meanwhile are sent as commands, this must not be called by
+ * a completion callback.
+ * @param[in] DevHandle : Handle to the CSx or to one of its CSEs
+ * @return CS_SUCCESS, CS_INVALID_HANDLE or CS_INVALID_ARG if not enabled
+ * */
+extern CS_STATUS csTspDisableRequestRings(CS_DEV_HANDLE DevHandle);
+
+/*-*****************
+ * Compute Batches *
+ *-*****************/
+
+/**
+ * @brief Queues compute requests for the same CSE in as few commands as possible
+ *
+ * CSx that support the wire format (see tsp_wire.h) take several requests per
+ * command (CSEProperties MaxRequestsPerBatch), with argument lists larger than
+ * a legacy 4 KiB command. The requests of a command are executed in order and
+ * the execution stops at the first failure. Other CSx get a command per
+ * request.
+ * @param[in] NumReqs : Number of requests in Reqs
+ * @param[in] Reqs : The requests, they can be reused as soon as this function
+ * returns
+ * @param[in] Context : Passed to CallbackFn
+ * @param[in] CallbackFn : Called once per command if not NULL
+ * @param[in] EventHandle : Event signaled once per command if not 0
+ * @param[out] CompValue : Number of requests that succeeded for synchronous
+ * calls (neither CallbackFn nor EventHandle). For asynchronous calls, number of
+ * requests queued: if an error is returned after some commands were queued,
+ * these still complete through CallbackFn and EventHandle. May be NULL
+ * @return CS_SUCCESS, CS_QUEUED, CS_INVALID_ARG, CS_INVALID_LENGTH,
+ * CS_NOT_ENOUGH_MEMORY or the status of the failed request
+ * */
+extern CS_STATUS csTspQueueComputeBatch(int NumReqs, CsComputeRequest **Reqs, void *Context,
+                                        csQueueCallbackFn CallbackFn,
+                                        CS_EVT_HANDLE EventHandle, u32 *CompValue);
+
+/**
+ * @brief Queues requests already encoded in the wire format (see tsp_wire.h)
+ *
+ * The buffer is sent as the data of a single command, without copy. It has to
+ * be aligned on TSP_WIRE_ALIGN bytes and remain valid until the command
+ * completed.
+ * @param[in] CSEHandle : Handle to CSE
+ * @param[in] Buffer : A TspWireHeader followed by its requests
+ * @param[in] Length : Length of the transfer, equal to the Length of the header
+ * @param[in] Context : Passed to CallbackFn
+ * @param[in] CallbackFn : Called on completion if not NULL
+ * @param[in] EventHandle : Event signaled on completion if not 0
+ * @param[out] CompValue : Number of requests that succeeded, synchronous calls
+ * only, may be NULL
+ * @return CS_SUCCESS, CS_QUEUED, CS_INVALID_HANDLE, CS_INVALID_ARG,
+ * CS_INVALID_LENGTH, CS_UNSUPPORTED if the CSx only supports the legacy
+ * format, CS_NOT_ENOUGH_MEMORY or the status of the failed request
+ * */
+extern CS_STATUS csTspQueueWireRequests(CS_CSE_HANDLE CSEHandle, void *Buffer, u32 Length,
+                                        void *Context, csQueueCallbackFn CallbackFn,
+                                        CS_EVT_HANDLE EventHandle, u32 *CompValue);
+
+/*-******
+ * Jobs *
+ *-******/
+
+typedef u32 CS_TSP_JOB_ID;
+
+typedef enum {
+    CS_TSP_JOB_QUEUED,    // waiting for the device to start it
+    CS_TSP_JOB_RUNNING,
+    CS_TSP_JOB_DONE,      // the function succeeded
+    CS_TSP_JOB_FAILED,    // the function failed, see Status
+    CS_TSP_JOB_CANCELLED, // cancelled by csTspCancelJob() or csAbortCSE()
+} CS_TSP_JOB_STATE;
+
+/**
+ * @brief State of a job as reported by the device
+ * */
+typedef struct {
+    CS_TSP_JOB_STATE State;
+    CS_STATUS Status;  // CS_SUCCESS, or the error of a failed job
+    u32 Progress;      // per mille, as reported by the function
+    u32 Reserved;
+    u64 ResultBytes;   // bytes of the result that can be fetched
+    u64 RuntimeUs;     // time the job spent running
+} CsTspJobStatus;
+
+/**
+ * @brief Submits a compute request as a job, which runs on the device
+ * independently of the host
+ *
+ * The command completes as soon as the device accepted the job, no host
+ * thread nor command waits for the function. The job survives the process
+ * that submitted it : any process that opens the CSE can query, fetch or
+ * cancel it by its ID. The result of a job is its last FDM argument, the
+ * function may report the part of it that is final while it runs.
+ * @param[in] Req : The request, can be reused as soon as this function returns
+ * @param[out] JobId : ID of the job on its CSE
+ * @return CS_SUCCESS, CS_INVALID_ARG, CS_INVALID_LENGTH, CS_OUT_OF_RESOURCES
+ * if the device runs as many jobs as it can, CS_NOT_ENOUGH_MEMORY,
+ * CS_ERROR_IN_EXECUTION if the device refused the request or
+ * CS_DEVICE_NOT_AVAILABLE
+ * */
+extern CS_STATUS csTspSubmitJob(CsComputeRequest *Req, CS_TSP_JOB_ID *JobId);
+
+/**
+ * @brief Queries the state and progress of a job
+ * @param[in] CSEHandle : CSE the job was submitted to
+ * @param[in] JobId : ID returned by csTspSubmitJob()
+ * @param[out] Status : State of the job
+ * @return CS_SUCCESS, CS_INVALID_ARG, CS_INVALID_ID or CS_DEVICE_NOT_AVAILABLE
+ * */
+extern CS_STATUS csTspQueryJob(CS_CSE_HANDLE CSEHandle, CS_TSP_JOB_ID JobId,
+                               CsTspJobStatus *Status);
+
+/**
+ * @brief Polls a job until it is not queued nor running anymore
+ * @param[in] CSEHandle : CSE the job was submitted to
+ * @param[in] JobId : ID returned by csTspSubmitJob()
+ * @param[in] TimeoutMs : Maximum time to wait, 0 to wait forever
+ * @param[out] Status : State of the job, may be NULL
+ * @return CS_SUCCESS once finished, CS_NOT_DONE on timeout or the error of
+ * csTspQueryJob()
+ * */
+extern CS_STATUS csTspWaitJob(CS_CSE_HANDLE CSEHandle, CS_TSP_JOB_ID JobId,
+                              u32 TimeoutMs, CsTspJobStatus *Status);
+
+/**
+ * @brief Reads the result of a job (partial while it runs) from the device
+ * @param[in] CSEHandle : CSE the job was submitted to
+ * @param[in] JobId : ID returned by csTspSubmitJob()
+ * @param[in] Offset : Byte offset in the result
+ * @param[in] Length : Bytes to read, up to TSP_MDTS
+ * @param[out] Buffer : Receives the bytes
+ * @param[out] BytesRead : Bytes read, fewer than Length past the final part of
+ * the result
+ * @return CS_SUCCESS, CS_INVALID_ARG, CS_INVALID_LENGTH, CS_INVALID_ID or
+ * CS_DEVICE_NOT_AVAILABLE
+ * */
+extern CS_STATUS csTspReadJobResult(CS_CSE_HANDLE CSEHandle, CS_TSP_JOB_ID JobId,
+                                    u64 Offset, u32 Length, void *Buffer, u32 *BytesRead);
+
+/**
+ * @brief Asks the function of a job to stop, see csTspWaitJob() to know when
+ * it did. csAbortCSE() cancels all the jobs of a CSE.
+ * @return CS_SUCCESS, CS_INVALID_ID or CS_DEVICE_NOT_AVAILABLE
+ * */
+extern CS_STATUS csTspCancelJob(CS_CSE_HANDLE CSEHandle, CS_TSP_JOB_ID JobId);
+
+/**
+ * @brief Forgets a finished job, its ID is no longer valid. The device keeps
+ * finished jobs (and their slot) until they are released.
+ * @return CS_SUCCESS, CS_INVALID_ID, CS_HANDLE_IN_USE if the job is still
+ * running or CS_DEVICE_NOT_AVAILABLE
+ * */
+extern CS_STATUS csTspReleaseJob(CS_CSE_HANDLE CSEHandle, CS_TSP_JOB_ID JobId);
+
+/*-******************
+ * Event Management *
+ *-******************/
+
+/**
+ * @brief Waits until the requests queued with an event have completed
+ * @param[in] EventHandle : Event created with csCreateEvent()
+ * @return The status of the completed requests (the first error if any), or
+ * CS_INVALID_EVENT
+ * */
+extern CS_STATUS csTspWaitEvent(CS_EVT_HANDLE EventHandle);
+
+/*-***********
+ * Emulation *
+ *-***********/
+
+/**
+ * @brief Performance model of an emulated CSx (named "tsp-emu<N>")
+ *
+ * Emulated CSx execute the TSP commands in the process, their FDM is host
+ * memory. They allow to run and benchmark the host stack without a CSD, see
+ * the README for their configuration through the environment.
+ * */
+typedef struct {
+    u32 LatencyUs;   // latency added to every command
+    u32 LinkMBps;    // bandwidth of the host link (command data), 0 : unlimited
+    u32 StorageMBps; // bandwidth of the storage (storage requests), 0 : unlimited
+    u32 Reserved;
+} CsTspEmuModel;
+
+/**
+ * @brief Sets the performance model of an emulated CSx, the device is created
+ * if it was not used yet
+ * @param[in] DevName : Name of the emulated CSx (e.g., "tsp-emu0")
+ * @param[in] Model : Model applied to the commands submitted from now on
+ * @return CS_SUCCESS, CS_INVALID_ARG or CS_NO_SUCH_ENTITY_EXISTS
+ * */
+extern CS_STATUS csTspEmuSetModel(char *DevName, const CsTspEmuModel *Model);
+
+/**
+ * @brief Argument of a compute request as seen by an emulated function
+ * */
+typedef struct {
+    void *Ptr; // host address of a CS_AFDM_TYPE argument, NULL for the other types
+    u64 Bytes; // bytes from Ptr to the end of its FDM allocation
+} CsTspEmuArg;
+
+/**
+ * @brief Implementation of a compute function by the emulated CSx
+ * @param[in] Req : The request, as received by the device
+ * @param[in] Args : Host view of the Req->NumArgs arguments
+ * @return CS_SUCCESS, any other status fails the request
+ * */
+typedef CS_STATUS (*csTspEmuFunctionFn)(const CsComputeRequest *Req, const CsTspEmuArg *Args);
+
+/**
+ * @brief Reports the progress of the job run by the calling emulated function
+ * (see csTspSubmitJob()), the first ResultBytes bytes of its last FDM argument
+ * are final and can be fetched
+ * @param[in] Progress : Per mille
+ * @param[in] ResultBytes : Bytes of the result that are final
+ * @return 1 if the job was cancelled and the function should return, 0
+ * otherwise (or if the function is not running as a job)
+ * */
+extern int csTspEmuJobProgress(u32 Progress, u64 ResultBytes);
+
+/**
+ * @brief Adds (or replaces) a compute function of the emulated CSx
+ *
+ * The emulated CSx provide the "Checksum" function (sum of the 32-bit words of
+ * Args[0], Args[1] bytes long, stored in Args[2]) and a sleep function (ID 100,
+ * sleeps for Args[0] milliseconds, reports its progress and stops when
+ * cancelled if run as a job). Functions should be registered before the
+ * capabilities of the CSx are first queried, they are cached by the library.
+ * @param[in] FunctionId : ID of the function in the compute requests
+ * @param[in] FunctionBit : Bit of the function in CsCapabilities, -1 if the
+ * function is only reachable by its ID
+ * @param[in] Fn : Implementation of the function, NULL to remove it
+ * @return CS_SUCCESS, CS_INVALID_ARG or CS_NOT_ENOUGH_MEMORY
+ * */
+extern CS_STATUS csTspEmuRegisterFunction(CS_FUNCTION_ID FunctionId, int FunctionBit,
+                                          csTspEmuFunctionFn Fn);
+
+/**
+ * @brief Adds (or replaces) a compute function of the emulated CSx with its
+ * name and signature
+ *
+ * Functions registered by csTspEmuRegisterFunction() are named after their bit
+ * in CsCapabilities ("Function<ID>" without one) and have no signature.
+ * @param[in] Info : FunctionId, FunctionBit, Name and signature of the
+ * function, a NumUnits of 0 stands for the workers of each CSx
+ * @param[in] Fn : Implementation of the function, NULL to remove it
+ * @return CS_SUCCESS, CS_INVALID_ARG or CS_NOT_ENOUGH_MEMORY
+ * */
+extern CS_STATUS csTspEmuRegisterFunctionInfo(const CsTspFunctionInfo *Info,
+                                              csTspEmuFunctionFn Fn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CS_TSP_H__ */
@@ -0,0 +1,736 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * TSP specific definitions shared by the CS API implementation, the host
+ * tools and the CSD side code. These describe how the CS API is mapped onto
+ * the vendor specific NVMe commands ("C" as in compute, opcode 0xC0), the
+ * commands are then differentiated by sub-opcodes (CDW10 mainly).
+ * */
+
+#ifndef __TSP_H__
+#define __TSP_H__
+
+#include "cs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Vendor specific admin opcode for all TSP commands */
+#define TSP_NVME_OPCODE 0xc0
+
+/* Vendor specific I/O opcodes, the same commands (sub-opcodes) are sent on the
+ * I/O queues, bits 1:0 give the direction of the data transfer */
+#define TSP_NVME_IO_OPCODE_WRITE 0xc1 /* host to device (or no data) */
+#define TSP_NVME_IO_OPCODE_READ  0xc2 /* device to host */
+
+/* Size of the data buffer used by most TSP commands */
+#define TSP_BUFFER_SIZE 4096
+
+/* Maximum data transfer size of the CSD (PCI_EPF_NVME_MDTS in the firmware) */
+#define TSP_MDTS (128 * 1024)
+
+typedef enum {
+    TSP_CS_IDENTIFY = 0,
+    TSP_CS_GET = 8,
+    TSP_CS_ALLOCATE = 16,
+    TSP_CS_DEALLOCATE = 17,
+    TSP_CS_STORAGE_IO = 24,
+    TSP_CS_COMPUTE = 32,
+    TSP_CS_JOB = 40,
+    TSP_CS_RING_SETUP = 48,
+    TSP_CS_COMM = 64,
+    TSP_CS_OPEN_RELAY = 128, /* descriptor returned in completion dword 0 */
+    TSP_CS_CLOSE_RELAY = 129,
+} TSP_CDW10;
+
+typedef enum {
+    TSP_CS_CSX = 0,
+    TSP_CS_PROPS = 8,
+    TSP_CS_CAPS = 16,
+    TSP_CS_STATS = 24, /* usage counters, see TspStats */
+    TSP_CS_FUN = 32,
+    TSP_CS_FUNCTIONS = 40, /* table of the functions, see TspFunctionTable */
+    TSP_CS_MEM = 64,
+    TSP_CS_WIRE = 128, /* wire formats of the compute commands, see tsp_wire.h */
+} TSP_CDW11;
+
+/*-***********
+ * Functions *
+ *-***********/
+
+/* Set in CDW10 of a compute command, the command is executed by the compute
+ * daemon of the CSD (firmware/compute) instead of the kernel */
+#define TSP_CS_COMPUTE_USER 1
+
+/* TSP_CS_GET with TSP_CS_FUNCTIONS returns a TspFunctionTable listing every
+ * function of the CSE, the ones of CsCapabilities and the others. The host
+ * looks the functions up by name in this table, devices that do not answer
+ * are only known by the functions of their CsCapabilities. */
+#define TSP_FUNCTION_NO_BIT 0xFF       /* Bit of a function outside CsCapabilities */
+#define TSP_FUNCTION_SIGNATURE (1 << 0) /* ArgTypes, MinArgs and MaxArgs are valid */
+#define TSP_FUNCTION_VARIADIC (1 << 1)  /* arguments past MaxArgs are accepted */
+#define TSP_FUNCTION_MAX_ARGS 16
+
+/**
+ * @brief A function of the CSE
+ * */
+typedef struct {
+    u32 FunctionId;
+    u8 Bit;                             // bit in CsCapabilities or TSP_FUNCTION_NO_BIT
+    u8 NumUnits;                        // instances that can run concurrently
+    u8 MinArgs;                         // required arguments
+    u8 MaxArgs;                         // typed arguments in ArgTypes
+    u32 Flags;                          // TSP_FUNCTION_* flags
+    u32 Reserved;
+    u8 ArgTypes[TSP_FUNCTION_MAX_ARGS]; // CS_COMPUTE_ARG_TYPE of each argument
+    char Name[32];                      // NUL terminated
+} TspFunctionEntry;
+
+/**
+ * @brief Returned by TSP_CS_FUNCTIONS, the whole table fits in one command
+ * */
+typedef struct {
+    u32 NumFunctions;
+    u32 Reserved;
+    TspFunctionEntry Functions[];
+} TspFunctionTable;
+
+#define TSP_FUNCTIONS_MAX \
+    ((TSP_BUFFER_SIZE - sizeof(TspFunctionTable)) / sizeof(TspFunctionEntry))
+
+/* Algorithm of the Checksum function, given by its optional fourth argument (a
+ * 32-bit value). The other arguments are the data (FDM), its size in bytes
+ * (32-bit value) and the result (FDM). */
+typedef enum {
+    TSP_CHECKSUM_SUM32 = 0,  /* sum of the little endian 32-bit words, 4 bytes */
+    TSP_CHECKSUM_CRC32C = 1, /* CRC32C (Castagnoli), 4 bytes */
+    TSP_CHECKSUM_XXH3 = 2,   /* XXH3 64-bit with seed 0, 8 bytes */
+} TSP_CHECKSUM_ALGORITHM;
+
+/* Algorithm of the Compression function, given by the low byte of its optional
+ * sixth argument (a 32-bit value), the upper bytes hold the signed compression
+ * level (0 for the default of the algorithm). The output is a sequence of
+ * standard frames (.lz4 or .zst), each with the size of its content. */
+typedef enum {
+    TSP_COMPRESSION_LZ4 = 0,  /* LZ4 frame format, levels above 2 are LZ4 HC */
+    TSP_COMPRESSION_ZSTD = 1, /* Zstandard */
+} TSP_COMPRESSION_ALGORITHM;
+
+/**
+ * @brief Result of the Compression and Decompression functions. The arguments
+ * of both are the source (FDM), its size in bytes (value), the destination
+ * (FDM), its size in bytes (value) and the result (FDM).
+ *
+ * Both process whole frames : the compression stops before the frame that does
+ * not fit in the destination, the decompression (the algorithm of each frame
+ * is recognized) before the frame that is truncated in the source or does not
+ * fit in the destination. Data larger than the FDM is streamed by submitting
+ * the rest of the source (from InBytes) again. A request that cannot process
+ * its first frame fails.
+ * */
+typedef struct {
+    u64 InBytes;  // source bytes consumed
+    u64 OutBytes; // destination bytes produced
+} TspCompressionResult;
+
+/* The DbFilter function scans records with a predicate program and returns the
+ * matching records or a selection bitmap. Its arguments are the program (FDM),
+ * its size in bytes (value), the data (FDM), its size (value), the destination
+ * (FDM), its size (value) and the TspFilterResult (FDM). The program is a
+ * TspFilterProgram followed by its columns, its instructions and the string
+ * constants. The instructions are in postfix order : a comparison pushes the
+ * selection of the records that satisfy it, AND and OR pop two selections and
+ * push their combination, NOT inverts the top one, the program leaves the
+ * final selection. */
+typedef enum {
+    TSP_FILTER_FIXED = 0,     /* binary records of RecordBytes */
+    TSP_FILTER_DELIMITED = 1, /* text lines of fields separated by Delimiter (CSV) */
+} TSP_FILTER_FORMAT;
+
+#define TSP_FILTER_BITMAP (1 << 0)      /* output a bit per record instead of the records */
+#define TSP_FILTER_SKIP_HEADER (1 << 1) /* the first line is skipped (delimited only) */
+#define TSP_FILTER_END (1 << 2)         /* an unterminated last line is a record */
+
+#define TSP_FILTER_MAX_COLUMNS 32
+#define TSP_FILTER_MAX_INSTRS 256
+#define TSP_FILTER_MAX_DEPTH 16
+
+typedef enum {
+    TSP_FILTER_I32 = 0, /* little endian in fixed-width records, decimal in text */
+    TSP_FILTER_I64 = 1,
+    TSP_FILTER_U32 = 2,
+    TSP_FILTER_U64 = 3,
+    TSP_FILTER_F32 = 4,
+    TSP_FILTER_F64 = 5,
+    TSP_FILTER_STR = 6, /* Width bytes padded with NUL or spaces in fixed-width records */
+} TSP_FILTER_TYPE;
+
+typedef enum {
+    TSP_FILTER_EQ = 0,
+    TSP_FILTER_NE = 1,
+    TSP_FILTER_LT = 2,
+    TSP_FILTER_LE = 3,
+    TSP_FILTER_GT = 4,
+    TSP_FILTER_GE = 5,
+    TSP_FILTER_PREFIX = 6, /* strings only */
+    TSP_FILTER_AND = 16,
+    TSP_FILTER_OR = 17,
+    TSP_FILTER_NOT = 18,
+} TSP_FILTER_OP;
+
+/**
+ * @brief Column of the records
+ * */
+typedef struct {
+    u32 Offset; // byte offset in a fixed-width record, field index in a text line
+    u8 Type;    // TSP_FILTER_TYPE
+    u8 Width;   // bytes of a fixed-width string
+    u16 Reserved;
+} TspFilterColumn;
+
+/**
+ * @brief Instruction of a predicate program, a comparison of a column with a
+ * constant of the type of the column or a logical operation. Text fields that
+ * are not numbers (or missing fields) fail all the comparisons.
+ * */
+typedef struct {
+    u8 Op;      // TSP_FILTER_OP
+    u8 Column;  // compared column
+    u16 Length; // bytes of a string constant
+    u32 Reserved;
+    union {
+        s64 Int;
+        u64 UInt;
+        double Float;
+        u64 Offset; // of a string constant from the start of the program
+    } Value;
+} TspFilterInstr;
+
+/**
+ * @brief Header of a predicate program
+ * */
+typedef struct {
+    u8 Format;       // TSP_FILTER_FORMAT
+    u8 Delimiter;    // separator of the fields of text lines, e.g., ','
+    u16 Flags;       // TSP_FILTER_* flags
+    u32 RecordBytes; // size of the fixed-width records
+    u16 NumColumns;
+    u16 NumInstrs;
+    u32 Reserved;
+} TspFilterProgram;
+
+/**
+ * @brief Result of the DbFilter function. The scan stops before the matching
+ * record that does not fit in the destination (a bitmap of the destination
+ * covers at most 8 records per byte), data larger than the FDM is streamed by
+ * submitting the rest of the data (from InBytes) again.
+ * */
+typedef struct {
+    u64 InBytes;  // data bytes of the records scanned (and skipped header)
+    u64 OutBytes; // destination bytes written
+    u64 Records;  // records scanned, bit n of the bitmap is record n
+    u64 Matches;  // records selected
+} TspFilterResult;
+
+/* The RegEx function searches data for a set of patterns. Its arguments are
+ * the pattern set (FDM), its size in bytes (value), the data (FDM), its size
+ * (value), the destination of the TspRegexMatch (FDM), its size (value), the
+ * TspRegexResult (FDM) and optionally the State of a previous result to
+ * continue a search. The set is a TspRegexSet followed by its patterns, each a
+ * TspRegexPattern followed by the pattern, the next one 8 bytes aligned. The
+ * CSD keeps the sets it compiled, a set that stays in the FDM is compiled once.
+ *
+ * The syntax is the one of extended regular expressions : literals, '.',
+ * classes ([a-z], [^0-9]), escapes (\d \w \s and their negations, \xHH, \t,
+ * \n, ...), groups ((...) and (?:...)), alternations and quantifiers (*, +, ?,
+ * {m}, {m,}, {m,n}), '^' at the start of a pattern anchors it at the start of a
+ * line. '.' does not match a new line, patterns that match the empty string
+ * are rejected. */
+#define TSP_REGEX_LINES (1 << 0)    /* set : report the lines that match (once per pattern) */
+#define TSP_REGEX_CASELESS (1 << 0) /* pattern : letters match both cases */
+#define TSP_REGEX_MAX_PATTERNS 1024
+
+/**
+ * @brief Header of a pattern set
+ * */
+typedef struct {
+    u32 NumPatterns;
+    u32 Flags;   // TSP_REGEX_LINES
+} TspRegexSet;
+
+typedef struct {
+    u32 Id;      // reported with the matches
+    u32 Flags;   // TSP_REGEX_CASELESS
+    u32 Length;  // bytes of the pattern that follows
+    u32 Reserved;
+} TspRegexPattern;
+
+/**
+ * @brief A match, in the order of the data. Without TSP_REGEX_LINES, Offset is
+ * the end of the match (the offset after its last byte) and Length 0, every
+ * end of a match of a pattern is reported. With TSP_REGEX_LINES, Offset and
+ * Length are the ones of the line (without the new line), a line that started
+ * in a previous request starts at 0.
+ * */
+typedef struct {
+    u64 Offset;
+    u32 PatternId;
+    u32 Length;
+} TspRegexMatch;
+
+/**
+ * @brief Result of the RegEx function, the search stops before the matches
+ * (of a position, or of a line) that do not fit in the destination. The rest
+ * of the data (from InBytes) is searched by submitting it again with State.
+ * */
+typedef struct {
+    u64 InBytes;  // data bytes searched
+    u64 Matches;  // matches written
+    u32 State;    // state of the search at InBytes
+    u32 Reserved;
+} TspRegexResult;
+
+/* The Dedup function splits data in content defined chunks (FastCDC, gear
+ * hash) and fingerprints them with SHA-256. Its arguments are the data (FDM),
+ * its size (value), the destination of the TspDedupChunk (FDM), its size
+ * (value), the TspDedupResult (FDM) and optionally the options (value, flags
+ * in the low byte, log2 of the average chunk size in the next one). The chunks
+ * are at least a quarter and at most 8 times the average. Without
+ * TSP_DEDUP_END the data that follows the last cut is left for the next
+ * request. The fingerprint index of the CSD is kept by its daemons (in a file
+ * when they are given one, it then persists and is shared by them). */
+#define TSP_DEDUP_END (1 << 0)    /* the data ends the stream, its tail is a chunk */
+#define TSP_DEDUP_LOOKUP (1 << 1) /* looks the fingerprints up in the index */
+#define TSP_DEDUP_INSERT (1 << 2) /* looks them up and adds the new ones */
+#define TSP_DEDUP_OPTIONS(flags, avg_log2) ((flags) | (avg_log2) << 8)
+#define TSP_DEDUP_AVG_LOG2 13     /* 8 KiB chunks by default */
+#define TSP_DEDUP_MIN_AVG_LOG2 8
+#define TSP_DEDUP_MAX_AVG_LOG2 22
+
+#define TSP_DEDUP_CHUNK_KNOWN (1 << 0)  /* the fingerprint was in the index */
+#define TSP_DEDUP_INDEX_FULL (1 << 0)   /* result : fingerprints could not be added */
+
+typedef struct {
+    u64 Offset;         // in the data
+    u32 Length;
+    u32 Flags;          // TSP_DEDUP_CHUNK_KNOWN
+    u8 Fingerprint[32]; // SHA-256
+} TspDedupChunk;
+
+/**
+ * @brief Result of the Dedup function, the chunking stops before the chunks
+ * that do not fit in the destination, the rest of the data (from InBytes) is
+ * submitted again
+ * */
+typedef struct {
+    u64 InBytes;     // data bytes chunked
+    u64 Chunks;      // chunks written
+    u64 KnownChunks; // chunks found in the index
+    u64 KnownBytes;
+    u32 Flags;       // TSP_DEDUP_INDEX_FULL
+    u32 Reserved;
+} TspDedupResult;
+
+/* The Hash function computes 32-byte digests of the data, or of each object
+ * of a table of ranges of the data. Its arguments are the data (FDM), its
+ * size (value), the digests (FDM), the options (value, the algorithm in the
+ * low byte and flags) and optionally the objects (FDM, TspHashObject) and
+ * their number (value). With TSP_HASH_NAMESPACE the data is read by the CSD
+ * from its namespace instead of the FDM : the first argument is then a
+ * TspExtentList (its DevMem is not used) and the second its size, the data is
+ * the Bytes of the extents from HeadBytes (as a storage load). */
+typedef enum {
+    TSP_HASH_BLAKE3 = 0, /* BLAKE3, 32 bytes */
+    TSP_HASH_SHA256 = 1, /* SHA-256 */
+} TSP_HASH_ALGORITHM;
+
+#define TSP_HASH_NAMESPACE (1 << 8) /* the data is on the namespace */
+#define TSP_HASH_DIGEST_BYTES 32
+
+typedef struct {
+    u64 Offset; // in the data
+    u64 Length;
+} TspHashObject;
+
+/* The EC and RAID functions compute the parity of a stripe or rebuild its
+ * lost shards, in place. Their arguments are the stripe (FDM), the bytes of a
+ * shard (value), the options (value), the erased shards (64-bit value, bit i
+ * for shard i, needed to reconstruct) and optionally the distance between the
+ * shards in the FDM (value, the bytes of a shard if not given). The k data
+ * shards come first, followed by the m parity shards. With a distance larger
+ * than the shards a stripe too large for a request is processed a column
+ * slice at a time : the FDM offset of the argument selects the slice and the
+ * bytes its width, the columns are independent so the slices need no state.
+ *
+ * EC is a systematic Reed-Solomon code over GF(2^8) (polynomial 0x11D) with a
+ * Cauchy parity matrix, coefficient 1 / (i ^ j) for parity shard i and data
+ * shard j (as ISA-L gf_gen_cauchy1_matrix), any k of the shards rebuild the
+ * others. RAID computes the parity of the Linux md driver, P (XOR) for RAID 5
+ * and P and Q (generator 2) for RAID 6, its options give the level and the
+ * number of data disks, whose chunks are given in the order of md. */
+#define TSP_EC_ENCODE 0      /* computes the parity shards */
+#define TSP_EC_RECONSTRUCT 1 /* rebuilds the erased shards from the others */
+#define TSP_EC_OPTIONS(op, k, m) ((op) | (k) << 8 | (m) << 16)
+#define TSP_RAID_OPTIONS(op, level, disks) ((op) | (level) << 8 | (disks) << 16)
+#define TSP_EC_MAX_SHARDS 64 /* k + m, data disks + parity disks */
+
+/* The VectorSearch function (bit 13 of CsCapabilities, the first CustomType
+ * bit) finds the vectors of an index with the largest inner product with a
+ * query (its cosine with TSP_VECTOR_NORMALIZE), e.g., the CLIP embeddings of
+ * images closest to the embedding of a text. Its arguments are the index (FDM,
+ * at a 64-byte aligned offset), its size (value), the vectors (FDM, Dim
+ * floats each), their number (value) and the options (value), followed by :
+ * - TSP_VECTOR_SEARCH : the hits (FDM), k TspVectorHit per query, the best
+ *   first. With TSP_VECTOR_NAMESPACE the index is read by the CSD from its
+ *   namespace and kept in memory for the next queries : the first argument is
+ *   then a TspExtentList (its DevMem is not used) and the second its size.
+ * - TSP_VECTOR_BUILD : the dimension (value) and optionally the IDs of the
+ *   vectors (FDM, u64 each, their position if not given). The index is written
+ *   in the first argument, TSP_VECTOR_INDEX_BYTES() bytes, to be stored on the
+ *   namespace by the host.
+ *
+ * The index holds the vectors quantized to 8 bits with a scale per vector,
+ * grouped in lists with IVF (inverted file) : the vectors are assigned to the
+ * closest of lists centroids (k-means) and a search scans the nprobe lists
+ * whose centroids are the closest to the query, all of them if nprobe is 0.
+ * One list is an exhaustive search. The layout is the TspVectorHeader then,
+ * each at a 64-byte aligned offset, the centroids (float [lists][Dim]), the
+ * first vector of each list (u64 [lists + 1]), the IDs (u64 [n]), the scales
+ * (float [n]) and the codes (s8 [n][TSP_VECTOR_ROW_BYTES(Dim)]). */
+#define TSP_VECTOR_SEARCH 0
+#define TSP_VECTOR_BUILD 1
+#define TSP_VECTOR_NAMESPACE (1 << 4) /* the index is on the namespace */
+#define TSP_VECTOR_NORMALIZE (1 << 5) /* build : vectors scaled to a norm of 1 */
+/* k for a search, lists for a build (0 is 1), nprobe for a search */
+#define TSP_VECTOR_OPTIONS(op, n, nprobe) ((op) | (n) << 8 | (nprobe) << 24)
+#define TSP_VECTOR_MAX_K 1024
+#define TSP_VECTOR_MAX_QUERIES 256
+#define TSP_VECTOR_MAX_DIM 4096
+#define TSP_VECTOR_MAGIC 0x56505354 /* "TSPV" */
+#define TSP_VECTOR_NO_ID (~0ULL)    /* Id of the hits past the vectors searched */
+
+#define TSP_VECTOR_ALIGN(x) (((x) + 63) & ~(u64)63)
+#define TSP_VECTOR_ROW_BYTES(dim) (((dim) + 31) & ~31u)
+#define TSP_VECTOR_INDEX_BYTES(n, dim, lists)                                     \
+    (sizeof(TspVectorHeader) + TSP_VECTOR_ALIGN((u64)(lists) * (dim) * 4) +       \
+     TSP_VECTOR_ALIGN(((u64)(lists) + 1) * 8) + TSP_VECTOR_ALIGN((u64)(n) * 8) + \
+     TSP_VECTOR_ALIGN((u64)(n) * 4) + (u64)(n) * TSP_VECTOR_ROW_BYTES(dim))
+
+typedef struct {
+    u32 Magic;      // TSP_VECTOR_MAGIC
+    u32 Flags;      // TSP_VECTOR_NORMALIZE
+    u32 Dim;
+    u32 NumLists;
+    u64 NumVectors;
+    u64 Generation; // differs between builds, the cache of the CSD is keyed by it
+    u64 Bytes;      // of the index
+    u64 Reserved[3];
+} TspVectorHeader;
+
+typedef struct {
+    u64 Id;
+    float Score;
+    u32 Reserved;
+} TspVectorHit;
+
+/* The Sort function (bit 14 of CsCapabilities) sorts fixed-width records by
+ * their keys, in place in the FDM or externally, runs merged from temporary
+ * space. Its arguments are the TspSortSpec (FDM), its size (value), the data
+ * (FDM), its size (value), the options (value), the TspSortResult (FDM) and
+ * optionally a temporary file on the namespace (FDM, TspExtentList, with
+ * TSP_SORT_BEGIN) and its size (value).
+ * - TSP_SORT_RECORDS sorts the whole records of the data in place.
+ * - TSP_SORT_RUN sorts them as well and keeps the sorted run in the session,
+ *   in the temporary file or in the memory of the CSD without it.
+ *   TSP_SORT_BEGIN starts a new session, dropping the runs of the previous.
+ * - TSP_SORT_MERGE writes the next records of the merge of the runs in the
+ *   data, as many as fit. The last one sets TSP_SORT_DONE and ends the
+ *   session.
+ * The sort is stable, equal keys keep the order of the data and of the runs.
+ * The sessions are the ones of the compute daemon of the queue. */
+#define TSP_SORT_RECORDS 0
+#define TSP_SORT_RUN 1
+#define TSP_SORT_MERGE 2
+#define TSP_SORT_BEGIN (1 << 4)       /* options : starts a new session */
+#define TSP_SORT_DESCENDING (1 << 0)  /* key */
+#define TSP_SORT_DONE (1 << 0)        /* result : the merge is complete */
+#define TSP_SORT_OPTIONS(op, session) ((op) | (session) << 8)
+#define TSP_SORT_MAX_KEYS 8
+#define TSP_SORT_MAX_RUNS 256
+#define TSP_SORT_MAX_SESSIONS 4
+
+/**
+ * @brief Key of the records, a column of the type of the DbFilter columns
+ * */
+typedef struct {
+    u32 Offset; // byte offset in the record
+    u8 Type;    // TSP_FILTER_TYPE
+    u8 Width;   // bytes of a TSP_FILTER_STR, compared as unsigned bytes
+    u8 Flags;   // TSP_SORT_DESCENDING
+    u8 Reserved;
+} TspSortKey;
+
+typedef struct {
+    u32 RecordBytes;
+    u32 NumKeys;
+    TspSortKey Keys[]; // the first key is the most significant
+} TspSortSpec;
+
+typedef struct {
+    u64 InBytes;  // data bytes sorted (whole records)
+    u64 OutBytes; // data bytes of sorted records
+    u64 Records;
+    u32 Runs;     // runs of the session
+    u32 Flags;    // TSP_SORT_DONE
+} TspSortResult;
+
+/* The GroupBy function (bit 15 of CsCapabilities) aggregates fixed-width
+ * records by key with a hash table, the count of the records of each group
+ * and the sum, minimum and maximum of numeric columns. Its arguments are the
+ * TspGroupBySpec (FDM), its size (value), the data (FDM), its size (value),
+ * the options (value) and the TspGroupByResult (FDM).
+ * - TSP_GROUPBY_ADD aggregates the whole records of the data in the groups of
+ *   the session, TSP_GROUPBY_BEGIN starts a new session.
+ * - TSP_GROUPBY_OUTPUT writes the next groups in the data, as many as fit,
+ *   the last one sets TSP_GROUPBY_DONE and ends the session.
+ * A group is written as the bytes of its key columns (padded to 8 bytes), its
+ * count (u64), then the sum, minimum and maximum of each aggregate column (8
+ * bytes each : s64 for signed columns, u64 for unsigned and double for
+ * floating point), TSP_GROUPBY_ROW_BYTES(). The groups are in no order. */
+#define TSP_GROUPBY_ADD 0
+#define TSP_GROUPBY_OUTPUT 1
+#define TSP_GROUPBY_BEGIN (1 << 4) /* options : starts a new session */
+#define TSP_GROUPBY_DONE (1 << 0)  /* result : all the groups were written */
+#define TSP_GROUPBY_OPTIONS(op, session) ((op) | (session) << 8)
+#define TSP_GROUPBY_MAX_COLUMNS 16 /* keys and aggregates */
+#define TSP_GROUPBY_MAX_SESSIONS 4
+#define TSP_GROUPBY_ROW_BYTES(key_bytes, aggregates) \
+    ((((key_bytes) + 7) & ~7u) + 8 + 24 * (aggregates))
+
+typedef struct {
+    u32 RecordBytes;
+    u16 NumKeys;
+    u16 NumAggregates;
+    TspFilterColumn Columns[]; // the keys followed by the aggregates
+} TspGroupBySpec;
+
+typedef struct {
+    u64 InBytes;  // data bytes aggregated (whole records)
+    u64 OutBytes; // data bytes of the groups written
+    u64 Records;  // records aggregated, or groups written
+    u64 Groups;   // groups of the session
+    u32 Flags;    // TSP_GROUPBY_DONE
+    u32 Reserved;
+} TspGroupByResult;
+
+/*-************************
+ * Storage (extent) loads *
+ *-************************/
+
+/* The extent is not backed by storage (hole or unwritten), the CSD zero fills */
+#define TSP_EXTENT_ZERO (1 << 0)
+
+/**
+ * @brief A contiguous range of logical blocks on the namespace
+ * */
+typedef struct {
+    u64 Lba;       // first logical block of the extent
+    u32 NumBlocks; // number of logical blocks
+    u32 Flags;     // TSP_EXTENT_* flags
+} __attribute__((packed)) TspExtent;
+
+/**
+ * @brief Descriptor sent with TSP_CS_STORAGE_IO, CDW11 holds the
+ * CS_STORAGE_IO_TYPE and CDW12 the length of the descriptor in bytes.
+ *
+ * The CSD transfers Bytes bytes between the extents (in order) and the AFDM,
+ * skipping HeadBytes in the first block of the first extent. Physically
+ * contiguous extents are merged by the host so that a file is described by as
+ * few extents as its on-disk layout allows, a single command covers up to
+ * TSP_EXTENTS_PER_CMD extents.
+ * */
+typedef struct {
+    u32 NamespaceId;   // namespace the extents refer to
+    u32 LbaShift;      // log2 of the logical block size of the namespace
+    u32 HeadBytes;     // bytes to skip in the first block
+    u32 Bytes;         // total bytes to transfer
+    CsDevAFDM DevMem;  // destination (load) or source (store) in the AFDM
+    u32 NumExtents;
+    u32 Reserved;
+    TspExtent Extents[];
+} __attribute__((packed)) TspExtentList;
+
+#define TSP_EXTENTS_PER_CMD ((TSP_MDTS - sizeof(TspExtentList)) / sizeof(TspExtent))
+
+/* The completion result of a storage command is the write generation of its
+ * extents, with TSP_STORAGE_GEN_VALID set if the device tracks generations.
+ * The device changes the generation of the blocks it writes (by any means), so
+ * two loads of the same extents with the same generation load the same data. */
+#define TSP_STORAGE_GEN_VALID (1u << 31)
+
+/*-***************
+ * Request rings *
+ *-***************/
+
+/* Size of a submission entry, the compute request has to fit in it */
+#define TSP_RING_SQE_SIZE 256
+#define TSP_RING_MAX_ENTRIES 4096
+
+/**
+ * @brief Doorbell of the request rings, written by the host, alone in its
+ * cache line
+ * */
+typedef struct {
+    u32 SqTail;       // number of entries submitted since the setup (wraps)
+    u32 Reserved[15];
+} __attribute__((packed)) TspRingDoorbell;
+
+/**
+ * @brief Submission entry, holds a CsComputeRequest
+ * */
+typedef struct {
+    u16 CommandId;    // given back in the completion
+    u16 Reserved;
+    u32 Length;       // bytes of the request
+    u8 Request[TSP_RING_SQE_SIZE - 8];
+} __attribute__((packed)) TspRingSqe;
+
+/**
+ * @brief Completion entry, the device writes Phase last. Phase is 1 in the
+ * first pass over the ring and toggles at every wrap (the ring is zeroed by
+ * the host before the setup).
+ * */
+typedef struct {
+    u16 CommandId;
+    u16 Phase;
+    u32 Status;       // 0 or an NVMe status, as for a compute command
+    u32 Result;
+    u32 Reserved;
+} __attribute__((packed)) TspRingCqe;
+
+/* The rings are laid out in the FDM as : doorbell, SQ entries, CQ entries.
+ * TSP_CS_RING_SETUP sends their address in CDW12 (low) and CDW13 (high) and
+ * the number of entries in CDW14 (0 stops the device from polling), CDW15
+ * holds TSP_RING_SQE_SIZE. The device then polls the doorbell, executes the
+ * requests in order and posts a completion for each of them. */
+#define TSP_RING_BYTES(entries) \
+    (sizeof(TspRingDoorbell) + (u64)(entries) * (sizeof(TspRingSqe) + sizeof(TspRingCqe)))
+
+/*-************
+ * Statistics *
+ *-************/
+
+/* TSP_CS_GET with TSP_CS_STATS returns a TspStats followed by the counters of
+ * the functions. With TSP_STATS_DELTA in CDW12 the counters (not the gauges)
+ * are the changes since the previous delta query, which starts a new interval. */
+#define TSP_STATS_DELTA (1 << 0)
+
+/**
+ * @brief Execution counters of a function
+ * */
+typedef struct {
+    u32 FunctionId;
+    u32 Reserved;
+    u64 Executions;
+    u64 TotalNs;      // time spent executing
+    u64 MinNs;        // shortest execution, 0 if none
+    u64 MaxNs;        // longest execution
+} TspFunctionStats;
+
+/**
+ * @brief Returned by TSP_CS_STATS, all the counters fit in one command
+ * */
+typedef struct {
+    u32 Flags;              // TSP_STATS_DELTA if the counters cover an interval
+    u32 NumFunctions;       // entries of Functions
+    u64 IntervalUs;         // time covered by the counters
+    u64 PowerOnUs;
+    u64 BusyNs;             // time spent executing functions, summed over the cores
+    u64 Executions;
+    u64 FdmAllocations;
+    u64 FdmDeallocations;
+    u64 FdmAllocatedBytes;  // gauge
+    u64 FdmFreeBytes;       // gauge
+    u64 FdmLargestFree;     // gauge
+    u64 FdmLiveAllocations; // gauge
+    u64 StorageToFdmBytes;
+    u64 FdmToStorageBytes;
+    TspFunctionStats Functions[];
+} TspStats;
+
+#define TSP_STATS_MAX_FUNCTIONS \
+    ((TSP_BUFFER_SIZE - sizeof(TspStats)) / sizeof(TspFunctionStats))
+
+/*-******
+ * Jobs *
+ *-******/
+
+/* A job is a compute request that runs on the device independently of the
+ * command that submitted it. TSP_CS_JOB takes the action in CDW11 and the job
+ * ID in CDW12 (except for the submission). The result of a job is its last
+ * FDM argument. */
+typedef enum {
+    TSP_JOB_SUBMIT = 0,  /* data, CDW12 and CDW13 as TSP_CS_COMPUTE, result is the job ID */
+    TSP_JOB_STATUS = 1,  /* returns a TspJobStatus */
+    TSP_JOB_RESULT = 2,  /* reads the result from byte CDW13 (low) CDW14 (high),
+                            result is the number of bytes read */
+    TSP_JOB_CANCEL = 3,  /* the job ID may be TSP_JOB_ALL */
+    TSP_JOB_RELEASE = 4, /* forgets a job that is not running anymore */
+} TSP_JOB_ACTION;
+
+#define TSP_JOB_ALL 0xffffffff
+
+typedef enum {
+    TSP_JOB_QUEUED = 0,
+    TSP_JOB_RUNNING = 1,
+    TSP_JOB_DONE = 2,
+    TSP_JOB_FAILED = 3,
+    TSP_JOB_CANCELLED = 4,
+} TSP_JOB_STATE;
+
+/* Vendor specific status codes of TSP_CS_JOB */
+#define TSP_SC_JOB_LIMIT 0xc0   /* the device runs as many jobs as it can */
+#define TSP_SC_JOB_UNKNOWN 0xc1 /* no job with this ID */
+#define TSP_SC_JOB_BUSY 0xc2    /* the job is still running */
+
+/**
+ * @brief Returned by TSP_JOB_STATUS
+ * */
+typedef struct {
+    u32 JobId;
+    u32 State;        // TSP_JOB_STATE
+    u32 Status;       // NVMe status of the request once finished
+    u32 Progress;     // per mille, as reported by the function
+    u64 ResultBytes;  // bytes of the result that are final
+    u64 RuntimeUs;    // time spent running
+} TspJobStatus;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TSP_H__ */
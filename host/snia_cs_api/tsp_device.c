@@ -0,0 +1,282 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#include "tsp_device.h"
+#include "tsp_emu.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+static tsp_device_st *tsp_devices[TSP_MAX_DEVICES];
+static pthread_mutex_t tsp_devices_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Controllers of the contexts, protected by tsp_devices_lock */
+static tsp_ctrl_st *tsp_ctrls;
+static u64 tsp_ctrl_ids;
+
+/* Returns the controller of path with a new reference, a controller of its
+ * own if path is empty (the handle is not a device known to sysfs). Called
+ * with tsp_devices_lock held. */
+static tsp_ctrl_st *tsp_ctrl_get(const char *path) {
+    tsp_ctrl_st *ctrl;
+
+    for (ctrl = path[0] ? tsp_ctrls : NULL; ctrl; ctrl = ctrl->next) {
+        if (!strcmp(ctrl->path, path)) {
+            ctrl->refs++;
+            return ctrl;
+        }
+    }
+
+    ctrl = calloc(1, sizeof(*ctrl));
+    if (!ctrl) {
+        return NULL;
+    }
+    snprintf(ctrl->path, sizeof(ctrl->path), "%s", path);
+    ctrl->id = ++tsp_ctrl_ids;
+    ctrl->refs = 1;
+    pthread_mutex_init(&ctrl->ring_setup, NULL);
+    pthread_rwlock_init(&ctrl->ring_lock, NULL);
+    ctrl->next = tsp_ctrls;
+    tsp_ctrls = ctrl;
+    return ctrl;
+}
+
+/* Drops a reference to a controller, called with tsp_devices_lock held
+ * @return 1 if it was the last one and the controller is freed */
+static int tsp_ctrl_put(tsp_ctrl_st *ctrl) {
+    tsp_ctrl_st **p;
+
+    if (--ctrl->refs) {
+        return 0;
+    }
+    for (p = &tsp_ctrls; *p != ctrl; p = &(*p)->next) {
+    }
+    *p = ctrl->next;
+    tsp_admit_destroy(ctrl);
+    pthread_rwlock_destroy(&ctrl->ring_lock);
+    pthread_mutex_destroy(&ctrl->ring_setup);
+    free(ctrl);
+    return 1;
+}
+
+static tsp_device_st *tsp_device_create(CS_DEV_HANDLE fd, const char *ctrl_path) {
+    tsp_device_st *dev = calloc(1, sizeof(tsp_device_st));
+
+    if (!dev) {
+        return NULL;
+    }
+    dev->ctrl = tsp_ctrl_get(ctrl_path);
+    if (!dev->ctrl) {
+        free(dev);
+        return NULL;
+    }
+    dev->fd = fd;
+    pthread_rwlock_init(&dev->cache_lock, NULL);
+    pthread_mutex_init(&dev->mem_lock, NULL);
+    pthread_mutex_init(&dev->transport_lock, NULL);
+    dev->io_fd = -1;
+    return dev;
+}
+
+static void tsp_device_destroy(tsp_device_st *dev) {
+    u64 ctrl_id = dev->ctrl->id;
+    int last;
+
+    tsp_transport_release(dev);
+    pthread_mutex_destroy(&dev->transport_lock);
+    pthread_mutex_destroy(&dev->mem_lock);
+    pthread_rwlock_destroy(&dev->cache_lock);
+    pthread_mutex_lock(&tsp_devices_lock);
+    last = tsp_ctrl_put(dev->ctrl);
+    pthread_mutex_unlock(&tsp_devices_lock);
+    // The ids are not reused, the results of the controller are only dropped
+    if (last) {
+        tsp_memo_release(ctrl_id);
+    }
+    free(dev);
+}
+
+tsp_device_st *tsp_device_get(CS_DEV_HANDLE fd) {
+    char ctrl_path[PATH_MAX];
+    tsp_device_st *dev;
+    struct stat s;
+
+    if (fd < 0 || fd >= TSP_MAX_DEVICES) {
+        return NULL;
+    }
+
+    // Fast path, the context already exists
+    dev = __atomic_load_n(&tsp_devices[fd], __ATOMIC_ACQUIRE);
+    if (dev) {
+        return dev;
+    }
+
+    if (fstat(fd, &s) < 0) {
+        return NULL;
+    }
+    // The handles of a controller share its state
+    if (tsp_sysfs_ctrl_path(fd, ctrl_path) != CS_SUCCESS) {
+        ctrl_path[0] = '\0';
+    }
+
+    pthread_mutex_lock(&tsp_devices_lock);
+    dev = tsp_devices[fd];
+    if (!dev) {
+        dev = tsp_device_create(fd, ctrl_path);
+        __atomic_store_n(&tsp_devices[fd], dev, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&tsp_devices_lock);
+
+    return dev;
+}
+
+tsp_device_st *tsp_device_next(CS_DEV_HANDLE fd) {
+    for (; fd >= 0 && fd < TSP_MAX_DEVICES; ++fd) {
+        tsp_device_st *dev = __atomic_load_n(&tsp_devices[fd], __ATOMIC_ACQUIRE);
+        if (dev) {
+            return dev;
+        }
+    }
+    return NULL;
+}
+
+void tsp_device_release(CS_DEV_HANDLE fd) {
+    tsp_device_st *dev;
+
+    if (fd < 0 || fd >= TSP_MAX_DEVICES) {
+        return;
+    }
+
+    /** @note the caller has to make sure no other thread uses the handle
+     * anymore, as with close() */
+    dev = __atomic_load_n(&tsp_devices[fd], __ATOMIC_ACQUIRE);
+    if (dev) {
+        // Stopping the rings and freeing the FDM need commands, which would
+        // create a new context if this one was not published anymore
+        tsp_ring_release(dev);
+        tsp_mem_release(dev);
+    }
+
+    pthread_mutex_lock(&tsp_devices_lock);
+    dev = tsp_devices[fd];
+    __atomic_store_n(&tsp_devices[fd], NULL, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&tsp_devices_lock);
+
+    if (dev) {
+        tsp_device_destroy(dev);
+    }
+}
+
+void tsp_device_invalidate(tsp_device_st *dev) {
+    pthread_rwlock_wrlock(&dev->cache_lock);
+    memset(&dev->cache, 0, sizeof(dev->cache));
+    pthread_rwlock_unlock(&dev->cache_lock);
+}
+
+/*-*******
+ * Sysfs *
+ *-*******/
+
+int tsp_sysfs_read_u64(const char *dir, const char *attr, u64 *val) {
+    char path[PATH_MAX];
+    char buf[32];
+    ssize_t len;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, attr);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0) {
+        return -1;
+    }
+    buf[len] = '\0';
+    *val = strtoull(buf, NULL, 0);
+    return 0;
+}
+
+void tsp_path_strip(char *path) {
+    char *slash = strrchr(path, '/');
+    if (slash) {
+        *slash = '\0';
+    }
+}
+
+CS_STATUS tsp_sysfs_ctrl_path_dev(dev_t rdev, int is_chr, char *ctrl_path) {
+    char path[PATH_MAX];
+    u64 val;
+
+    snprintf(path, sizeof(path), "/sys/dev/%s/%u:%u", is_chr ? "char" : "block",
+             major(rdev), minor(rdev));
+    if (!realpath(path, ctrl_path)) {
+        return CS_ENXIO;
+    }
+
+    if (is_chr) {
+        // Namespace generic devices (ngXnY) are children of the controller
+        const char *name = strrchr(ctrl_path, '/');
+        if (name && !strncmp(name + 1, "ng", 2)) {
+            tsp_path_strip(ctrl_path);
+        }
+    } else {
+        if (tsp_sysfs_read_u64(ctrl_path, "partition", &val) == 0) {
+            tsp_path_strip(ctrl_path);
+        }
+        tsp_path_strip(ctrl_path);
+    }
+
+    return CS_SUCCESS;
+}
+
+CS_STATUS tsp_sysfs_ctrl_path(CS_DEV_HANDLE fd, char *ctrl_path) {
+    struct tsp_emu *emu = tsp_emu_lookup(fd);
+    struct stat s;
+
+    // Emulated CSx are not in sysfs, the name stands for the controller
+    if (emu) {
+        snprintf(ctrl_path, PATH_MAX, "%s", tsp_emu_name(emu));
+        return CS_SUCCESS;
+    }
+
+    if (fstat(fd, &s) < 0) {
+        return CS_INVALID_HANDLE;
+    }
+
+    if (!S_ISCHR(s.st_mode) && !S_ISBLK(s.st_mode)) {
+        return CS_INVALID_HANDLE;
+    }
+
+    return tsp_sysfs_ctrl_path_dev(s.st_rdev, S_ISCHR(s.st_mode), ctrl_path);
+}
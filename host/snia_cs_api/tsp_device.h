@@ -0,0 +1,335 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Per CSx context of the library, internal to the CS API implementation.
+ *
+ * A context is created the first time a CSx handle is used and released by
+ * csCloseCSx(). Contexts are indexed by the handle (file descriptor) so that
+ * looking them up does not require any lock.
+ *
+ * The handles opened on the same controller (e.g., by csOpenCSx() and
+ * csOpenCSE()) have their own context but share the state of the controller,
+ * its load, its request rings and what limits it, which lives as long as one
+ * of them.
+ * */
+
+#ifndef __TSP_DEVICE_H__
+#define __TSP_DEVICE_H__
+
+#include "cs.h"
+#include "tsp.h"
+#include "tsp_wire.h"
+
+#include <pthread.h>
+#include <limits.h>
+#include <sys/types.h>
+
+/* Contexts exist for handles (file descriptors) below this value */
+#define TSP_MAX_DEVICES 1024
+
+struct tsp_mem;
+struct tsp_ring;
+struct tsp_cmd;
+struct tsp_admit;
+
+/* Size of the name index of the functions, a power of two that keeps the
+ * index at most half full */
+#define TSP_FUNCTION_INDEX_SIZE 128
+
+/* State of a controller shared by the contexts of its handles */
+typedef struct tsp_ctrl {
+    char path[PATH_MAX];      /* sysfs directory of the controller, "" if unknown */
+    u64 id;                   /* unique over the life of the process */
+    u32 refs;                 /* contexts of the controller, under the device lock */
+    u32 outstanding;          /* commands in flight, atomic, used by the scheduler */
+    pthread_mutex_t ring_setup; /* serializes enabling and disabling the rings */
+    pthread_rwlock_t ring_lock; /* held by the users of ring, written to unpublish it */
+    struct tsp_ring *ring;    /* shared-memory request rings, see cs_ring.c */
+    struct tsp_admit *admit;  /* admission control, NULL without limits, see cs_admit.c */
+    struct tsp_ctrl *next;
+} tsp_ctrl_st;
+
+/* Function table of a CSx with its index on the names */
+typedef struct {
+    u32 num;
+    TspFunctionEntry entry[TSP_FUNCTIONS_MAX];
+    u8 index[TSP_FUNCTION_INDEX_SIZE]; /* open addressing, entry + 1 (0 if free) */
+} tsp_functions_st;
+
+/* Discovery information cached after the first query, see cs_api_nvme_tsp.c */
+typedef struct {
+    int has_cs;                /* the device identified as a CSx */
+    int props_valid;
+    u8 props[TSP_BUFFER_SIZE]; /* CSxProperties (and CSEs) as returned by the device */
+    int caps_valid;
+    CsCapabilities caps;
+    u64 fid_valid;             /* bit n set if fid[n] is the id of function bit n */
+    CS_FUNCTION_ID fid[64];
+    int ctrl_valid;
+    char ctrl_path[PATH_MAX];  /* sysfs directory of the controller */
+    int wire_valid;
+    TspWireInfo wire;          /* wire formats of the compute commands */
+    int functions_valid;
+    tsp_functions_st functions;
+} tsp_cache_st;
+
+typedef struct tsp_device {
+    CS_DEV_HANDLE fd;
+    tsp_ctrl_st *ctrl;        /* shared with the other handles of the controller */
+    pthread_rwlock_t cache_lock; /* protects cache */
+    tsp_cache_st cache;
+    pthread_mutex_t mem_lock; /* protects mem */
+    struct tsp_mem *mem;      /* FDM sub-allocator state, see cs_mem.c */
+    /* Host mapping of the device memory window (PCI BAR), protected by mem_lock */
+    void *window_va;
+    u64 window_base;          /* bus address of the window */
+    u64 window_size;
+    int window_state;         /* 0 : not mapped yet, 1 : mapped, -1 : unavailable */
+    /* Transport of the commands, see tsp_transport.c */
+    pthread_mutex_t transport_lock;
+    const struct tsp_transport_ops *transport; /* NULL until set up */
+    void *transport_priv;     /* state of the transport (e.g., io_uring ring) */
+    int admin_only;           /* the firmware rejected the I/O opcodes */
+    int io_fd;                /* namespace (generic) device */
+    u32 nsid;
+    /* Bytes copied by the host to and from the FDM, atomic, see cs_stats.c */
+    u64 host_to_fdm;
+    u64 fdm_to_host;
+    u64 host_to_fdm_base;     /* values at the last delta query */
+    u64 fdm_to_host_base;
+} tsp_device_st;
+
+/**
+ * @brief Returns the context of a CSx handle, creates it if needed
+ * @return NULL if the handle is invalid or memory is exhausted
+ * */
+tsp_device_st *tsp_device_get(CS_DEV_HANDLE fd);
+
+/**
+ * @brief Returns the context of the first open CSx with a handle greater than
+ * or equal to fd, allows to iterate over all contexts, NULL when done.
+ * */
+tsp_device_st *tsp_device_next(CS_DEV_HANDLE fd);
+
+/**
+ * @brief Releases all the resources associated to a CSx handle
+ * */
+void tsp_device_release(CS_DEV_HANDLE fd);
+
+/**
+ * @brief Drops the cached discovery information, it will be queried from the
+ * device again when needed
+ * */
+void tsp_device_invalidate(tsp_device_st *dev);
+
+/**
+ * @brief Accounts for a command sent to (delta 1) or completed by (delta -1)
+ * the CSx, the count of commands in flight on its controller (by any of its
+ * handles) is the load seen by the scheduler
+ * */
+static inline void tsp_device_busy(CS_DEV_HANDLE fd, int delta) {
+    tsp_device_st *dev = tsp_device_get(fd);
+    if (dev) {
+        __atomic_add_fetch(&dev->ctrl->outstanding, delta, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Reads an integer attribute (decimal or hex) in a sysfs directory
+ * @return 0 on success, -1 otherwise
+ * */
+int tsp_sysfs_read_u64(const char *dir, const char *attr, u64 *val);
+
+/**
+ * @brief Strips the last component of a path, "/a/b/c" becomes "/a/b"
+ * */
+void tsp_path_strip(char *path);
+
+/**
+ * @brief Resolves the sysfs directory of the NVMe controller behind a CSx
+ * handle, the handle may be the controller character device or a namespace
+ * block device. ctrl_path must hold PATH_MAX bytes.
+ * */
+CS_STATUS tsp_sysfs_ctrl_path(CS_DEV_HANDLE fd, char *ctrl_path);
+
+/**
+ * @brief Same as tsp_sysfs_ctrl_path() from a device number, for a character
+ * device (controller or namespace generic device) or a block device (namespace
+ * or partition).
+ * */
+CS_STATUS tsp_sysfs_ctrl_path_dev(dev_t rdev, int is_chr, char *ctrl_path);
+
+/* cs_api_nvme_tsp.c */
+/* Named functions in CsCapabilities, VectorSearch, Sort and GroupBy are the first
+ * CustomType bits */
+#define TSP_NUM_FUNCTIONS 16
+
+/* Returned by the identify command of a CSx */
+extern const char *TSP_CS_ID_STRING;
+
+int tsp_cached_has_cs(CS_DEV_HANDLE fd);
+CS_STATUS tsp_cached_capabilities(CS_DEV_HANDLE fd, CsCapabilities *caps);
+CS_STATUS tsp_cached_ctrl_path(CS_DEV_HANDLE fd, char *ctrl_path);
+
+/**
+ * @brief Fills the command and its buffer for n compute requests on the same
+ * CSE. The wire format is used if the device supports it, transfers larger
+ * than buffer (TSP_BUFFER_SIZE) are allocated and returned in *heap, to be
+ * freed by the caller once the command completed. Devices that only support
+ * the legacy format take a single request of up to TSP_BUFFER_SIZE bytes.
+ * */
+CS_STATUS tsp_compute_command(CsComputeRequest **reqs, int n, struct tsp_cmd *cmd,
+                              char *buffer, void **heap);
+
+/**
+ * @brief Returns the name of function bit n of CsCapabilities, NULL if unnamed
+ * */
+const char *tsp_function_name(int bit);
+
+/**
+ * @brief Returns the bit of CsCapabilities of a named function, -1 if unknown
+ * */
+int tsp_function_bit(const char *name);
+
+/* cs_mem.c */
+void tsp_mem_release(tsp_device_st *dev);
+
+/**
+ * @brief Copies between the host and the FDM, without the checks of
+ * csQueueCopyMemRequest()
+ * */
+CS_STATUS tsp_mem_copy(const CsCopyMemRequest *CopyReq);
+
+/* tsp_transport.c */
+void tsp_transport_release(tsp_device_st *dev);
+
+/* cs_ring.c */
+/* Disables the request rings of the controller if enabled through dev */
+void tsp_ring_release(tsp_device_st *dev);
+
+/**
+ * @brief Sends a compute request through the request rings of its CSE
+ * @return CS_UNSUPPORTED if the rings are not enabled or the request does not
+ * fit in an entry, the status of the request otherwise (CS_QUEUED if
+ * asynchronous)
+ * */
+CS_STATUS tsp_ring_compute(CsComputeRequest *req, size_t size, void *Context,
+                           csQueueCallbackFn CallbackFn, CS_EVT_HANDLE EventHandle);
+
+/* cs_admit.c */
+#define TSP_ADMIT_MAX_FUNCTIONS 16 /* functions with a limit per CSx */
+
+/* Admission of a command, released once the command completed */
+typedef struct {
+    struct tsp_admit *admit; /* NULL if the CSx has no limits */
+    u32 tenant;
+    u32 requests;
+    u16 functions[TSP_ADMIT_MAX_FUNCTIONS]; /* requests of each limited function */
+} tsp_admit_ticket_st;
+
+/**
+ * @brief Admits a command of n requests, of the functions fids, on a CSx. The
+ * caller waits if the CSx queues the requests over its limits, except from a
+ * completion (see tsp_admit_completion()).
+ * @return CS_SUCCESS, or CS_OUT_OF_RESOURCES if the command is refused
+ * */
+CS_STATUS tsp_admit_acquire(CS_DEV_HANDLE fd, const CS_FUNCTION_ID *fids, int n,
+                            tsp_admit_ticket_st *ticket);
+
+/**
+ * @brief Releases the admission of a command, the requests waiting for it are
+ * admitted
+ * */
+void tsp_admit_release(tsp_admit_ticket_st *ticket);
+
+/**
+ * @brief Marks the calling thread as running completion callbacks (1) until it
+ * is done (-1), the requests they issue are refused rather than queued
+ * */
+void tsp_admit_completion(int delta);
+
+void tsp_admit_destroy(tsp_ctrl_st *ctrl);
+
+/* cs_memo.c */
+struct tsp_memo_key;
+
+/**
+ * @brief Looks up the result of a compute request in the result cache. On a
+ * hit, the result is written to the last FDM argument of the request. On a
+ * miss, *key is set if the request may be cached, to be passed to
+ * tsp_memo_insert() once the request completed.
+ * @return 1 on a hit, 0 otherwise
+ * */
+int tsp_memo_lookup(const CsComputeRequest *req, struct tsp_memo_key **key);
+
+/**
+ * @brief Caches the result of a request if it succeeded and frees its key,
+ * key may be NULL
+ * */
+void tsp_memo_insert(struct tsp_memo_key *key, CS_STATUS status);
+
+/**
+ * @brief Forgets the content of the FDM the requests may write to, for
+ * requests that did not go through tsp_memo_lookup()
+ * */
+void tsp_memo_invalidate_args(CsComputeRequest **reqs, int n);
+
+/**
+ * @brief Forgets the content of FDM written by the host
+ * */
+void tsp_memo_written(CS_MEM_HANDLE mem, u64 offset, u64 bytes);
+
+/**
+ * @brief Forgets the content of all the FDM of a CSx, for commands whose
+ * outputs are not known
+ * */
+void tsp_memo_invalidate_device(CS_DEV_HANDLE fd);
+
+/**
+ * @brief Records a completed storage command of an extent list, result is its
+ * completion result. append is set if the list continues the previous one of
+ * the same load.
+ * */
+void tsp_memo_storage(CS_DEV_HANDLE fd, CS_STORAGE_IO_TYPE type, const TspExtentList *list,
+                      u32 result, int append);
+
+/**
+ * @brief Forgets the content of the FDM allocations in [base, base + bytes),
+ * freed at once (e.g., the arenas of a closed handle)
+ * */
+void tsp_memo_freed(CS_MEM_HANDLE base, u64 bytes);
+
+/**
+ * @brief Drops the memoized functions and results of a controller, once its
+ * last handle is closed
+ * */
+void tsp_memo_release(u64 ctrl);
+
+/* cs_event.c */
+void tsp_event_arm(CS_EVT_HANDLE EventHandle);
+void tsp_event_signal(CS_EVT_HANDLE EventHandle, CS_STATUS status);
+
+#endif /* __TSP_DEVICE_H__ */
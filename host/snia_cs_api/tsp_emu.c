@@ -0,0 +1,1901 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#include "tsp_emu.h"
+#include "tsp_device.h"
+#include "tsp_wire.h"
+#include "cs_tsp.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#define TSP_EMU_MAX_DEVICES 64
+#define TSP_EMU_MAX_FUNCTIONS 64
+#define TSP_EMU_MAX_RELAYS 64
+/* Arguments that fit in a legacy compute command */
+#define TSP_EMU_MAX_ARGS ((TSP_BUFFER_SIZE - offsetof(CsComputeRequest, Args)) / sizeof(CsComputeArg))
+/* Arguments and requests that fit in a wire format compute command */
+#define TSP_EMU_MAX_WIRE_ARGS \
+    ((TSP_MDTS - sizeof(TspWireHeader) - sizeof(TspWireRequest)) / sizeof(TspWireArg))
+#define TSP_EMU_MAX_BATCH 64
+/* Jobs kept by each device, running or finished (until released) */
+#define TSP_EMU_MAX_JOBS 64
+/* Granularity of the progress of the sleep function */
+#define TSP_EMU_SLEEP_SLICE_MS 10
+/* Statistics slots of each device, the CPUs share them modulo this value */
+#define TSP_EMU_STAT_SLOTS 16
+
+/* The FDM of each device has its own (bus) address range */
+#define TSP_EMU_FDM_BASE(index) ((u64)((index) + 1) << 36)
+#define TSP_EMU_FDM_ALIGN 4096ULL
+/* The ring poller spins, then yields, this many times before sleeping between
+ * polls */
+#define TSP_EMU_RING_SPINS 1000
+#define TSP_EMU_RING_YIELDS 100000
+#define TSP_EMU_RING_IDLE_NS 20000L
+/* Logical block size of the namespace */
+#define TSP_EMU_LBA_SHIFT 9
+/* Write generations are kept per chunk of the namespace, in a hashed table */
+#define TSP_EMU_GEN_CHUNK_SHIFT 20
+#define TSP_EMU_GEN_SLOTS 4096
+/* Delays end with a busy wait of at most this long */
+#define TSP_EMU_SPIN_NS 100000L
+
+#define TSP_EMU_VENDOR_ID 0xffff
+/* Named built-in functions have the ID TSP_EMU_FUNCTION_ID_BASE + bit */
+#define TSP_EMU_FUNCTION_ID_BASE 1
+#define TSP_EMU_SLEEP_FUNCTION_ID 100
+
+/* NVMe generic command status */
+#define TSP_EMU_SC_INVALID_FIELD 0x2
+#define TSP_EMU_SC_INTERNAL 0x6
+
+/* Region of the FDM, free or allocated, the list is sorted by offset */
+typedef struct tsp_emu_region {
+    u64 offset;
+    u64 size;
+    int used;
+    struct tsp_emu_region *next;
+} tsp_emu_region_st;
+
+/* Asynchronous command waiting for a worker */
+typedef struct tsp_emu_work {
+    tsp_cmd_st *cmd;
+    struct tsp_emu_work *next;
+} tsp_emu_work_st;
+
+typedef struct {
+    u32 id;                 /* 0 if the slot is free */
+    u32 state;              /* TSP_JOB_STATE */
+    u32 status;
+    u32 progress;
+    u64 result_bytes;
+    int reported;           /* the function reported result_bytes */
+    int cancel;
+    struct timespec start;
+    u64 runtime_us;
+    /* Result (last FDM argument), set when the function starts */
+    void *result;
+    u64 result_max;
+    /* Copy of the compute command, owned by the job thread */
+    tsp_cmd_st cmd;
+    struct tsp_emu *emu;
+} tsp_emu_job_st;
+
+/* Execution counters of a function, min_ns is 0 until the first execution */
+typedef struct {
+    u64 executions;
+    u64 total_ns;
+    u64 min_ns;
+    u64 max_ns;
+    u64 win_min_ns; /* since the last delta query */
+    u64 win_max_ns;
+} tsp_emu_fstat_st;
+
+/* Counters of the CPUs using a slot, updated with relaxed atomics without any
+ * lock, functions are indexed like stat_keys */
+typedef struct {
+    u64 busy_ns;
+    u64 allocations;
+    u64 deallocations;
+    u64 storage_to_fdm;
+    u64 fdm_to_storage;
+    tsp_emu_fstat_st functions[TSP_EMU_MAX_FUNCTIONS];
+} __attribute__((aligned(64))) tsp_emu_stat_slot_st;
+
+struct tsp_emu {
+    char name[32];
+    int index;
+    /* FDM, host memory shared with the library through the memfd */
+    int memfd;
+    void *fdm;
+    u64 fdm_base;
+    u64 fdm_size;
+    pthread_mutex_t fdm_lock; /* protects regions */
+    tsp_emu_region_st *regions;
+    /* Performance model, protected by model_lock */
+    pthread_mutex_t model_lock;
+    CsTspEmuModel model;
+    struct timespec link_free;    /* the link is busy until then */
+    struct timespec storage_free; /* the storage is busy until then */
+    int ns_fd;                    /* backing file of the namespace */
+    u32 gens[TSP_EMU_GEN_SLOTS];  /* write generations of the chunks, atomic */
+    /* Relays, sockets indexed by the descriptor given to the host */
+    pthread_mutex_t relay_lock;
+    int relays[TSP_EMU_MAX_RELAYS];
+    /* Workers executing the asynchronous commands, protected by work_lock */
+    pthread_mutex_t work_lock;
+    pthread_cond_t work_cond;
+    tsp_emu_work_st *work_head;
+    tsp_emu_work_st *work_tail;
+    int num_workers;
+    int workers_started;
+    /* Request rings polled by ring_thread, protected by ring_lock */
+    pthread_mutex_t ring_lock;
+    pthread_t ring_thread;
+    int ring_running;
+    int ring_stop;
+    char *ring_va;
+    u32 ring_entries;
+    /* Jobs, protected by job_lock (progress and cancel are also atomic) */
+    pthread_mutex_t job_lock;
+    tsp_emu_job_st jobs[TSP_EMU_MAX_JOBS];
+    u32 next_job;
+    /* Statistics, the slots are summed by the queries which stat_lock
+     * serializes, stat_keys are the function IDs + 1 (0 for a free entry) */
+    tsp_emu_stat_slot_st *stat_slots;
+    u64 stat_keys[TSP_EMU_MAX_FUNCTIONS];
+    pthread_mutex_t stat_lock;
+    u64 created_ns;
+    u64 delta_ns;                   /* start of the current delta interval */
+    tsp_emu_stat_slot_st stat_base; /* totals at the last delta query */
+};
+
+typedef struct {
+    CS_FUNCTION_ID id;
+    int bit; /* bit in CsCapabilities, -1 if none */
+    csTspEmuFunctionFn fn;
+    TspFunctionEntry entry; /* as reported by TSP_CS_FUNCTIONS, NumUnits 0 for the workers */
+} tsp_emu_function_st;
+
+/* As sent by the host with TSP_CS_OPEN_RELAY */
+typedef struct {
+    char node[256];
+    char service[256];
+} __attribute__((packed)) tsp_emu_addr_st;
+
+static struct tsp_emu *tsp_emus[TSP_EMU_MAX_DEVICES];
+static pthread_mutex_t tsp_emus_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Emulated device of each handle, NULL for real devices */
+static struct tsp_emu *tsp_emu_handles[TSP_MAX_DEVICES];
+
+static tsp_emu_function_st tsp_emu_functions[TSP_EMU_MAX_FUNCTIONS];
+static int tsp_emu_num_functions;
+static pthread_rwlock_t tsp_emu_functions_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_once_t tsp_emu_builtins_once = PTHREAD_ONCE_INIT;
+/* Job run by the calling thread, see csTspEmuJobProgress() */
+static __thread tsp_emu_job_st *tsp_emu_current_job;
+
+static u32 tsp_emu_env(const char *name, u32 def) {
+    const char *env = getenv(name);
+    return env ? (u32)strtoul(env, NULL, 0) : def;
+}
+
+/*-***********
+ * Functions *
+ *-***********/
+
+static CS_STATUS tsp_emu_checksum(const CsComputeRequest *req, const CsTspEmuArg *args) {
+    const u8 *data;
+    u32 bytes, sum = 0, word;
+
+    if (req->NumArgs < 3 || !args[0].Ptr || !args[2].Ptr || args[2].Bytes < sizeof(sum)) {
+        return CS_INVALID_ARG;
+    }
+    bytes = req->Args[1].u.Value32;
+    if (bytes > args[0].Bytes) {
+        return CS_INVALID_LENGTH;
+    }
+    // The other algorithms are only provided by the compute daemon of the CSD
+    if (req->NumArgs > 3 && req->Args[3].u.Value32 != TSP_CHECKSUM_SUM32) {
+        return CS_UNSUPPORTED;
+    }
+
+    data = args[0].Ptr;
+    for (; bytes >= sizeof(word); bytes -= sizeof(word), data += sizeof(word)) {
+        memcpy(&word, data, sizeof(word));
+        sum += word;
+    }
+    // The last word is zero padded
+    if (bytes) {
+        word = 0;
+        memcpy(&word, data, bytes);
+        sum += word;
+    }
+
+    memcpy(args[2].Ptr, &sum, sizeof(sum));
+    return CS_SUCCESS;
+}
+
+static CS_STATUS tsp_emu_sleep(const CsComputeRequest *req, const CsTspEmuArg *args) {
+    struct timespec ts;
+    u32 ms, slept = 0;
+
+    if (req->NumArgs < 1) {
+        return CS_INVALID_ARG;
+    }
+    ms = req->Args[0].u.Value32;
+
+    // Sleeps in slices to report the progress and notice the cancellation of a job
+    while (slept < ms) {
+        u32 slice = ms - slept < TSP_EMU_SLEEP_SLICE_MS ? ms - slept : TSP_EMU_SLEEP_SLICE_MS;
+        ts.tv_sec = slice / 1000;
+        ts.tv_nsec = (slice % 1000) * 1000000L;
+        while (nanosleep(&ts, &ts) && errno == EINTR);
+        slept += slice;
+        if (csTspEmuJobProgress((u64)slept * 1000 / ms, 0)) {
+            return CS_ERROR_IN_EXECUTION;
+        }
+    }
+    return CS_SUCCESS;
+}
+
+static CS_STATUS tsp_emu_register(const TspFunctionEntry *entry, csTspEmuFunctionFn fn) {
+    CS_FUNCTION_ID id = entry->FunctionId;
+    int bit = entry->Bit == TSP_FUNCTION_NO_BIT ? -1 : entry->Bit;
+    CS_STATUS status = CS_SUCCESS;
+    int i;
+
+    pthread_rwlock_wrlock(&tsp_emu_functions_lock);
+    for (i = 0; i < tsp_emu_num_functions; ++i) {
+        if (tsp_emu_functions[i].id == id || (bit >= 0 && tsp_emu_functions[i].bit == bit)) {
+            break;
+        }
+    }
+    if (!fn) {
+        // Removal, the last entry takes the place of the removed one
+        if (i < tsp_emu_num_functions) {
+            tsp_emu_functions[i] = tsp_emu_functions[--tsp_emu_num_functions];
+        }
+    } else if (i == TSP_EMU_MAX_FUNCTIONS) {
+        status = CS_NOT_ENOUGH_MEMORY;
+    } else {
+        tsp_emu_functions[i].id = id;
+        tsp_emu_functions[i].bit = bit;
+        tsp_emu_functions[i].fn = fn;
+        tsp_emu_functions[i].entry = *entry;
+        if (i == tsp_emu_num_functions) {
+            tsp_emu_num_functions++;
+        }
+    }
+    pthread_rwlock_unlock(&tsp_emu_functions_lock);
+    return status;
+}
+
+/* Entry of a function without signature, named after its bit */
+static void tsp_emu_entry(TspFunctionEntry *entry, CS_FUNCTION_ID id, int bit) {
+    memset(entry, 0, sizeof(*entry));
+    entry->FunctionId = id;
+    entry->Bit = bit < 0 ? TSP_FUNCTION_NO_BIT : bit;
+    if (tsp_function_name(bit)) {
+        snprintf(entry->Name, sizeof(entry->Name), "%s", tsp_function_name(bit));
+    } else {
+        snprintf(entry->Name, sizeof(entry->Name), "Function%u", id);
+    }
+}
+
+static void tsp_emu_register_builtins(void) {
+    TspFunctionEntry entry;
+
+    tsp_emu_entry(&entry, TSP_EMU_FUNCTION_ID_BASE + tsp_function_bit("Checksum"),
+                  tsp_function_bit("Checksum"));
+    entry.Flags = TSP_FUNCTION_SIGNATURE;
+    entry.MinArgs = 3;
+    entry.MaxArgs = 4;
+    entry.ArgTypes[0] = CS_AFDM_TYPE;
+    entry.ArgTypes[1] = CS_32BIT_VALUE_TYPE;
+    entry.ArgTypes[2] = CS_AFDM_TYPE;
+    entry.ArgTypes[3] = CS_32BIT_VALUE_TYPE;
+    tsp_emu_register(&entry, tsp_emu_checksum);
+
+    tsp_emu_entry(&entry, TSP_EMU_SLEEP_FUNCTION_ID, -1);
+    snprintf(entry.Name, sizeof(entry.Name), "Sleep");
+    entry.Flags = TSP_FUNCTION_SIGNATURE;
+    entry.MinArgs = 1;
+    entry.MaxArgs = 1;
+    entry.ArgTypes[0] = CS_32BIT_VALUE_TYPE;
+    tsp_emu_register(&entry, tsp_emu_sleep);
+}
+
+/**
+ * @copydoc csTspEmuRegisterFunction
+ * */
+CS_STATUS csTspEmuRegisterFunction(CS_FUNCTION_ID FunctionId, int FunctionBit,
+                                   csTspEmuFunctionFn Fn) {
+    TspFunctionEntry entry;
+
+    if (FunctionBit < -1 || FunctionBit >= 64) {
+        return CS_INVALID_ARG;
+    }
+
+    // The built-in functions can be replaced
+    pthread_once(&tsp_emu_builtins_once, tsp_emu_register_builtins);
+    tsp_emu_entry(&entry, FunctionId, FunctionBit);
+    return tsp_emu_register(&entry, Fn);
+}
+
+/**
+ * @copydoc csTspEmuRegisterFunctionInfo
+ * */
+CS_STATUS csTspEmuRegisterFunctionInfo(const CsTspFunctionInfo *Info,
+                                       csTspEmuFunctionFn Fn) {
+    TspFunctionEntry entry;
+
+    if (!Info || Info->FunctionBit < -1 || Info->FunctionBit >= 64 ||
+        Info->NumUnits > 0xFF || Info->MinArgs > Info->MaxArgs ||
+        Info->MaxArgs > CS_TSP_FUNCTION_MAX_ARGS) {
+        return CS_INVALID_ARG;
+    }
+
+    pthread_once(&tsp_emu_builtins_once, tsp_emu_register_builtins);
+    tsp_emu_entry(&entry, Info->FunctionId, Info->FunctionBit);
+    if (Info->Name[0]) {
+        snprintf(entry.Name, sizeof(entry.Name), "%.*s", (int)sizeof(Info->Name), Info->Name);
+    }
+    entry.NumUnits = Info->NumUnits;
+    if (Info->HasSignature) {
+        entry.Flags = TSP_FUNCTION_SIGNATURE | (Info->Variadic ? TSP_FUNCTION_VARIADIC : 0);
+        entry.MinArgs = Info->MinArgs;
+        entry.MaxArgs = Info->MaxArgs;
+        for (u32 i = 0; i < Info->MaxArgs; ++i) {
+            entry.ArgTypes[i] = Info->ArgTypes[i];
+        }
+    }
+    return tsp_emu_register(&entry, Fn);
+}
+
+/*-*****
+ * FDM *
+ *-*****/
+
+static u64 tsp_emu_alloc(struct tsp_emu *emu, u64 bytes) {
+    u64 addr = 0;
+
+    bytes = (bytes + TSP_EMU_FDM_ALIGN - 1) & ~(TSP_EMU_FDM_ALIGN - 1);
+    if (!bytes) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&emu->fdm_lock);
+    // First fit
+    for (tsp_emu_region_st *r = emu->regions; r; r = r->next) {
+        if (r->used || r->size < bytes) {
+            continue;
+        }
+        if (r->size > bytes) {
+            tsp_emu_region_st *rest = malloc(sizeof(tsp_emu_region_st));
+            if (!rest) {
+                break;
+            }
+            rest->offset = r->offset + bytes;
+            rest->size = r->size - bytes;
+            rest->used = 0;
+            rest->next = r->next;
+            r->next = rest;
+            r->size = bytes;
+        }
+        r->used = 1;
+        addr = emu->fdm_base + r->offset;
+        break;
+    }
+    pthread_mutex_unlock(&emu->fdm_lock);
+
+    return addr;
+}
+
+static int tsp_emu_free(struct tsp_emu *emu, u64 addr) {
+    tsp_emu_region_st *prev = NULL, *r;
+    int ret = -1;
+
+    pthread_mutex_lock(&emu->fdm_lock);
+    for (r = emu->regions; r; prev = r, r = r->next) {
+        if (emu->fdm_base + r->offset == addr) {
+            break;
+        }
+    }
+    if (r && r->used) {
+        r->used = 0;
+        // Coalesces with the free neighbours
+        if (r->next && !r->next->used) {
+            tsp_emu_region_st *next = r->next;
+            r->size += next->size;
+            r->next = next->next;
+            free(next);
+        }
+        if (prev && !prev->used) {
+            prev->size += r->size;
+            prev->next = r->next;
+            free(r);
+        }
+        ret = 0;
+    }
+    pthread_mutex_unlock(&emu->fdm_lock);
+
+    return ret;
+}
+
+/* Host address of addr, which has to be in an allocation, bytes is set to the
+ * bytes from addr to the end of the allocation */
+static void *tsp_emu_va(struct tsp_emu *emu, u64 addr, u64 *bytes) {
+    void *va = NULL;
+
+    if (addr < emu->fdm_base || addr >= emu->fdm_base + emu->fdm_size) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&emu->fdm_lock);
+    for (tsp_emu_region_st *r = emu->regions; r; r = r->next) {
+        u64 offset = addr - emu->fdm_base;
+        if (offset >= r->offset && offset < r->offset + r->size) {
+            if (r->used) {
+                va = (char *)emu->fdm + offset;
+                *bytes = r->offset + r->size - offset;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&emu->fdm_lock);
+
+    return va;
+}
+
+CS_STATUS tsp_emu_map_window(struct tsp_emu *emu, void **va, u64 *base, u64 *size) {
+    void *mapped = mmap(NULL, emu->fdm_size, PROT_READ | PROT_WRITE, MAP_SHARED, emu->memfd, 0);
+
+    if (mapped == MAP_FAILED) {
+        return CS_COULD_NOT_MAP_MEMORY;
+    }
+    *va = mapped;
+    *base = emu->fdm_base;
+    *size = emu->fdm_size;
+    return CS_SUCCESS;
+}
+
+/*-*******
+ * Model *
+ *-*******/
+
+static void tsp_emu_ts_add(struct timespec *ts, u64 ns) {
+    ns += ts->tv_nsec;
+    ts->tv_sec += ns / 1000000000ULL;
+    ts->tv_nsec = ns % 1000000000ULL;
+}
+
+/* Time to transfer bytes at mbps MB/s (1 MB/s is 1 byte per us) */
+static u64 tsp_emu_transfer_ns(u64 bytes, u32 mbps) {
+    return mbps ? bytes * 1000 / mbps : 0;
+}
+
+/* Reserves a resource shared by the commands (link, storage) for ns, busy is
+ * the time the resource is busy until, end is set to the end of the reservation */
+static void tsp_emu_reserve(struct tsp_emu *emu, struct timespec *busy, u64 ns, struct timespec *end) {
+    clock_gettime(CLOCK_MONOTONIC, end);
+
+    pthread_mutex_lock(&emu->model_lock);
+    if (busy->tv_sec > end->tv_sec ||
+        (busy->tv_sec == end->tv_sec && busy->tv_nsec > end->tv_nsec)) {
+        *end = *busy;
+    }
+    tsp_emu_ts_add(end, ns);
+    *busy = *end;
+    pthread_mutex_unlock(&emu->model_lock);
+}
+
+/* Sleeps until shortly before the deadline and spins for the rest, a sleep
+ * alone overshoots by the timer slack (tens of us) which is of the order of the
+ * latencies modelled */
+static void tsp_emu_wait(const struct timespec *deadline) {
+    struct timespec wake = *deadline, now;
+
+    if (wake.tv_nsec >= TSP_EMU_SPIN_NS) {
+        wake.tv_nsec -= TSP_EMU_SPIN_NS;
+    } else {
+        wake.tv_sec--;
+        wake.tv_nsec += 1000000000L - TSP_EMU_SPIN_NS;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR);
+
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (now.tv_sec < deadline->tv_sec ||
+             (now.tv_sec == deadline->tv_sec && now.tv_nsec < deadline->tv_nsec));
+}
+
+/* Delays a command by its transfer on the link and the latency */
+static void tsp_emu_command_delay(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    struct timespec deadline;
+    CsTspEmuModel model;
+
+    pthread_mutex_lock(&emu->model_lock);
+    model = emu->model;
+    pthread_mutex_unlock(&emu->model_lock);
+
+    if (!model.LatencyUs && !model.LinkMBps) {
+        return;
+    }
+    tsp_emu_reserve(emu, &emu->link_free, tsp_emu_transfer_ns(cmd->data_len, model.LinkMBps), &deadline);
+    tsp_emu_ts_add(&deadline, model.LatencyUs * 1000ULL);
+    tsp_emu_wait(&deadline);
+}
+
+/* Delays a storage transfer by the bandwidth of the storage */
+static void tsp_emu_storage_delay(struct tsp_emu *emu, u64 bytes) {
+    struct timespec deadline;
+    u32 mbps;
+
+    pthread_mutex_lock(&emu->model_lock);
+    mbps = emu->model.StorageMBps;
+    pthread_mutex_unlock(&emu->model_lock);
+
+    if (mbps) {
+        tsp_emu_reserve(emu, &emu->storage_free, tsp_emu_transfer_ns(bytes, mbps), &deadline);
+        tsp_emu_wait(&deadline);
+    }
+}
+
+/*-************
+ * Statistics *
+ *-************/
+
+static u64 tsp_emu_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Slot of the calling CPU */
+static tsp_emu_stat_slot_st *tsp_emu_stat_slot(struct tsp_emu *emu) {
+    int cpu = sched_getcpu();
+    return &emu->stat_slots[(cpu < 0 ? 0 : cpu) % TSP_EMU_STAT_SLOTS];
+}
+
+static void tsp_emu_stat_add(u64 *counter, u64 value) {
+    __atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
+
+static void tsp_emu_stat_min(u64 *min, u64 value) {
+    u64 cur = __atomic_load_n(min, __ATOMIC_RELAXED);
+    while ((!cur || value < cur) &&
+           !__atomic_compare_exchange_n(min, &cur, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void tsp_emu_stat_max(u64 *max, u64 value) {
+    u64 cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > cur &&
+           !__atomic_compare_exchange_n(max, &cur, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/* Index of the counters of a function, the entry is claimed on the first
+ * execution, -1 if all the entries are taken */
+static int tsp_emu_stat_index(struct tsp_emu *emu, CS_FUNCTION_ID id, int claim) {
+    u64 key = (u64)id + 1;
+
+    for (int i = 0; i < TSP_EMU_MAX_FUNCTIONS; ++i) {
+        u64 cur = __atomic_load_n(&emu->stat_keys[i], __ATOMIC_ACQUIRE);
+        if (cur == key) {
+            return i;
+        }
+        if (!cur) {
+            if (!claim) {
+                return -1;
+            }
+            if (__atomic_compare_exchange_n(&emu->stat_keys[i], &cur, key, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ||
+                cur == key) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+static void tsp_emu_stat_function(struct tsp_emu *emu, CS_FUNCTION_ID id, u64 ns) {
+    tsp_emu_stat_slot_st *slot = tsp_emu_stat_slot(emu);
+    int i = tsp_emu_stat_index(emu, id, 1);
+
+    ns = ns ? ns : 1; // 0 means no execution for the minimum
+    tsp_emu_stat_add(&slot->busy_ns, ns);
+    if (i < 0) {
+        return;
+    }
+    tsp_emu_fstat_st *f = &slot->functions[i];
+    tsp_emu_stat_add(&f->executions, 1);
+    tsp_emu_stat_add(&f->total_ns, ns);
+    tsp_emu_stat_min(&f->min_ns, ns);
+    tsp_emu_stat_max(&f->max_ns, ns);
+    tsp_emu_stat_min(&f->win_min_ns, ns);
+    tsp_emu_stat_max(&f->win_max_ns, ns);
+}
+
+/* Sums the slots, the windows are restarted if delta is set */
+static void tsp_emu_stat_sum(struct tsp_emu *emu, tsp_emu_stat_slot_st *sum, int delta) {
+    memset(sum, 0, sizeof(*sum));
+    for (int s = 0; s < TSP_EMU_STAT_SLOTS; ++s) {
+        tsp_emu_stat_slot_st *slot = &emu->stat_slots[s];
+        sum->busy_ns += __atomic_load_n(&slot->busy_ns, __ATOMIC_RELAXED);
+        sum->allocations += __atomic_load_n(&slot->allocations, __ATOMIC_RELAXED);
+        sum->deallocations += __atomic_load_n(&slot->deallocations, __ATOMIC_RELAXED);
+        sum->storage_to_fdm += __atomic_load_n(&slot->storage_to_fdm, __ATOMIC_RELAXED);
+        sum->fdm_to_storage += __atomic_load_n(&slot->fdm_to_storage, __ATOMIC_RELAXED);
+        for (int i = 0; i < TSP_EMU_MAX_FUNCTIONS; ++i) {
+            tsp_emu_fstat_st *f = &slot->functions[i];
+            tsp_emu_fstat_st *t = &sum->functions[i];
+            u64 min = __atomic_load_n(&f->min_ns, __ATOMIC_RELAXED);
+            u64 win_min = delta ? __atomic_exchange_n(&f->win_min_ns, 0, __ATOMIC_RELAXED)
+                                : __atomic_load_n(&f->win_min_ns, __ATOMIC_RELAXED);
+            u64 win_max = delta ? __atomic_exchange_n(&f->win_max_ns, 0, __ATOMIC_RELAXED)
+                                : __atomic_load_n(&f->win_max_ns, __ATOMIC_RELAXED);
+
+            t->executions += __atomic_load_n(&f->executions, __ATOMIC_RELAXED);
+            t->total_ns += __atomic_load_n(&f->total_ns, __ATOMIC_RELAXED);
+            if (min && (!t->min_ns || min < t->min_ns)) {
+                t->min_ns = min;
+            }
+            u64 max = __atomic_load_n(&f->max_ns, __ATOMIC_RELAXED);
+            if (max > t->max_ns) {
+                t->max_ns = max;
+            }
+            if (win_min && (!t->win_min_ns || win_min < t->win_min_ns)) {
+                t->win_min_ns = win_min;
+            }
+            if (win_max > t->win_max_ns) {
+                t->win_max_ns = win_max;
+            }
+        }
+    }
+}
+
+/* TSP_CS_STATS, one command returns all the counters */
+static int tsp_emu_stats(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    TspStats *st = cmd->data;
+    tsp_emu_stat_slot_st sum;
+    const tsp_emu_stat_slot_st *base = NULL;
+    int delta = cmd->cdw12 & TSP_STATS_DELTA;
+    u64 now;
+
+    if (cmd->data_len < sizeof(TspStats)) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+
+    // The gauges of the FDM
+    pthread_mutex_lock(&emu->fdm_lock);
+    for (tsp_emu_region_st *r = emu->regions; r; r = r->next) {
+        if (r->used) {
+            st->FdmAllocatedBytes += r->size;
+            st->FdmLiveAllocations++;
+        } else {
+            st->FdmFreeBytes += r->size;
+            if (r->size > st->FdmLargestFree) {
+                st->FdmLargestFree = r->size;
+            }
+        }
+    }
+    pthread_mutex_unlock(&emu->fdm_lock);
+
+    pthread_mutex_lock(&emu->stat_lock);
+    now = tsp_emu_now_ns();
+    tsp_emu_stat_sum(emu, &sum, delta);
+    st->PowerOnUs = (now - emu->created_ns) / 1000;
+    st->IntervalUs = st->PowerOnUs;
+    if (delta) {
+        st->Flags = TSP_STATS_DELTA;
+        st->IntervalUs = (now - emu->delta_ns) / 1000;
+        base = &emu->stat_base;
+    }
+#define TSP_EMU_STAT_DIFF(field) (sum.field - (base ? base->field : 0))
+    st->BusyNs = TSP_EMU_STAT_DIFF(busy_ns);
+    st->FdmAllocations = TSP_EMU_STAT_DIFF(allocations);
+    st->FdmDeallocations = TSP_EMU_STAT_DIFF(deallocations);
+    st->StorageToFdmBytes = TSP_EMU_STAT_DIFF(storage_to_fdm);
+    st->FdmToStorageBytes = TSP_EMU_STAT_DIFF(fdm_to_storage);
+
+    // The registered functions, in the order of the registry
+    pthread_rwlock_rdlock(&tsp_emu_functions_lock);
+    for (int n = 0; n < tsp_emu_num_functions; ++n) {
+        TspFunctionStats *fs;
+        int i;
+
+        if (st->NumFunctions == TSP_STATS_MAX_FUNCTIONS ||
+            sizeof(TspStats) + (st->NumFunctions + 1) * sizeof(TspFunctionStats) > cmd->data_len) {
+            break;
+        }
+        fs = &st->Functions[st->NumFunctions++];
+        fs->FunctionId = tsp_emu_functions[n].id;
+        i = tsp_emu_stat_index(emu, fs->FunctionId, 0);
+        if (i < 0) {
+            continue;
+        }
+        fs->Executions = TSP_EMU_STAT_DIFF(functions[i].executions);
+        fs->TotalNs = TSP_EMU_STAT_DIFF(functions[i].total_ns);
+        fs->MinNs = delta ? sum.functions[i].win_min_ns : sum.functions[i].min_ns;
+        fs->MaxNs = delta ? sum.functions[i].win_max_ns : sum.functions[i].max_ns;
+        st->Executions += fs->Executions;
+    }
+    pthread_rwlock_unlock(&tsp_emu_functions_lock);
+#undef TSP_EMU_STAT_DIFF
+
+    if (delta) {
+        emu->stat_base = sum;
+        emu->delta_ns = now;
+    }
+    pthread_mutex_unlock(&emu->stat_lock);
+    return 0;
+}
+
+/*-**********
+ * Commands *
+ *-**********/
+
+static int tsp_emu_identify(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    size_t len = strlen(TSP_CS_ID_STRING) + 1;
+
+    if (cmd->cdw11 != TSP_CS_CSX || cmd->data_len < len) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+    memset(cmd->data, 0, cmd->data_len);
+    memcpy(cmd->data, TSP_CS_ID_STRING, len);
+    return 0;
+}
+
+static u64 tsp_emu_function_bits(void) {
+    u64 bits = 0;
+
+    pthread_rwlock_rdlock(&tsp_emu_functions_lock);
+    for (int i = 0; i < tsp_emu_num_functions; ++i) {
+        if (tsp_emu_functions[i].bit >= 0) {
+            bits |= 1ULL << tsp_emu_functions[i].bit;
+        }
+    }
+    pthread_rwlock_unlock(&tsp_emu_functions_lock);
+    return bits;
+}
+
+static int tsp_emu_function_table(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    TspFunctionTable *table = cmd->data;
+    u32 max = (cmd->data_len - sizeof(*table)) / sizeof(TspFunctionEntry);
+
+    pthread_rwlock_rdlock(&tsp_emu_functions_lock);
+    for (int i = 0; i < tsp_emu_num_functions && table->NumFunctions < max; ++i) {
+        TspFunctionEntry *e = &table->Functions[table->NumFunctions++];
+
+        *e = tsp_emu_functions[i].entry;
+        if (!e->NumUnits) {
+            e->NumUnits = emu->num_workers < 0xFF ? emu->num_workers : 0xFF;
+        }
+    }
+    pthread_rwlock_unlock(&tsp_emu_functions_lock);
+    return 0;
+}
+
+static int tsp_emu_get(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    CSxProperties props;
+    TspWireInfo wire;
+    u64 bits, f;
+    int ret = TSP_EMU_SC_INVALID_FIELD;
+
+    if (cmd->data_len < sizeof(CSxProperties)) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+    memset(cmd->data, 0, cmd->data_len);
+
+    switch (cmd->cdw11) {
+    case TSP_CS_PROPS:
+        memset(&props, 0, sizeof(props));
+        props.HwVersion = 1;
+        props.SwVersion = 1;
+        props.VendorId = TSP_EMU_VENDOR_ID;
+        snprintf(props.FriendlyName, sizeof(props.FriendlyName), "TSP emulator");
+        props.FDMinMB = emu->fdm_size >> 20;
+        props.Flags.FDMIsDeviceManaged = 1;
+        props.Flags.FDMIsHostVisible = 1;
+        props.NumCSEs = 1;
+        props.CSE[0].HwVersion = 1;
+        props.CSE[0].SwVersion = 1;
+        snprintf(props.CSE[0].UniqueName, sizeof(props.CSE[0].UniqueName), "%s", emu->name);
+        pthread_rwlock_rdlock(&tsp_emu_functions_lock);
+        props.CSE[0].NumBuiltinFunctions = tsp_emu_num_functions;
+        pthread_rwlock_unlock(&tsp_emu_functions_lock);
+        props.Flags.BatchRequestsSupported = 1;
+        props.CSE[0].MaxRequestsPerBatch = TSP_EMU_MAX_BATCH;
+        props.CSE[0].MaxFunctionParametersAllows = TSP_EMU_MAX_WIRE_ARGS;
+        props.CSE[0].MaxConcurrentFunctionInstances = emu->num_workers;
+        memcpy(cmd->data, &props, sizeof(props));
+        ret = 0;
+        break;
+    case TSP_CS_CAPS:
+        bits = tsp_emu_function_bits();
+        memcpy(cmd->data, &bits, sizeof(bits));
+        ret = 0;
+        break;
+    case TSP_CS_WIRE:
+        wire.Magic = TSP_WIRE_MAGIC;
+        wire.Reserved = 0;
+        wire.Versions = 1 | (1u << TSP_WIRE_VERSION);
+        wire.MaxTransfer = TSP_MDTS;
+        wire.MaxRequests = TSP_EMU_MAX_BATCH;
+        memcpy(cmd->data, &wire, sizeof(wire));
+        ret = 0;
+        break;
+    case TSP_CS_STATS:
+        ret = tsp_emu_stats(emu, cmd);
+        break;
+    case TSP_CS_FUNCTIONS:
+        ret = tsp_emu_function_table(emu, cmd);
+        break;
+    case TSP_CS_FUN:
+        f = cmd->cdw12 | ((u64)cmd->cdw13 << 32);
+        if (!f) {
+            break;
+        }
+        pthread_rwlock_rdlock(&tsp_emu_functions_lock);
+        for (int i = 0; i < tsp_emu_num_functions; ++i) {
+            if (tsp_emu_functions[i].bit == __builtin_ctzll(f)) {
+                memcpy(cmd->data, &tsp_emu_functions[i].id, sizeof(CS_FUNCTION_ID));
+                ret = 0;
+                break;
+            }
+        }
+        pthread_rwlock_unlock(&tsp_emu_functions_lock);
+        break;
+    default:
+        break;
+    }
+
+    return ret;
+}
+
+static int tsp_emu_allocate(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    u64 addr;
+
+    if (cmd->cdw11 != TSP_CS_MEM || cmd->data_len < sizeof(addr)) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+    // A null address tells the host the FDM is exhausted
+    addr = tsp_emu_alloc(emu, cmd->cdw12);
+    memcpy(cmd->data, &addr, sizeof(addr));
+    if (addr) {
+        tsp_emu_stat_add(&tsp_emu_stat_slot(emu)->allocations, 1);
+    }
+    return 0;
+}
+
+static int tsp_emu_deallocate(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    u64 addr = cmd->cdw12 | ((u64)cmd->cdw13 << 32);
+
+    if (cmd->cdw11 != TSP_CS_MEM || tsp_emu_free(emu, addr)) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+    tsp_emu_stat_add(&tsp_emu_stat_slot(emu)->deallocations, 1);
+    return 0;
+}
+
+/* Sums the write generations of the chunks of an extent, after incrementing
+ * them if bump is set. Chunks that share a slot are written together. */
+static u32 tsp_emu_generation(struct tsp_emu *emu, const TspExtent *e, u32 lba_shift, int bump) {
+    u64 first = (e->Lba << lba_shift) >> TSP_EMU_GEN_CHUNK_SHIFT;
+    u64 last = (((e->Lba + e->NumBlocks) << lba_shift) - 1) >> TSP_EMU_GEN_CHUNK_SHIFT;
+    u32 sum = 0;
+
+    if (!e->NumBlocks) {
+        return 0;
+    }
+    if (last - first >= TSP_EMU_GEN_SLOTS) {
+        first = 0;
+        last = TSP_EMU_GEN_SLOTS - 1;
+    }
+    for (u64 c = first; c <= last; ++c) {
+        u32 *gen = &emu->gens[c % TSP_EMU_GEN_SLOTS];
+        sum += bump ? __atomic_add_fetch(gen, 1, __ATOMIC_RELAXED) : __atomic_load_n(gen, __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+static int tsp_emu_storage_io(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    const TspExtentList *list = cmd->data;
+    u64 avail, head, total = 0, done = 0;
+    u32 lba_shift, gen = 0;
+    char *va;
+
+    if (emu->ns_fd < 0) {
+        MSG_PRINT_DEBUG("%s has no namespace (TSP_EMU_NAMESPACE)", emu->name);
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+    if (cmd->cdw12 < sizeof(*list) || cmd->cdw12 > cmd->data_len ||
+        list->NumExtents > (cmd->cdw12 - sizeof(*list)) / sizeof(TspExtent) ||
+        (cmd->cdw11 != CS_STORAGE_LOAD_TYPE && cmd->cdw11 != CS_STORAGE_STORE_TYPE)) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+
+    // Without a format nor a size, the blocks of the namespace are transferred
+    lba_shift = list->LbaShift ? list->LbaShift : TSP_EMU_LBA_SHIFT;
+    for (u32 i = 0; i < list->NumExtents; ++i) {
+        total += (u64)list->Extents[i].NumBlocks << lba_shift;
+    }
+    if (total < list->HeadBytes) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+    total -= list->HeadBytes;
+    if (list->Bytes) {
+        if (list->Bytes > total) {
+            return TSP_EMU_SC_INVALID_FIELD;
+        }
+        total = list->Bytes;
+    }
+
+    va = tsp_emu_va(emu, list->DevMem.MemHandle + list->DevMem.ByteOffset, &avail);
+    if (!va || avail < total) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+
+    head = list->HeadBytes;
+    for (u32 i = 0; i < list->NumExtents && done < total; ++i) {
+        const TspExtent *e = &list->Extents[i];
+        u64 bytes = ((u64)e->NumBlocks << lba_shift) - head;
+        off_t offset = (e->Lba << lba_shift) + head;
+        ssize_t ret;
+
+        if (bytes > total - done) {
+            bytes = total - done;
+        }
+        if (e->Flags & TSP_EXTENT_ZERO) {
+            if (cmd->cdw11 == CS_STORAGE_LOAD_TYPE) {
+                memset(va + done, 0, bytes);
+            }
+            ret = bytes;
+        } else if (cmd->cdw11 == CS_STORAGE_LOAD_TYPE) {
+            ret = pread(emu->ns_fd, va + done, bytes, offset);
+        } else {
+            ret = pwrite(emu->ns_fd, va + done, bytes, offset);
+        }
+        if (ret != (ssize_t)bytes) {
+            return TSP_EMU_SC_INTERNAL;
+        }
+        done += bytes;
+        head = 0;
+    }
+
+    for (u32 i = 0; i < list->NumExtents; ++i) {
+        gen += tsp_emu_generation(emu, &list->Extents[i], lba_shift,
+                                  cmd->cdw11 == CS_STORAGE_STORE_TYPE);
+    }
+    cmd->result = (gen & ~TSP_STORAGE_GEN_VALID) | TSP_STORAGE_GEN_VALID;
+
+    tsp_emu_stat_add(cmd->cdw11 == CS_STORAGE_LOAD_TYPE ? &tsp_emu_stat_slot(emu)->storage_to_fdm
+                                                        : &tsp_emu_stat_slot(emu)->fdm_to_storage,
+                     done);
+    tsp_emu_storage_delay(emu, done);
+    return 0;
+}
+
+/* Executes a request, args receives the host view of its req->NumArgs arguments */
+static int tsp_emu_run(struct tsp_emu *emu, const CsComputeRequest *req, CsTspEmuArg *args) {
+    csTspEmuFunctionFn fn = NULL;
+    CS_STATUS status;
+    u64 start;
+
+    pthread_rwlock_rdlock(&tsp_emu_functions_lock);
+    for (int i = 0; i < tsp_emu_num_functions; ++i) {
+        if (tsp_emu_functions[i].id == req->FunctionId) {
+            fn = tsp_emu_functions[i].fn;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&tsp_emu_functions_lock);
+    if (!fn) {
+        MSG_PRINT_DEBUG("%s has no function %u", emu->name, req->FunctionId);
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+
+    for (int i = 0; i < req->NumArgs; ++i) {
+        const CsComputeArg *arg = &req->Args[i];
+        args[i].Ptr = NULL;
+        args[i].Bytes = 0;
+        if (arg->Type == CS_AFDM_TYPE) {
+            args[i].Ptr = tsp_emu_va(emu, (u64)arg->u.DevMem.MemHandle + arg->u.DevMem.ByteOffset,
+                                     &args[i].Bytes);
+            if (!args[i].Ptr) {
+                MSG_PRINT_DEBUG("Argument %d is not in the FDM of %s", i, emu->name);
+                return TSP_EMU_SC_INVALID_FIELD;
+            }
+        }
+    }
+
+    // The result of a job is its last FDM argument
+    if (tsp_emu_current_job) {
+        for (int i = req->NumArgs - 1; i >= 0; --i) {
+            if (args[i].Ptr) {
+                pthread_mutex_lock(&emu->job_lock);
+                tsp_emu_current_job->result = args[i].Ptr;
+                tsp_emu_current_job->result_max = args[i].Bytes;
+                pthread_mutex_unlock(&emu->job_lock);
+                break;
+            }
+        }
+    }
+
+    start = tsp_emu_now_ns();
+    status = fn(req, args);
+    tsp_emu_stat_function(emu, req->FunctionId, tsp_emu_now_ns() - start);
+    return status == CS_SUCCESS ? 0 : TSP_EMU_SC_INTERNAL;
+}
+
+/* Legacy format, a single packed CsComputeRequest */
+static int tsp_emu_compute_legacy(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    const CsComputeRequest *req = cmd->data;
+    CsTspEmuArg args[TSP_EMU_MAX_ARGS];
+
+    if (cmd->cdw12 < sizeof(CsComputeRequest) || cmd->cdw12 > cmd->data_len || req->NumArgs < 0 ||
+        (u64)req->NumArgs > (cmd->cdw12 - offsetof(CsComputeRequest, Args)) / sizeof(CsComputeArg)) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+
+    return tsp_emu_run(emu, req, args);
+}
+
+/* Wire format, the requests are converted to the layout of the CS API for the
+ * functions, as a firmware would for its existing kernels */
+static int tsp_emu_compute_wire(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    const TspWireHeader *h = cmd->data;
+    const TspWireRequest *w;
+    char buffer[TSP_BUFFER_SIZE];
+    CsTspEmuArg args[TSP_EMU_MAX_ARGS];
+    int ret = 0;
+    u32 i;
+
+    w = cmd->cdw12 <= cmd->data_len ? tsp_wire_first(cmd->data, cmd->cdw12) : NULL;
+    if (!w || h->Length != cmd->cdw12 || h->NumRequests > TSP_EMU_MAX_BATCH) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+
+    for (i = 0; i < h->NumRequests; ++i, w = tsp_wire_next(w)) {
+        CsComputeRequest *req = (CsComputeRequest *)buffer;
+        CsTspEmuArg *a = args;
+
+        if (!tsp_wire_check(h, w) || w->NumArgs > TSP_EMU_MAX_WIRE_ARGS) {
+            ret = TSP_EMU_SC_INVALID_FIELD;
+            break;
+        }
+        if (w->NumArgs > TSP_EMU_MAX_ARGS) {
+            req = malloc(offsetof(CsComputeRequest, Args) + w->NumArgs * sizeof(CsComputeArg));
+            a = malloc(w->NumArgs * sizeof(CsTspEmuArg));
+            if (!req || !a) {
+                free(req);
+                free(a);
+                ret = TSP_EMU_SC_INTERNAL;
+                break;
+            }
+        }
+
+        req->CSEHandle = 0;
+        req->FunctionId = w->FunctionId;
+        req->NumArgs = w->NumArgs;
+        for (u32 j = 0; j < w->NumArgs; ++j) {
+            CsComputeArg *arg = &req->Args[j];
+
+            arg->Type = w->Args[j].Type;
+            arg->u.DevMem.MemHandle = w->Args[j].u.DevMem.MemHandle;
+            arg->u.DevMem.ByteOffset = w->Args[j].u.DevMem.ByteOffset;
+        }
+
+        ret = tsp_emu_run(emu, req, a);
+        if (req != (CsComputeRequest *)buffer) {
+            free(req);
+            free(a);
+        }
+        if (ret) {
+            break;
+        }
+    }
+
+    // Index of the failed request, NumRequests if all of them succeeded
+    cmd->result = ret ? i : h->NumRequests;
+    return ret;
+}
+
+static int tsp_emu_compute(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    switch (cmd->cdw13) {
+    case 0:
+        return tsp_emu_compute_legacy(emu, cmd);
+    case TSP_WIRE_VERSION:
+        return tsp_emu_compute_wire(emu, cmd);
+    default:
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+}
+
+/*-******
+ * Jobs *
+ *-******/
+
+static u64 tsp_emu_elapsed_us(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000ULL + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void *tsp_emu_job_thread(void *arg) {
+    tsp_emu_job_st *job = arg;
+    struct tsp_emu *emu = job->emu;
+    int ret;
+
+    tsp_emu_current_job = job;
+    pthread_mutex_lock(&emu->job_lock);
+    job->state = TSP_JOB_RUNNING;
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+    pthread_mutex_unlock(&emu->job_lock);
+
+    ret = tsp_emu_compute(emu, &job->cmd);
+    free(job->cmd.data);
+
+    // The slot may be released as soon as the job is finished
+    pthread_mutex_lock(&emu->job_lock);
+    job->runtime_us = tsp_emu_elapsed_us(&job->start);
+    job->status = ret;
+    if (__atomic_load_n(&job->cancel, __ATOMIC_RELAXED)) {
+        job->state = TSP_JOB_CANCELLED;
+    } else if (ret) {
+        job->state = TSP_JOB_FAILED;
+    } else {
+        job->state = TSP_JOB_DONE;
+        job->progress = 1000;
+        // Functions that do not report their result produce all of it
+        if (!job->reported) {
+            job->result_bytes = job->result_max;
+        }
+    }
+    job->cmd.data = NULL;
+    pthread_mutex_unlock(&emu->job_lock);
+
+    return NULL;
+}
+
+static tsp_emu_job_st *tsp_emu_job_find(struct tsp_emu *emu, u32 id) {
+    for (int i = 0; i < TSP_EMU_MAX_JOBS; ++i) {
+        if (id && emu->jobs[i].id == id) {
+            return &emu->jobs[i];
+        }
+    }
+    return NULL;
+}
+
+static int tsp_emu_job_submit(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    tsp_emu_job_st *job = NULL;
+    pthread_attr_t attr;
+    pthread_t thread;
+    void *data;
+    int ret;
+
+    if (!cmd->data || cmd->cdw12 > cmd->data_len) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+    // The command completes now, the job keeps its own copy of the request
+    data = malloc(cmd->data_len);
+    if (!data) {
+        return TSP_EMU_SC_INTERNAL;
+    }
+    memcpy(data, cmd->data, cmd->data_len);
+
+    pthread_mutex_lock(&emu->job_lock);
+    for (int i = 0; i < TSP_EMU_MAX_JOBS; ++i) {
+        if (!emu->jobs[i].id) {
+            job = &emu->jobs[i];
+            break;
+        }
+    }
+    if (!job) {
+        pthread_mutex_unlock(&emu->job_lock);
+        free(data);
+        return TSP_SC_JOB_LIMIT;
+    }
+
+    memset(job, 0, sizeof(*job));
+    do {
+        job->id = ++emu->next_job;
+    } while (!job->id || job->id == TSP_JOB_ALL || tsp_emu_job_find(emu, job->id) != job);
+    job->state = TSP_JOB_QUEUED;
+    job->emu = emu;
+    job->cmd = *cmd;
+    job->cmd.data = data;
+    job->cmd.done = NULL;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&thread, &attr, tsp_emu_job_thread, job);
+    pthread_attr_destroy(&attr);
+    if (ret) {
+        job->id = 0;
+        pthread_mutex_unlock(&emu->job_lock);
+        free(data);
+        return TSP_SC_JOB_LIMIT;
+    }
+
+    cmd->result = job->id;
+    pthread_mutex_unlock(&emu->job_lock);
+    return 0;
+}
+
+static int tsp_emu_job_status(struct tsp_emu *emu, tsp_emu_job_st *job, tsp_cmd_st *cmd) {
+    TspJobStatus st;
+
+    if (!cmd->data || cmd->data_len < sizeof(st)) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+    memset(&st, 0, sizeof(st));
+    st.JobId = job->id;
+    st.State = job->state;
+    st.Status = job->status;
+    st.Progress = __atomic_load_n(&job->progress, __ATOMIC_RELAXED);
+    st.ResultBytes = __atomic_load_n(&job->result_bytes, __ATOMIC_ACQUIRE);
+    st.RuntimeUs = job->state == TSP_JOB_RUNNING ? tsp_emu_elapsed_us(&job->start) : job->runtime_us;
+    memcpy(cmd->data, &st, sizeof(st));
+    return 0;
+}
+
+static int tsp_emu_job_result(struct tsp_emu *emu, tsp_emu_job_st *job, tsp_cmd_st *cmd) {
+    u64 offset = cmd->cdw13 | ((u64)cmd->cdw14 << 32);
+    u64 final = __atomic_load_n(&job->result_bytes, __ATOMIC_ACQUIRE);
+    u64 bytes = 0;
+
+    if (cmd->data && job->result && offset < final) {
+        bytes = final - offset < cmd->data_len ? final - offset : cmd->data_len;
+        memcpy(cmd->data, (char *)job->result + offset, bytes);
+    }
+    cmd->result = bytes;
+    return 0;
+}
+
+static int tsp_emu_job(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    tsp_emu_job_st *job;
+    int ret = 0;
+
+    if (cmd->cdw11 == TSP_JOB_SUBMIT) {
+        return tsp_emu_job_submit(emu, cmd);
+    }
+
+    pthread_mutex_lock(&emu->job_lock);
+    if (cmd->cdw11 == TSP_JOB_CANCEL && cmd->cdw12 == TSP_JOB_ALL) {
+        for (int i = 0; i < TSP_EMU_MAX_JOBS; ++i) {
+            __atomic_store_n(&emu->jobs[i].cancel, 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&emu->job_lock);
+        return 0;
+    }
+
+    job = tsp_emu_job_find(emu, cmd->cdw12);
+    if (!job) {
+        pthread_mutex_unlock(&emu->job_lock);
+        return TSP_SC_JOB_UNKNOWN;
+    }
+
+    switch (cmd->cdw11) {
+    case TSP_JOB_STATUS:
+        ret = tsp_emu_job_status(emu, job, cmd);
+        break;
+    case TSP_JOB_RESULT:
+        ret = tsp_emu_job_result(emu, job, cmd);
+        break;
+    case TSP_JOB_CANCEL:
+        __atomic_store_n(&job->cancel, 1, __ATOMIC_RELAXED);
+        break;
+    case TSP_JOB_RELEASE:
+        if (job->state == TSP_JOB_QUEUED || job->state == TSP_JOB_RUNNING) {
+            ret = TSP_SC_JOB_BUSY;
+        } else {
+            job->id = 0;
+        }
+        break;
+    default:
+        ret = TSP_EMU_SC_INVALID_FIELD;
+        break;
+    }
+    pthread_mutex_unlock(&emu->job_lock);
+
+    return ret;
+}
+
+/**
+ * @copydoc csTspEmuJobProgress
+ * */
+int csTspEmuJobProgress(u32 Progress, u64 ResultBytes) {
+    tsp_emu_job_st *job = tsp_emu_current_job;
+
+    if (!job) {
+        return 0;
+    }
+    __atomic_store_n(&job->progress, Progress > 1000 ? 1000 : Progress, __ATOMIC_RELAXED);
+    if (ResultBytes > job->result_max) {
+        ResultBytes = job->result_max;
+    }
+    // The result is written before it is reported
+    if (ResultBytes) {
+        __atomic_store_n(&job->reported, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&job->result_bytes, ResultBytes, __ATOMIC_RELEASE);
+    return __atomic_load_n(&job->cancel, __ATOMIC_RELAXED);
+}
+
+static int tsp_emu_open_relay(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    tsp_emu_addr_st addr;
+    struct addrinfo hints = {.ai_socktype = SOCK_STREAM}, *res, *ai;
+    int sock = -1, desc = -1;
+
+    if (cmd->data_len < sizeof(addr)) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+    memcpy(&addr, cmd->data, sizeof(addr));
+    addr.node[sizeof(addr.node) - 1] = '\0';
+    addr.service[sizeof(addr.service) - 1] = '\0';
+
+    if (getaddrinfo(addr.node, addr.service, &hints, &res)) {
+        MSG_PRINT_DEBUG("Could not resolve %s:%s", addr.node, addr.service);
+        return TSP_EMU_SC_INTERNAL;
+    }
+    for (ai = res; ai; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (sock >= 0 && connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        if (sock >= 0) {
+            close(sock);
+            sock = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (sock < 0) {
+        MSG_PRINT_DEBUG("Could not connect to %s:%s", addr.node, addr.service);
+        return TSP_EMU_SC_INTERNAL;
+    }
+
+    pthread_mutex_lock(&emu->relay_lock);
+    for (int i = 0; i < TSP_EMU_MAX_RELAYS; ++i) {
+        if (emu->relays[i] < 0) {
+            emu->relays[i] = sock;
+            desc = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&emu->relay_lock);
+    if (desc < 0) {
+        close(sock);
+        return TSP_EMU_SC_INTERNAL;
+    }
+
+    cmd->result = desc;
+    return 0;
+}
+
+static int tsp_emu_relay_socket(struct tsp_emu *emu, u32 desc) {
+    int sock;
+
+    if (desc >= TSP_EMU_MAX_RELAYS) {
+        return -1;
+    }
+    pthread_mutex_lock(&emu->relay_lock);
+    sock = emu->relays[desc];
+    pthread_mutex_unlock(&emu->relay_lock);
+    return sock;
+}
+
+static int tsp_emu_close_relay(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    int sock = -1;
+
+    if (cmd->cdw13 >= TSP_EMU_MAX_RELAYS) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+    pthread_mutex_lock(&emu->relay_lock);
+    sock = emu->relays[cmd->cdw13];
+    emu->relays[cmd->cdw13] = -1;
+    pthread_mutex_unlock(&emu->relay_lock);
+    if (sock < 0) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+    // Wakes up a pending read before the socket goes away
+    shutdown(sock, SHUT_RDWR);
+    close(sock);
+    return 0;
+}
+
+static int tsp_emu_comm(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    int sock = tsp_emu_relay_socket(emu, cmd->cdw13);
+    u32 size;
+    ssize_t ret;
+
+    if (sock < 0 || !cmd->data || cmd->data_len <= sizeof(size)) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+
+    if (cmd->cdw11) {
+        // Write, cdw12 bytes from the buffer
+        const char *data = cmd->data;
+        size = cmd->cdw12 < cmd->data_len ? cmd->cdw12 : cmd->data_len;
+        while (size) {
+            ret = send(sock, data, size, MSG_NOSIGNAL);
+            if (ret <= 0) {
+                return TSP_EMU_SC_INTERNAL;
+            }
+            data += ret;
+            size -= ret;
+        }
+        return 0;
+    }
+
+    // Read, blocks until data is available, the size precedes the data
+    do {
+        ret = recv(sock, (char *)cmd->data + sizeof(size), cmd->data_len - sizeof(size), 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret <= 0) {
+        return TSP_EMU_SC_INTERNAL;
+    }
+    size = ret;
+    memcpy(cmd->data, &size, sizeof(size));
+    return 0;
+}
+
+/* Polls the doorbell of the request rings and executes the requests, as the
+ * firmware of a CSx would. Polling backs off to short sleeps when idle. */
+static void *tsp_emu_ring_poller(void *arg) {
+    struct tsp_emu *emu = arg;
+    u32 entries = emu->ring_entries;
+    TspRingDoorbell *db = (TspRingDoorbell *)emu->ring_va;
+    TspRingSqe *sq = (TspRingSqe *)(db + 1);
+    TspRingCqe *cq = (TspRingCqe *)(sq + entries);
+    const struct timespec idle = {.tv_nsec = TSP_EMU_RING_IDLE_NS};
+    char buffer[TSP_BUFFER_SIZE];
+    u32 head = 0, cq_tail = 0, polls = 0;
+    u16 phase = 1;
+
+    while (!__atomic_load_n(&emu->ring_stop, __ATOMIC_ACQUIRE)) {
+        tsp_cmd_st cmd = {
+            .cdw10 = TSP_CS_COMPUTE,
+            .dir = TSP_DIR_TO_DEV,
+            .data_len = sizeof(buffer),
+            .data = buffer,
+        };
+        TspRingSqe *sqe;
+        TspRingCqe *cqe;
+        u32 len;
+
+        if (__atomic_load_n(&db->SqTail, __ATOMIC_ACQUIRE) == head) {
+            // Spins, then yields (the host may share the CPU), then sleeps
+            if (++polls > TSP_EMU_RING_SPINS + TSP_EMU_RING_YIELDS) {
+                nanosleep(&idle, NULL);
+            } else if (polls > TSP_EMU_RING_SPINS) {
+                sched_yield();
+            }
+            continue;
+        }
+        polls = 0;
+
+        // The entry is copied first, as the DMA of a command
+        sqe = &sq[head % entries];
+        len = sqe->Length < sizeof(sqe->Request) ? sqe->Length : sizeof(sqe->Request);
+        memcpy(buffer, sqe->Request, len);
+        cmd.cdw12 = len;
+
+        cqe = &cq[cq_tail];
+        cqe->CommandId = sqe->CommandId;
+        cqe->Status = tsp_emu_compute(emu, &cmd);
+        cqe->Result = 0;
+        __atomic_store_n(&cqe->Phase, phase, __ATOMIC_RELEASE);
+
+        head++;
+        if (++cq_tail == entries) {
+            cq_tail = 0;
+            phase ^= 1;
+        }
+    }
+
+    return NULL;
+}
+
+static void tsp_emu_ring_stop(struct tsp_emu *emu) {
+    if (emu->ring_running) {
+        __atomic_store_n(&emu->ring_stop, 1, __ATOMIC_RELEASE);
+        pthread_join(emu->ring_thread, NULL);
+        emu->ring_running = 0;
+    }
+}
+
+static int tsp_emu_ring_setup(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    u64 addr = cmd->cdw12 | ((u64)cmd->cdw13 << 32);
+    u32 entries = cmd->cdw14;
+    int ret = 0;
+    u64 bytes;
+    char *va;
+
+    pthread_mutex_lock(&emu->ring_lock);
+    tsp_emu_ring_stop(emu);
+    if (entries) {
+        va = tsp_emu_va(emu, addr, &bytes);
+        if (!va || cmd->cdw15 != TSP_RING_SQE_SIZE || entries > TSP_RING_MAX_ENTRIES ||
+            bytes < TSP_RING_BYTES(entries)) {
+            ret = TSP_EMU_SC_INVALID_FIELD;
+        } else {
+            emu->ring_va = va;
+            emu->ring_entries = entries;
+            emu->ring_stop = 0;
+            if (pthread_create(&emu->ring_thread, NULL, tsp_emu_ring_poller, emu)) {
+                ret = TSP_EMU_SC_INTERNAL;
+            } else {
+                emu->ring_running = 1;
+            }
+        }
+    }
+    pthread_mutex_unlock(&emu->ring_lock);
+
+    return ret;
+}
+
+int tsp_emu_execute(struct tsp_emu *emu, tsp_cmd_st *cmd) {
+    u32 op = cmd->cdw10;
+
+    tsp_emu_command_delay(emu, cmd);
+    cmd->result = 0;
+
+    // Compute requests have a routing bit
+    if ((op & ~1u) == TSP_CS_COMPUTE) {
+        op = TSP_CS_COMPUTE;
+    }
+    if (!cmd->data && op != TSP_CS_DEALLOCATE && op != TSP_CS_CLOSE_RELAY && op != TSP_CS_RING_SETUP &&
+        op != TSP_CS_JOB) {
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+
+    switch (op) {
+    case TSP_CS_IDENTIFY:
+        return tsp_emu_identify(emu, cmd);
+    case TSP_CS_GET:
+        return tsp_emu_get(emu, cmd);
+    case TSP_CS_ALLOCATE:
+        return tsp_emu_allocate(emu, cmd);
+    case TSP_CS_DEALLOCATE:
+        return tsp_emu_deallocate(emu, cmd);
+    case TSP_CS_STORAGE_IO:
+        return tsp_emu_storage_io(emu, cmd);
+    case TSP_CS_COMPUTE:
+        return tsp_emu_compute(emu, cmd);
+    case TSP_CS_JOB:
+        return tsp_emu_job(emu, cmd);
+    case TSP_CS_RING_SETUP:
+        return tsp_emu_ring_setup(emu, cmd);
+    case TSP_CS_COMM:
+        return tsp_emu_comm(emu, cmd);
+    case TSP_CS_OPEN_RELAY:
+        return tsp_emu_open_relay(emu, cmd);
+    case TSP_CS_CLOSE_RELAY:
+        return tsp_emu_close_relay(emu, cmd);
+    default:
+        MSG_PRINT_DEBUG("%s does not handle sub-opcode %u", emu->name, cmd->cdw10);
+        return TSP_EMU_SC_INVALID_FIELD;
+    }
+}
+
+/*-*********
+ * Devices *
+ *-*********/
+
+int tsp_emu_is_name(const char *name) {
+    size_t len = strlen(TSP_EMU_PREFIX);
+
+    // Paths (e.g., /dev/disk/by-id/tsp-emu0, ./tsp-emu0) are files, not names
+    if (strncmp(name, TSP_EMU_PREFIX, len) || !name[len]) {
+        return 0;
+    }
+    for (name += len; *name; ++name) {
+        if (*name < '0' || *name > '9') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int tsp_emu_count(void) {
+    u32 count = tsp_emu_env("TSP_EMU_DEVICES", 0);
+    return count > TSP_EMU_MAX_DEVICES ? TSP_EMU_MAX_DEVICES : (int)count;
+}
+
+static struct tsp_emu *tsp_emu_create(int index) {
+    struct tsp_emu *emu = calloc(1, sizeof(struct tsp_emu));
+    const char *ns;
+
+    if (!emu) {
+        return NULL;
+    }
+    snprintf(emu->name, sizeof(emu->name), TSP_EMU_PREFIX "%d", index);
+    emu->index = index;
+    emu->fdm_base = TSP_EMU_FDM_BASE(index);
+    emu->fdm_size = (u64)tsp_emu_env("TSP_EMU_FDM_MB", 256) << 20;
+
+    // The FDM is sparse, pages are only backed once touched
+    emu->memfd = memfd_create(emu->name, MFD_CLOEXEC);
+    if (emu->memfd < 0 || !emu->fdm_size || ftruncate(emu->memfd, emu->fdm_size) < 0) {
+        goto fail;
+    }
+    emu->fdm = mmap(NULL, emu->fdm_size, PROT_READ | PROT_WRITE, MAP_SHARED, emu->memfd, 0);
+    if (emu->fdm == MAP_FAILED) {
+        goto fail;
+    }
+    emu->regions = calloc(1, sizeof(tsp_emu_region_st));
+    if (!emu->regions) {
+        munmap(emu->fdm, emu->fdm_size);
+        goto fail;
+    }
+    emu->regions->size = emu->fdm_size;
+    emu->stat_slots = aligned_alloc(64, TSP_EMU_STAT_SLOTS * sizeof(tsp_emu_stat_slot_st));
+    if (!emu->stat_slots) {
+        free(emu->regions);
+        munmap(emu->fdm, emu->fdm_size);
+        goto fail;
+    }
+    memset(emu->stat_slots, 0, TSP_EMU_STAT_SLOTS * sizeof(tsp_emu_stat_slot_st));
+    emu->created_ns = tsp_emu_now_ns();
+    emu->delta_ns = emu->created_ns;
+
+    emu->model.LatencyUs = tsp_emu_env("TSP_EMU_LATENCY_US", 0);
+    emu->model.LinkMBps = tsp_emu_env("TSP_EMU_LINK_MBPS", 0);
+    emu->model.StorageMBps = tsp_emu_env("TSP_EMU_STORAGE_MBPS", 0);
+    emu->num_workers = tsp_emu_env("TSP_EMU_WORKERS", 4);
+    if (emu->num_workers < 1) {
+        emu->num_workers = 1;
+    }
+
+    emu->ns_fd = -1;
+    ns = getenv("TSP_EMU_NAMESPACE");
+    if (ns) {
+        emu->ns_fd = open(ns, O_RDWR | O_CLOEXEC);
+        if (emu->ns_fd < 0) {
+            MSG_PRINT_WARNING("Could not open the namespace of %s : %s", emu->name, ns);
+        }
+    }
+
+    for (int i = 0; i < TSP_EMU_MAX_RELAYS; ++i) {
+        emu->relays[i] = -1;
+    }
+    pthread_mutex_init(&emu->fdm_lock, NULL);
+    pthread_mutex_init(&emu->model_lock, NULL);
+    pthread_mutex_init(&emu->relay_lock, NULL);
+    pthread_mutex_init(&emu->work_lock, NULL);
+    pthread_mutex_init(&emu->ring_lock, NULL);
+    pthread_mutex_init(&emu->job_lock, NULL);
+    pthread_mutex_init(&emu->stat_lock, NULL);
+    pthread_cond_init(&emu->work_cond, NULL);
+
+    MSG_PRINT_DEBUG("Emulating %s with %llu MiB of FDM", emu->name,
+                    (unsigned long long)(emu->fdm_size >> 20));
+    return emu;
+
+fail:
+    MSG_PRINT_ERROR("Could not create the FDM of %s", emu->name);
+    if (emu->memfd >= 0) {
+        close(emu->memfd);
+    }
+    free(emu);
+    return NULL;
+}
+
+/* Returns the emulated device of a name, created on first use. Devices are
+ * never destroyed, their FDM outlives the handles as on a real device. */
+static struct tsp_emu *tsp_emu_get_device(const char *name) {
+    struct tsp_emu *emu;
+    long index;
+
+    if (!tsp_emu_is_name(name)) {
+        return NULL;
+    }
+    index = strtol(name + strlen(TSP_EMU_PREFIX), NULL, 10);
+    if (index >= TSP_EMU_MAX_DEVICES) {
+        MSG_PRINT_ERROR("At most %d devices can be emulated", TSP_EMU_MAX_DEVICES);
+        return NULL;
+    }
+
+    pthread_once(&tsp_emu_builtins_once, tsp_emu_register_builtins);
+
+    pthread_mutex_lock(&tsp_emus_lock);
+    emu = tsp_emus[index];
+    if (!emu) {
+        emu = tsp_emu_create(index);
+        tsp_emus[index] = emu;
+    }
+    pthread_mutex_unlock(&tsp_emus_lock);
+
+    return emu;
+}
+
+int tsp_emu_open(const char *name) {
+    struct tsp_emu *emu = tsp_emu_get_device(name);
+    int fd;
+
+    if (!emu) {
+        return -1;
+    }
+
+    // The handle only has to be a unique descriptor
+    fd = eventfd(0, EFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fd >= TSP_MAX_DEVICES) {
+        close(fd);
+        return -1;
+    }
+    __atomic_store_n(&tsp_emu_handles[fd], emu, __ATOMIC_RELEASE);
+    return fd;
+}
+
+void tsp_emu_close(CS_DEV_HANDLE fd) {
+    if (fd >= 0 && fd < TSP_MAX_DEVICES) {
+        __atomic_store_n(&tsp_emu_handles[fd], NULL, __ATOMIC_RELEASE);
+    }
+}
+
+struct tsp_emu *tsp_emu_lookup(CS_DEV_HANDLE fd) {
+    if (fd < 0 || fd >= TSP_MAX_DEVICES) {
+        return NULL;
+    }
+    return __atomic_load_n(&tsp_emu_handles[fd], __ATOMIC_ACQUIRE);
+}
+
+const char *tsp_emu_name(struct tsp_emu *emu) {
+    return emu->name;
+}
+
+/**
+ * @copydoc csTspEmuSetModel
+ * */
+CS_STATUS csTspEmuSetModel(char *DevName, const CsTspEmuModel *Model) {
+    struct tsp_emu *emu;
+
+    if (!DevName || !Model) {
+        return CS_INVALID_ARG;
+    }
+    emu = tsp_emu_get_device(DevName);
+    if (!emu) {
+        return CS_NO_SUCH_ENTITY_EXISTS;
+    }
+
+    pthread_mutex_lock(&emu->model_lock);
+    emu->model = *Model;
+    pthread_mutex_unlock(&emu->model_lock);
+    return CS_SUCCESS;
+}
+
+/*-***********
+ * Transport *
+ *-***********/
+
+/* Executes the asynchronous commands, workers live as long as the device */
+static void *tsp_emu_worker(void *arg) {
+    struct tsp_emu *emu = arg;
+
+    for (;;) {
+        tsp_emu_work_st *w;
+
+        pthread_mutex_lock(&emu->work_lock);
+        while (!emu->work_head) {
+            pthread_cond_wait(&emu->work_cond, &emu->work_lock);
+        }
+        w = emu->work_head;
+        emu->work_head = w->next;
+        if (!emu->work_head) {
+            emu->work_tail = NULL;
+        }
+        pthread_mutex_unlock(&emu->work_lock);
+
+        w->cmd->done(w->cmd, tsp_emu_execute(emu, w->cmd));
+        free(w);
+    }
+    return NULL;
+}
+
+/* Called with work_lock held */
+static int tsp_emu_start_workers(struct tsp_emu *emu) {
+    pthread_attr_t attr;
+    pthread_t thread;
+    int started = 0;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < emu->num_workers; ++i) {
+        if (pthread_create(&thread, &attr, tsp_emu_worker, emu) == 0) {
+            started++;
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    emu->workers_started = started;
+    return started ? 0 : -1;
+}
+
+static int tsp_emu_setup(tsp_device_st *dev) {
+    return tsp_emu_lookup(dev->fd) ? 0 : -1;
+}
+
+static int tsp_emu_submit(tsp_device_st *dev, tsp_cmd_st *cmd) {
+    return tsp_emu_execute(tsp_emu_lookup(dev->fd), cmd);
+}
+
+static int tsp_emu_submit_async(tsp_device_st *dev, tsp_cmd_st *cmd) {
+    struct tsp_emu *emu = tsp_emu_lookup(dev->fd);
+    tsp_emu_work_st *w = malloc(sizeof(tsp_emu_work_st));
+    int ret = 0;
+
+    if (!w) {
+        return -ENOMEM;
+    }
+    w->cmd = cmd;
+    w->next = NULL;
+
+    pthread_mutex_lock(&emu->work_lock);
+    if (!emu->workers_started && tsp_emu_start_workers(emu) < 0) {
+        ret = -EAGAIN;
+    } else {
+        if (emu->work_tail) {
+            emu->work_tail->next = w;
+        } else {
+            emu->work_head = w;
+        }
+        emu->work_tail = w;
+        pthread_cond_signal(&emu->work_cond);
+    }
+    pthread_mutex_unlock(&emu->work_lock);
+
+    if (ret) {
+        free(w);
+    }
+    return ret;
+}
+
+const tsp_transport_ops_st tsp_transport_emu = {
+    .name = "emulator",
+    .setup = tsp_emu_setup,
+    .submit = tsp_emu_submit,
+    .submit_async = tsp_emu_submit_async,
+};
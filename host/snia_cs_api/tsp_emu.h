@@ -0,0 +1,115 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * In-process emulation of a TSP CSx, internal to the CS API implementation.
+ *
+ * A CSx named "tsp-emu<N>" (e.g., "tsp-emu0") is not an NVMe controller but a
+ * device emulated by the library : its handle is an eventfd and its commands,
+ * admin and I/O, are executed by tsp_emu_execute() instead of being sent to a
+ * controller. The FDM is host memory (a memfd) that is mapped by the library
+ * like the memory window of a real CSx. All the handles opened on the same name
+ * share the same emulated device, which lives until the process exits.
+ *
+ * The emulator is configured through the environment (read when a device is
+ * first used) or csTspEmuSetModel() :
+ *
+ * - TSP_EMU_DEVICES : number of emulated CSx listed by the discovery functions
+ *   (csQueryCSEList(), csQueryFunctionList()), 0 by default. Any "tsp-emu<N>"
+ *   name can be opened regardless.
+ * - TSP_EMU_FDM_MB : size of the FDM of each device, 256 MiB by default.
+ * - TSP_EMU_LATENCY_US : latency added to every command.
+ * - TSP_EMU_LINK_MBPS : bandwidth of the host link, shared by the commands of
+ *   a device, the data of the commands is accounted for (0 : unlimited).
+ * - TSP_EMU_STORAGE_MBPS : bandwidth of the storage, accounted for by storage
+ *   requests (0 : unlimited).
+ * - TSP_EMU_NAMESPACE : file (or block device) that backs the namespace of the
+ *   devices for storage requests, these fail if not set.
+ * - TSP_EMU_WORKERS : number of requests executed concurrently by a device for
+ *   asynchronous submissions, 4 by default.
+ *
+ * The request rings (TSP_CS_RING_SETUP) are polled by a thread of the emulated
+ * device, the shared-memory stand-in of a CSx polling its memory.
+ * */
+
+#ifndef __TSP_EMU_H__
+#define __TSP_EMU_H__
+
+#include "cs.h"
+#include "tsp_transport.h"
+
+/* Prefix of the names of the emulated CSx */
+#define TSP_EMU_PREFIX "tsp-emu"
+
+struct tsp_emu;
+
+/**
+ * @brief Returns 1 if name is the name of an emulated CSx, "tsp-emu<N>" without
+ * any directory, paths are real files
+ * */
+int tsp_emu_is_name(const char *name);
+
+/**
+ * @brief Opens a handle on an emulated CSx, the device is created on the first
+ * open of its name
+ * @return the handle, or -1 on failure
+ * */
+int tsp_emu_open(const char *name);
+
+/**
+ * @brief Releases a handle opened by tsp_emu_open(), does nothing for the
+ * handles of real devices. The handle itself is closed by the caller.
+ * */
+void tsp_emu_close(CS_DEV_HANDLE fd);
+
+/**
+ * @brief Returns the emulated device behind a handle, NULL for real devices
+ * */
+struct tsp_emu *tsp_emu_lookup(CS_DEV_HANDLE fd);
+
+/**
+ * @brief Name of an emulated device (e.g., "tsp-emu0")
+ * */
+const char *tsp_emu_name(struct tsp_emu *emu);
+
+/**
+ * @brief Number of emulated CSx listed by the discovery functions
+ * */
+int tsp_emu_count(void);
+
+/**
+ * @brief Maps the FDM of an emulated device in the host address space, as the
+ * memory window of a real CSx, the mapping is released with munmap()
+ * @return CS_SUCCESS or CS_COULD_NOT_MAP_MEMORY
+ * */
+CS_STATUS tsp_emu_map_window(struct tsp_emu *emu, void **va, u64 *base, u64 *size);
+
+/**
+ * @brief Executes a TSP command, admin or I/O, on an emulated device
+ * @return 0 on success or a positive NVMe status, as tsp_submit()
+ * */
+int tsp_emu_execute(struct tsp_emu *emu, tsp_cmd_st *cmd);
+
+#endif /* __TSP_EMU_H__ */
@@ -0,0 +1,333 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+#include "tsp_transport.h"
+#include "tsp_device.h"
+#include "tsp_emu.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <limits.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/nvme_ioctl.h>
+
+#include <libnvme.h>
+
+/* Status code of a command the controller does not support (generic) */
+#define TSP_NVME_SC_INVALID_OPCODE 0x1
+#define TSP_NVME_SC_MASK 0x7ff
+
+static const u8 tsp_io_opcodes[] = {
+    [TSP_DIR_TO_DEV] = TSP_NVME_IO_OPCODE_WRITE,
+    [TSP_DIR_FROM_DEV] = TSP_NVME_IO_OPCODE_READ,
+};
+
+/*-***********
+ * Namespace *
+ *-***********/
+
+static int tsp_ng_filter(const struct dirent *d) {
+    return !strncmp(d->d_name, "ng", 2);
+}
+
+/* Opens the first namespace generic device of the controller */
+static int tsp_open_ng(CS_DEV_HANDLE fd) {
+    char ctrl_path[PATH_MAX];
+    char path[PATH_MAX];
+    struct dirent **list;
+    int n, io_fd = -1;
+
+    if (tsp_cached_ctrl_path(fd, ctrl_path) != CS_SUCCESS) {
+        return -1;
+    }
+
+    n = scandir(ctrl_path, &list, tsp_ng_filter, versionsort);
+    if (n < 0) {
+        return -1;
+    }
+    for (int i = 0; i < n; ++i) {
+        if (io_fd < 0) {
+            snprintf(path, sizeof(path), "/dev/%s", list[i]->d_name);
+            io_fd = open(path, O_RDWR);
+            if (io_fd < 0) {
+                MSG_PRINT_DEBUG("Could not open %s", path);
+            }
+        }
+        free(list[i]);
+    }
+    free(list);
+
+    return io_fd;
+}
+
+int tsp_transport_open_namespace(tsp_device_st *dev) {
+    struct stat s;
+    int nsid;
+
+    if (dev->io_fd >= 0) {
+        return 0;
+    }
+
+    if (fstat(dev->fd, &s) < 0) {
+        return -1;
+    }
+
+    if (S_ISBLK(s.st_mode)) {
+        // The CSx was opened through a namespace, commands can go through it
+        dev->io_fd = dev->fd;
+    } else {
+        dev->io_fd = tsp_open_ng(dev->fd);
+    }
+    if (dev->io_fd < 0) {
+        MSG_PRINT_DEBUG("No namespace for CSx %d", dev->fd);
+        return -1;
+    }
+
+    nsid = ioctl(dev->io_fd, NVME_IOCTL_ID);
+    if (nsid <= 0) {
+        if (dev->io_fd != dev->fd) {
+            close(dev->io_fd);
+        }
+        dev->io_fd = -1;
+        return -1;
+    }
+
+    dev->nsid = nsid;
+    return 0;
+}
+
+/*-*******
+ * Admin *
+ *-*******/
+
+int tsp_submit_admin(CS_DEV_HANDLE fd, tsp_cmd_st *cmd) {
+    struct tsp_emu *emu = tsp_emu_lookup(fd);
+
+    if (emu) {
+        return tsp_emu_execute(emu, cmd);
+    }
+    return nvme_admin_passthru(fd, TSP_NVME_OPCODE /*opcode*/, 0 /*flags*/, 0 /*rsvd*/,
+		0 /*nsid*/, 0 /*cdw2*/, 0 /*cdw3*/, cmd->cdw10, cmd->cdw11,
+		cmd->cdw12, cmd->cdw13, cmd->cdw14, cmd->cdw15,
+		cmd->data_len, cmd->data, 0 /*metadata_len*/, NULL /*metadata*/,
+		cmd->timeout_ms, &cmd->result);
+}
+
+static int tsp_admin_submit(tsp_device_st *dev, tsp_cmd_st *cmd) {
+    return tsp_submit_admin(dev->fd, cmd);
+}
+
+const tsp_transport_ops_st tsp_transport_admin = {
+    .name = "admin",
+    .submit = tsp_admin_submit,
+};
+
+/*-***********************
+ * I/O commands (ioctl) *
+ *-***********************/
+
+static int tsp_ioctl_setup(tsp_device_st *dev) {
+    return tsp_transport_open_namespace(dev);
+}
+
+static int tsp_ioctl_submit(tsp_device_st *dev, tsp_cmd_st *cmd) {
+    return nvme_io_passthru(dev->io_fd, tsp_io_opcodes[cmd->dir], 0 /*flags*/, 0 /*rsvd*/,
+		dev->nsid, 0 /*cdw2*/, 0 /*cdw3*/, cmd->cdw10, cmd->cdw11,
+		cmd->cdw12, cmd->cdw13, cmd->cdw14, cmd->cdw15,
+		cmd->data_len, cmd->data, 0 /*metadata_len*/, NULL /*metadata*/,
+		cmd->timeout_ms, &cmd->result);
+}
+
+const tsp_transport_ops_st tsp_transport_ioctl = {
+    .name = "ioctl",
+    .setup = tsp_ioctl_setup,
+    .submit = tsp_ioctl_submit,
+};
+
+/*-***********
+ * Selection *
+ *-***********/
+
+static const tsp_transport_ops_st *tsp_transports_default[] = {
+    &tsp_transport_ioctl, &tsp_transport_admin, NULL,
+};
+static const tsp_transport_ops_st *tsp_transports_uring[] = {
+    &tsp_transport_uring, &tsp_transport_ioctl, &tsp_transport_admin, NULL,
+};
+static const tsp_transport_ops_st *tsp_transports_admin[] = {
+    &tsp_transport_admin, NULL,
+};
+static const tsp_transport_ops_st *tsp_transports_loopback[] = {
+    &tsp_transport_loopback, NULL,
+};
+static const tsp_transport_ops_st *tsp_transports_emu[] = {
+    &tsp_transport_emu, NULL,
+};
+
+static const tsp_transport_ops_st **tsp_transport_candidates(void) {
+    const char *env = getenv("TSP_TRANSPORT");
+
+    if (!env || !strcmp(env, "ioctl")) {
+        return tsp_transports_default;
+    } else if (!strcmp(env, "io_uring")) {
+        return tsp_transports_uring;
+    } else if (!strcmp(env, "admin")) {
+        return tsp_transports_admin;
+    } else if (!strcmp(env, "loopback")) {
+        return tsp_transports_loopback;
+    }
+
+    MSG_PRINT_WARNING("Unknown TSP_TRANSPORT %s, using the default transport", env);
+    return tsp_transports_default;
+}
+
+static const tsp_transport_ops_st *tsp_transport_get(tsp_device_st *dev) {
+    const tsp_transport_ops_st *t = __atomic_load_n(&dev->transport, __ATOMIC_ACQUIRE);
+
+    if (t) {
+        return t;
+    }
+
+    pthread_mutex_lock(&dev->transport_lock);
+    if (!dev->transport) {
+        const tsp_transport_ops_st **c = tsp_emu_lookup(dev->fd) ? tsp_transports_emu :
+                                         tsp_transport_candidates();
+        for (; *c; ++c) {
+            if (!(*c)->setup || (*c)->setup(dev) == 0) {
+                break;
+            }
+            MSG_PRINT_DEBUG("Transport %s not available for CSx %d", (*c)->name, dev->fd);
+        }
+        MSG_PRINT_DEBUG("CSx %d uses the %s transport", dev->fd, *c ? (*c)->name : "admin");
+        __atomic_store_n(&dev->transport, *c ? *c : &tsp_transport_admin, __ATOMIC_RELEASE);
+    }
+    t = dev->transport;
+    pthread_mutex_unlock(&dev->transport_lock);
+
+    return t;
+}
+
+void tsp_transport_release(tsp_device_st *dev) {
+    if (dev->transport && dev->transport->release) {
+        dev->transport->release(dev);
+    }
+    dev->transport = NULL;
+    dev->transport_priv = NULL;
+    if (dev->io_fd >= 0 && dev->io_fd != dev->fd) {
+        close(dev->io_fd);
+    }
+    dev->io_fd = -1;
+}
+
+/* Older firmware only handles the admin command */
+static int tsp_invalid_opcode(tsp_device_st *dev, int ret) {
+    if (ret > 0 && (ret & TSP_NVME_SC_MASK) == TSP_NVME_SC_INVALID_OPCODE &&
+        dev->transport != &tsp_transport_admin && dev->transport != &tsp_transport_loopback) {
+        if (!__atomic_exchange_n(&dev->admin_only, 1, __ATOMIC_RELAXED)) {
+            MSG_PRINT_WARNING("CSx %d does not accept TSP I/O commands, using the admin queue", dev->fd);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/*-************
+ * Submission *
+ *-************/
+
+void tsp_transport_complete(tsp_device_st *dev, tsp_cmd_st *cmd, int ret) {
+    if (tsp_invalid_opcode(dev, ret)) {
+        ret = tsp_submit_admin(dev->fd, cmd);
+    }
+    cmd->done(cmd, ret);
+}
+
+int tsp_submit(CS_DEV_HANDLE fd, tsp_cmd_st *cmd) {
+    tsp_device_st *dev = tsp_device_get(fd);
+    const tsp_transport_ops_st *t;
+    int ret;
+
+    if (!dev) {
+        return tsp_submit_admin(fd, cmd);
+    }
+
+    t = tsp_transport_get(dev);
+    if (__atomic_load_n(&dev->admin_only, __ATOMIC_RELAXED)) {
+        return tsp_submit_admin(fd, cmd);
+    }
+
+    ret = t->submit(dev, cmd);
+    if (tsp_invalid_opcode(dev, ret)) {
+        return tsp_submit_admin(fd, cmd);
+    }
+    return ret;
+}
+
+int tsp_submit_batch(CS_DEV_HANDLE fd, tsp_cmd_st **cmds, int n) {
+    tsp_device_st *dev = tsp_device_get(fd);
+    const tsp_transport_ops_st *t;
+    int ret = 0;
+
+    if (dev) {
+        t = tsp_transport_get(dev);
+        if (t->submit_batch && !__atomic_load_n(&dev->admin_only, __ATOMIC_RELAXED)) {
+            ret = t->submit_batch(dev, cmds, n);
+            if (!tsp_invalid_opcode(dev, ret)) {
+                return ret;
+            }
+            ret = 0;
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        int r = tsp_submit(fd, cmds[i]);
+        if (r && !ret) {
+            ret = r;
+        }
+    }
+    return ret;
+}
+
+int tsp_submit_async(CS_DEV_HANDLE fd, tsp_cmd_st *cmd) {
+    tsp_device_st *dev = tsp_device_get(fd);
+    const tsp_transport_ops_st *t;
+
+    if (dev) {
+        t = tsp_transport_get(dev);
+        if (t->submit_async && !__atomic_load_n(&dev->admin_only, __ATOMIC_RELAXED)) {
+            return t->submit_async(dev, cmd);
+        }
+    }
+
+    // Synchronous transports complete the command before returning
+    cmd->done(cmd, tsp_submit(fd, cmd));
+    return 0;
+}
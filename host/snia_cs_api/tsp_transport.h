@@ -0,0 +1,168 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Transport of the TSP commands, internal to the CS API implementation.
+ *
+ * Discovery (identify, get) uses the vendor specific admin command. All the
+ * other commands (compute, memory, storage, relay) go through the transport of
+ * the CSx, selected with the TSP_TRANSPORT environment variable :
+ *
+ * - "ioctl" (default) : vendor specific I/O commands on the namespace generic
+ *   character device (/dev/ngXnY) of the CSx, the NVMe driver submits them on
+ *   the I/O queue of the CPU of the calling thread, so that the commands of
+ *   several threads do not share the single and shallow admin queue.
+ * - "io_uring" : the same I/O commands through io_uring NVMe passthrough
+ *   (IORING_OP_URING_CMD), see tsp_uring.c. Several commands are submitted per
+ *   system call and completions can be polled instead of interrupt driven.
+ * - "admin" : the vendor specific admin command, as for discovery.
+ * - "loopback" : no device, commands are completed by a handler in the process
+ *   through an io_uring ring (or directly if io_uring is not available). This
+ *   allows to run the transport without a CSD.
+ *
+ * The commands of an emulated CSx (see tsp_emu.h), admin and I/O, are always
+ * executed by the emulator, regardless of TSP_TRANSPORT.
+ *
+ * If a transport cannot be used with a CSx (no namespace, no io_uring, the
+ * firmware rejects the I/O opcodes), the next one is used : io_uring, ioctl,
+ * admin.
+ * */
+
+#ifndef __TSP_TRANSPORT_H__
+#define __TSP_TRANSPORT_H__
+
+#include "cs.h"
+#include "tsp.h"
+
+struct tsp_device;
+
+typedef enum {
+    TSP_DIR_TO_DEV,   // the buffer is sent to the device (or there is none)
+    TSP_DIR_FROM_DEV, // the buffer is filled by the device
+} TSP_DIR;
+
+struct tsp_cmd;
+
+/* Called once the command completed, ret as returned by tsp_submit() */
+typedef void (*tsp_cmd_done_fn)(struct tsp_cmd *cmd, int ret);
+
+/**
+ * @brief A TSP command, the opcode and namespace are given by the transport
+ * */
+typedef struct tsp_cmd {
+    u32 cdw10;      // sub-opcode
+    u32 cdw11;
+    u32 cdw12;
+    u32 cdw13;
+    u32 cdw14;
+    u32 cdw15;
+    TSP_DIR dir;
+    u32 data_len;
+    void *data;
+    u32 timeout_ms; // 0 for the default timeout of the driver
+    u32 result;     // completion dword 0
+    /* Asynchronous commands only */
+    tsp_cmd_done_fn done;
+    void *ctx;
+} tsp_cmd_st;
+
+/**
+ * @brief Operations of a transport, submit is mandatory, the others may be
+ * NULL (the commands are then submitted one by one, synchronously)
+ * */
+typedef struct tsp_transport_ops {
+    const char *name;
+    /* Prepares the transport for a CSx, returns 0 if it can be used */
+    int (*setup)(struct tsp_device *dev);
+    void (*release)(struct tsp_device *dev);
+    /* Sends a command and waits for its completion */
+    int (*submit)(struct tsp_device *dev, tsp_cmd_st *cmd);
+    /* Sends n commands and waits for all of them, returns the first error */
+    int (*submit_batch)(struct tsp_device *dev, tsp_cmd_st **cmds, int n);
+    /* Sends a command, cmd->done is called on completion (from any thread) */
+    int (*submit_async)(struct tsp_device *dev, tsp_cmd_st *cmd);
+} tsp_transport_ops_st;
+
+/* tsp_transport.c */
+extern const tsp_transport_ops_st tsp_transport_admin;
+extern const tsp_transport_ops_st tsp_transport_ioctl;
+/* tsp_uring.c */
+extern const tsp_transport_ops_st tsp_transport_uring;
+extern const tsp_transport_ops_st tsp_transport_loopback;
+/* tsp_emu.c */
+extern const tsp_transport_ops_st tsp_transport_emu;
+
+/**
+ * @brief Handler that executes the commands of the loopback transport, it
+ * fills the buffer (if any) and returns a status like tsp_submit(). The
+ * default handler completes every command successfully with a zeroed buffer.
+ * */
+typedef int (*tsp_loopback_fn)(CS_DEV_HANDLE fd, tsp_cmd_st *cmd);
+void tsp_loopback_set_handler(tsp_loopback_fn fn);
+int tsp_loopback_execute(CS_DEV_HANDLE fd, tsp_cmd_st *cmd);
+
+/**
+ * @brief Completes an asynchronous command for a transport, resends it as an
+ * admin command if the firmware did not accept the I/O opcode, then calls done
+ * */
+void tsp_transport_complete(struct tsp_device *dev, tsp_cmd_st *cmd, int ret);
+
+/**
+ * @brief Opens the namespace the I/O commands of a CSx are sent to, sets
+ * dev->io_fd and dev->nsid
+ * @return 0 on success, -1 if the CSx has no usable namespace
+ * */
+int tsp_transport_open_namespace(struct tsp_device *dev);
+
+/**
+ * @brief Sends a command on the data path of the CSx and waits for its
+ * completion
+ * @return 0 on success, a negative error if the command could not be sent or a
+ * positive NVMe status if it failed (like nvme_admin_passthru())
+ * */
+int tsp_submit(CS_DEV_HANDLE fd, tsp_cmd_st *cmd);
+
+/**
+ * @brief Sends several commands, with a single system call if the transport
+ * allows it, and waits for all of them
+ * @return 0 if all commands succeeded, the status of the first failed command
+ * otherwise
+ * */
+int tsp_submit_batch(CS_DEV_HANDLE fd, tsp_cmd_st **cmds, int n);
+
+/**
+ * @brief Sends a command without waiting, cmd->done(cmd, ret) is called once
+ * it completed (possibly before this function returns)
+ * @return 0 if the command was sent, a negative error otherwise (done is not
+ * called)
+ * */
+int tsp_submit_async(CS_DEV_HANDLE fd, tsp_cmd_st *cmd);
+
+/**
+ * @brief Sends a command as a vendor specific admin command
+ * */
+int tsp_submit_admin(CS_DEV_HANDLE fd, tsp_cmd_st *cmd);
+
+#endif /* __TSP_TRANSPORT_H__ */
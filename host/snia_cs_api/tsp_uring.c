@@ -0,0 +1,709 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * io_uring NVMe passthrough transport (IORING_OP_URING_CMD), see
+ * tsp_transport.h.
+ *
+ * One ring per CSx, shared by all the threads. Commands that fit in
+ * TSP_BUFFER_SIZE are copied in bounce buffers registered with the ring (the
+ * pages are pinned once instead of for every command). Threads waiting for a
+ * command take turns to reap the completion queue : the first one waits in the
+ * kernel (and submits its own command with the same system call), the others
+ * wait for it to hand over their completions. Asynchronous commands are reaped
+ * by a thread started with the first of them.
+ *
+ * Environment variables :
+ * - TSP_URING_DEPTH : number of submission queue entries (default 64)
+ * - TSP_URING_SQPOLL : a kernel thread polls the submission queue, commands
+ *   are submitted without system calls and the completions are polled for a
+ *   while before waiting in the kernel
+ * - TSP_URING_IOPOLL : completions are polled by the kernel instead of
+ *   interrupt driven (the NVMe driver needs poll queues, nvme.poll_queues=N)
+ *
+ * The loopback transport uses the same ring with IORING_OP_NOP, the commands
+ * are executed by a handler in the process when they are reaped.
+ * */
+
+#include "tsp_transport.h"
+#include "tsp_device.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <linux/nvme_ioctl.h>
+
+#define TSP_URING_DEFAULT_DEPTH 64
+#define TSP_URING_MAX_DEPTH 4096
+/* Time the completions are polled in user space before waiting (SQPOLL) */
+#define TSP_URING_SPIN_NS 50000
+
+/* Entries are 128 and 32 bytes (IORING_SETUP_SQE128 / CQE32) */
+#define TSP_URING_SQE_SHIFT 7
+#define TSP_URING_CQE_SHIFT 5
+
+static const u8 tsp_io_opcodes[] = {
+    [TSP_DIR_TO_DEV] = TSP_NVME_IO_OPCODE_WRITE,
+    [TSP_DIR_FROM_DEV] = TSP_NVME_IO_OPCODE_READ,
+};
+
+typedef struct {
+    tsp_cmd_st *cmd;
+    int ret;
+    int done;          /* set once reaped (synchronous commands) */
+    int async;
+    u8 *buffer;        /* bounce buffer, NULL if the command uses its own */
+    u32 next_free;
+} tsp_uring_slot_st;
+
+typedef struct {
+    tsp_device_st *dev;
+    int ring_fd;
+    unsigned int setup_flags;
+    int loopback;
+    /* Submission queue */
+    void *sq_ring;
+    size_t sq_ring_size;
+    u32 *sq_head;
+    u32 *sq_tail;
+    u32 sq_mask;
+    u32 *sq_flags;
+    u32 *sq_array;
+    u8 *sqes;
+    size_t sqes_size;
+    /* Completion queue */
+    void *cq_ring;
+    size_t cq_ring_size;
+    u32 *cq_head;
+    u32 *cq_tail;
+    u32 cq_mask;
+    u8 *cqes;
+    /* Slots (one per command in flight) and their bounce buffers */
+    u32 depth;
+    u8 *buffers;
+    int registered;
+    tsp_uring_slot_st *slots;
+    u32 free_head;
+    pthread_mutex_t sq_lock;   /* protects the submission queue and the slots */
+    pthread_cond_t slot_cond;
+    /* Reaping */
+    pthread_mutex_t cq_lock;
+    pthread_cond_t cq_cond;
+    int reaping;               /* a thread reaps the completion queue */
+    u32 async_inflight;
+    int reaper_started;
+    int stop;
+    pthread_t reaper;
+} tsp_uring_st;
+
+/*-**********
+ * Syscalls *
+ *-**********/
+
+static int tsp_uring_setup_sys(unsigned int entries, struct io_uring_params *p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int tsp_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                           unsigned int flags) {
+    int ret;
+    do {
+        ret = syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? -errno : ret;
+}
+
+static int tsp_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static u32 tsp_env_u32(const char *name, u32 def) {
+    const char *env = getenv(name);
+    return env ? (u32)strtoul(env, NULL, 0) : def;
+}
+
+/*-******
+ * Ring *
+ *-******/
+
+static void tsp_uring_destroy(tsp_uring_st *r) {
+    if (r->reaper_started) {
+        pthread_mutex_lock(&r->cq_lock);
+        r->stop = 1;
+        pthread_cond_broadcast(&r->cq_cond);
+        pthread_mutex_unlock(&r->cq_lock);
+        pthread_join(r->reaper, NULL);
+    }
+    if (r->sqes) {
+        munmap(r->sqes, r->sqes_size);
+    }
+    if (r->cq_ring && r->cq_ring != r->sq_ring) {
+        munmap(r->cq_ring, r->cq_ring_size);
+    }
+    if (r->sq_ring) {
+        munmap(r->sq_ring, r->sq_ring_size);
+    }
+    if (r->ring_fd >= 0) {
+        close(r->ring_fd);
+    }
+    pthread_mutex_destroy(&r->sq_lock);
+    pthread_cond_destroy(&r->slot_cond);
+    pthread_mutex_destroy(&r->cq_lock);
+    pthread_cond_destroy(&r->cq_cond);
+    free(r->buffers);
+    free(r->slots);
+    free(r);
+}
+
+static tsp_uring_st *tsp_uring_create(tsp_device_st *dev, int loopback) {
+    struct io_uring_params p;
+    struct iovec iov;
+    tsp_uring_st *r = calloc(1, sizeof(tsp_uring_st));
+    u32 depth = tsp_env_u32("TSP_URING_DEPTH", TSP_URING_DEFAULT_DEPTH);
+
+    if (!r) {
+        return NULL;
+    }
+    r->dev = dev;
+    r->ring_fd = -1;
+    r->loopback = loopback;
+    pthread_mutex_init(&r->sq_lock, NULL);
+    pthread_cond_init(&r->slot_cond, NULL);
+    pthread_mutex_init(&r->cq_lock, NULL);
+    pthread_cond_init(&r->cq_cond, NULL);
+
+    if (!depth || depth > TSP_URING_MAX_DEPTH) {
+        depth = TSP_URING_DEFAULT_DEPTH;
+    }
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SQE128 | IORING_SETUP_CQE32 | IORING_SETUP_CQSIZE;
+    p.cq_entries = depth * 2;
+    if (tsp_env_u32("TSP_URING_SQPOLL", 0)) {
+        p.flags |= IORING_SETUP_SQPOLL;
+        p.sq_thread_idle = 1000; /* ms */
+    }
+    // NOPs cannot be polled
+    if (!loopback && tsp_env_u32("TSP_URING_IOPOLL", 0)) {
+        p.flags |= IORING_SETUP_IOPOLL;
+    }
+
+    r->ring_fd = tsp_uring_setup_sys(depth, &p);
+    if (r->ring_fd < 0) {
+        MSG_PRINT_DEBUG("io_uring_setup failed (%s)", strerror(errno));
+        goto err;
+    }
+    r->setup_flags = p.flags;
+    r->depth = p.sq_entries;
+
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(u32);
+    r->cq_ring_size = p.cq_off.cqes + ((size_t)p.cq_entries << TSP_URING_CQE_SHIFT);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size) {
+            r->sq_ring_size = r->cq_ring_size;
+        }
+        r->cq_ring_size = r->sq_ring_size;
+    }
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      r->ring_fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) {
+        r->sq_ring = NULL;
+        goto err;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    } else {
+        r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          r->ring_fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED) {
+            r->cq_ring = NULL;
+            goto err;
+        }
+    }
+    r->sqes_size = (size_t)p.sq_entries << TSP_URING_SQE_SHIFT;
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->ring_fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        goto err;
+    }
+
+    r->sq_head = (u32 *)((u8 *)r->sq_ring + p.sq_off.head);
+    r->sq_tail = (u32 *)((u8 *)r->sq_ring + p.sq_off.tail);
+    r->sq_mask = *(u32 *)((u8 *)r->sq_ring + p.sq_off.ring_mask);
+    r->sq_flags = (u32 *)((u8 *)r->sq_ring + p.sq_off.flags);
+    r->sq_array = (u32 *)((u8 *)r->sq_ring + p.sq_off.array);
+    r->cq_head = (u32 *)((u8 *)r->cq_ring + p.cq_off.head);
+    r->cq_tail = (u32 *)((u8 *)r->cq_ring + p.cq_off.tail);
+    r->cq_mask = *(u32 *)((u8 *)r->cq_ring + p.cq_off.ring_mask);
+    r->cqes = (u8 *)r->cq_ring + p.cq_off.cqes;
+
+    // Slots and bounce buffers, the buffers are registered if possible
+    r->slots = calloc(r->depth, sizeof(tsp_uring_slot_st));
+    if (!r->slots || posix_memalign((void **)&r->buffers, TSP_BUFFER_SIZE,
+                                    (size_t)r->depth * TSP_BUFFER_SIZE)) {
+        r->buffers = NULL;
+        goto err;
+    }
+    for (u32 i = 0; i < r->depth; ++i) {
+        r->slots[i].next_free = i + 1;
+    }
+    r->free_head = 0;
+
+    iov.iov_base = r->buffers;
+    iov.iov_len = (size_t)r->depth * TSP_BUFFER_SIZE;
+    r->registered = !loopback &&
+        tsp_uring_register(r->ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+    if (!loopback && !r->registered) {
+        MSG_PRINT_DEBUG("Could not register the bounce buffers (%s)", strerror(errno));
+    }
+
+    return r;
+
+err:
+    tsp_uring_destroy(r);
+    return NULL;
+}
+
+/*-************
+ * Submission *
+ *-************/
+
+static u32 tsp_uring_get_slot(tsp_uring_st *r) {
+    u32 s;
+    while (r->free_head >= r->depth) {
+        pthread_cond_wait(&r->slot_cond, &r->sq_lock);
+    }
+    s = r->free_head;
+    r->free_head = r->slots[s].next_free;
+    return s;
+}
+
+static void tsp_uring_put_slot(tsp_uring_st *r, u32 s) {
+    pthread_mutex_lock(&r->sq_lock);
+    r->slots[s].next_free = r->free_head;
+    r->free_head = s;
+    pthread_cond_signal(&r->slot_cond);
+    pthread_mutex_unlock(&r->sq_lock);
+}
+
+/* Fills the next SQE for the command, sq_lock held */
+static u32 tsp_uring_push(tsp_uring_st *r, tsp_cmd_st *cmd, int async) {
+    u32 s = tsp_uring_get_slot(r);
+    tsp_uring_slot_st *slot = &r->slots[s];
+    u32 tail = *r->sq_tail;
+    u32 idx = tail & r->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)(r->sqes + ((size_t)idx << TSP_URING_SQE_SHIFT));
+    void *data = cmd->data;
+
+    slot->cmd = cmd;
+    slot->ret = 0;
+    slot->done = 0;
+    slot->async = async;
+    slot->buffer = NULL;
+
+    memset(sqe, 0, 1 << TSP_URING_SQE_SHIFT);
+    sqe->user_data = s;
+
+    if (r->loopback) {
+        sqe->opcode = IORING_OP_NOP;
+    } else {
+        struct nvme_uring_cmd *nc = (struct nvme_uring_cmd *)sqe->cmd;
+
+        if (cmd->data && cmd->data_len <= TSP_BUFFER_SIZE) {
+            slot->buffer = r->buffers + (size_t)s * TSP_BUFFER_SIZE;
+            if (cmd->dir != TSP_DIR_FROM_DEV) {
+                memcpy(slot->buffer, cmd->data, cmd->data_len);
+            }
+            data = slot->buffer;
+            if (r->registered) {
+                sqe->uring_cmd_flags = IORING_URING_CMD_FIXED;
+                sqe->buf_index = 0;
+            }
+        }
+
+        sqe->opcode = IORING_OP_URING_CMD;
+        sqe->fd = r->dev->io_fd;
+        sqe->cmd_op = NVME_URING_CMD_IO;
+        nc->opcode = tsp_io_opcodes[cmd->dir];
+        nc->nsid = r->dev->nsid;
+        nc->cdw10 = cmd->cdw10;
+        nc->cdw11 = cmd->cdw11;
+        nc->cdw12 = cmd->cdw12;
+        nc->cdw13 = cmd->cdw13;
+        nc->cdw14 = cmd->cdw14;
+        nc->cdw15 = cmd->cdw15;
+        nc->addr = (u64)(uintptr_t)data;
+        nc->data_len = cmd->data ? cmd->data_len : 0;
+        nc->timeout_ms = cmd->timeout_ms;
+    }
+
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return s;
+}
+
+/* Lets the kernel know about the new entries, returns the number of entries
+ * left for the caller to submit (0 with SQPOLL) */
+static u32 tsp_uring_kick(tsp_uring_st *r) {
+    if (r->setup_flags & IORING_SETUP_SQPOLL) {
+        if (__atomic_load_n(r->sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP) {
+            tsp_uring_enter(r->ring_fd, 0, 0, IORING_ENTER_SQ_WAKEUP);
+        }
+        return 0;
+    }
+    // The kernel submits at most the entries that are in the queue
+    return r->depth;
+}
+
+/*-*********
+ * Reaping *
+ *-*********/
+
+/* Reaps the available completions, the asynchronous ones are chained in
+ * *async to be completed once reaping is over */
+static int tsp_uring_drain(tsp_uring_st *r, int *async) {
+    u32 head = *r->cq_head;
+    u32 tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    for (; head != tail; ++head, ++n) {
+        struct io_uring_cqe *cqe = (struct io_uring_cqe *)(r->cqes +
+            ((size_t)(head & r->cq_mask) << TSP_URING_CQE_SHIFT));
+        u32 s = (u32)cqe->user_data;
+        tsp_uring_slot_st *slot = &r->slots[s];
+        tsp_cmd_st *cmd = slot->cmd;
+
+        if (r->loopback) {
+            slot->ret = tsp_loopback_execute(r->dev->fd, cmd);
+        } else {
+            slot->ret = cqe->res;
+            cmd->result = (u32)cqe->big_cqe[0];
+            if (slot->buffer && cmd->dir != TSP_DIR_TO_DEV && cqe->res >= 0) {
+                memcpy(cmd->data, slot->buffer, cmd->data_len);
+            }
+        }
+
+        if (slot->async) {
+            slot->next_free = *async;
+            *async = s;
+        } else {
+            __atomic_store_n(&slot->done, 1, __ATOMIC_RELEASE);
+        }
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+static void tsp_uring_complete_async(tsp_uring_st *r, int s) {
+    while (s >= 0) {
+        tsp_uring_slot_st *slot = &r->slots[s];
+        tsp_cmd_st *cmd = slot->cmd;
+        int ret = slot->ret;
+        int next = slot->next_free;
+
+        tsp_uring_put_slot(r, s);
+        __atomic_sub_fetch(&r->async_inflight, 1, __ATOMIC_RELAXED);
+        tsp_transport_complete(r->dev, cmd, ret);
+        s = next;
+    }
+}
+
+static int tsp_uring_spin(tsp_uring_st *r) {
+    struct timespec t0, t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do {
+        if (__atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE) != *r->cq_head) {
+            return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t);
+    } while ((t.tv_sec - t0.tv_sec) * 1000000000L + (t.tv_nsec - t0.tv_nsec) < TSP_URING_SPIN_NS);
+    return 0;
+}
+
+/**
+ * @brief Reaps completions until done() holds, one thread at a time waits in
+ * the kernel, to_submit entries are submitted by the first wait
+ * @return 0, or a negative error if the kernel could not be entered
+ * */
+static int tsp_uring_wait(tsp_uring_st *r, int (*done)(tsp_uring_st *, void *), void *arg,
+                          u32 to_submit) {
+    int ret = 0;
+
+    pthread_mutex_lock(&r->cq_lock);
+    while (!done(r, arg) && !ret) {
+        if (r->reaping) {
+            if (to_submit) {
+                // The reaper may be waiting for a long command, submit now
+                pthread_mutex_unlock(&r->cq_lock);
+                ret = tsp_uring_enter(r->ring_fd, to_submit, 0, 0);
+                to_submit = 0;
+                pthread_mutex_lock(&r->cq_lock);
+                ret = ret < 0 ? ret : 0;
+                continue;
+            }
+            pthread_cond_wait(&r->cq_cond, &r->cq_lock);
+        } else {
+            int async = -1;
+
+            r->reaping = 1;
+            pthread_mutex_unlock(&r->cq_lock);
+
+            if (!to_submit && (r->setup_flags & IORING_SETUP_SQPOLL) && tsp_uring_spin(r)) {
+                // Completed while polling, no system call
+            } else {
+                ret = tsp_uring_enter(r->ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+                ret = ret < 0 ? ret : 0;
+            }
+            to_submit = 0;
+            tsp_uring_drain(r, &async);
+
+            pthread_mutex_lock(&r->cq_lock);
+            r->reaping = 0;
+            pthread_cond_broadcast(&r->cq_cond);
+            if (async >= 0) {
+                pthread_mutex_unlock(&r->cq_lock);
+                tsp_uring_complete_async(r, async);
+                pthread_mutex_lock(&r->cq_lock);
+            }
+        }
+    }
+    pthread_mutex_unlock(&r->cq_lock);
+
+    return ret;
+}
+
+typedef struct {
+    u32 *slots;
+    int n;
+} tsp_uring_wait_st;
+
+static int tsp_uring_slots_done(tsp_uring_st *r, void *arg) {
+    tsp_uring_wait_st *w = arg;
+    for (int i = 0; i < w->n; ++i) {
+        if (!__atomic_load_n(&r->slots[w->slots[i]].done, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int tsp_uring_reaper_done(tsp_uring_st *r, void *arg) {
+    return r->stop || !__atomic_load_n(&r->async_inflight, __ATOMIC_RELAXED);
+}
+
+static void *tsp_uring_reaper_fn(void *arg) {
+    tsp_uring_st *r = arg;
+
+    pthread_mutex_lock(&r->cq_lock);
+    while (!r->stop) {
+        if (!__atomic_load_n(&r->async_inflight, __ATOMIC_RELAXED)) {
+            pthread_cond_wait(&r->cq_cond, &r->cq_lock);
+            continue;
+        }
+        pthread_mutex_unlock(&r->cq_lock);
+        if (tsp_uring_wait(r, tsp_uring_reaper_done, NULL, 0) < 0) {
+            MSG_PRINT_ERROR("io_uring completions could not be reaped");
+        }
+        pthread_mutex_lock(&r->cq_lock);
+    }
+    pthread_mutex_unlock(&r->cq_lock);
+
+    return NULL;
+}
+
+/*-************
+ * Operations *
+ *-************/
+
+static int tsp_uring_submit_batch(tsp_device_st *dev, tsp_cmd_st **cmds, int n) {
+    tsp_uring_st *r = dev->transport_priv;
+    u32 slots[n > 0 ? n : 1];
+    tsp_uring_wait_st w = { .slots = slots, .n = 0 };
+    int ret = 0;
+
+    while (w.n < n) {
+        int first = w.n;
+        u32 to_submit;
+
+        // At most depth commands at a time, slots are freed once all completed
+        pthread_mutex_lock(&r->sq_lock);
+        for (; w.n < n && w.n - first < (int)r->depth; ++w.n) {
+            slots[w.n] = tsp_uring_push(r, cmds[w.n], 0);
+        }
+        to_submit = tsp_uring_kick(r);
+        pthread_mutex_unlock(&r->sq_lock);
+
+        tsp_uring_wait_st part = { .slots = slots + first, .n = w.n - first };
+        int err = tsp_uring_wait(r, tsp_uring_slots_done, &part, to_submit);
+        if (err < 0) {
+            /** @todo the slots of the commands are lost if the kernel cannot
+             * be entered anymore, the ring is unusable anyway */
+            return err;
+        }
+        for (int i = first; i < w.n; ++i) {
+            int r_i = r->slots[slots[i]].ret;
+            if (r_i && !ret) {
+                ret = r_i;
+            }
+            tsp_uring_put_slot(r, slots[i]);
+        }
+    }
+
+    return ret;
+}
+
+static int tsp_uring_submit(tsp_device_st *dev, tsp_cmd_st *cmd) {
+    return tsp_uring_submit_batch(dev, &cmd, 1);
+}
+
+static int tsp_uring_submit_async(tsp_device_st *dev, tsp_cmd_st *cmd) {
+    tsp_uring_st *r = dev->transport_priv;
+    u32 to_submit;
+    int ret = 0;
+
+    pthread_mutex_lock(&r->cq_lock);
+    if (!r->reaper_started) {
+        if (pthread_create(&r->reaper, NULL, tsp_uring_reaper_fn, r)) {
+            pthread_mutex_unlock(&r->cq_lock);
+            return -EAGAIN;
+        }
+        r->reaper_started = 1;
+    }
+    __atomic_add_fetch(&r->async_inflight, 1, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&r->cq_cond);
+    pthread_mutex_unlock(&r->cq_lock);
+
+    pthread_mutex_lock(&r->sq_lock);
+    tsp_uring_push(r, cmd, 1);
+    to_submit = tsp_uring_kick(r);
+    pthread_mutex_unlock(&r->sq_lock);
+
+    if (to_submit) {
+        ret = tsp_uring_enter(r->ring_fd, to_submit, 0, 0);
+    }
+    return ret < 0 ? ret : 0;
+}
+
+static int tsp_uring_setup(tsp_device_st *dev) {
+    if (tsp_transport_open_namespace(dev)) {
+        return -1;
+    }
+    dev->transport_priv = tsp_uring_create(dev, 0);
+    return dev->transport_priv ? 0 : -1;
+}
+
+static void tsp_uring_release(tsp_device_st *dev) {
+    if (dev->transport_priv) {
+        tsp_uring_destroy(dev->transport_priv);
+        dev->transport_priv = NULL;
+    }
+}
+
+const tsp_transport_ops_st tsp_transport_uring = {
+    .name = "io_uring",
+    .setup = tsp_uring_setup,
+    .release = tsp_uring_release,
+    .submit = tsp_uring_submit,
+    .submit_batch = tsp_uring_submit_batch,
+    .submit_async = tsp_uring_submit_async,
+};
+
+/*-**********
+ * Loopback *
+ *-**********/
+
+static int tsp_loopback_default(CS_DEV_HANDLE fd, tsp_cmd_st *cmd) {
+    if (cmd->data && cmd->dir != TSP_DIR_TO_DEV) {
+        memset(cmd->data, 0, cmd->data_len);
+    }
+    cmd->result = 0;
+    return 0;
+}
+
+static tsp_loopback_fn tsp_loopback_handler = tsp_loopback_default;
+
+void tsp_loopback_set_handler(tsp_loopback_fn fn) {
+    __atomic_store_n(&tsp_loopback_handler, fn ? fn : tsp_loopback_default, __ATOMIC_RELEASE);
+}
+
+int tsp_loopback_execute(CS_DEV_HANDLE fd, tsp_cmd_st *cmd) {
+    tsp_loopback_fn fn = __atomic_load_n(&tsp_loopback_handler, __ATOMIC_ACQUIRE);
+    return fn(fd, cmd);
+}
+
+static int tsp_loopback_setup(tsp_device_st *dev) {
+    // Without io_uring the handler is called directly
+    dev->transport_priv = tsp_uring_create(dev, 1);
+    return 0;
+}
+
+static int tsp_loopback_submit(tsp_device_st *dev, tsp_cmd_st *cmd) {
+    if (!dev->transport_priv) {
+        return tsp_loopback_execute(dev->fd, cmd);
+    }
+    return tsp_uring_submit(dev, cmd);
+}
+
+static int tsp_loopback_submit_batch(tsp_device_st *dev, tsp_cmd_st **cmds, int n) {
+    int ret = 0;
+
+    if (dev->transport_priv) {
+        return tsp_uring_submit_batch(dev, cmds, n);
+    }
+    for (int i = 0; i < n; ++i) {
+        int r = tsp_loopback_execute(dev->fd, cmds[i]);
+        if (r && !ret) {
+            ret = r;
+        }
+    }
+    return ret;
+}
+
+static int tsp_loopback_submit_async(tsp_device_st *dev, tsp_cmd_st *cmd) {
+    if (!dev->transport_priv) {
+        cmd->done(cmd, tsp_loopback_execute(dev->fd, cmd));
+        return 0;
+    }
+    return tsp_uring_submit_async(dev, cmd);
+}
+
+const tsp_transport_ops_st tsp_transport_loopback = {
+    .name = "loopback",
+    .setup = tsp_loopback_setup,
+    .release = tsp_uring_release,
+    .submit = tsp_loopback_submit,
+    .submit_batch = tsp_loopback_submit_batch,
+    .submit_async = tsp_loopback_submit_async,
+};
@@ -0,0 +1,160 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Wire format of the TSP compute commands, shared by the CS API
+ * implementation and the CSD side code.
+ *
+ * The structures of the CS API (cs.h) are packed, which leaves their 64-bit
+ * fields unaligned, and a legacy compute command (version 0) carries a single
+ * CsComputeRequest in a TSP_BUFFER_SIZE buffer. From version 1 on, a transfer
+ * is a header followed by one or more requests with naturally aligned fields,
+ * every request starts on a TSP_WIRE_ALIGN boundary and the argument lists
+ * are only bounded by the size of the transfer (TSP_MDTS).
+ *
+ * TSP_CS_COMPUTE sends the transfer with its length in CDW12 and the version
+ * in CDW13. The device executes the requests in order and stops at the first
+ * failure, the status of the command is the status of that request and the
+ * completion dword 0 its index (NumRequests if all of them succeeded).
+ * TSP_CS_GET with TSP_CS_WIRE returns a TspWireInfo, devices that fail it only
+ * support the legacy format.
+ * */
+
+#ifndef __TSP_WIRE_H__
+#define __TSP_WIRE_H__
+
+#include <stddef.h>
+#include "tsp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TSP_WIRE_MAGIC 0x5754 /* "TW" */
+#define TSP_WIRE_VERSION 1
+#define TSP_WIRE_ALIGN 8
+
+/**
+ * @brief Returned by TSP_CS_GET / TSP_CS_WIRE
+ * */
+typedef struct {
+    u16 Magic;        // TSP_WIRE_MAGIC
+    u16 Reserved;
+    u32 Versions;     // bit n set if version n is supported
+    u32 MaxTransfer;  // maximum length of a transfer in bytes
+    u32 MaxRequests;  // maximum number of requests in a transfer
+} TspWireInfo;
+
+/**
+ * @brief Header of a transfer, followed by NumRequests TspWireRequest
+ * */
+typedef struct {
+    u16 Magic;        // TSP_WIRE_MAGIC
+    u8 Version;       // TSP_WIRE_VERSION
+    u8 Flags;         // 0
+    u32 Length;       // bytes of the transfer, header included
+    u32 NumRequests;
+    u32 Reserved;
+} TspWireHeader;
+
+/**
+ * @brief Argument of a request, same types as CsComputeArg
+ * */
+typedef struct {
+    u32 Type;         // CS_COMPUTE_ARG_TYPE
+    u32 Reserved;
+    union {
+        struct {
+            u64 MemHandle;   // CS_MEM_HANDLE (device address)
+            u64 ByteOffset;
+        } DevMem;
+        u64 Value64;
+        u32 Value32;
+        u64 StreamHandle;
+    } u;
+} TspWireArg;
+
+/**
+ * @brief A compute request, followed by its NumArgs arguments
+ * */
+typedef struct {
+    u32 Length;       // bytes of the request, arguments included
+    u32 FunctionId;
+    u32 NumArgs;
+    u32 Reserved;
+    TspWireArg Args[];
+} TspWireRequest;
+
+#ifndef __cplusplus
+_Static_assert(sizeof(TspWireHeader) == 16, "TspWireHeader layout");
+_Static_assert(sizeof(TspWireArg) == 24, "TspWireArg layout");
+_Static_assert(offsetof(TspWireArg, u.DevMem.ByteOffset) == 16, "TspWireArg layout");
+_Static_assert(sizeof(TspWireRequest) == 16, "TspWireRequest layout");
+#endif
+
+/* Bytes of a request with num_args arguments, a multiple of TSP_WIRE_ALIGN */
+static inline u64 tsp_wire_request_size(u64 num_args) {
+    return sizeof(TspWireRequest) + num_args * sizeof(TspWireArg);
+}
+
+/**
+ * @brief Returns the first request of a transfer (length bytes at buffer) if
+ * its header is valid, NULL otherwise
+ * */
+static inline const TspWireRequest *tsp_wire_first(const void *buffer, u64 length) {
+    const TspWireHeader *h = (const TspWireHeader *)buffer;
+
+    if (((uintptr_t)buffer & (TSP_WIRE_ALIGN - 1)) || length < sizeof(*h) ||
+        h->Magic != TSP_WIRE_MAGIC || h->Version != TSP_WIRE_VERSION ||
+        h->Length > length || h->Length < sizeof(*h)) {
+        return NULL;
+    }
+    return (const TspWireRequest *)(h + 1);
+}
+
+/**
+ * @brief Returns req if it and its arguments are within the transfer of
+ * header h, NULL otherwise
+ * */
+static inline const TspWireRequest *tsp_wire_check(const TspWireHeader *h, const TspWireRequest *req) {
+    u64 off = (u64)((const char *)req - (const char *)h);
+
+    if (off + sizeof(*req) > h->Length || req->Length < tsp_wire_request_size(req->NumArgs) ||
+        req->Length > h->Length - off || (req->Length & (TSP_WIRE_ALIGN - 1))) {
+        return NULL;
+    }
+    return req;
+}
+
+/* Request that follows req in its transfer, to be checked with tsp_wire_check() */
+static inline const TspWireRequest *tsp_wire_next(const TspWireRequest *req) {
+    return (const TspWireRequest *)((const char *)req + req->Length);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TSP_WIRE_H__ */
@@ -1,6 +1,7 @@
 #include "cs.h"
+#include "tsp.h"
+#include "tsp_transport.h"
 #include "debug.h"
-#include <libnvme.h>
 
 #include <stdint.h>
 #include <stdio.h>
@@ -23,17 +24,6 @@
 #define PORT 44422
 #define SIZE_4K 4096
 
-typedef enum {
-    TSP_CS_IDENTIFY = 0,
-    TSP_CS_GET = 8,
-    TSP_CS_ALLOCATE = 16,
-    TSP_CS_DEALLOCATE = 17,
-    TSP_CS_COMPUTE = 32,
-    TSP_CS_COMM = 64,
-    TSP_CS_OPEN_RELAY = 128,
-    TSP_CS_CLOSE_RELAY = 129,
-} TSP_CDW10;
-
 typedef struct {
     int connfd;
     CS_DEV_HANDLE devfd;
@@ -62,27 +52,30 @@ static int tsp_nvme_open_relay(CS_DEV_HANDLE fd, const char *node, const char *s
     strncpy(ai->node, node, sizeof(ai->node));
     strncpy(ai->service, service, sizeof(ai->service));
 
-    ret = nvme_admin_passthru(fd, 0xc0 /*opcode*/, 0 /*flags*/, 0 /*rsvd*/,
-		0 /** @todo ?*/ /*nsid*/, 0 /*cdw2*/, 0 /*cdw3*/, TSP_CS_OPEN_RELAY /*cdw10*/, 0 /* cdw11*/,
-		0 /* cdw12*/, 0 /*cdw13*/, 0 /*cdw14*/, 0 /*cdw15*/,
-		SIZE_4K /*data_len*/, buffer /*data*/, 0 /*metadata_len*/, NULL /*metadata*/,
-		0 /*timeout_ms*/, NULL /*result, not used in QEMU emulation...*/);
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_OPEN_RELAY,
+        .dir = TSP_DIR_TO_DEV, /* the descriptor is returned in completion dword 0 */
+        .data_len = SIZE_4K,
+        .data = buffer,
+    };
+    ret = tsp_submit(fd, &cmd);
     //printf("Return code is 0x%08x\n", ret);
     if (ret) {
         MSG_PRINT_ERROR("Failed to open relay");
         return -1;
     } else {
-        return *(int32_t *)buffer;
+        return (int32_t)cmd.result;
     }
 }
 
 static void tsp_nvme_close_relay(CS_DEV_HANDLE fd, int relay_desc) {
     int ret = 0;
-    ret = nvme_admin_passthru(fd, 0xc0 /*opcode*/, 0 /*flags*/, 0 /*rsvd*/,
-		0 /** @todo ?*/ /*nsid*/, 0 /*cdw2*/, 0 /*cdw3*/, TSP_CS_CLOSE_RELAY /*cdw10*/, 0 /* cdw11*/,
-		0 /* cdw12*/, relay_desc /* relay desc cdw13*/, 0 /*cdw14*/, 0 /*cdw15*/,
-		0 /*data_len*/, NULL /*data*/, 0 /*metadata_len*/, NULL /*metadata*/,
-		0 /*timeout_ms*/, NULL /*result, not used in QEMU emulation...*/);
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_CLOSE_RELAY,
+        .cdw13 = relay_desc,
+        .dir = TSP_DIR_TO_DEV,
+    };
+    ret = tsp_submit(fd, &cmd);
     if (ret) {
         MSG_PRINT_WARNING("Close relay command unsuccessful");
     }
@@ -94,11 +87,16 @@ static CS_STATUS tsp_nvme_write_relay(CS_DEV_HANDLE fd, int relay_desc, char *da
     char buffer[buffer_len];
     assert(len > 0);
     memcpy(buffer, data, MIN(len, SIZE_4K));
-    ret = nvme_admin_passthru(fd, 0xc0 /*opcode*/, 0 /*flags*/, 0 /*rsvd*/,
-		0 /** @todo ?*/ /*nsid*/, 0 /*cdw2*/, 0 /*cdw3*/, TSP_CS_COMM /*cdw10*/, 1 /* Write_nRead cdw11*/,
-		len /* length cdw12*/, relay_desc /*cdw13*/, 0 /*cdw14*/, 0 /*cdw15*/,
-		buffer_len /*data_len*/, buffer /*data*/, 0 /*metadata_len*/, NULL /*metadata*/,
-		0 /*timeout_ms*/, NULL /*result*/);
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_COMM,
+        .cdw11 = 1, /* Write_nRead */
+        .cdw12 = len,
+        .cdw13 = relay_desc,
+        .dir = TSP_DIR_TO_DEV,
+        .data_len = buffer_len,
+        .data = buffer,
+    };
+    ret = tsp_submit(fd, &cmd);
     if (ret) {
         MSG_PRINT_ERROR("Failed to write relay");
         return CS_ERROR_IN_EXECUTION;
@@ -111,11 +109,18 @@ static ssize_t tsp_nvme_read_relay(CS_DEV_HANDLE fd, int relay_desc, char *data,
     int ret = 0;
     const unsigned int buffer_len = SIZE_4K;
     char buffer[buffer_len];
-    ret = nvme_admin_passthru(fd, 0xc0 /*opcode*/, 0 /*flags*/, 0 /*rsvd*/,
-		0 /** @todo ?*/ /*nsid*/, 0 /*cdw2*/, 0 /*cdw3*/, TSP_CS_COMM /*cdw10*/, 0 /* Write_nRead cdw11*/,
-		0 /*cdw12*/, relay_desc /*cdw13*/, 0 /*cdw14*/, 0 /*cdw15*/,
-		buffer_len /*data_len*/, buffer /*data*/, 0 /*metadata_len*/, NULL /*metadata*/,
-		86400000 /* timeout_ms*/, NULL /*result*/);
+    /* Blocks until the device has data, this only holds a slot of an I/O
+     * queue, the admin queue remains available */
+    tsp_cmd_st cmd = {
+        .cdw10 = TSP_CS_COMM,
+        .cdw11 = 0, /* Write_nRead */
+        .cdw13 = relay_desc,
+        .dir = TSP_DIR_FROM_DEV,
+        .data_len = buffer_len,
+        .data = buffer,
+        .timeout_ms = 86400000,
+    };
+    ret = tsp_submit(fd, &cmd);
     if (ret) {
         MSG_PRINT_ERROR("Failed to read relay");
         return -1;
@@ -0,0 +1,91 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Tests of the C++ interface (cs.hpp) against the emulated CSx : the CSx is
+ * opened from its path, then the Checksum function is called synchronously
+ * and asynchronously. Returns 0 if all the checks passed.
+ * */
+
+#include "cs.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+
+#define EMU_DEVICE "tsp-emu0"
+
+static int failures;
+
+#define CHECK(cond)                                                                \
+    do {                                                                           \
+        if (!(cond)) {                                                             \
+            fprintf(stderr, "%s:%d: check failed : %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                            \
+        }                                                                          \
+    } while (0)
+
+static void test_path() {
+    char name[4];
+    unsigned int length = sizeof(name);
+
+    // The required length is reported, cs::Device::fromPath() grows its buffer
+    CHECK(csGetCSxFromPath(const_cast<char *>(EMU_DEVICE), &length, name) == CS_INVALID_LENGTH);
+    CHECK(length == sizeof(EMU_DEVICE));
+}
+
+static void test_compute() {
+    cs::Device dev = cs::Device::fromPath(EMU_DEVICE);
+    cs::Engine cse(dev);
+    cs::Function<cs::Mem, u32, cs::Mem> checksum(cse, "Checksum");
+    cs::Buffer data(dev, 4096), result(dev, 4096);
+    u32 *words = data.data<u32>();
+
+    for (u32 i = 0; i < 1024; ++i) {
+        words[i] = i * 2654435761u;
+    }
+    const u32 expected = std::accumulate(words, words + 1024, 0u);
+
+    CHECK(checksum(data, 4096, result) == CS_SUCCESS);
+    CHECK(*result.data<u32>() == expected);
+
+    *result.data<u32>() = 0;
+    std::future<CS_STATUS> done = checksum.async(data, 4096, result);
+    CHECK(done.get() == CS_SUCCESS);
+    CHECK(*result.data<u32>() == expected);
+}
+
+int main() {
+    try {
+        test_path();
+        test_compute();
+    } catch (const cs::Error &e) {
+        fprintf(stderr, "%s\n", e.what());
+        failures++;
+    }
+
+    printf("%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,785 @@
+/*******************************************************************************
+ * Copyright (C) 2026 Rick Wertenbroek
+ * Reconfigurable Embedded Digital Systems (REDS),
+ * School of Management and Engineering Vaud (HEIG-VD),
+ * University of Applied Sciences and Arts Western Switzerland (HES-SO).
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Tests of the CS API against the emulated CSx (see the README of the library).
+ *
+ * Every test opens the CSx and one of its CSEs, each with a handle of its own,
+ * and uses both : what is set or allocated through one of them has to apply to
+ * the requests sent to the other, as with a CSD. Runs without a CSD nor root,
+ * returns 0 if all the tests passed.
+ * */
+
+#include "cs.h"
+#include "cs_tsp.h"
+#include "tsp_wire.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
+#define EMU_DEVICE "tsp-emu0"
+/* Function of the emulator that sleeps Args[0] milliseconds */
+#define SLEEP_FUNCTION_ID 100
+/* Function registered by the tests, always fails */
+#define FAILING_FUNCTION_ID 101
+/* Bytes of the emulated namespace, filled with a known pattern */
+#define NAMESPACE_BYTES (64 * 1024)
+#define BLOCK_SHIFT 9
+
+static int failures;
+
+#define CHECK(cond)                                                                \
+    do {                                                                           \
+        if (!(cond)) {                                                             \
+            fprintf(stderr, "%s:%d: check failed : %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                            \
+        }                                                                          \
+    } while (0)
+
+#define CHECK_STATUS(expr, expected)                                               \
+    do {                                                                           \
+        CS_STATUS _status = (expr);                                                \
+        if (_status != (expected)) {                                               \
+            fprintf(stderr, "%s:%d: %s returned %d, expected %d\n", __FILE__, __LINE__, \
+                    #expr, _status, (expected));                                   \
+            failures++;                                                            \
+        }                                                                          \
+    } while (0)
+
+/* Handles of the CSx and of its CSE, opened by each test */
+static CS_DEV_HANDLE dev;
+static CS_CSE_HANDLE cse;
+static CS_FUNCTION_ID checksum_id;
+
+static int completions;
+
+static void count_completion(void *Context, CS_STATUS Status) {
+    (void)Context;
+    if (Status == CS_SUCCESS) {
+        __atomic_add_fetch(&completions, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void open_handles(void) {
+    CHECK_STATUS(csOpenCSx(EMU_DEVICE, NULL, &dev), CS_SUCCESS);
+    CHECK_STATUS(csOpenCSE(EMU_DEVICE, NULL, &cse), CS_SUCCESS);
+    CHECK(dev != cse);
+    CHECK_STATUS(csGetFunction(cse, "Checksum", NULL, &checksum_id), CS_SUCCESS);
+}
+
+static void close_handles(void) {
+    CHECK_STATUS(csCloseCSE(cse), CS_SUCCESS);
+    CHECK_STATUS(csCloseCSx(dev), CS_SUCCESS);
+}
+
+static u32 host_checksum(const void *data, u32 bytes) {
+    const u32 *words = data;
+    u32 sum = 0;
+
+    for (u32 i = 0; i < bytes / sizeof(u32); ++i) {
+        sum += words[i];
+    }
+    return sum;
+}
+
+/* Checksum of bytes at in, written at out */
+static CsComputeRequest *checksum_request(CS_CSE_HANDLE handle, CS_MEM_HANDLE in, u32 bytes,
+                                          CS_MEM_HANDLE out, u64 out_offset) {
+    CsComputeRequest *req = calloc(1, sizeof(*req) + 3 * sizeof(CsComputeArg));
+
+    req->CSEHandle = handle;
+    req->FunctionId = checksum_id;
+    req->NumArgs = 3;
+    csHelperSetComputeArg(&req->Args[0], CS_AFDM_TYPE, in, 0);
+    csHelperSetComputeArg(&req->Args[1], CS_32BIT_VALUE_TYPE, bytes);
+    csHelperSetComputeArg(&req->Args[2], CS_AFDM_TYPE, out, out_offset);
+    return req;
+}
+
+static CsComputeRequest *sleep_request(CS_CSE_HANDLE handle, u32 ms) {
+    CsComputeRequest *req = calloc(1, sizeof(*req) + sizeof(CsComputeArg));
+
+    req->CSEHandle = handle;
+    req->FunctionId = SLEEP_FUNCTION_ID;
+    req->NumArgs = 1;
+    csHelperSetComputeArg(&req->Args[0], CS_32BIT_VALUE_TYPE, ms);
+    return req;
+}
+
+/*-*******
+ * Tests *
+ *-*******/
+
+static void test_names(void) {
+    char dir[] = "/tmp/tsp-emu-names-XXXXXX", path[64], name[64];
+    unsigned int length = sizeof(name);
+    CS_DEV_HANDLE handle;
+    int fd;
+
+    CHECK_STATUS(csGetCSxFromPath(EMU_DEVICE, &length, name), CS_SUCCESS);
+    CHECK(!strcmp(name, EMU_DEVICE));
+
+    // A file named after the emulated CSx is not the emulated CSx
+    CHECK(mkdtemp(dir) != NULL);
+    snprintf(path, sizeof(path), "%s/" EMU_DEVICE, dir);
+    fd = open(path, O_CREAT | O_WRONLY, 0600);
+    CHECK(fd >= 0);
+    close(fd);
+    length = sizeof(name);
+    CHECK(csGetCSxFromPath(path, &length, name) != CS_SUCCESS);
+    CHECK(csOpenCSx(path, NULL, &handle) != CS_SUCCESS);
+    CHECK(csOpenCSx("/dev/" EMU_DEVICE, NULL, &handle) != CS_SUCCESS);
+    unlink(path);
+    rmdir(dir);
+}
+
+static void test_alloc_free(void) {
+    CS_MEM_HANDLE small, large;
+    CS_MEM_PTR small_va, large_va;
+    u8 host[4096];
+
+    CHECK_STATUS(csAllocMem(dev, 4096, 0, &small, &small_va), CS_SUCCESS);
+    CHECK_STATUS(csAllocMem(dev, 1 << 20, 0, &large, &large_va), CS_SUCCESS);
+    CHECK(small != large);
+
+    // Host copies both ways, the FDM is also visible through its mapping
+    for (u32 i = 0; i < sizeof(host); ++i) {
+        host[i] = i * 7;
+    }
+    CsCopyMemRequest copy = {
+        .Type = CS_COPY_TO_DEVICE,
+        .HostVAddress = host,
+        .DevMem = {large, (1 << 20) - sizeof(host)},
+        .Bytes = sizeof(host),
+    };
+    CHECK_STATUS(csQueueCopyMemRequest(&copy, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK(!memcmp((u8 *)large_va + (1 << 20) - sizeof(host), host, sizeof(host)));
+    memset(host, 0, sizeof(host));
+    copy.Type = CS_COPY_FROM_DEVICE;
+    CHECK_STATUS(csQueueCopyMemRequest(&copy, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK(host[1] == 7 && host[sizeof(host) - 1] == (u8)((sizeof(host) - 1) * 7));
+
+    // Asynchronous copies complete through the event or the callback
+    CS_EVT_HANDLE ev;
+    u32 copied = 0;
+    CHECK_STATUS(csCreateEvent(&ev), CS_SUCCESS);
+    memset(host, 0, sizeof(host));
+    CHECK_STATUS(csQueueCopyMemRequest(&copy, NULL, NULL, ev, &copied), CS_QUEUED);
+    CHECK_STATUS(csTspWaitEvent(ev), CS_SUCCESS);
+    CHECK(copied == sizeof(host) && host[1] == 7);
+    completions = 0;
+    copy.Type = CS_COPY_TO_DEVICE;
+    CHECK_STATUS(csQueueCopyMemRequest(&copy, NULL, count_completion, NULL, NULL), CS_QUEUED);
+    CHECK(completions == 1);
+
+    // Copies past the allocation are refused, also through the event
+    copy.DevMem.ByteOffset = (1 << 20) - sizeof(host) + 1;
+    CHECK_STATUS(csQueueCopyMemRequest(&copy, NULL, NULL, NULL, NULL), CS_INVALID_LENGTH);
+    CHECK_STATUS(csQueueCopyMemRequest(&copy, NULL, NULL, ev, &copied), CS_QUEUED);
+    CHECK_STATUS(csTspWaitEvent(ev), CS_INVALID_LENGTH);
+    CHECK(copied == 0);
+    csDeleteEvent(ev);
+
+    CHECK_STATUS(csFreeMem(small), CS_SUCCESS);
+    CHECK_STATUS(csFreeMem(large), CS_SUCCESS);
+    copy.DevMem.ByteOffset = 0;
+    CHECK(csQueueCopyMemRequest(&copy, NULL, NULL, NULL, NULL) != CS_SUCCESS);
+}
+
+static void test_checksum(void) {
+    CS_MEM_HANDLE in, out;
+    CS_MEM_PTR in_va, out_va;
+    CsComputeRequest *req;
+
+    // Allocated through the CSx, computed on by the CSE
+    CHECK_STATUS(csAllocMem(dev, 8192, 0, &in, &in_va), CS_SUCCESS);
+    CHECK_STATUS(csAllocMem(dev, 4096, 0, &out, &out_va), CS_SUCCESS);
+    for (u32 i = 0; i < 8192 / sizeof(u32); ++i) {
+        ((u32 *)in_va)[i] = i * 0x9e3779b9u;
+    }
+
+    req = checksum_request(cse, in, 8192, out, 0);
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK(*(u32 *)out_va == host_checksum(in_va, 8192));
+
+    // Asynchronous, with an event and a callback
+    CS_EVT_HANDLE ev;
+    CHECK_STATUS(csCreateEvent(&ev), CS_SUCCESS);
+    *(u32 *)out_va = 0;
+    completions = 0;
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, count_completion, ev, NULL), CS_QUEUED);
+    CHECK_STATUS(csTspWaitEvent(ev), CS_SUCCESS);
+    CHECK(completions == 1);
+    CHECK(*(u32 *)out_va == host_checksum(in_va, 8192));
+    csDeleteEvent(ev);
+
+    // Unknown function
+    req->FunctionId = 0xdead;
+    CHECK(csQueueComputeRequest(req, NULL, NULL, NULL, NULL) != CS_SUCCESS);
+
+    free(req);
+    csFreeMem(out);
+    csFreeMem(in);
+}
+
+static CS_STATUS failing_function(const CsComputeRequest *Req, const CsTspEmuArg *Args) {
+    (void)Req;
+    (void)Args;
+    return CS_ERROR_IN_EXECUTION;
+}
+
+/* Status of a failing request, synchronous then through an event */
+static void check_failure_status(CsComputeRequest *req, CS_EVT_HANDLE ev) {
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, NULL, NULL), CS_ERROR_IN_EXECUTION);
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, ev, NULL), CS_QUEUED);
+    CHECK_STATUS(csTspWaitEvent(ev), CS_ERROR_IN_EXECUTION);
+}
+
+static void test_status(void) {
+    CsComputeRequest *req = sleep_request(cse, 0);
+    CS_EVT_HANDLE ev;
+
+    // The failure of a function is reported the same way on every path
+    CHECK_STATUS(csTspEmuRegisterFunction(FAILING_FUNCTION_ID, -1, failing_function), CS_SUCCESS);
+    CHECK_STATUS(csCreateEvent(&ev), CS_SUCCESS);
+    req->FunctionId = FAILING_FUNCTION_ID;
+    check_failure_status(req, ev);
+    CHECK_STATUS(csTspEnableRequestRings(dev, 8), CS_SUCCESS);
+    check_failure_status(req, ev);
+    CHECK_STATUS(csTspDisableRequestRings(dev), CS_SUCCESS);
+
+    csDeleteEvent(ev);
+    free(req);
+    CHECK_STATUS(csTspEmuRegisterFunction(FAILING_FUNCTION_ID, -1, NULL), CS_SUCCESS);
+}
+
+/* Checks in the completion of a copy that the memoized result was dropped */
+typedef struct {
+    CsComputeRequest *req;
+    const void *input;
+    u32 *result;
+    int fresh;
+} memo_check_st;
+
+static void memo_check_completion(void *Context, CS_STATUS Status) {
+    memo_check_st *check = Context;
+
+    *check->result = 0;
+    check->fresh = Status == CS_SUCCESS &&
+                   csQueueComputeRequest(check->req, NULL, NULL, NULL, NULL) == CS_SUCCESS &&
+                   *check->result == host_checksum(check->input, 4096);
+}
+
+static void test_memo(void) {
+    CS_MEM_HANDLE mem;
+    CS_MEM_PTR va;
+    CsTspMemoStats before, after;
+    CsComputeRequest *req;
+    u32 expected, *result;
+
+    CHECK_STATUS(csAllocMem(dev, 1 << 16, 0, &mem, &va), CS_SUCCESS);
+    result = (u32 *)((u8 *)va + 32768);
+    CHECK_STATUS(csTspSetMemoCache(1 << 20), CS_SUCCESS);
+    // Memoized through the CSx, requests sent to the CSE
+    CHECK_STATUS(csTspMemoizeFunction(dev, checksum_id, sizeof(u32)), CS_SUCCESS);
+
+    CsStorageRequest load = {.Mode = CS_STORAGE_BLOCK_IO, .DevHandle = dev};
+    load.u.BlockIo = (CsBlockIo){
+        .Type = CS_STORAGE_LOAD_TYPE,
+        .NamespaceId = 1,
+        .StartLba = 0,
+        .NumBlocks = 4096 >> BLOCK_SHIFT,
+        .DevMem = {mem, 0},
+    };
+    CHECK_STATUS(csQueueStorageRequest(&load, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    expected = host_checksum(va, 4096);
+
+    req = checksum_request(cse, mem, 4096, mem, 32768);
+    csTspQueryMemoStats(&before);
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK(*result == expected);
+    *result = 0;
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK(*result == expected);
+    csTspQueryMemoStats(&after);
+    CHECK(after.Misses == before.Misses + 1);
+    CHECK(after.Hits == before.Hits + 1);
+
+    // The same request through the CSx hits the result of the CSE
+    req->CSEHandle = dev;
+    *result = 0;
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK(*result == expected);
+    csTspQueryMemoStats(&after);
+    CHECK(after.Hits == before.Hits + 2);
+
+    // Written by the host, the input is not the loaded data anymore
+    u32 word = 0x12345678;
+    CsCopyMemRequest copy = {
+        .Type = CS_COPY_TO_DEVICE,
+        .HostVAddress = &word,
+        .DevMem = {mem, 16},
+        .Bytes = sizeof(word),
+    };
+    CHECK_STATUS(csQueueCopyMemRequest(&copy, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    expected = host_checksum(va, 4096);
+    req->CSEHandle = cse;
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK(*result == expected);
+    csTspQueryMemoStats(&after);
+    CHECK(after.Hits == before.Hits + 2);
+
+    // Also before an asynchronous copy completes
+    CHECK_STATUS(csQueueStorageRequest(&load, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    memo_check_st check = {.req = req, .input = va, .result = result};
+    CHECK_STATUS(csQueueCopyMemRequest(&copy, &check, memo_check_completion, NULL, NULL), CS_QUEUED);
+    CHECK(check.fresh);
+
+    // Loaded again then stored over, the cached result is dropped
+    CHECK_STATUS(csQueueStorageRequest(&load, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    expected = host_checksum(va, 4096);
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK(*result == expected);
+    csTspQueryMemoStats(&before);
+    CsStorageRequest store = load;
+    store.u.BlockIo.Type = CS_STORAGE_STORE_TYPE;
+    CHECK_STATUS(csQueueStorageRequest(&store, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    csTspQueryMemoStats(&after);
+    CHECK(after.Invalidations > before.Invalidations);
+
+    free(req);
+    CHECK_STATUS(csTspSetMemoCache(0), CS_SUCCESS);
+    csFreeMem(mem);
+}
+
+/* Requests of the admission test, started at once */
+static pthread_barrier_t admit_barrier;
+static int admit_ok, admit_refused;
+
+static void *admit_worker(void *arg) {
+    CsComputeRequest *req = sleep_request(cse, 100);
+    CS_STATUS status;
+
+    (void)arg;
+    pthread_barrier_wait(&admit_barrier);
+    status = csQueueComputeRequest(req, NULL, NULL, NULL, NULL);
+    if (status == CS_SUCCESS) {
+        __atomic_add_fetch(&admit_ok, 1, __ATOMIC_RELAXED);
+    } else if (status == CS_OUT_OF_RESOURCES) {
+        __atomic_add_fetch(&admit_refused, 1, __ATOMIC_RELAXED);
+    }
+    free(req);
+    return NULL;
+}
+
+/* Batch of two requests, which waits for two slots */
+static void *admit_batch_worker(void *arg) {
+    CsComputeRequest *reqs[2] = {sleep_request(cse, 100), sleep_request(cse, 100)};
+
+    *(CS_STATUS *)arg = csTspQueueComputeBatch(2, reqs, NULL, NULL, NULL, NULL);
+    free(reqs[0]);
+    free(reqs[1]);
+    return NULL;
+}
+
+/* Completion queueing a request, Context, while the CSx is full */
+static CS_STATUS admit_callback_status;
+static int admit_callback_done;
+
+static void admit_completion(void *Context, CS_STATUS Status) {
+    (void)Status;
+    admit_callback_status = csQueueComputeRequest(Context, NULL, NULL, NULL, NULL);
+    __atomic_store_n(&admit_callback_done, 1, __ATOMIC_RELEASE);
+}
+
+static void admit_run(int n) {
+    pthread_t threads[8];
+
+    admit_ok = admit_refused = 0;
+    pthread_barrier_init(&admit_barrier, NULL, n);
+    for (int i = 0; i < n; ++i) {
+        pthread_create(&threads[i], NULL, admit_worker, NULL);
+    }
+    for (int i = 0; i < n; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&admit_barrier);
+}
+
+static void test_admission(void) {
+    CsCapabilityInfo caps = {.MaxIOs.TotalOutstandingIOs = 1};
+    double t0;
+
+    // Limits set on the CSx apply to the requests of the CSE
+    CHECK_STATUS(csSetDeviceCapability(dev, CS_CAPABILITY_CSx_MAX_IOS, &caps), CS_SUCCESS);
+    admit_run(4);
+    CHECK(admit_ok == 1 && admit_refused == 3);
+
+    // Queued over the limit, whichever handle sets the policy
+    CHECK_STATUS(csTspSetAdmissionPolicy(cse, CS_TSP_ADMIT_QUEUE, 8), CS_SUCCESS);
+    t0 = now_ms();
+    admit_run(4);
+    CHECK(admit_ok == 4 && admit_refused == 0);
+    CHECK(now_ms() - t0 >= 4 * 100 - 10);
+
+    // A request issued by a completion is refused rather than waiting for
+    // the completion thread
+    CsComputeRequest *first = sleep_request(cse, 100), *next = sleep_request(cse, 10);
+    CHECK_STATUS(csQueueComputeRequest(first, next, admit_completion, NULL, NULL), CS_QUEUED);
+    CHECK_STATUS(csQueueComputeRequest(next, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    for (int ms = 0; ms < 2000 && !__atomic_load_n(&admit_callback_done, __ATOMIC_ACQUIRE); ++ms) {
+        usleep(1000);
+    }
+    CHECK(admit_callback_done && admit_callback_status == CS_OUT_OF_RESOURCES);
+
+    // Newcomers queue behind the requests waiting, even if they would fit
+    CS_STATUS batch_status = CS_INVALID_ARG;
+    pthread_t batch;
+    caps.MaxIOs.TotalOutstandingIOs = 2;
+    CHECK_STATUS(csSetDeviceCapability(dev, CS_CAPABILITY_CSx_MAX_IOS, &caps), CS_SUCCESS);
+    csHelperSetComputeArg(&first->Args[0], CS_32BIT_VALUE_TYPE, 200);
+    CHECK_STATUS(csQueueComputeRequest(first, NULL, count_completion, NULL, NULL), CS_QUEUED);
+    pthread_create(&batch, NULL, admit_batch_worker, &batch_status);
+    usleep(50000);
+    t0 = now_ms();
+    CHECK_STATUS(csQueueComputeRequest(next, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK(now_ms() - t0 >= 100);
+    pthread_join(batch, NULL);
+    CHECK(batch_status == CS_SUCCESS);
+    free(first);
+    free(next);
+
+    // Per function limit, set through the CSE
+    caps.MaxIOs.TotalOutstandingIOs = 0;
+    CHECK_STATUS(csSetDeviceCapability(dev, CS_CAPABILITY_CSx_MAX_IOS, &caps), CS_SUCCESS);
+    CHECK_STATUS(csTspSetAdmissionPolicy(dev, CS_TSP_ADMIT_REJECT, 0), CS_SUCCESS);
+    CHECK_STATUS(csTspSetFunctionLimit(cse, SLEEP_FUNCTION_ID, 2), CS_SUCCESS);
+    admit_run(4);
+    CHECK(admit_ok == 2 && admit_refused == 2);
+}
+
+/* Completion callbacks queueing new requests, with the rings full */
+typedef struct {
+    CsComputeRequest *req;
+    u32 *out;
+    u32 expected;
+    int remaining;
+    int ended;
+    int wrong;
+} chain_st;
+
+static void chain_completion(void *Context, CS_STATUS Status) {
+    chain_st *chain = Context;
+
+    if (Status != CS_SUCCESS) {
+        __atomic_add_fetch(&chain->wrong, 1, __ATOMIC_RELAXED);
+    }
+    if (__atomic_sub_fetch(&chain->remaining, 1, __ATOMIC_ACQ_REL) < 0) {
+        __atomic_add_fetch(&chain->ended, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    // All the requests write the same checksum
+    if (csQueueComputeRequest(chain->req, NULL, NULL, NULL, NULL) != CS_SUCCESS ||
+        *chain->out != chain->expected) {
+        __atomic_add_fetch(&chain->wrong, 1, __ATOMIC_RELAXED);
+    }
+    if (csQueueComputeRequest(chain->req, chain, chain_completion, NULL, NULL) != CS_QUEUED) {
+        __atomic_add_fetch(&chain->wrong, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void test_rings(void) {
+    CS_MEM_HANDLE in, out;
+    CS_MEM_PTR in_va, out_va;
+    CsComputeRequest *req;
+    CS_EVT_HANDLE ev;
+    u32 expected;
+
+    CHECK_STATUS(csAllocMem(dev, 4096, 0, &in, &in_va), CS_SUCCESS);
+    CHECK_STATUS(csAllocMem(dev, 4096, 0, &out, &out_va), CS_SUCCESS);
+    memset(in_va, 0x3c, 4096);
+    expected = host_checksum(in_va, 4096);
+
+    // The rings belong to the controller
+    CHECK_STATUS(csTspEnableRequestRings(dev, 16), CS_SUCCESS);
+    CHECK_STATUS(csTspEnableRequestRings(cse, 16), CS_HANDLE_IN_USE);
+
+    req = checksum_request(cse, in, 4096, out, 0);
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK(*(u32 *)out_va == expected);
+
+    // More requests than entries, asynchronous
+    CHECK_STATUS(csCreateEvent(&ev), CS_SUCCESS);
+    completions = 0;
+    for (int i = 0; i < 100; ++i) {
+        CHECK_STATUS(csQueueComputeRequest(req, NULL, count_completion, ev, NULL), CS_QUEUED);
+    }
+    CHECK_STATUS(csTspWaitEvent(ev), CS_SUCCESS);
+    CHECK(completions == 100);
+    csDeleteEvent(ev);
+
+    CHECK_STATUS(csTspDisableRequestRings(cse), CS_SUCCESS);
+    CHECK_STATUS(csTspDisableRequestRings(dev), CS_INVALID_ARG);
+
+    // Callbacks queue new requests, they run without the ring locks held
+    chain_st chain = {.out = out_va, .expected = expected, .remaining = 50};
+    CHECK_STATUS(csTspEnableRequestRings(dev, 4), CS_SUCCESS);
+    chain.req = checksum_request(cse, in, 4096, out, 0);
+    for (int i = 0; i < 3; ++i) {
+        CHECK_STATUS(csQueueComputeRequest(chain.req, &chain, chain_completion, NULL, NULL), CS_QUEUED);
+    }
+    for (int ms = 0; ms < 10000 && __atomic_load_n(&chain.ended, __ATOMIC_ACQUIRE) < 3; ++ms) {
+        usleep(1000);
+    }
+    CHECK(chain.ended == 3 && chain.wrong == 0);
+    CHECK_STATUS(csTspDisableRequestRings(dev), CS_SUCCESS);
+    free(chain.req);
+
+    // Closing the handle that enabled them disables them
+    CS_CSE_HANDLE owner;
+    CHECK_STATUS(csOpenCSE(EMU_DEVICE, NULL, &owner), CS_SUCCESS);
+    CHECK_STATUS(csTspEnableRequestRings(owner, 8), CS_SUCCESS);
+    CHECK_STATUS(csCloseCSE(owner), CS_SUCCESS);
+    *(u32 *)out_va = 0;
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    CHECK(*(u32 *)out_va == expected);
+    CHECK_STATUS(csTspEnableRequestRings(dev, 8), CS_SUCCESS);
+    CHECK_STATUS(csTspDisableRequestRings(dev), CS_SUCCESS);
+
+    free(req);
+    csFreeMem(out);
+    csFreeMem(in);
+}
+
+static void test_jobs(void) {
+    CsComputeRequest *req = sleep_request(cse, 100);
+    CsTspJobStatus status;
+    CS_TSP_JOB_ID id;
+
+    CHECK_STATUS(csTspSubmitJob(req, &id), CS_SUCCESS);
+    CHECK_STATUS(csTspQueryJob(dev, id, &status), CS_SUCCESS);
+    CHECK(status.State == CS_TSP_JOB_QUEUED || status.State == CS_TSP_JOB_RUNNING);
+    CHECK_STATUS(csTspReleaseJob(cse, id), CS_HANDLE_IN_USE);
+    CHECK_STATUS(csTspWaitJob(cse, id, 10, &status), CS_NOT_DONE);
+    CHECK_STATUS(csTspWaitJob(cse, id, 0, &status), CS_SUCCESS);
+    CHECK(status.State == CS_TSP_JOB_DONE && status.Status == CS_SUCCESS);
+    CHECK(status.RuntimeUs >= 100000);
+    CHECK_STATUS(csTspReleaseJob(cse, id), CS_SUCCESS);
+    CHECK_STATUS(csTspQueryJob(cse, id, &status), CS_INVALID_ID);
+
+    // Cancelled while it runs
+    csHelperSetComputeArg(&req->Args[0], CS_32BIT_VALUE_TYPE, 10000);
+    CHECK_STATUS(csTspSubmitJob(req, &id), CS_SUCCESS);
+    CHECK_STATUS(csTspCancelJob(dev, id), CS_SUCCESS);
+    CHECK_STATUS(csTspWaitJob(cse, id, 5000, &status), CS_SUCCESS);
+    CHECK(status.State == CS_TSP_JOB_CANCELLED);
+    CHECK_STATUS(csTspReleaseJob(cse, id), CS_SUCCESS);
+    free(req);
+}
+
+static void test_load(void) {
+    CsComputeRequest *req = sleep_request(cse, 200);
+    CS_EVT_HANDLE ev;
+    u32 load;
+
+    // Commands in flight on the CSE are the load of the controller
+    CHECK_STATUS(csCreateEvent(&ev), CS_SUCCESS);
+    CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, ev, NULL), CS_QUEUED);
+    CHECK_STATUS(csTspQueryCSELoad(dev, &load), CS_SUCCESS);
+    CHECK(load == 1);
+    CHECK_STATUS(csTspWaitEvent(ev), CS_SUCCESS);
+    CHECK_STATUS(csTspQueryCSELoad(cse, &load), CS_SUCCESS);
+    CHECK(load == 0);
+    csDeleteEvent(ev);
+    free(req);
+}
+
+static void test_stats(void) {
+    CS_MEM_HANDLE in, out;
+    CS_MEM_PTR in_va, out_va;
+    CsTspDeviceStats stats;
+    CsComputeRequest *req;
+    u64 executions = 0;
+
+    CHECK_STATUS(csAllocMem(dev, 4096, 0, &in, &in_va), CS_SUCCESS);
+    CHECK_STATUS(csAllocMem(dev, 4096, 0, &out, &out_va), CS_SUCCESS);
+    req = checksum_request(cse, in, 4096, out, 0);
+
+    CHECK_STATUS(csTspQueryDeviceStatistics(dev, CS_TSP_STATS_DELTA, &stats), CS_SUCCESS);
+    for (int i = 0; i < 10; ++i) {
+        CHECK_STATUS(csQueueComputeRequest(req, NULL, NULL, NULL, NULL), CS_SUCCESS);
+    }
+    CHECK_STATUS(csTspQueryDeviceStatistics(cse, CS_TSP_STATS_DELTA, &stats), CS_SUCCESS);
+    CHECK(stats.Cse.TotalFunctionExecutions == 10);
+    for (u32 i = 0; i < stats.NumFunctions; ++i) {
+        if (stats.Functions[i].FunctionId == checksum_id) {
+            executions = stats.Functions[i].Usage.TotalExecutions;
+        }
+    }
+    CHECK(executions == 10);
+    CHECK(stats.Memory.TotalAllocatedFDM >= 8192);
+
+    CsStatsInfo info;
+    CHECK_STATUS(csQueryDeviceStatistics(dev, CS_STAT_FUNCTION, &checksum_id, &info), CS_SUCCESS);
+    CHECK(info.FunctionDetails.TotalExecutions >= 10);
+
+    free(req);
+    csFreeMem(out);
+    csFreeMem(in);
+}
+
+static void test_batch(void) {
+    CsComputeRequest *reqs[100];
+    u32 queued = 1;
+
+    for (int i = 0; i < 100; ++i) {
+        reqs[i] = sleep_request(cse, 0);
+    }
+    // A command of the batch does not fit, none of them is queued
+    reqs[70] = realloc(reqs[70], sizeof(CsComputeRequest) + 8000 * sizeof(CsComputeArg));
+    memset(reqs[70]->Args, 0, 8000 * sizeof(CsComputeArg));
+    reqs[70]->NumArgs = 8000;
+    completions = 0;
+    CHECK_STATUS(csTspQueueComputeBatch(100, reqs, NULL, count_completion, 0, &queued),
+                 CS_INVALID_LENGTH);
+    CHECK(queued == 0);
+    usleep(50000);
+    CHECK(completions == 0);
+
+    reqs[70]->NumArgs = 1;
+    CHECK_STATUS(csTspQueueComputeBatch(100, reqs, NULL, NULL, 0, &queued), CS_SUCCESS);
+    CHECK(queued == 100);
+
+    // A failing request stops its command with the status of the single requests
+    CS_EVT_HANDLE ev;
+    CHECK_STATUS(csTspEmuRegisterFunction(FAILING_FUNCTION_ID, -1, failing_function), CS_SUCCESS);
+    CHECK_STATUS(csCreateEvent(&ev), CS_SUCCESS);
+    reqs[1]->FunctionId = FAILING_FUNCTION_ID;
+    CHECK_STATUS(csTspQueueComputeBatch(2, reqs, NULL, NULL, 0, &queued), CS_ERROR_IN_EXECUTION);
+    CHECK(queued == 1);
+    CHECK_STATUS(csTspQueueComputeBatch(2, reqs, NULL, NULL, ev, NULL), CS_QUEUED);
+    CHECK_STATUS(csTspWaitEvent(ev), CS_ERROR_IN_EXECUTION);
+
+    // Same for requests encoded by the caller
+    u64 wire[(sizeof(TspWireHeader) + 2 * (sizeof(TspWireRequest) + sizeof(TspWireArg))) / sizeof(u64)];
+    memset(wire, 0, sizeof(wire));
+    TspWireHeader *h = (TspWireHeader *)wire;
+    *h = (TspWireHeader){.Magic = TSP_WIRE_MAGIC, .Version = TSP_WIRE_VERSION,
+                         .Length = sizeof(wire), .NumRequests = 2};
+    for (int i = 0; i < 2; ++i) {
+        TspWireRequest *r = (TspWireRequest *)((u8 *)(h + 1) + i * tsp_wire_request_size(1));
+        r->Length = tsp_wire_request_size(1);
+        r->FunctionId = i ? FAILING_FUNCTION_ID : SLEEP_FUNCTION_ID;
+        r->NumArgs = 1;
+        r->Args[0].Type = CS_32BIT_VALUE_TYPE;
+    }
+    CHECK_STATUS(csTspQueueWireRequests(cse, wire, sizeof(wire), NULL, NULL, 0, &queued),
+                 CS_ERROR_IN_EXECUTION);
+    CHECK(queued == 1);
+    CHECK_STATUS(csTspQueueWireRequests(cse, wire, sizeof(wire), NULL, NULL, ev, NULL), CS_QUEUED);
+    CHECK_STATUS(csTspWaitEvent(ev), CS_ERROR_IN_EXECUTION);
+    csDeleteEvent(ev);
+    CHECK_STATUS(csTspEmuRegisterFunction(FAILING_FUNCTION_ID, -1, NULL), CS_SUCCESS);
+    for (int i = 0; i < 100; ++i) {
+        free(reqs[i]);
+    }
+}
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} tests[] = {
+    {"names", test_names},
+    {"alloc_free", test_alloc_free},
+    {"checksum", test_checksum},
+    {"status", test_status},
+    {"memo", test_memo},
+    {"admission", test_admission},
+    {"rings", test_rings},
+    {"jobs", test_jobs},
+    {"load", test_load},
+    {"stats", test_stats},
+    {"batch", test_batch},
+};
+
+/* Backs the namespace of the emulated CSx with a file of known content */
+static int create_namespace(char *path) {
+    u32 words[NAMESPACE_BYTES / sizeof(u32)];
+    int fd = mkstemp(path);
+
+    if (fd < 0) {
+        return -1;
+    }
+    for (u32 i = 0; i < NAMESPACE_BYTES / sizeof(u32); ++i) {
+        words[i] = i * 2654435761u;
+    }
+    if (write(fd, words, sizeof(words)) != sizeof(words)) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return setenv("TSP_EMU_NAMESPACE", path, 1);
+}
+
+int main(int argc, char *argv[]) {
+    char path[] = "/tmp/tsp-emu-test-XXXXXX";
+    int failed = 0;
+
+    if (create_namespace(path)) {
+        perror("Could not create the namespace");
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+        int before = failures;
+
+        // A test name given on the command line runs that test only
+        if (argc > 1 && strcmp(argv[1], tests[i].name)) {
+            continue;
+        }
+        open_handles();
+        tests[i].run();
+        close_handles();
+        printf("%-12s %s\n", tests[i].name, failures == before ? "ok" : "FAILED");
+        failed += failures != before;
+    }
+
+    unlink(path);
+    printf("%d test(s) failed\n", failed);
+    return failed != 0;
+}